@@ -872,11 +872,9 @@ fork (void)
 	pid_t pid = 0;
 	char child = 0;
 
-	glusterfs_log_lock ();
-	{
-		pid = real_fork ();
-	}
-	glusterfs_log_unlock ();
+	/* the log is held across the fork by libglusterfs' own atfork
+	   handlers, taking it here as well would deadlock in them */
+	pid = real_fork ();
 
 	child = (pid == 0);
 	if (child) {
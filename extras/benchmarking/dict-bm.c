@@ -0,0 +1,371 @@
+/*
+  Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  dict-bm: the life of the dict of a typical fop (create, set a few
+  keys, look them up, serialize it, unref it) with libglusterfs' dict_t
+  and with a copy of the chained, key copying dict it replaced.
+
+  gcc -o dict-bm dict-bm.c -I<glusterfs>/libglusterfs/src \
+      -DHAVE_CONFIG_H -I<glusterfs> -lglusterfs -lpthread
+  ./dict-bm [iterations] [keys-per-dict]
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "glusterfs.h"
+#include "dict.h"
+#include "hashfn.h"
+#include "byte-order.h"
+#include "logging.h"
+
+#define TS(tv) ((((unsigned long long) tv.tv_sec) * 1000000) + (tv.tv_usec))
+
+static char *keys[] = {
+        "trusted.glusterfs.dht",
+        "trusted.glusterfs.afr.data-pending",
+        "trusted.glusterfs.afr.metadata-pending",
+        "trusted.glusterfs.afr.entry-pending",
+        "glusterfs.content",
+        "user.benchmark.0",
+        "user.benchmark.1",
+        "user.benchmark.2",
+        "user.benchmark.3",
+        "user.benchmark.4",
+        "user.benchmark.5",
+        "user.benchmark.6",
+        "user.benchmark.7",
+        "user.benchmark.8",
+        "user.benchmark.9",
+        "user.benchmark.10",
+};
+
+#define KEY_COUNT (sizeof (keys) / sizeof (keys[0]))
+
+
+/* the dict as it was: a pair and a key copy per set, chained buckets
+   (one of them for dict_new ()), and a lock taken for every ref */
+
+struct old_data {
+        int32_t      len;
+        char        *data;
+        int32_t      refcount;
+        gf_lock_t    lock;
+};
+
+struct old_pair {
+        struct old_pair *hash_next;
+        struct old_pair *prev;
+        struct old_pair *next;
+        struct old_data *value;
+        char            *key;
+};
+
+struct old_dict {
+        int32_t           hash_size;
+        int32_t           count;
+        int32_t           refcount;
+        struct old_pair **members;
+        struct old_pair  *members_list;
+        gf_lock_t         lock;
+};
+
+
+static struct old_data *
+old_data_ref (struct old_data *data)
+{
+        LOCK (&data->lock);
+        data->refcount++;
+        UNLOCK (&data->lock);
+
+        return data;
+}
+
+
+static void
+old_data_unref (struct old_data *data)
+{
+        int32_t ref = 0;
+
+        LOCK (&data->lock);
+        ref = --data->refcount;
+        UNLOCK (&data->lock);
+
+        if (!ref) {
+                LOCK_DESTROY (&data->lock);
+                free (data->data);
+                free (data);
+        }
+}
+
+
+static struct old_data *
+old_data_from_int64 (int64_t value)
+{
+        struct old_data *data = calloc (1, sizeof (*data));
+
+        LOCK_INIT (&data->lock);
+        asprintf (&data->data, "%"PRId64, value);
+        data->len = strlen (data->data) + 1;
+
+        return data;
+}
+
+
+static struct old_dict *
+old_dict_new (void)
+{
+        struct old_dict *dict = calloc (1, sizeof (*dict));
+
+        dict->hash_size = 1;
+        dict->members = calloc (1, sizeof (struct old_pair *));
+        LOCK_INIT (&dict->lock);
+
+        LOCK (&dict->lock);
+        dict->refcount++;
+        UNLOCK (&dict->lock);
+
+        return dict;
+}
+
+
+static struct old_pair *
+old_dict_lookup (struct old_dict *this, char *key)
+{
+        int              hashval = 0;
+        struct old_pair *pair = NULL;
+
+        hashval = SuperFastHash (key, strlen (key)) % this->hash_size;
+
+        for (pair = this->members[hashval]; pair; pair = pair->hash_next)
+                if (!strcmp (pair->key, key))
+                        return pair;
+
+        return NULL;
+}
+
+
+static void
+old_dict_set (struct old_dict *this, char *key, struct old_data *value)
+{
+        int              hashval = 0;
+        struct old_pair *pair = NULL;
+        struct old_data *unref_data = NULL;
+
+        LOCK (&this->lock);
+
+        hashval = SuperFastHash (key, strlen (key)) % this->hash_size;
+        pair = old_dict_lookup (this, key);
+        if (pair) {
+                unref_data = pair->value;
+                pair->value = old_data_ref (value);
+                old_data_unref (unref_data);
+                UNLOCK (&this->lock);
+                return;
+        }
+
+        pair = calloc (1, sizeof (*pair));
+        pair->key = calloc (1, strlen (key) + 1);
+        strcpy (pair->key, key);
+        pair->value = old_data_ref (value);
+
+        pair->hash_next = this->members[hashval];
+        this->members[hashval] = pair;
+
+        pair->next = this->members_list;
+        if (this->members_list)
+                this->members_list->prev = pair;
+        this->members_list = pair;
+        this->count++;
+
+        UNLOCK (&this->lock);
+}
+
+
+static struct old_data *
+old_dict_get (struct old_dict *this, char *key)
+{
+        struct old_pair *pair = NULL;
+
+        LOCK (&this->lock);
+        pair = old_dict_lookup (this, key);
+        UNLOCK (&this->lock);
+
+        return pair ? pair->value : NULL;
+}
+
+
+static int
+old_dict_serialized_length (struct old_dict *this)
+{
+        struct old_pair *pair = NULL;
+        int              len = 4;
+
+        for (pair = this->members_list; pair; pair = pair->next)
+                len += 8 + strlen (pair->key) + 1 + pair->value->len;
+
+        return len;
+}
+
+
+static void
+old_dict_serialize (struct old_dict *this, char *buf)
+{
+        struct old_pair *pair = NULL;
+        int32_t          keylen = 0;
+
+        *(int32_t *) buf = hton32 (this->count);
+        buf += 4;
+
+        for (pair = this->members_list; pair; pair = pair->next) {
+                keylen = strlen (pair->key);
+                *(int32_t *) buf = hton32 (keylen);
+                buf += 4;
+                *(int32_t *) buf = hton32 (pair->value->len);
+                buf += 4;
+                memcpy (buf, pair->key, keylen + 1);
+                buf += keylen + 1;
+                memcpy (buf, pair->value->data, pair->value->len);
+                buf += pair->value->len;
+        }
+}
+
+
+static void
+old_dict_unref (struct old_dict *this)
+{
+        struct old_pair *pair = NULL;
+        struct old_pair *next = NULL;
+        int32_t          ref = 0;
+
+        LOCK (&this->lock);
+        ref = --this->refcount;
+        UNLOCK (&this->lock);
+
+        if (ref)
+                return;
+
+        for (pair = this->members_list; pair; pair = next) {
+                next = pair->next;
+                old_data_unref (pair->value);
+                free (pair->key);
+                free (pair);
+        }
+
+        LOCK_DESTROY (&this->lock);
+        free (this->members);
+        free (this);
+}
+
+
+static double
+elapsed_usec (struct timeval *start)
+{
+        struct timeval now;
+
+        gettimeofday (&now, NULL);
+
+        return (double) (TS (now) - TS ((*start)));
+}
+
+
+int
+main (int argc, char *argv[])
+{
+        struct old_dict *old = NULL;
+        dict_t          *dict = NULL;
+        char             buf[4096];
+        int              iterations = 1000000;
+        int              count = 6;
+        int              i = 0, k = 0;
+        int64_t          val = 0;
+        struct timeval   start;
+        double           set[2] = {0, }, get[2] = {0, }, ser[2] = {0, };
+        double           total[2] = {0, };
+
+        if (argc > 1)
+                iterations = atoi (argv[1]);
+        if (argc > 2)
+                count = atoi (argv[2]);
+        if (count > KEY_COUNT)
+                count = KEY_COUNT;
+
+        gf_log_init ("/dev/null");
+
+        for (i = 0; i < iterations; i++) {
+                gettimeofday (&start, NULL);
+                old = old_dict_new ();
+                for (k = 0; k < count; k++) {
+                        struct old_data *data = old_data_from_int64 (k);
+                        old_dict_set (old, keys[k], data);
+                }
+                set[0] += elapsed_usec (&start);
+
+                gettimeofday (&start, NULL);
+                for (k = 0; k < count; k++)
+                        val += old_dict_get (old, keys[k])->len;
+                get[0] += elapsed_usec (&start);
+
+                gettimeofday (&start, NULL);
+                if (old_dict_serialized_length (old) <= sizeof (buf))
+                        old_dict_serialize (old, buf);
+                old_dict_unref (old);
+                ser[0] += elapsed_usec (&start);
+        }
+
+        for (i = 0; i < iterations; i++) {
+                gettimeofday (&start, NULL);
+                dict = dict_new ();
+                for (k = 0; k < count; k++)
+                        if (dict_set_int64 (dict, keys[k], k) != 0)
+                                return 1;
+                set[1] += elapsed_usec (&start);
+
+                gettimeofday (&start, NULL);
+                for (k = 0; k < count; k++)
+                        val += dict_get (dict, keys[k])->len;
+                get[1] += elapsed_usec (&start);
+
+                gettimeofday (&start, NULL);
+                if (dict_serialized_length (dict) <= sizeof (buf))
+                        dict_serialize (dict, buf);
+                dict_unref (dict);
+                ser[1] += elapsed_usec (&start);
+        }
+
+        for (i = 0; i < 2; i++)
+                total[i] = set[i] + get[i] + ser[i];
+
+        printf ("%d dicts of %d keys (%"PRId64")\n", iterations, count,
+                val);
+        for (i = 0; i < 2; i++)
+                printf ("%-10s new+set %7.3f get %7.3f "
+                        "serialize+unref %7.3f total %7.3f usec/dict\n",
+                        i ? "dict_t" : "chained", set[i] / iterations,
+                        get[i] / iterations, ser[i] / iterations,
+                        total[i] / iterations);
+
+        return 0;
+}
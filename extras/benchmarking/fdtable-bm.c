@@ -0,0 +1,199 @@
+/*
+  Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  fdtable-bm: allocate, look up and release fd slots with libglusterfs'
+  fdtable, and allocate and release them with a copy of the linear scan
+  it replaced.
+
+  gcc -o fdtable-bm fdtable-bm.c -I<glusterfs>/libglusterfs/src \
+      -DHAVE_CONFIG_H -I<glusterfs> -lglusterfs -lpthread
+  ./fdtable-bm [fd-count] [linear-scan-fd-count]
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "glusterfs.h"
+#include "xlator.h"
+#include "inode.h"
+#include "fd.h"
+#include "logging.h"
+
+#define TS(tv) ((((unsigned long long) tv.tv_sec) * 1000000) + (tv.tv_usec))
+
+/* the table as it was: scan for the first empty slot, grow when full */
+struct scan_table {
+        uint32_t   max_fds;
+        fd_t     **fds;
+};
+
+
+static void
+scan_expand (struct scan_table *table)
+{
+        fd_t     **fds = NULL;
+        uint32_t   nr = 0;
+
+        nr = table->max_fds ? table->max_fds * 2 : 128;
+        fds = calloc (nr, sizeof (*fds));
+        if (table->fds)
+                memcpy (fds, table->fds, table->max_fds * sizeof (*fds));
+        free (table->fds);
+
+        table->fds = fds;
+        table->max_fds = nr;
+}
+
+
+static int32_t
+scan_unused_get (struct scan_table *table, fd_t *fdptr)
+{
+        uint32_t i = 0;
+
+        for (i = 0; i < table->max_fds; i++)
+                if (!table->fds[i])
+                        break;
+
+        if (i == table->max_fds)
+                scan_expand (table);
+
+        table->fds[i] = fdptr;
+
+        return i;
+}
+
+
+static void
+scan_put (struct scan_table *table, int32_t fd)
+{
+        table->fds[fd] = NULL;
+}
+
+
+static double
+elapsed_usec (struct timeval *start)
+{
+        struct timeval now;
+
+        gettimeofday (&now, NULL);
+
+        return (double) (TS (now) - TS ((*start)));
+}
+
+
+static void
+shuffle (int32_t *fds, int count)
+{
+        int     i = 0;
+        int     j = 0;
+        int32_t tmp = 0;
+
+        for (i = count - 1; i > 0; i--) {
+                j = random () % (i + 1);
+                tmp = fds[i];
+                fds[i] = fds[j];
+                fds[j] = tmp;
+        }
+}
+
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t     ctx = {{0, }, };
+        xlator_t            xl = {0, };
+        inode_table_t      *itable = NULL;
+        fd_t               *fd = NULL;
+        fdtable_t          *fdtable = NULL;
+        struct scan_table   scan = {0, };
+        int                 count = 1000000;
+        int                 scan_count = 50000;
+        int                 i = 0;
+        int32_t            *fds = NULL;
+        struct timeval      start;
+        double              get = 0, lookup = 0, put = 0;
+
+        if (argc > 1)
+                count = atoi (argv[1]);
+        if (argc > 2)
+                scan_count = atoi (argv[2]);
+
+        gf_log_init ("/dev/null");
+
+        xl.name = "fdtable-bm";
+        xl.ctx  = &ctx;
+        itable = inode_table_new (0, &xl);
+        fd = fd_create (inode_new (itable), 0);
+
+        fds = calloc ((count > scan_count) ? count : scan_count,
+                      sizeof (*fds));
+        srandom (count);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < scan_count; i++)
+                fds[i] = scan_unused_get (&scan, fd);
+        get = elapsed_usec (&start);
+
+        shuffle (fds, scan_count);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < scan_count; i++)
+                scan_put (&scan, fds[i]);
+        put = elapsed_usec (&start);
+
+        printf ("%-12s %8d fds: get %8.3f usec/op, put %8.3f usec/op\n",
+                "linear-scan", scan_count, get / scan_count,
+                put / scan_count);
+
+        fdtable = gf_fd_fdtable_alloc ();
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < count; i++) {
+                /* the ref handed over to the table, put drops it */
+                fd_ref (fd);
+                fds[i] = gf_fd_unused_get (fdtable, fd);
+        }
+        get = elapsed_usec (&start);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < count; i++)
+                fd_unref (gf_fd_fdptr_get (fdtable, fds[i]));
+        lookup = elapsed_usec (&start);
+
+        shuffle (fds, count);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < count; i++)
+                gf_fd_put (fdtable, fds[i]);
+        put = elapsed_usec (&start);
+
+        printf ("%-12s %8d fds: get %8.3f usec/op, put %8.3f usec/op, "
+                "lookup %8.3f usec/op\n", "free-list", count,
+                get / count, put / count, lookup / count);
+
+        gf_fd_fdtable_destroy (fdtable);
+
+        return 0;
+}
@@ -0,0 +1,499 @@
+/*
+  Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  fuse-readdir-bm: send fuse-bridge the requests the kernel sends for
+  'ls -l' of a directory, an OPENDIR, READDIRs till the end and a LOOKUP
+  of every entry listed, over a child which counts the fops it gets. for
+  a directory whose readdirp entries carry no attributes and for one
+  whose entries do, twice each, the second time with the entries known
+  to fuse. fuse keeps no attributes of its own, every lookup has to
+  reach the child, whatever readdirp returned: the translators below
+  need it for their inode contexts. exits with 1 if a lookup is not
+  wound, or if a reply is wrong.
+
+  the libfuse calls fuse-bridge makes are defined here, no fuse mount
+  is needed.
+
+  fuse=<glusterfs>/xlators/mount/fuse/src
+  gcc -o fuse-readdir-bm fuse-readdir-bm.c $fuse/fuse-bridge.c -I$fuse \
+      -I<glusterfs>/libglusterfs/src -DHAVE_CONFIG_H -I<glusterfs> \
+      -D_GNU_SOURCE -D_FILE_OFFSET_BITS=64 -DGF_LINUX_HOST_OS \
+      -DFUSE_USE_VERSION=26 -lglusterfs -lpthread
+  ./fuse-readdir-bm [entries]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include "glusterfs.h"
+#include "xlator.h"
+#include "stack.h"
+#include "logging.h"
+#include "gf-dirent.h"
+
+#include <fuse/fuse_lowlevel.h>
+
+#define TS(tv) ((((unsigned long long) tv.tv_sec) * 1000000) + (tv.tv_usec))
+
+#define DIR_PLAIN   2             /* readdirp without attributes */
+#define DIR_PLUS    3             /* readdirp with attributes */
+
+int32_t init (xlator_t *this);
+
+struct fuse_req {
+        uint64_t unique;
+};
+
+static struct fuse_lowlevel_ops  ops;
+static void                     *userdata;
+static struct fuse_ctx           req_ctx;
+static uint64_t                  unique;
+
+/* the last reply fuse-bridge sent */
+static int                       reply_err;
+static struct fuse_entry_param   reply_entry;
+static uint64_t                  reply_fh;
+
+/* the names the last READDIR listed */
+static char                    **names;
+static int                       name_count;
+
+static int                       entry_count = 10000;
+static uint64_t                  child_lookups, child_readdirps;
+
+
+/* libfuse */
+
+struct fuse_chan *
+fuse_mount (const char *mountpoint, struct fuse_args *args)
+{
+        return (struct fuse_chan *) &ops;
+}
+
+void
+fuse_unmount (const char *mountpoint, struct fuse_chan *ch)
+{
+}
+
+struct fuse_session *
+fuse_lowlevel_new (struct fuse_args *args,
+                   const struct fuse_lowlevel_ops *op, size_t op_size,
+                   void *data)
+{
+        memcpy (&ops, op, op_size);
+        userdata = data;
+
+        return (struct fuse_session *) &ops;
+}
+
+int
+fuse_set_signal_handlers (struct fuse_session *se)
+{
+        return 0;
+}
+
+void
+fuse_opt_free_args (struct fuse_args *args)
+{
+}
+
+void
+fuse_session_add_chan (struct fuse_session *se, struct fuse_chan *ch)
+{
+}
+
+void
+fuse_session_remove_chan (struct fuse_chan *ch)
+{
+}
+
+void
+fuse_session_destroy (struct fuse_session *se)
+{
+}
+
+void
+fuse_session_exit (struct fuse_session *se)
+{
+}
+
+int
+fuse_session_exited (struct fuse_session *se)
+{
+        return 1;
+}
+
+void
+fuse_session_process (struct fuse_session *se, const char *buf,
+                      size_t len, struct fuse_chan *ch)
+{
+}
+
+int
+fuse_chan_fd (struct fuse_chan *ch)
+{
+        return -1;
+}
+
+size_t
+fuse_chan_bufsize (struct fuse_chan *ch)
+{
+        return 1048576 + 4096;
+}
+
+int
+fuse_chan_receive (struct fuse_chan *ch, char *buf, size_t size)
+{
+        return 0;
+}
+
+void *
+fuse_req_userdata (fuse_req_t req)
+{
+        return userdata;
+}
+
+const struct fuse_ctx *
+fuse_req_ctx (fuse_req_t req)
+{
+        return &req_ctx;
+}
+
+int
+fuse_reply_err (fuse_req_t req, int err)
+{
+        reply_err = err;
+        return 0;
+}
+
+void
+fuse_reply_none (fuse_req_t req)
+{
+}
+
+int
+fuse_reply_entry (fuse_req_t req, const struct fuse_entry_param *e)
+{
+        reply_err = 0;
+        reply_entry = *e;
+        return 0;
+}
+
+int
+fuse_reply_open (fuse_req_t req, const struct fuse_file_info *fi)
+{
+        reply_err = 0;
+        reply_fh = fi->fh;
+        return 0;
+}
+
+int
+fuse_reply_buf (fuse_req_t req, const char *buf, size_t size)
+{
+        reply_err = 0;
+        return 0;
+}
+
+size_t
+fuse_add_direntry (fuse_req_t req, char *buf, size_t bufsize,
+                   const char *name, const struct stat *stbuf, off_t off)
+{
+        names[name_count++] = strdup (name);
+        return bufsize;
+}
+
+int fuse_reply_create (fuse_req_t req, const struct fuse_entry_param *e,
+                       const struct fuse_file_info *fi) { return 0; }
+int fuse_reply_attr (fuse_req_t req, const struct stat *attr,
+                     double attr_timeout) { return 0; }
+int fuse_reply_readlink (fuse_req_t req, const char *link) { return 0; }
+int fuse_reply_write (fuse_req_t req, size_t count) { return 0; }
+int fuse_reply_statfs (fuse_req_t req,
+                       const struct statvfs *stbuf) { return 0; }
+int fuse_reply_xattr (fuse_req_t req, size_t count) { return 0; }
+int fuse_reply_lock (fuse_req_t req, struct flock *lock) { return 0; }
+
+/* fuse-extra.c, which needs the internals of libfuse */
+
+uint64_t
+req_callid (fuse_req_t req)
+{
+        return req->unique;
+}
+
+size_t
+fuse_dirent_size (size_t dname_len)
+{
+        return (24 + dname_len + 7) & ~7;
+}
+
+int32_t
+fuse_reply_vec (fuse_req_t req, struct iovec *vector, int32_t count)
+{
+        return 0;
+}
+
+
+/* the child */
+
+static void
+child_stat (ino_t dir, int i, struct stat *stbuf)
+{
+        memset (stbuf, 0, sizeof (*stbuf));
+
+        stbuf->st_ino = dir * 1000000 + i;
+        stbuf->st_mode = S_IFREG | 0644;
+        stbuf->st_nlink = 1;
+        stbuf->st_size = i;
+        stbuf->st_ctime = 1234567890;
+}
+
+
+static int32_t
+child_lookup (call_frame_t *frame, xlator_t *this, loc_t *loc,
+              dict_t *xattr_req)
+{
+        struct stat stbuf = {0, };
+        int         i = 0;
+
+        child_lookups++;
+
+        if (loc->parent->ino == 1) {
+                stbuf.st_ino = strcmp (loc->name, "plain") ? DIR_PLUS
+                        : DIR_PLAIN;
+                stbuf.st_mode = S_IFDIR | 0755;
+                stbuf.st_nlink = 2;
+        } else {
+                sscanf (loc->name, "file-%d", &i);
+                child_stat (loc->parent->ino, i, &stbuf);
+        }
+
+        STACK_UNWIND (frame, 0, 0, loc->inode, &stbuf, NULL);
+        return 0;
+}
+
+
+static int32_t
+child_opendir (call_frame_t *frame, xlator_t *this, loc_t *loc, fd_t *fd)
+{
+        STACK_UNWIND (frame, 0, 0, fd);
+        return 0;
+}
+
+
+static int32_t
+child_readdirp (call_frame_t *frame, xlator_t *this, fd_t *fd, size_t size,
+                off_t offset)
+{
+        gf_dirent_t  entries;
+        gf_dirent_t *entry = NULL;
+        char         name[32];
+        size_t       filled = 0;
+        int          count = 0;
+        int          i = 0;
+
+        child_readdirps++;
+        INIT_LIST_HEAD (&entries.list);
+
+        for (i = offset; i < entry_count; i++) {
+                sprintf (name, "file-%06d", i);
+                filled += fuse_dirent_size (strlen (name));
+                if (filled > size)
+                        break;
+
+                entry = gf_dirent_for_name (name);
+                child_stat (fd->inode->ino, i, &entry->d_stat);
+                entry->d_ino = entry->d_stat.st_ino;
+                entry->d_off = i + 1;
+                if (fd->inode->ino == DIR_PLAIN)
+                        memset (&entry->d_stat, 0, sizeof (entry->d_stat));
+
+                list_add_tail (&entry->list, &entries.list);
+                count++;
+        }
+
+        STACK_UNWIND (frame, count, 0, &entries);
+
+        gf_dirent_free (&entries);
+        return 0;
+}
+
+
+/* the kernel */
+
+static int
+kernel_lookup (fuse_ino_t parent, const char *name)
+{
+        struct fuse_req req = {++unique};
+
+        reply_err = -1;
+        ops.lookup (&req, parent, name);
+
+        return reply_err;
+}
+
+
+/* ls -l of dir: its entries, with their attributes */
+static int
+ls_l (const char *dir)
+{
+        struct fuse_req       req = {0, };
+        struct fuse_file_info fi = {0, };
+        struct timeval        start, end;
+        fuse_ino_t            ino = 0;
+        uint64_t              lookups = 0;
+        uint64_t              readdirps = 0;
+        off_t                 off = 0;
+        int                   bad = 0;
+        int                   i = 0;
+        int                   n = 0;
+
+        if (kernel_lookup (1, dir) != 0) {
+                printf ("%s: LOOKUP failed\n", dir);
+                return 1;
+        }
+        ino = reply_entry.ino;
+
+        gettimeofday (&start, NULL);
+        lookups = child_lookups;
+        readdirps = child_readdirps;
+
+        req.unique = ++unique;
+        reply_err = -1;
+        ops.opendir (&req, ino, &fi);
+        if (reply_err != 0) {
+                printf ("%s: OPENDIR failed\n", dir);
+                return 1;
+        }
+        fi.fh = reply_fh;
+
+        name_count = 0;
+        do {
+                n = name_count;
+                req.unique = ++unique;
+                reply_err = -1;
+                ops.readdir (&req, ino, 4096, off, &fi);
+                if (reply_err != 0) {
+                        printf ("%s: READDIR failed\n", dir);
+                        return 1;
+                }
+                off += name_count - n;
+        } while (name_count > n);
+
+        readdirps = child_readdirps - readdirps;
+        lookups = child_lookups;
+
+        for (i = 0; i < name_count; i++) {
+                if (kernel_lookup (ino, names[i]) != 0
+                    || reply_entry.ino != ino * 1000000 + i
+                    || reply_entry.attr.st_size != i
+                    || !S_ISREG (reply_entry.attr.st_mode))
+                        bad++;
+                free (names[i]);
+        }
+
+        lookups = child_lookups - lookups;
+        gettimeofday (&end, NULL);
+
+        req.unique = ++unique;
+        ops.releasedir (&req, ino, &fi);
+
+        printf ("%-24s %8d %10"PRIu64" %10"PRIu64" %10.2f\n", dir,
+                name_count, readdirps, lookups,
+                (double) (TS (end) - TS (start)) / name_count);
+
+        if (name_count != entry_count || bad) {
+                printf ("%s: %d entries listed, %d wrong LOOKUP replies\n",
+                        dir, name_count, bad);
+                return 1;
+        }
+
+        if (lookups != name_count) {
+                printf ("%s: %"PRIu64" of %d LOOKUPs reached the child\n",
+                        dir, lookups, name_count);
+                return 1;
+        }
+
+        return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t      ctx = {{0, }, };
+        struct xlator_fops   child_fops = {0, };
+        struct xlator_mops   child_mops = {0, };
+        xlator_list_t        children = {0, };
+        xlator_t             fuse, child;
+        char                 mountpoint[] = "/tmp";
+        int                  ret = 0;
+
+        if (argc > 1)
+                entry_count = atoi (argv[1]);
+        if (entry_count < 1)
+                entry_count = 10000;
+
+        gf_global_variable_init ();
+        gf_log_init ("/dev/null");
+        gf_log_set_loglevel (GF_LOG_ERROR);
+
+        ctx.pool = call_pool_new ();
+        ctx.xl_count = 2;
+
+        memset (&fuse, 0, sizeof (fuse));
+        memset (&child, 0, sizeof (child));
+
+        child_fops.lookup = child_lookup;
+        child_fops.opendir = child_opendir;
+        child_fops.readdirp = child_readdirp;
+
+        child.name = "child";
+        child.fops = &child_fops;
+        child.mops = &child_mops;
+        fuse.name = "fuse";
+        fuse.options = dict_new ();
+        ret = dict_set_str (fuse.options, "mountpoint", mountpoint);
+        if (ret != 0)
+                return 1;
+        children.xlator = &child;
+        fuse.children = &children;
+        fuse.ctx = child.ctx = &ctx;
+
+        if (init (&fuse) != 0)
+                return 1;
+        ops.init (userdata, NULL);
+
+        names = calloc (entry_count + 1, sizeof (*names));
+
+        printf ("%-24s %8s %10s %10s %10s\n", "readdirp entries", "listed",
+                "readdirps", "lookups", "usec/entry");
+
+        ret |= ls_l ("plain");
+        ret |= ls_l ("plain");
+        ret |= ls_l ("plus");
+        ret |= ls_l ("plus");
+
+        return ret;
+}
@@ -0,0 +1,261 @@
+/*
+  Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  inode-path-bm: build a directory tree in a libglusterfs inode table
+  and resolve the path of every file in it, the way server_loc_fill()
+  and fuse do for each fop, with inode_path() and with a copy of the
+  dentry walk it replaced.
+
+  gcc -o inode-path-bm inode-path-bm.c -I<glusterfs>/libglusterfs/src \
+      -DHAVE_CONFIG_H -I<glusterfs> -lglusterfs -lpthread
+  ./inode-path-bm [depth] [dirs-per-level] [files-per-dir]
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include "glusterfs.h"
+#include "xlator.h"
+#include "inode.h"
+#include "logging.h"
+
+#define TS(tv) ((((unsigned long long) tv.tv_sec) * 1000000) + (tv.tv_usec))
+
+
+static dentry_t *
+walk_arbit (inode_t *inode)
+{
+        dentry_t *trav = NULL;
+
+        list_for_each_entry (trav, &inode->dentry_list, inode_list) {
+                if (!list_empty (&trav->hash))
+                        return trav;
+        }
+
+        list_for_each_entry (trav, &inode->dentry_list, inode_list) {
+                return trav;
+        }
+
+        return NULL;
+}
+
+
+/* inode_path() as it was: measure the walk to root, then fill it in
+   backwards on a second walk */
+static int
+walk_path (inode_t *inode, const char *name, char **bufp)
+{
+        dentry_t *trav = NULL;
+        size_t    i = 0;
+        int       len = 0;
+        char     *buf = NULL;
+
+        for (trav = walk_arbit (inode); trav;
+             trav = walk_arbit (trav->parent)) {
+                i++;
+                i += strlen (trav->name);
+        }
+
+        if (name) {
+                i++;
+                i += strlen (name);
+        }
+
+        buf = calloc (i + 1, sizeof (char));
+
+        if (name) {
+                len = strlen (name);
+                strncpy (buf + (i - len), name, len);
+                buf[i - len - 1] = '/';
+                i -= (len + 1);
+        }
+
+        for (trav = walk_arbit (inode); trav;
+             trav = walk_arbit (trav->parent)) {
+                len = strlen (trav->name);
+                strncpy (buf + (i - len), trav->name, len);
+                buf[i - len - 1] = '/';
+                i -= (len + 1);
+        }
+
+        *bufp = buf;
+
+        return 0;
+}
+
+
+static double
+elapsed_usec (struct timeval *start)
+{
+        struct timeval now;
+
+        gettimeofday (&now, NULL);
+
+        return (double) (TS (now) - TS ((*start)));
+}
+
+
+static ino_t next_ino = 2;
+
+
+static inode_t *
+make_entry (inode_table_t *itable, inode_t *parent, const char *name,
+            mode_t mode)
+{
+        inode_t     *inode = NULL;
+        struct stat  stbuf = {0, };
+
+        inode = inode_new (itable);
+
+        stbuf.st_ino  = next_ino++;
+        stbuf.st_mode = mode;
+
+        inode_link (inode, parent, name, &stbuf);
+        inode_lookup (inode);
+
+        return inode;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t     ctx = {{0, }, };
+        xlator_t            xl = {0, };
+        inode_table_t      *itable = NULL;
+        inode_t           **dirs = NULL;
+        inode_t           **files = NULL;
+        char              **names = NULL;
+        char               *a = NULL, *b = NULL;
+        char                name[64];
+        struct stat         stbuf = {0, };
+        int                 depth = 16;
+        int                 width = 4;
+        int                 per_dir = 64;
+        int                 dir_count = 0, file_count = 0;
+        int                 level = 0, i = 0, j = 0, first = 0, last = 0;
+        struct timeval      start;
+        double              walk = 0, cold = 0, warm = 0, file = 0;
+
+        if (argc > 1)
+                depth = atoi (argv[1]);
+        if (argc > 2)
+                width = atoi (argv[2]);
+        if (argc > 3)
+                per_dir = atoi (argv[3]);
+
+        gf_log_init ("/dev/null");
+
+        xl.name = "inode-path-bm";
+        xl.ctx  = &ctx;
+        itable = inode_table_new (0, &xl);
+
+        /* a chain of depth directories, each level holding width of
+           them, with per_dir files in the ones at the bottom */
+        dirs = calloc (depth * width + 1, sizeof (*dirs));
+        dirs[dir_count++] = itable->root;
+        for (level = 0; level < depth; level++) {
+                for (i = 0; i < width; i++) {
+                        sprintf (name, "directory-%02d-%02d", level, i);
+                        dirs[dir_count++] = make_entry (itable,
+                                                        dirs[first], name,
+                                                        S_IFDIR|0755);
+                }
+                first = dir_count - width;
+        }
+
+        last = dir_count;
+        files = calloc (width * per_dir, sizeof (*files));
+        names = calloc (width * per_dir, sizeof (*names));
+        for (i = first; i < last; i++) {
+                for (j = 0; j < per_dir; j++) {
+                        sprintf (name, "file-%06d", j);
+                        names[file_count] = strdup (name);
+                        files[file_count++] = make_entry (itable, dirs[i],
+                                                          name,
+                                                          S_IFREG|0644);
+                }
+        }
+
+        /* the same strings from both */
+        for (i = 0; i < file_count; i++) {
+                walk_path (files[i], NULL, &a);
+                inode_path (files[i], NULL, &b);
+                if (strcmp (a, b)) {
+                        fprintf (stderr, "path mismatch: %s != %s\n", a, b);
+                        return 1;
+                }
+                free (a);
+                free (b);
+        }
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < file_count; i++) {
+                walk_path (dirs[first + i / per_dir], names[i], &a);
+                free (a);
+        }
+        walk = elapsed_usec (&start);
+
+        /* a rename of the top directory drops the cached paths below
+           it, which are all of them. the first pass after it rebuilds
+           them */
+        stbuf.st_ino  = dirs[1]->ino;
+        stbuf.st_mode = S_IFDIR|0755;
+        inode_rename (itable, itable->root, "directory-00-00",
+                      itable->root, "directory-00-00", dirs[1], &stbuf);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < file_count; i++) {
+                inode_path (dirs[first + i / per_dir], names[i], &a);
+                free (a);
+        }
+        cold = elapsed_usec (&start);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < file_count; i++) {
+                inode_path (dirs[first + i / per_dir], names[i], &a);
+                free (a);
+        }
+        warm = elapsed_usec (&start);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < file_count; i++) {
+                inode_path (files[i], NULL, &a);
+                free (a);
+        }
+        file = elapsed_usec (&start);
+
+        printf ("%d files at depth %d\n", file_count, depth);
+        printf ("%-24s %8.3f usec/op\n", "dentry walk", walk / file_count);
+        printf ("%-24s %8.3f usec/op\n", "cached, after rename",
+                cold / file_count);
+        printf ("%-24s %8.3f usec/op\n", "cached, parent + name",
+                warm / file_count);
+        printf ("%-24s %8.3f usec/op\n", "cached, file inode",
+                file / file_count);
+
+        return 0;
+}
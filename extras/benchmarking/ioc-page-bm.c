@@ -0,0 +1,152 @@
+/*
+  Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  ioc-page-bm: fill an io-cache inode with the pages of a fully cached
+  file (page headers only, no data) and look pages up at random offsets,
+  the way ioc_dispatch_requests() does for each read, with ioc_page_get()
+  and with a copy of the list scan and lru bump it replaced. then prune
+  the cache down to half its size with ioc_prune().
+
+  io=<glusterfs>/xlators/performance/io-cache/src
+  gcc -o ioc-page-bm ioc-page-bm.c $io/io-cache.c $io/page.c \
+      $io/ioc-inode.c -I$io -I<glusterfs>/libglusterfs/src \
+      -DHAVE_CONFIG_H -I<glusterfs> -lglusterfs -lpthread
+  ./ioc-page-bm [file-size-in-MB] [lookups]
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "glusterfs.h"
+#include "xlator.h"
+#include "logging.h"
+#include "io-cache.h"
+
+#define TS(tv) ((((unsigned long long) tv.tv_sec) * 1000000) + (tv.tv_usec))
+
+
+static ioc_page_t *
+scan_page_get (ioc_inode_t *ioc_inode, off_t offset)
+{
+        ioc_page_t  *page = NULL;
+        off_t        rounded_offset = floor (offset,
+                                             ioc_inode->table->page_size);
+
+        list_for_each_entry (page, &ioc_inode->pages, pages) {
+                if (page->offset == rounded_offset) {
+                        list_move_tail (&page->page_lru,
+                                        &ioc_inode->page_lru);
+                        return page;
+                }
+        }
+
+        return NULL;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+        xlator_t        xl = {0, };
+        ioc_table_t     table = {0, };
+        ioc_inode_t    *ioc_inode = NULL;
+        ioc_page_t     *page = NULL;
+        uint64_t        file_size = 4096ULL * 1048576;
+        uint64_t        pages = 0;
+        off_t          *offsets = NULL;
+        int             lookups = 100000;
+        int             found = 0;
+        int             i = 0;
+        struct timeval  start, end;
+
+        if (argc > 1)
+                file_size = strtoull (argv[1], NULL, 0) * 1048576;
+        if (argc > 2)
+                lookups = atoi (argv[2]);
+
+        gf_log_init ("/dev/null");
+        gf_log_set_loglevel (GF_LOG_ERROR);
+
+        xl.name = "ioc-page-bm";
+        table.xl = &xl;
+        table.page_size = IOC_PAGE_SIZE;
+        table.max_pri = 1;
+        INIT_LIST_HEAD (&table.inodes);
+        INIT_LIST_HEAD (&table.priority_list);
+        table.inode_lru = calloc (1, sizeof (struct list_head));
+        INIT_LIST_HEAD (&table.inode_lru[0]);
+        pthread_mutex_init (&table.table_lock, NULL);
+
+        ioc_inode = ioc_inode_update (&table, NULL, 0);
+
+        pages = file_size / table.page_size;
+        for (i = 0; i < pages; i++) {
+                page = ioc_page_create (ioc_inode, i * table.page_size);
+                page->size = table.page_size;
+                page->ready = 1;
+                table.cache_used += page->size;
+        }
+
+        offsets = calloc (lookups, sizeof (*offsets));
+        srandom (1);
+        for (i = 0; i < lookups; i++)
+                offsets[i] = ((random () % file_size) / 4096) * 4096;
+
+        printf ("%"PRIu64" pages of %"PRIu64" bytes, %d random lookups\n",
+                pages, table.page_size, lookups);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < lookups; i++) {
+                pthread_mutex_lock (&ioc_inode->inode_lock);
+                if (ioc_page_get (ioc_inode, offsets[i]))
+                        found++;
+                pthread_mutex_unlock (&ioc_inode->inode_lock);
+        }
+        gettimeofday (&end, NULL);
+        printf ("ioc_page_get:   %8.3f usec per lookup (%d found)\n",
+                (double) (TS (end) - TS (start)) / lookups, found);
+
+        found = 0;
+        gettimeofday (&start, NULL);
+        for (i = 0; i < lookups; i++) {
+                pthread_mutex_lock (&ioc_inode->inode_lock);
+                if (scan_page_get (ioc_inode, offsets[i]))
+                        found++;
+                pthread_mutex_unlock (&ioc_inode->inode_lock);
+        }
+        gettimeofday (&end, NULL);
+        printf ("list scan:      %8.3f usec per lookup (%d found)\n",
+                (double) (TS (end) - TS (start)) / lookups, found);
+
+        table.cache_size = table.cache_used / 2;
+        gettimeofday (&start, NULL);
+        ioc_prune (&table);
+        gettimeofday (&end, NULL);
+        printf ("ioc_prune:      %8.3f msec to prune %"PRIu64" pages\n",
+                (double) (TS (end) - TS (start)) / 1000,
+                pages - ioc_inode->page_count);
+
+        return 0;
+}
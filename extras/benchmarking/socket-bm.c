@@ -0,0 +1,198 @@
+/*
+  Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  socket-bm: write bursts of small replies, shaped like the ones
+  protocol/server submits to transport/socket (a header followed by a
+  small payload), over a socketpair. once with one writev () per reply
+  as __socket_ioq_churn_entry () does, and once gathering a whole burst
+  into a single writev () as __socket_ioq_churn () does with
+  transport.socket.cork enabled. prints writev () calls and time per
+  reply for both.
+
+  gcc -O2 -o socket-bm socket-bm.c -lpthread
+  ./socket-bm [reply-count] [burst-size]
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#define REPLY_HDR_SIZE  64
+#define REPLY_BUF_SIZE  128
+#define BURST_MAX       512
+
+struct reply {
+        struct iovec vector[2];
+        int          count;
+};
+
+static char hdr[REPLY_HDR_SIZE];
+static char buf[REPLY_BUF_SIZE];
+
+static long
+usecs_since (struct timeval *start)
+{
+        struct timeval now;
+
+        gettimeofday (&now, NULL);
+
+        return (now.tv_sec - start->tv_sec) * 1000000
+                + (now.tv_usec - start->tv_usec);
+}
+
+static void *
+drain (void *data)
+{
+        int  sock = (long) data;
+        char sink[65536];
+        int  ret = 0;
+
+        do {
+                ret = read (sock, sink, sizeof (sink));
+        } while (ret > 0 || (ret == -1 && errno == EINTR));
+
+        return NULL;
+}
+
+/* blocking socket, a writev () only comes back short on a signal */
+static long
+write_fully (int sock, struct iovec *vector, int count)
+{
+        long calls = 0;
+        int  ret = 0;
+
+        while (count) {
+                calls++;
+                ret = writev (sock, vector, count);
+                if (ret == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        perror ("writev");
+                        exit (1);
+                }
+
+                while (count && ret >= (int) vector[0].iov_len) {
+                        ret -= vector[0].iov_len;
+                        vector++;
+                        count--;
+                }
+                if (count) {
+                        vector[0].iov_base += ret;
+                        vector[0].iov_len  -= ret;
+                }
+        }
+
+        return calls;
+}
+
+static void
+run (const char *name, int replies, int burst, int gather)
+{
+        int             socks[2];
+        pthread_t       reader;
+        struct reply    queue[BURST_MAX];
+        struct iovec    vector[BURST_MAX * 2];
+        struct timeval  start;
+        long            calls = 0;
+        long            usecs = 0;
+        int             done = 0;
+        int             count = 0;
+        int             i = 0;
+
+        if (socketpair (AF_UNIX, SOCK_STREAM, 0, socks) == -1) {
+                perror ("socketpair");
+                exit (1);
+        }
+        pthread_create (&reader, NULL, drain, (void *)(long) socks[1]);
+
+        gettimeofday (&start, NULL);
+
+        while (done < replies) {
+                count = (replies - done < burst) ? replies - done : burst;
+
+                /* replies produced by one POLLIN event */
+                for (i = 0; i < count; i++) {
+                        queue[i].vector[0].iov_base = hdr;
+                        queue[i].vector[0].iov_len  = sizeof (hdr);
+                        queue[i].vector[1].iov_base = buf;
+                        queue[i].vector[1].iov_len  = sizeof (buf);
+                        queue[i].count = 2;
+                }
+
+                if (gather) {
+                        for (i = 0; i < count; i++)
+                                memcpy (&vector[i * 2], queue[i].vector,
+                                        sizeof (queue[i].vector));
+                        calls += write_fully (socks[0], vector, count * 2);
+                } else {
+                        for (i = 0; i < count; i++)
+                                calls += write_fully (socks[0],
+                                                      queue[i].vector,
+                                                      queue[i].count);
+                }
+
+                done += count;
+        }
+
+        usecs = usecs_since (&start);
+
+        shutdown (socks[0], SHUT_WR);
+        pthread_join (reader, NULL);
+        close (socks[0]);
+        close (socks[1]);
+
+        printf ("%-20s %10d replies %8ld writev %6.3f writev/reply "
+                "%8.3f usec/reply\n", name, replies, calls,
+                (double) calls / replies, (double) usecs / replies);
+}
+
+int
+main (int argc, char *argv[])
+{
+        int replies = 1000000;
+        int burst = 16;
+
+        if (argc > 1)
+                replies = atoi (argv[1]);
+        if (argc > 2)
+                burst = atoi (argv[2]);
+
+        if (replies <= 0 || burst <= 0 || burst > BURST_MAX) {
+                fprintf (stderr, "usage: %s [reply-count] [burst-size "
+                         "(1-%d)]\n", argv[0], BURST_MAX);
+                return 1;
+        }
+
+        printf ("%d byte replies in bursts of %d\n",
+                REPLY_HDR_SIZE + REPLY_BUF_SIZE, burst);
+
+        run ("writev per reply", replies, burst, 0);
+        run ("gathered writev", replies, burst, 1);
+
+        return 0;
+}
@@ -0,0 +1,175 @@
+/*
+  Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  timer-bm: arm and cancel timers with libglusterfs' timer wheel, and
+  with a copy of the sorted list registry it replaced.
+
+  gcc -o timer-bm timer-bm.c -I<glusterfs>/libglusterfs/src \
+      -DHAVE_CONFIG_H -I<glusterfs> -lglusterfs -lpthread
+  ./timer-bm [timer-count]
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "glusterfs.h"
+#include "timer.h"
+#include "logging.h"
+
+
+#define TS(tv) ((((unsigned long long) tv.tv_sec) * 1000000) + (tv.tv_usec))
+
+/* the registry as it was: one list sorted by expiry time */
+struct list_timer {
+        struct list_timer *next, *prev;
+        struct timeval at;
+};
+
+static struct list_timer list_head = { &list_head, &list_head, };
+static pthread_mutex_t   list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static struct list_timer *
+list_timer_call_after (struct timeval delta)
+{
+        struct list_timer  *event = NULL;
+        struct list_timer  *trav = NULL;
+        unsigned long long  at = 0;
+
+        event = calloc (1, sizeof (*event));
+        gettimeofday (&event->at, NULL);
+        event->at.tv_sec += ((event->at.tv_usec + delta.tv_usec) / 1000000);
+        event->at.tv_usec = ((event->at.tv_usec + delta.tv_usec) % 1000000);
+        event->at.tv_sec += delta.tv_sec;
+        at = TS (event->at);
+
+        pthread_mutex_lock (&list_lock);
+        {
+                trav = list_head.prev;
+                while (trav != &list_head) {
+                        if (TS (trav->at) < at)
+                                break;
+                        trav = trav->prev;
+                }
+                event->prev = trav;
+                event->next = event->prev->next;
+                event->prev->next = event;
+                event->next->prev = event;
+        }
+        pthread_mutex_unlock (&list_lock);
+
+        return event;
+}
+
+
+static void
+list_timer_call_cancel (struct list_timer *event)
+{
+        pthread_mutex_lock (&list_lock);
+        {
+                event->next->prev = event->prev;
+                event->prev->next = event->next;
+        }
+        pthread_mutex_unlock (&list_lock);
+
+        free (event);
+}
+
+
+static void
+bm_cbk (void *data)
+{
+        return;
+}
+
+
+static double
+elapsed_usec (struct timeval *start)
+{
+        struct timeval now;
+
+        gettimeofday (&now, NULL);
+
+        return (double) (TS (now) - TS ((*start)));
+}
+
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t     ctx = {{0, }, };
+        int                 count = 10000;
+        int                 i = 0;
+        struct timeval     *deltas = NULL;
+        gf_timer_t        **timers = NULL;
+        struct list_timer **list_timers = NULL;
+        struct timeval      start;
+        double              arm = 0, cancel = 0;
+
+        if (argc > 1)
+                count = atoi (argv[1]);
+
+        gf_log_init ("/dev/null");
+
+        deltas = calloc (count, sizeof (*deltas));
+        timers = calloc (count, sizeof (*timers));
+        list_timers = calloc (count, sizeof (*list_timers));
+
+        /* spread between 10 and 1000 seconds, so nothing fires */
+        srandom (count);
+        for (i = 0; i < count; i++) {
+                deltas[i].tv_sec  = 10 + (random () % 990);
+                deltas[i].tv_usec = random () % 1000000;
+        }
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < count; i++)
+                list_timers[i] = list_timer_call_after (deltas[i]);
+        arm = elapsed_usec (&start);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < count; i++)
+                list_timer_call_cancel (list_timers[i]);
+        cancel = elapsed_usec (&start);
+
+        printf ("%-12s %8d timers: arm %8.3f usec/op, cancel %8.3f usec/op\n",
+                "sorted-list", count, arm / count, cancel / count);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < count; i++)
+                timers[i] = gf_timer_call_after (&ctx, deltas[i],
+                                                 bm_cbk, NULL);
+        arm = elapsed_usec (&start);
+
+        gettimeofday (&start, NULL);
+        for (i = 0; i < count; i++)
+                gf_timer_call_cancel (&ctx, timers[i]);
+        cancel = elapsed_usec (&start);
+
+        printf ("%-12s %8d timers: arm %8.3f usec/op, cancel %8.3f usec/op\n",
+                "timer-wheel", count, arm / count, cancel / count);
+
+        return 0;
+}
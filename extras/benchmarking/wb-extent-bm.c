@@ -0,0 +1,436 @@
+/*
+  Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  wb-extent-bm: drive write-behind with the writes of an application
+  that waits for each write to be acknowledged, over a child which keeps
+  the writevs it is sent in flight and replies to one of them at random
+  once more than <depth> are, the way a remote server behind io-threads
+  does. three workloads: sequential 64KB writes, 4KB overwrites at
+  random offsets of a 4MB region with a 4KB read every 16 writes, and
+  512 byte appends. for each it prints the writes and bytes the child
+  got for those of the application, the iovecs per writev and the reads
+  that had to go to the child, and checks the file the child ends up
+  with against what was written.
+
+  wb=<glusterfs>/xlators/performance/write-behind/src
+  gcc -o wb-extent-bm wb-extent-bm.c $wb/write-behind.c $wb/extent.c \
+      -I$wb -I<glusterfs>/libglusterfs/src -DHAVE_CONFIG_H -I<glusterfs> \
+      -D_GNU_SOURCE -D_FILE_OFFSET_BITS=64 -DGF_LINUX_HOST_OS \
+      -lglusterfs -lpthread
+  ./wb-extent-bm [writes] [depth]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#include "glusterfs.h"
+#include "xlator.h"
+#include "stack.h"
+#include "logging.h"
+#include "iobuf.h"
+#include "write-behind.h"
+
+#define TS(tv) ((((unsigned long long) tv.tv_sec) * 1000000) + (tv.tv_usec))
+
+#define FILE_SIZE   (64 * 1048576)
+#define MAX_DEPTH   64
+#define MAX_PENDING 4096          /* a 1MB window of 256 byte writes */
+
+extern struct xlator_fops fops;
+extern struct xlator_mops mops;
+extern struct xlator_cbks cbks;
+int32_t init (xlator_t *this);
+
+struct pending {
+        call_frame_t *frame;
+        off_t         offset;
+        size_t        size;
+        char         *data;
+};
+
+static xlator_t        top, wb, child;
+static call_pool_t    *pool;
+static fd_t           *fd;
+static struct pending  pending[MAX_PENDING];
+static int             pending_count;
+static char           *image;           /* the file on the child */
+static char           *reference;       /* what the application wrote */
+static off_t           file_size;
+static int             done;
+static int             bad;
+
+static uint64_t child_writes, child_bytes, child_iovecs, child_reads;
+
+
+static void
+child_reply (void)
+{
+        struct pending  p;
+        struct stat     stbuf = {0, };
+        int             i = random () % pending_count;
+
+        p = pending[i];
+        pending[i] = pending[--pending_count];
+
+        memcpy (image + p.offset, p.data, p.size);
+        free (p.data);
+
+        stbuf.st_size = FILE_SIZE;
+        STACK_UNWIND (p.frame, p.size, 0, &stbuf);
+}
+
+
+static int32_t
+child_writev (call_frame_t *frame, xlator_t *this, fd_t *fd,
+              struct iovec *vector, int32_t count, off_t offset)
+{
+        struct pending *p = NULL;
+        size_t          copied = 0;
+        int             i = 0;
+
+        if (pending_count == MAX_PENDING) {
+                printf ("more than %d writevs in flight\n", MAX_PENDING);
+                exit (1);
+        }
+
+        p = &pending[pending_count++];
+        p->frame = frame;
+        p->offset = offset;
+        p->size = iov_length (vector, count);
+        p->data = malloc (p->size);
+        for (i = 0; i < count; i++) {
+                memcpy (p->data + copied, vector[i].iov_base,
+                        vector[i].iov_len);
+                copied += vector[i].iov_len;
+        }
+
+        child_writes++;
+        child_bytes += p->size;
+        child_iovecs += count;
+
+        return 0;
+}
+
+
+static int32_t
+child_readv (call_frame_t *frame, xlator_t *this, fd_t *fd, size_t size,
+             off_t offset)
+{
+        struct iovec vector = {image + offset, size};
+        struct stat  stbuf = {0, };
+
+        child_reads++;
+        stbuf.st_size = FILE_SIZE;
+        STACK_UNWIND (frame, size, 0, &vector, 1, &stbuf);
+        return 0;
+}
+
+
+static int32_t
+child_open (call_frame_t *frame, xlator_t *this, loc_t *loc, int32_t flags,
+            fd_t *fd)
+{
+        STACK_UNWIND (frame, 0, 0, fd);
+        return 0;
+}
+
+
+static int32_t
+child_fsync (call_frame_t *frame, xlator_t *this, fd_t *fd, int32_t datasync)
+{
+        STACK_UNWIND (frame, 0, 0);
+        return 0;
+}
+
+
+static void
+top_done (call_frame_t *frame, int32_t op_ret)
+{
+        if (op_ret == -1)
+                bad++;
+        done = 1;
+        STACK_DESTROY (frame->root);
+}
+
+
+static int32_t
+top_open_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+              int32_t op_ret, int32_t op_errno, fd_t *fd)
+{
+        top_done (frame, op_ret);
+        return 0;
+}
+
+
+static int32_t
+top_writev_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+                int32_t op_ret, int32_t op_errno, struct stat *stbuf)
+{
+        top_done (frame, op_ret);
+        return 0;
+}
+
+
+static int32_t
+top_fsync_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+               int32_t op_ret, int32_t op_errno)
+{
+        top_done (frame, op_ret);
+        return 0;
+}
+
+
+static int32_t
+top_readv_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+               int32_t op_ret, int32_t op_errno, struct iovec *vector,
+               int32_t count, struct stat *stbuf)
+{
+        off_t offset = (off_t)(long) cookie;
+        int   i = 0;
+
+        for (i = 0; i < count; i++) {
+                if (memcmp (vector[i].iov_base, reference + offset,
+                            vector[i].iov_len))
+                        bad++;
+                offset += vector[i].iov_len;
+        }
+
+        done = 1;
+        STACK_DESTROY (frame->root);
+        return 0;
+}
+
+
+/* let the child answer until the fop wound last is */
+static void
+wait_done (void)
+{
+        while (!done) {
+                if (!pending_count) {
+                        printf ("fop stuck with nothing in flight\n");
+                        exit (1);
+                }
+                child_reply ();
+        }
+}
+
+
+static void
+app_write (off_t offset, size_t size)
+{
+        call_frame_t  *frame = NULL;
+        struct iobuf  *iobuf = NULL;
+        struct iobref *iobref = NULL;
+        struct iovec   vector;
+        static char    fill;
+
+        memset (reference + offset, ++fill, size);
+        if (offset + size > file_size)
+                file_size = offset + size;
+
+        iobuf = iobuf_get2 (wb.ctx->iobuf_pool, size);
+        memcpy (iobuf->ptr, reference + offset, size);
+        vector.iov_base = iobuf->ptr;
+        vector.iov_len = size;
+
+        iobref = iobref_new ();
+        iobref_add (iobref, iobuf);
+        iobuf_unref (iobuf);
+
+        frame = create_frame (&top, pool);
+        frame->root->req_refs = iobref;
+
+        done = 0;
+        STACK_WIND (frame, top_writev_cbk, &wb, wb.fops->writev, fd,
+                    &vector, 1, offset);
+        iobref_unref (iobref);
+        wait_done ();
+}
+
+
+static void
+app_read (off_t offset, size_t size)
+{
+        call_frame_t *frame = create_frame (&top, pool);
+
+        done = 0;
+        STACK_WIND_COOKIE (frame, top_readv_cbk, (void *)(long) offset,
+                           &wb, wb.fops->readv, fd, size, offset);
+        wait_done ();
+}
+
+
+static void
+app_fsync (void)
+{
+        call_frame_t *frame = create_frame (&top, pool);
+
+        done = 0;
+        STACK_WIND (frame, top_fsync_cbk, &wb, wb.fops->fsync, fd, 0);
+        wait_done ();
+}
+
+
+static void
+app_open (inode_table_t *table)
+{
+        call_frame_t *frame = create_frame (&top, pool);
+        loc_t         loc = {0, };
+
+        if (fd) {
+                fd_unref (fd);
+                fd = NULL;
+        }
+
+        memset (image, 0, FILE_SIZE);
+        memset (reference, 0, FILE_SIZE);
+        file_size = 0;
+        child_writes = child_bytes = child_iovecs = child_reads = 0;
+
+        loc.inode = inode_new (table);
+        fd = fd_create (loc.inode, 0);
+        fd->flags = O_RDWR;
+
+        done = 0;
+        STACK_WIND (frame, top_open_cbk, &wb, wb.fops->open, &loc, O_RDWR,
+                    fd);
+        wait_done ();
+}
+
+
+static void
+report (const char *what, int writes, uint64_t bytes, int reads,
+        struct timeval *start)
+{
+        struct timeval end;
+
+        app_fsync ();
+        gettimeofday (&end, NULL);
+
+        if (memcmp (image, reference, file_size))
+                bad++;
+
+        printf ("%-17s %7d writes %9.1f MB -> %7"PRIu64" writevs "
+                "%9.1f MB, %4.1f iovecs each, %d/%d reads to child, "
+                "%6.2f usec per write\n", what, writes,
+                (double) bytes / 1048576, child_writes,
+                (double) child_bytes / 1048576,
+                child_writes ? (double) child_iovecs / child_writes : 0,
+                (int) child_reads, reads,
+                (double) (TS (end) - TS ((*start))) / writes);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+        glusterfs_ctx_t      ctx = {{0, }, };
+        struct xlator_fops   child_fops = {0, };
+        xlator_list_t        children = {0, };
+        inode_table_t       *table = NULL;
+        struct timeval       start;
+        int                  writes = 100000;
+        int                  depth = 4;
+        int                  reads = 0;
+        int                  i = 0;
+
+        if (argc > 1)
+                writes = atoi (argv[1]);
+        if (argc > 2)
+                depth = atoi (argv[2]);
+        if (depth < 1 || depth > MAX_DEPTH)
+                depth = 4;
+
+        gf_global_variable_init ();
+        gf_log_init ("/dev/null");
+        gf_log_set_loglevel (GF_LOG_ERROR);
+
+        pool = call_pool_new ();
+        ctx.pool = pool;
+        ctx.xl_count = 3;
+        ctx.iobuf_pool = iobuf_pool_new (GF_IOBUF_ARENA_SIZE,
+                                         GF_IOBUF_PAGE_SIZE);
+
+        child_fops.writev = child_writev;
+        child_fops.readv = child_readv;
+        child_fops.open = child_open;
+        child_fops.fsync = child_fsync;
+
+        top.name = "top";
+        child.name = "child";
+        child.fops = &child_fops;
+        child.mops = &mops;
+        wb.name = "wb";
+        wb.fops = &fops;
+        wb.mops = &mops;
+        wb.cbks = &cbks;
+        wb.options = dict_new ();
+        children.xlator = &child;
+        wb.children = &children;
+        top.ctx = wb.ctx = child.ctx = &ctx;
+
+        if (init (&wb) != 0)
+                return 1;
+
+        table = inode_table_new (0, &wb);
+        image = calloc (1, FILE_SIZE);
+        reference = calloc (1, FILE_SIZE);
+        srandom (1);
+
+        printf ("child keeps %d writevs in flight\n", depth);
+
+        app_open (table);
+        gettimeofday (&start, NULL);
+        for (i = 0; i < writes; i++) {
+                app_write ((i * 65536ULL) % FILE_SIZE, 65536);
+                while (pending_count > depth)
+                        child_reply ();
+        }
+        report ("sequential 64KB", writes, writes * 65536ULL, 0, &start);
+
+        app_open (table);
+        gettimeofday (&start, NULL);
+        for (i = 0; i < writes; i++) {
+                app_write ((random () % 1024) * 4096, 4096);
+                if (i % 16 == 15) {
+                        app_read ((random () % 1024) * 4096, 4096);
+                        reads++;
+                }
+                while (pending_count > depth)
+                        child_reply ();
+        }
+        report ("random 4KB", writes, writes * 4096ULL, reads, &start);
+
+        app_open (table);
+        gettimeofday (&start, NULL);
+        for (i = 0; i < writes && (i + 1) * 512 <= FILE_SIZE; i++) {
+                app_write (i * 512, 512);
+                while (pending_count > depth)
+                        child_reply ();
+        }
+        report ("append 512B", i, i * 512ULL, 0, &start);
+
+        printf ("%s\n", bad ? "MISMATCH" : "contents match");
+
+        return bad != 0;
+}
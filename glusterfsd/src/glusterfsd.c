@@ -121,6 +121,9 @@ static struct argp_option gf_options[] = {
 	 "in VOLFILE]"},
  	{"xlator-option", ARGP_XLATOR_OPTION_KEY,"VOLUME-NAME.OPTION=VALUE", 0,
 	 "Add/override a translator option for a volume with specified value"},
+	{"fop-stats", ARGP_FOP_STATS_KEY, 0, 0,
+	 "Count calls, errors and latencies of every fop in every translator, "
+	 "logged on SIGUSR1"},
 	
  	{0, 0, 0, 0, "Fuse options:"},
  	{"disable-direct-io-mode", ARGP_DISABLE_DIRECT_IO_MODE_KEY, 0, 0, 
@@ -130,6 +133,9 @@ static struct argp_option gf_options[] = {
  	{"attribute-timeout", ARGP_ATTRIBUTE_TIMEOUT_KEY, "SECONDS", 0, 
  	 "Set attribute timeout to SECONDS for inodes in fuse kernel module "
 	 "[default: 1]"},
+	{"reader-thread-count", ARGP_READER_THREAD_COUNT_KEY, "COUNT", 0,
+	 "Read requests from the fuse kernel module with COUNT threads "
+	 "[default: 1]"},
 #ifdef GF_DARWIN_HOST_OS
  	{"non-local", ARGP_NON_LOCAL_KEY, 0, 0, 
  	 "Mount the macfuse volume without '-o local' option"},
@@ -161,6 +167,7 @@ _gf_dump_details (int argc, char **argv)
 
         /* Which TLA? What time? */
         strftime (timestr, 256, "%Y-%m-%d %H:%M:%S", tm); 
+	gf_log_flush ();
 	fprintf (gf_log_logfile, 
 		 "========================================"
 		 "========================================\n");
@@ -235,6 +242,10 @@ _add_fuse_mount (xlator_t *graph)
 	if (cmd_args->fuse_entry_timeout)
 		ret = dict_set_uint32 (top->options, ZR_ENTRY_TIMEOUT_OPT, 
 				       cmd_args->fuse_entry_timeout);
+	if (cmd_args->fuse_reader_thread_count)
+		ret = dict_set_uint32 (top->options,
+				       ZR_READER_THREAD_COUNT_OPT,
+				       cmd_args->fuse_reader_thread_count);
 
 #ifdef GF_DARWIN_HOST_OS 
 	/* On Darwin machines, O_APPEND is not handled, 
@@ -752,6 +763,18 @@ parse_opts (int key, char *arg, struct argp_state *state)
 		argp_failure (state, -1, 0, 
 			      "unknown attribute timeout %s", arg);
 		break;
+
+	case ARGP_READER_THREAD_COUNT_KEY:
+		n = 0;
+
+		if (gf_string2uint_base10 (arg, &n) == 0 && n > 0) {
+			cmd_args->fuse_reader_thread_count = n;
+			break;
+		}
+
+		argp_failure (state, -1, 0,
+			      "invalid reader thread count %s", arg);
+		break;
 	
 	case ARGP_VOLUME_NAME_KEY:
 		cmd_args->volume_name = strdup (arg);
@@ -761,6 +784,10 @@ parse_opts (int key, char *arg, struct argp_state *state)
 		gf_remember_xlator_option (&cmd_args->xlator_options, arg);
 		break;
 
+	case ARGP_FOP_STATS_KEY:
+		cmd_args->fop_stats = 1;
+		break;
+
 #ifdef GF_DARWIN_HOST_OS		
 	case ARGP_NON_LOCAL_KEY:
 		cmd_args->non_local = _gf_true;
@@ -823,6 +850,77 @@ cleanup_and_exit (int signum)
 }
 
 
+static void
+gf_dump_stats (void)
+{
+	glusterfs_ctx_t *ctx = NULL;
+	xlator_t        *trav = NULL;
+
+	ctx = get_global_ctx_ptr ();
+
+#ifdef HAVE_MALLOC_STATS
+	malloc_stats ();
+#endif
+	call_pool_log_stats (ctx->pool);
+
+	/* the inode tables, once each from the translator owning it */
+	trav = ctx->graph;
+	while (trav && trav->prev)
+		trav = trav->prev;
+
+	for (; trav; trav = trav->next) {
+		if (trav->itable && trav->itable->xl == trav)
+			inode_table_log_stats (trav->itable);
+	}
+
+	if (ctx->graph)
+		xlator_fop_stats_log (ctx->graph);
+}
+
+
+/*
+ * SIGUSR1 is blocked in every thread and taken here with sigwait (), so
+ * that the dump may take locks and log like any other thread
+ */
+static void *
+gf_dump_stats_proc (void *data)
+{
+	sigset_t set;
+	int      sig = 0;
+
+	sigemptyset (&set);
+	sigaddset (&set, SIGUSR1);
+
+	while (1) {
+		if (sigwait (&set, &sig) != 0)
+			continue;
+
+		gf_dump_stats ();
+	}
+
+	return NULL;
+}
+
+
+static int
+gf_dump_stats_init (void)
+{
+	pthread_t thread;
+	int       ret = 0;
+
+	ret = pthread_create (&thread, NULL, gf_dump_stats_proc, NULL);
+	if (ret != 0) {
+		gf_log ("glusterfs", GF_LOG_ERROR,
+			"failed to start the stats thread (%s)",
+			strerror (ret));
+		return -1;
+	}
+
+	pthread_detach (thread);
+	return 0;
+}
+
+
 static char *
 zr_build_process_uuid ()
 {
@@ -880,7 +978,6 @@ main (int argc, char *argv[])
 {
 	glusterfs_ctx_t  *ctx = NULL;
 	cmd_args_t       *cmd_args = NULL;
-	call_pool_t      *pool = NULL;
 	struct stat       stbuf;
 	char              tmp_logfile[1024] = { 0 };
 	char              timestr[256] = { 0 };
@@ -889,6 +986,7 @@ main (int argc, char *argv[])
 	struct tm        *tm = NULL;
 	int               ret = 0;
 	struct rlimit     lim;
+	sigset_t          sigset;
 	FILE             *specfp = NULL;
 	xlator_t         *graph = NULL;
 	xlator_t         *trav = NULL;
@@ -896,6 +994,12 @@ main (int argc, char *argv[])
 	int               xl_count = 0;
 	uint8_t           process_mode = 0;
 
+	/* taken by the stats thread, threads started from here inherit it
+	   blocked */
+	sigemptyset (&sigset);
+	sigaddset (&sigset, SIGUSR1);
+	pthread_sigmask (SIG_BLOCK, &sigset, NULL);
+
 	utime = time (NULL);
 	ctx = CALLOC (1, sizeof (glusterfs_ctx_t));
 	ERR_ABORT (ctx);
@@ -936,10 +1040,11 @@ main (int argc, char *argv[])
 
 	ctx->event_pool = event_pool_new (DEFAULT_EVENT_POOL_SIZE);
 	pthread_mutex_init (&(ctx->lock), NULL);
-	pool = ctx->pool = CALLOC (1, sizeof (call_pool_t));
+	ctx->pool = call_pool_new ();
 	ERR_ABORT (ctx->pool);
-	LOCK_INIT (&pool->lock);
-	INIT_LIST_HEAD (&pool->all_frames);
+	ctx->iobuf_pool = iobuf_pool_new (GF_IOBUF_ARENA_SIZE,
+					  GF_IOBUF_PAGE_SIZE);
+	ERR_ABORT (ctx->iobuf_pool);
 	
  	if (cmd_args->pid_file != NULL) {
  		ctx->pidfp = fopen (cmd_args->pid_file, "a+");
@@ -1015,9 +1120,7 @@ main (int argc, char *argv[])
 #ifdef DEBUG
 	mtrace ();
 #endif
-	signal (SIGUSR1, (sighandler_t) malloc_stats);
 #endif
-
 	signal (SIGSEGV, gf_print_trace);
 	signal (SIGABRT, gf_print_trace);
 	signal (SIGPIPE, SIG_IGN);
@@ -1100,12 +1203,19 @@ main (int argc, char *argv[])
 		"running in pid %d", getpid ());
 	
 	gf_timer_registry_init (ctx);
+	gf_dump_stats_init ();
 
 	/* override xlator options with command line options
 	 * where applicable 
 	 */
 	gf_add_cmdline_options (graph, cmd_args);
 
+	if (cmd_args->fop_stats && xlator_fop_stats_enable (graph) != 0) {
+		gf_log ("glusterfs", GF_LOG_ERROR,
+			"failed to set up fop stats");
+		return -1;
+	}
+
 	ctx->graph = graph;
 	if (glusterfs_graph_init (graph, fuse_volume_found) != 0) {
 		gf_log ("glusterfs", GF_LOG_ERROR, 
@@ -48,6 +48,7 @@
 #define ZR_ATTR_TIMEOUT_OPT     "attribute-timeout"
 #define ZR_ENTRY_TIMEOUT_OPT    "entry-timeout"
 #define ZR_DIRECT_IO_OPT        "direct-io-mode"
+#define ZR_READER_THREAD_COUNT_OPT "reader-thread-count"
 
 enum argp_option_keys {
 	ARGP_VOLFILE_SERVER_KEY = 's', 
@@ -69,6 +70,8 @@ enum argp_option_keys {
 	ARGP_NON_LOCAL_KEY = 139,
 #endif /* DARWIN */
 	ARGP_VOLFILE_ID_KEY = 143, 
+	ARGP_FOP_STATS_KEY = 144,
+	ARGP_READER_THREAD_COUNT_KEY = 145,
 };
 
 /* Moved here from fetch-spec.h */
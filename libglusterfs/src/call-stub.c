@@ -1096,7 +1096,7 @@ fop_readv_cbk_stub (call_frame_t *frame,
 		stub->args.readv_cbk.count = count;
 		stub->args.readv_cbk.stbuf = *stbuf;
 		stub->args.readv_cbk.rsp_refs = 
-			dict_ref (frame->root->rsp_refs);
+			iobref_ref (frame->root->rsp_refs);
 	}
 out:
 	return stub;
@@ -1127,7 +1127,7 @@ fop_writev_stub (call_frame_t *frame,
 	stub->args.writev.off = off;
 
 	if (frame->root->req_refs)
-		stub->args.writev.req_refs = dict_ref (frame->root->req_refs);
+		stub->args.writev.req_refs = iobref_ref (frame->root->req_refs);
 out:
 	return stub;
 }
@@ -1912,6 +1912,65 @@ fop_readdir_stub (call_frame_t *frame,
 
   return stub;
 }
+
+call_stub_t *
+fop_readdirp_cbk_stub (call_frame_t *frame,
+		       fop_readdirp_cbk_t fn,
+		       int32_t op_ret,
+		       int32_t op_errno,
+		       gf_dirent_t *entries)
+{
+	call_stub_t *stub = NULL;
+	gf_dirent_t *stub_entry = NULL, *entry = NULL;
+
+	GF_VALIDATE_OR_GOTO ("call-stub", frame, out);
+
+	stub = stub_new (frame, 0, GF_FOP_READDIRP);
+	GF_VALIDATE_OR_GOTO ("call-stub", stub, out);
+
+	stub->args.readdirp_cbk.fn = fn;
+	stub->args.readdirp_cbk.op_ret = op_ret;
+	stub->args.readdirp_cbk.op_errno = op_errno;
+	INIT_LIST_HEAD (&stub->args.readdirp_cbk.entries.list);
+
+	if (op_ret > 0) {
+		list_for_each_entry (entry, &entries->list, list) {
+			stub_entry = gf_dirent_for_name (entry->d_name);
+			ERR_ABORT (stub_entry);
+			stub_entry->d_off  = entry->d_off;
+			stub_entry->d_ino  = entry->d_ino;
+			stub_entry->d_type = entry->d_type;
+			stub_entry->d_stat = entry->d_stat;
+
+			list_add_tail (&stub_entry->list,
+				       &stub->args.readdirp_cbk.entries.list);
+		}
+	}
+out:
+	return stub;
+}
+
+call_stub_t *
+fop_readdirp_stub (call_frame_t *frame,
+		   fop_readdirp_t fn,
+		   fd_t *fd,
+		   size_t size,
+		   off_t off)
+{
+	call_stub_t *stub = NULL;
+
+	GF_VALIDATE_OR_GOTO ("call-stub", frame, out);
+
+	stub = stub_new (frame, 1, GF_FOP_READDIRP);
+	GF_VALIDATE_OR_GOTO ("call-stub", stub, out);
+
+	stub->args.readdirp.fn = fn;
+	stub->args.readdirp.fd = fd_ref (fd);
+	stub->args.readdirp.size = size;
+	stub->args.readdirp.off = off;
+out:
+	return stub;
+}
 call_stub_t *
 fop_checksum_stub (call_frame_t *frame,
 		   fop_checksum_t fn,
@@ -2458,6 +2517,15 @@ call_resume_wind (call_stub_t *stub)
 
 		break;
 	}
+	case GF_FOP_READDIRP:
+	{
+		stub->args.readdirp.fn (stub->frame,
+					stub->frame->this,
+					stub->args.readdirp.fd,
+					stub->args.readdirp.size,
+					stub->args.readdirp.off);
+		break;
+	}
 	default:
 	{
 		gf_log ("call-stub",
@@ -3232,6 +3300,26 @@ call_resume_unwind (call_stub_t *stub)
 
 		break;
 	}
+	case GF_FOP_READDIRP:
+	{
+		if (!stub->args.readdirp_cbk.fn)
+			STACK_UNWIND (stub->frame,
+				      stub->args.readdirp_cbk.op_ret,
+				      stub->args.readdirp_cbk.op_errno,
+				      &stub->args.readdirp_cbk.entries);
+		else
+			stub->args.readdirp_cbk.fn (stub->frame,
+						    stub->frame->cookie,
+						    stub->frame->this,
+						    stub->args.readdirp_cbk.op_ret,
+						    stub->args.readdirp_cbk.op_errno,
+						    &stub->args.readdirp_cbk.entries);
+
+		if (stub->args.readdirp_cbk.op_ret > 0)
+			gf_dirent_free (&stub->args.readdirp_cbk.entries);
+
+		break;
+	}
 	case GF_FOP_MAXVALUE:
 	{
 		gf_log ("call-stub",
@@ -3345,12 +3433,12 @@ call_stub_destroy_wind (call_stub_t *stub)
   
 	case GF_FOP_WRITE:
 	{
-		dict_t *refs = stub->args.writev.req_refs;
+		struct iobref *refs = stub->args.writev.req_refs;
 		if (stub->args.writev.fd)
 			fd_unref (stub->args.writev.fd);
 		FREE (stub->args.writev.vector);
 		if (refs)
-			dict_unref (refs);
+			iobref_unref (refs);
 		break;
 	}
   
@@ -3540,6 +3628,12 @@ call_stub_destroy_wind (call_stub_t *stub)
 		dict_unref (stub->args.xattrop.xattr);
 		break;
 	}
+	case GF_FOP_READDIRP:
+	{
+		if (stub->args.readdirp.fd)
+			fd_unref (stub->args.readdirp.fd);
+		break;
+	}
 	case GF_FOP_MAXVALUE:
 	{
 		gf_log ("call-stub",
@@ -3633,11 +3727,11 @@ call_stub_destroy_unwind (call_stub_t *stub)
 	case GF_FOP_READ:
 	{
 		if (stub->args.readv_cbk.op_ret >= 0) {
-			dict_t *refs = stub->args.readv_cbk.rsp_refs;
+			struct iobref *refs = stub->args.readv_cbk.rsp_refs;
 			FREE (stub->args.readv_cbk.vector);
 			
 			if (refs) {
-				dict_unref (refs);
+				iobref_unref (refs);
 			}
 		}
 	}
@@ -3771,6 +3865,14 @@ call_stub_destroy_unwind (call_stub_t *stub)
 	}
 	break;
 
+	case GF_FOP_READDIRP:
+	{
+		if (stub->args.readdirp_cbk.op_ret > 0) {
+			gf_dirent_free (&stub->args.readdirp_cbk.entries);
+		}
+	}
+	break;
+
 	case GF_FOP_MAXVALUE:
 	{
 		gf_log ("call-stub",
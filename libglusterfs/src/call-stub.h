@@ -309,7 +309,7 @@ typedef struct {
 			struct iovec *vector;
 			int32_t count;
 			struct stat stbuf;
-			dict_t *rsp_refs;
+			struct iobref *rsp_refs;
 		} readv_cbk;
 
 		/* writev */
@@ -319,7 +319,7 @@ typedef struct {
 			struct iovec *vector;
 			int32_t count;
 			off_t off;
-			dict_t *req_refs;
+			struct iobref *req_refs;
 		} writev;
 		struct {
 			fop_writev_cbk_t fn;
@@ -567,6 +567,19 @@ typedef struct {
 			int32_t op_errno;
 			dict_t *xattr;
 		} fxattrop_cbk;
+
+		/* readdirp */
+		struct {
+			fop_readdirp_t fn;
+			fd_t *fd;
+			size_t size;
+			off_t off;
+		} readdirp;
+		struct {
+			fop_readdirp_cbk_t fn;
+			int32_t op_ret, op_errno;
+			gf_dirent_t entries;
+		} readdirp_cbk;
 	} args;
 } call_stub_t;
 
@@ -1099,6 +1112,20 @@ fop_fxattrop_stub_cbk_stub (call_frame_t *frame,
 			    int32_t op_ret,
 			    int32_t op_errno);
 
+call_stub_t *
+fop_readdirp_stub (call_frame_t *frame,
+		   fop_readdirp_t fn,
+		   fd_t *fd,
+		   size_t size,
+		   off_t off);
+
+call_stub_t *
+fop_readdirp_cbk_stub (call_frame_t *frame,
+		       fop_readdirp_cbk_t fn,
+		       int32_t op_ret,
+		       int32_t op_errno,
+		       gf_dirent_t *entries);
+
 void call_resume (call_stub_t *stub);
 void call_stub_destroy (call_stub_t *stub);
 #endif
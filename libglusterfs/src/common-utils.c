@@ -207,6 +207,8 @@ gf_global_variable_init()
 	gf_fop_list[GF_FOP_FENTRYLK]    = "FENTRYLK";   /* 40 */
 	gf_fop_list[GF_FOP_CHECKSUM]    = "CHECKSUM";   /* 41 */   
 	gf_fop_list[GF_FOP_XATTROP]     = "XATTROP";
+	gf_fop_list[GF_FOP_FXATTROP]    = "FXATTROP";
+	gf_fop_list[GF_FOP_READDIRP]    = "READDIRP";
 
 	gf_mop_list[GF_MOP_SETVOLUME]   = "SETVOLUME"; /* 0 */
 	gf_mop_list[GF_MOP_GETVOLUME]   = "GETVOLUME"; /* 1 */
@@ -244,6 +246,9 @@ gf_log_volume_file (FILE *specfp)
 	
 	fseek (specfp, 0L, SEEK_SET);
 	
+	/* write out what is queued for the log first */
+	gf_log_flush ();
+
 	fprintf (gf_log_logfile, "Given volfile:\n");
 	fprintf (gf_log_logfile, 
 		 "+---------------------------------------"
@@ -364,6 +369,8 @@ gf_print_trace (int32_t signum)
 	int fd = fileno (gf_log_logfile);
 	char msg[1024];
 
+	/* whatever was logged before the crash, unless a lock is held */
+	gf_log_flush_nowait ();
 
 	/* Pending frames, (if any), list them in order */
 	write (fd, "pending frames:\n", 16);
@@ -1337,6 +1337,48 @@ default_readdir (call_frame_t *frame,
 	return 0;
 }
 
+
+int32_t
+default_readdirp_cbk (call_frame_t *frame,
+		      void *cookie,
+		      xlator_t *this,
+		      int32_t op_ret,
+		      int32_t op_errno,
+		      gf_dirent_t *entries)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, entries);
+	return 0;
+}
+
+
+int32_t
+default_readdirp (call_frame_t *frame,
+		  xlator_t *this,
+		  fd_t *fd,
+		  size_t size,
+		  off_t off)
+{
+	STACK_WIND (frame,
+		    default_readdirp_cbk,
+		    FIRST_CHILD(this),
+		    FIRST_CHILD(this)->fops->readdirp,
+		    fd, size, off);
+	return 0;
+}
+
+
+/* readdirp of an xlator which has only a readdir: the readdir unwinds
+   the same way, the entries have no d_stat */
+int32_t
+default_readdirp_readdir (call_frame_t *frame,
+			  xlator_t *this,
+			  fd_t *fd,
+			  size_t size,
+			  off_t off)
+{
+	return this->fops->readdir (frame, this, fd, size, off);
+}
+
 /* notify */
 int32_t
 default_notify (xlator_t *this,
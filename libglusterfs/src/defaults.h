@@ -236,6 +236,16 @@ int32_t default_readdir (call_frame_t *frame,
 			  xlator_t *this,
 			  fd_t *fd,
 			  size_t size, off_t off);
+
+int32_t default_readdirp (call_frame_t *frame,
+			  xlator_t *this,
+			  fd_t *fd,
+			  size_t size, off_t off);
+
+int32_t default_readdirp_readdir (call_frame_t *frame,
+				  xlator_t *this,
+				  fd_t *fd,
+				  size_t size, off_t off);
 		 
 int32_t default_setdents (call_frame_t *frame,
 			  xlator_t *this,
@@ -19,6 +19,7 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <inttypes.h>
@@ -34,6 +35,7 @@
 #include "logging.h"
 #include "compat.h"
 #include "byte-order.h"
+#include "iobuf.h"
 
 data_pair_t *
 get_new_data_pair ()
@@ -73,13 +75,21 @@ get_new_dict_full (int size_hint)
 		return NULL;
 	}
 
-	dict->hash_size = size_hint;
-	dict->members = CALLOC (size_hint, sizeof (data_pair_t *));
+	dict->hash_size = DICT_INLINE_HASH;
+	dict->members = dict->inline_index;
 
-	if (!dict->members) {
-		gf_log ("dict", GF_LOG_CRITICAL,
-			"calloc () returned NULL");
-		return NULL;
+	if (size_hint * 2 > DICT_INLINE_HASH) {
+		while (dict->hash_size < size_hint * 2)
+			dict->hash_size *= 2;
+
+		dict->members = CALLOC (dict->hash_size,
+					sizeof (data_pair_t *));
+		if (!dict->members) {
+			gf_log ("dict", GF_LOG_CRITICAL,
+				"calloc () returned NULL");
+			FREE (dict);
+			return NULL;
+		}
 	}
 
 	LOCK_INIT (&dict->lock);
@@ -182,47 +192,250 @@ data_copy (data_t *old)
 	return newdata;
 }
 
+#if HAVE_SYNC_BUILTINS
+#define DICT_REF_ADD(obj, n, ret)					\
+	do {								\
+		ret = __sync_add_and_fetch (&(obj)->refcount, n);	\
+	} while (0)
+#define DICT_REF_INC(obj)						\
+	do {								\
+		__sync_add_and_fetch (&(obj)->refcount, 1);		\
+	} while (0)
+#else
+#define DICT_REF_ADD(obj, n, ret)					\
+	do {								\
+		LOCK (&(obj)->lock);					\
+		ret = ((obj)->refcount += n);				\
+		UNLOCK (&(obj)->lock);					\
+	} while (0)
+#define DICT_REF_INC(obj)						\
+	do {								\
+		LOCK (&(obj)->lock);					\
+		(obj)->refcount++;					\
+		UNLOCK (&(obj)->lock);					\
+	} while (0)
+#endif
+
+
+/* keys set on the way of most fops. pairs with one of these keys point
+   here instead of to a copy of it. */
+static char *dict_interned_keys[] = {
+	"trusted.glusterfs.dht",
+	"trusted.glusterfs.dht.linkto",
+	"trusted.glusterfs.afr.data-pending",
+	"trusted.glusterfs.afr.metadata-pending",
+	"trusted.glusterfs.afr.entry-pending",
+	"glusterfs.content",
+	"glusterfs.open-fd-count",
+	NULL
+};
+
+static uint32_t dict_interned_hash[sizeof (dict_interned_keys) /
+				   sizeof (dict_interned_keys[0])];
+
+static pthread_once_t dict_interned_once = PTHREAD_ONCE_INIT;
+
+
+static uint32_t
+_dict_key_hash (char *key)
+{
+	return SuperFastHash (key, strlen (key));
+}
+
+
+static void
+_dict_interned_init (void)
+{
+	int i = 0;
+
+	for (i = 0; dict_interned_keys[i]; i++)
+		dict_interned_hash[i] = _dict_key_hash (dict_interned_keys[i]);
+}
+
+
+static char *
+_dict_intern (char *key, uint32_t hash)
+{
+	int i = 0;
+
+	pthread_once (&dict_interned_once, _dict_interned_init);
+
+	for (i = 0; dict_interned_keys[i]; i++) {
+		if (dict_interned_hash[i] == hash &&
+		    !strcmp (dict_interned_keys[i], key))
+			return dict_interned_keys[i];
+	}
+
+	return NULL;
+}
+
+
+/* index slot holding @key, -1 if there is none */
+static int
+_dict_slot (dict_t *this, char *key, uint32_t hash)
+{
+	int          mask = this->hash_size - 1;
+	int          slot = hash & mask;
+	data_pair_t *pair = NULL;
+
+	while ((pair = this->members[slot]) != NULL) {
+		if (pair->key_hash == hash &&
+		    (pair->key == key || !strcmp (pair->key, key)))
+			return slot;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return -1;
+}
+
+
 static data_pair_t *
 _dict_lookup (dict_t *this, char *key)
 {
+	int slot = 0;
+
 	if (!this || !key) {
 		gf_log ("dict", GF_LOG_CRITICAL,
 			"@this=%p @key=%p", this, key);
 		return NULL;
 	}
 
-	int hashval = SuperFastHash (key, strlen (key)) % this->hash_size;
-	data_pair_t *pair;
-   
-	for (pair = this->members[hashval]; pair != NULL; pair = pair->hash_next) {
-		if (pair->key && !strcmp (pair->key, key))
-			return pair;
+	slot = _dict_slot (this, key, _dict_key_hash (key));
+	if (slot < 0)
+		return NULL;
+
+	return this->members[slot];
+}
+
+
+static void
+_dict_index_add (dict_t *this, data_pair_t *pair)
+{
+	int mask = this->hash_size - 1;
+	int slot = pair->key_hash & mask;
+
+	while (this->members[slot])
+		slot = (slot + 1) & mask;
+
+	this->members[slot] = pair;
+}
+
+
+/* empty @slot and move up the entries after it which would not be
+   found past the hole any more */
+static void
+_dict_index_del (dict_t *this, int slot)
+{
+	int mask = this->hash_size - 1;
+	int hole = slot;
+	int home = 0;
+
+	this->members[hole] = NULL;
+
+	for (slot = (hole + 1) & mask; this->members[slot];
+	     slot = (slot + 1) & mask) {
+		home = this->members[slot]->key_hash & mask;
+
+		if ((slot > hole) ? (home <= hole || home > slot)
+		                  : (home <= hole && home > slot)) {
+			this->members[hole] = this->members[slot];
+			this->members[slot] = NULL;
+			hole = slot;
+		}
 	}
-  
-	return NULL;
 }
 
 
+/* keep the index at most half full, with room for one more pair */
+static int
+_dict_index_grow (dict_t *this)
+{
+	data_pair_t **members = NULL;
+	data_pair_t  *pair = NULL;
+	int           hash_size = 0;
+
+	if ((this->count + 1) * 2 <= this->hash_size)
+		return 0;
+
+	hash_size = this->hash_size * 2;
+	members = CALLOC (hash_size, sizeof (data_pair_t *));
+	if (!members) {
+		gf_log ("dict", GF_LOG_CRITICAL,
+			"@members - NULL returned by CALLOC");
+		return -1;
+	}
+
+	if (this->members != this->inline_index)
+		FREE (this->members);
+
+	this->members = members;
+	this->hash_size = hash_size;
+
+	for (pair = this->members_list; pair; pair = pair->next)
+		_dict_index_add (this, pair);
+
+	return 0;
+}
+
+
+static data_pair_t *
+_dict_pair_new (dict_t *this)
+{
+	data_pair_t *pair = NULL;
+	int          idx = 0;
+
+	if (this->inline_used != (1 << DICT_INLINE_PAIRS) - 1) {
+		idx = ffs (~this->inline_used) - 1;
+		this->inline_used |= (1 << idx);
+
+		pair = &this->inline_pairs[idx];
+		memset (pair, 0, sizeof (*pair));
+		pair->is_inline = 1;
+
+		return pair;
+	}
+
+	return CALLOC (1, sizeof (*pair));
+}
+
+
+static void
+_dict_pair_free (dict_t *this, data_pair_t *pair)
+{
+	if (!pair->key_static)
+		FREE (pair->key);
+
+	if (pair->is_inline)
+		this->inline_used &= ~(1 << (pair - this->inline_pairs));
+	else
+		FREE (pair);
+}
+
+
+/* @key_static: @key outlives the dict and need not be copied */
 static int32_t
 _dict_set (dict_t *this, 
 	   char *key, 
-	   data_t *value)
+	   data_t *value,
+	   int key_static)
 {
-	int hashval;
 	data_pair_t *pair;
 	char key_free = 0;
-	int tmp = 0;
+	char *interned = NULL;
+	uint32_t hash = 0;
+	int slot = 0;
 
 	if (!key) {
 		asprintf (&key, "ref:%p", value);
 		key_free = 1;
 	}
 
-	tmp = SuperFastHash (key, strlen (key));
-	hashval = (tmp % this->hash_size);
-	pair = _dict_lookup (this, key);
+	hash = _dict_key_hash (key);
+	slot = _dict_slot (this, key, hash);
 
-	if (pair) {
+	if (slot >= 0) {
+		pair = this->members[slot];
 		data_t *unref_data = pair->value;
 		pair->value = data_ref (value);
 		data_unref (unref_data);
@@ -231,26 +444,49 @@ _dict_set (dict_t *this,
 		/* Indicates duplicate key */
 		return 0;
 	}
-	pair = (data_pair_t *) CALLOC (1, sizeof (*pair));
+
+	if (_dict_index_grow (this) != 0) {
+		if (key_free)
+			FREE (key);
+		return -1;
+	}
+
+	pair = _dict_pair_new (this);
 	if (!pair) {
 		gf_log ("dict", GF_LOG_CRITICAL,
 			"@pair - NULL returned by CALLOC");
+		if (key_free)
+			FREE (key);
 		return -1;
 	}
 
-	pair->key = (char *) CALLOC (1, strlen (key) + 1);
-	if (!pair->key) {
-		gf_log ("dict", GF_LOG_CRITICAL,
-			"@pair->key - NULL returned by CALLOC");
-		return -1;
+	interned = _dict_intern (key, hash);
+	if (interned) {
+		pair->key = interned;
+		pair->key_static = 1;
+	} else if (key_free) {
+		/* ours already */
+		pair->key = key;
+		key_free = 0;
+	} else if (key_static) {
+		pair->key = key;
+		pair->key_static = 1;
+	} else {
+		pair->key = strdup (key);
+		if (!pair->key) {
+			gf_log ("dict", GF_LOG_CRITICAL,
+				"@pair->key - NULL returned by strdup");
+			pair->key_static = 1;
+			_dict_pair_free (this, pair);
+			return -1;
+		}
 	}
 
-	strcpy (pair->key, key);
+	pair->key_hash = hash;
 	pair->value = data_ref (value);
- 
-	pair->hash_next = this->members[hashval];
-	this->members[hashval] = pair;
- 
+
+	_dict_index_add (this, pair);
+
 	pair->next = this->members_list;
 	pair->prev = NULL;
 	if (this->members_list)
@@ -278,7 +514,7 @@ dict_set (dict_t *this,
 
 	LOCK (&this->lock);
 
-	ret = _dict_set (this, key, value);
+	ret = _dict_set (this, key, value, 0);
 
 	UNLOCK (&this->lock);
 
@@ -314,6 +550,9 @@ void
 dict_del (dict_t *this,
   	  char *key)
 {
+	data_pair_t *pair = NULL;
+	int          slot = 0;
+
 	if (!this || !key) {
 		gf_log ("dict", GF_LOG_DEBUG,
 			"@this=%p @key=%p", this, key);
@@ -322,35 +561,23 @@ dict_del (dict_t *this,
 
 	LOCK (&this->lock);
 
-	int hashval = SuperFastHash (key, strlen (key)) % this->hash_size;
-	data_pair_t *pair = this->members[hashval];
-	data_pair_t *prev = NULL;
-  
-	while (pair) {
-		if (strcmp (pair->key, key) == 0) {
-			if (prev)
-				prev->hash_next = pair->hash_next;
-			else
-				this->members[hashval] = pair->hash_next;
-  
-			data_unref (pair->value);
-  
-			if (pair->prev)
-				pair->prev->next = pair->next;
-			else
-				this->members_list = pair->next;
+	slot = _dict_slot (this, key, _dict_key_hash (key));
+	if (slot >= 0) {
+		pair = this->members[slot];
+		_dict_index_del (this, slot);
 
-			if (pair->next)
-				pair->next->prev = pair->prev;
-  
-			FREE (pair->key);
-			FREE (pair);
-			this->count--;
-			break;
-		}
- 
-		prev = pair;
-		pair = pair->hash_next;
+		data_unref (pair->value);
+
+		if (pair->prev)
+			pair->prev->next = pair->next;
+		else
+			this->members_list = pair->next;
+
+		if (pair->next)
+			pair->next->prev = pair->prev;
+
+		_dict_pair_free (this, pair);
+		this->count--;
 	}
 
 	UNLOCK (&this->lock);
@@ -375,16 +602,22 @@ dict_destroy (dict_t *this)
 	while (prev) {
 		pair = pair->next;
 		data_unref (prev->value);
-		FREE (prev->key);
-		FREE (prev);
+		_dict_pair_free (this, prev);
 		prev = pair;
 	}
 
-	FREE (this->members);
+	if (this->members != this->inline_index)
+		FREE (this->members);
 
 	if (this->extra_free)
 		FREE (this->extra_free);
 
+	if (this->extra_data)
+		FREE (this->extra_data);
+
+	if (this->extra_refs)
+		iobref_unref (this->extra_refs);
+
 	if (!this->is_static)
 		FREE (this);
 
@@ -402,12 +635,7 @@ dict_unref (dict_t *this)
 		return;
 	}
 
-	LOCK (&this->lock);
-
-	this->refcount--;
-	ref = this->refcount;
-
-	UNLOCK (&this->lock);
+	DICT_REF_ADD (this, -1, ref);
 
 	if (!ref)
 		dict_destroy (this);
@@ -422,11 +650,7 @@ dict_ref (dict_t *this)
 		return NULL;
 	}
 
-	LOCK (&this->lock);
-
-	this->refcount++;
-
-	UNLOCK (&this->lock);
+	DICT_REF_INC (this);
 
 	return this;
 }
@@ -442,12 +666,7 @@ data_unref (data_t *this)
 		return;
 	}
 
-	LOCK (&this->lock);
-
-	this->refcount--;
-	ref = this->refcount;
-
-	UNLOCK (&this->lock);
+	DICT_REF_ADD (this, -1, ref);
 
 	if (!ref)
 		data_destroy (this);
@@ -462,11 +681,7 @@ data_ref (data_t *this)
 		return NULL;
 	}
 
-	LOCK (&this->lock);
-
-	this->refcount++;
-
-	UNLOCK (&this->lock);
+	DICT_REF_INC (this);
 
 	return this;
 }
@@ -617,100 +832,6 @@ ret:
 }
 
 
-int32_t
-dict_iovec_len (dict_t *this)
-{
-	if (!this) {
-		gf_log ("dict", GF_LOG_CRITICAL,
-			"@this=%p", this);
-		return -1;
-	}
-
-	int32_t len = 0;
-	data_pair_t *pair = this->members_list;
-
-	len++; /* initial header */
-	while (pair) {
-		len++; /* pair header */
-		len++; /* key */
-
-		if (pair->value->vec)
-			len += pair->value->len;
-		else
-			len++;
-		pair = pair->next;
-	}
-
-	return len;
-}
-
-int32_t
-dict_to_iovec (dict_t *this,
-	       struct iovec *vec,
-	       int32_t count)
-{
-	if (!this || !vec) {
-		gf_log ("dict", GF_LOG_CRITICAL,
-			"@this=%p @vec=%p", this, vec);
-		return -1;
-	}
-
-	int32_t i = 0;
-	data_pair_t *pair = this->members_list;
-
-	vec[0].iov_len = 9;
-	if (vec[0].iov_base)
-		sprintf (vec[0].iov_base,
-			 "%08"PRIx64"\n",
-			 (int64_t)this->count);
-	i++;
-
-	while (pair) {
-		int64_t keylen = strlen (pair->key) + 1;
-		int64_t vallen = 0;
-
-		if (pair->value->vec) {
-			int i;
-
-			for (i=0; i<pair->value->len; i++) {
-				vallen += pair->value->vec[i].iov_len;
-			}
-		} else {
-			vallen = pair->value->len;
-		}
-
-		vec[i].iov_len = 18;
-		if (vec[i].iov_base)
-			sprintf (vec[i].iov_base,
-				 "%08"PRIx64":%08"PRIx64"\n",
-				 keylen,
-				 vallen);
-		i++;
-
-		vec[i].iov_len = keylen;
-		vec[i].iov_base = pair->key;
-		i++;
-
-		if (pair->value->vec) {
-			int k;
-
-			for (k=0; k<pair->value->len; k++) {
-				vec[i].iov_len = pair->value->vec[k].iov_len;
-				vec[i].iov_base = pair->value->vec[k].iov_base;
-				i++;
-			}
-		} else {
-			vec[i].iov_len = pair->value->len;
-			vec[i].iov_base = pair->value->data;
-			i++;
-		}
-
-		pair = pair->next;
-	}
-
-	return 0;
-}
-
 data_t *
 int_to_data (int64_t value)
 {
@@ -1134,7 +1255,7 @@ dict_copy (dict_t *dict,
 	}
 
 	if (!new)
-		new = get_new_dict_full (dict->hash_size);
+		new = get_new_dict_full (dict->count);
 
 	dict_foreach (dict, _copy, new);
 
@@ -2148,6 +2269,7 @@ dict_unserialize (char *orig_buf, int32_t size, dict_t **fill)
 	int     i     = 0;
 
 	data_t * value   = NULL;
+	data_t * values  = NULL;
 	char   * key     = NULL;
 	int32_t  keylen  = 0;
 	int32_t  vallen  = 0;
@@ -2194,6 +2316,26 @@ dict_unserialize (char *orig_buf, int32_t size, dict_t **fill)
 		goto out;
 	}
 
+	/* every entry takes at least its two lengths and the '\0' of
+	   its key */
+	if (count > (size - DICT_HDR_LEN) / (DICT_DATA_HDR_KEY_LEN +
+					     DICT_DATA_HDR_VAL_LEN + 1)) {
+		gf_log ("dict", GF_LOG_ERROR,
+			"count (%d) too large for %d bytes", count, size);
+		goto out;
+	}
+
+	/* the values of all the entries in one allocation, they are
+	   freed with the dict like @buf */
+	if (count && !(*fill)->extra_data) {
+		values = CALLOC (count, sizeof (*values));
+		if (!values) {
+			gf_log ("dict", GF_LOG_ERROR, "out of memory");
+			goto out;
+		}
+		(*fill)->extra_data = values;
+	}
+
 	/* count will be set by the dict_set's below */
 	(*fill)->count = 0;
 
@@ -2227,13 +2369,27 @@ dict_unserialize (char *orig_buf, int32_t size, dict_t **fill)
 				"undersized buffer passsed");
 			goto out;
 		}
-		value = get_new_data ();
+		if (values) {
+			value = &values[i];
+			LOCK_INIT (&value->lock);
+			value->is_const = 1;
+		} else {
+			value = get_new_data ();
+			if (!value)
+				goto out;
+		}
 		value->len  = vallen;
 		value->data = buf;
 		value->is_static = 1;
 		buf += vallen;
 
-		dict_set (*fill, key, value);
+		/* keys stay in @buf like the values, which has to live
+		   as long as the dict anyway */
+		LOCK (&(*fill)->lock);
+		{
+			_dict_set (*fill, key, value, 1);
+		}
+		UNLOCK (&(*fill)->lock);
 	}
 
 	ret = 0;
@@ -2241,3 +2397,130 @@ out:
 	return ret;
 }
 
+
+
+/* values shorter than this are copied next to their key by
+   dict_to_iovec (), an iovec of their own costs more than that */
+#define DICT_IOVEC_COPY_MAX        256
+
+static int32_t
+_dict_to_iovec (dict_t *this, char *buf, int32_t *buflen,
+		struct iovec *vec, int32_t count)
+{
+	data_pair_t *pair   = NULL;
+	int32_t      len    = 0;
+	int32_t      start  = 0;   /* of the part of @buf not in @vec yet */
+	int32_t      keylen = 0;
+	int32_t      vallen = 0;
+	int32_t      i      = 0;
+
+	if (buf)
+		*(int32_t *) buf = hton32 (this->count);
+	len = DICT_HDR_LEN;
+
+	for (pair = this->members_list; pair; pair = pair->next) {
+		if (!pair->key || !pair->value || !pair->value->data) {
+			gf_log ("dict", GF_LOG_ERROR,
+				"pair without key or value data!");
+			return -EINVAL;
+		}
+
+		keylen = strlen (pair->key);
+		vallen = pair->value->len;
+
+		if (buf) {
+			*(int32_t *) (buf + len) = hton32 (keylen);
+			*(int32_t *) (buf + len + DICT_DATA_HDR_KEY_LEN) =
+				hton32 (vallen);
+		}
+		len += DICT_DATA_HDR_KEY_LEN + DICT_DATA_HDR_VAL_LEN;
+
+		if (buf)
+			memcpy (buf + len, pair->key, keylen + 1);
+		len += keylen + 1;
+
+		if (vallen < DICT_IOVEC_COPY_MAX) {
+			if (buf)
+				memcpy (buf + len, pair->value->data, vallen);
+			len += vallen;
+			continue;
+		}
+
+		if (vec) {
+			if ((i + 2) > count)
+				return -ENOBUFS;
+
+			vec[i].iov_base     = buf + start;
+			vec[i].iov_len      = len - start;
+			vec[i + 1].iov_base = pair->value->data;
+			vec[i + 1].iov_len  = vallen;
+		}
+		i += 2;
+		start = len;
+	}
+
+	if (len > start) {
+		if (vec) {
+			if ((i + 1) > count)
+				return -ENOBUFS;
+
+			vec[i].iov_base = buf + start;
+			vec[i].iov_len  = len - start;
+		}
+		i++;
+	}
+
+	if (buflen)
+		*buflen = len;
+
+	return i;
+}
+
+/**
+ * dict_iovec_len - size up dict_to_iovec () of a dict
+ *
+ * @this:   dict to be serialized
+ * @buflen: set to the size of the buffer dict_to_iovec () needs
+ *
+ * @return: success: number of iovecs dict_to_iovec () needs
+ *          failure: -errno
+ */
+
+int32_t
+dict_iovec_len (dict_t *this, int32_t *buflen)
+{
+	if (!this || !buflen) {
+		gf_log ("dict", GF_LOG_ERROR,
+			"@this=%p @buflen=%p", this, buflen);
+		return -EINVAL;
+	}
+
+	return _dict_to_iovec (this, NULL, buflen, NULL, 0);
+}
+
+/**
+ * dict_to_iovec - serialize a dict without copying its larger values
+ *
+ * @this:  dict to serialize
+ * @buf:   buffer for the lengths, keys and small values, of the size
+ *         returned by dict_iovec_len ()
+ * @vec:   filled with the serialized dict, in the format of
+ *         dict_serialize (). it points into @buf and at the values
+ *         of @this, both have to stay around till @vec is written.
+ * @count: number of entries in @vec
+ *
+ * @return: success: number of entries of @vec used
+ *          failure: -errno
+ */
+
+int32_t
+dict_to_iovec (dict_t *this, char *buf, struct iovec *vec, int32_t count)
+{
+	if (!this || !buf || !vec) {
+		gf_log ("dict", GF_LOG_ERROR,
+			"@this=%p @buf=%p @vec=%p", this, buf, vec);
+		return -EINVAL;
+	}
+
+	return _dict_to_iovec (this, buf, NULL, vec, count);
+}
@@ -35,6 +35,8 @@ typedef struct _data data_t;
 typedef struct _dict dict_t;
 typedef struct _data_pair data_pair_t;
 
+struct iobref;
+
 struct _data {
   unsigned char is_static:1;
   unsigned char is_const:1;
@@ -45,14 +47,29 @@ struct _data {
   gf_lock_t lock;
 };
 
+#define DICT_INLINE_PAIRS 8   /* pairs stored in the dict_t itself */
+#define DICT_INLINE_HASH  16  /* slots of the index stored in it too */
+
 struct _data_pair {
-  struct _data_pair *hash_next;
   struct _data_pair *prev;
   struct _data_pair *next;
   data_t *value;
   char *key;
+  uint32_t key_hash;
+  unsigned char key_static:1;   /* interned or borrowed, not freed */
+  unsigned char is_inline:1;    /* one of dict->inline_pairs */
 };
 
+/* members is an open addressed (linear probing) index of the pairs in
+   members_list, hash_size (a power of 2) slots large and kept at most
+   half full. most dicts hold a handful of keys: they use inline_index
+   and take their pairs from inline_pairs, and cost no allocation
+   besides the dict_t itself.
+
+   dict_unserialize () neither copies keys nor values out of the buffer
+   and takes all the data_t's from one allocation (extra_data), the
+   values of such a dict must not be held past its last unref. */
+
 struct _dict {
   unsigned char is_static:1;
   int32_t hash_size;
@@ -61,7 +78,12 @@ struct _dict {
   data_pair_t **members;
   data_pair_t *members_list;
   char *extra_free;
+  data_t *extra_data;           /* values of an unserialized dict */
+  struct iobref *extra_refs;    /* payload it was unserialized from */
   gf_lock_t lock;
+  uint32_t inline_used;         /* bitmap of inline_pairs in use */
+  data_pair_t *inline_index[DICT_INLINE_HASH];
+  data_pair_t inline_pairs[DICT_INLINE_PAIRS];
 };
 
 
@@ -76,8 +98,9 @@ int32_t dict_serialized_length (dict_t *dict);
 int32_t dict_serialize (dict_t *dict, char *buf);
 int32_t dict_unserialize (char *buf, int32_t size, dict_t **fill);
 
-int32_t dict_iovec_len (dict_t *dict);
-int32_t dict_to_iovec (dict_t *dict, struct iovec *vec, int32_t count);
+int32_t dict_iovec_len (dict_t *dict, int32_t *buflen);
+int32_t dict_to_iovec (dict_t *dict, char *buf, struct iovec *vec,
+		       int32_t count);
 			  
 void dict_destroy (dict_t *dict);
 void dict_unref (dict_t *dict);
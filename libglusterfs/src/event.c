@@ -515,6 +515,20 @@ event_pool_new_epoll (int count)
 }
 
 
+static inline int
+__event_epoll_events (struct event_pool *event_pool, int idx)
+{
+	int events = 0;
+
+	events = event_pool->reg[idx].events;
+
+	if (event_pool->oneshot)
+		events |= EPOLLONESHOT;
+
+	return events;
+}
+
+
 int
 event_register_epoll (struct event_pool *event_pool, int fd,
 		      event_handler_t handler,
@@ -533,27 +547,37 @@ event_register_epoll (struct event_pool *event_pool, int fd,
 
 	pthread_mutex_lock (&event_pool->mutex);
 	{
-		if (event_pool->count == event_pool->used) {
-			event_pool->count *= 2;
+		/* slots of unregistered fds are reused, registered fds
+		   never move so that their index stays valid in the
+		   epoll data while a handler may be running */
+		idx = __event_getindex (event_pool, -1, -1);
 
-			event_pool->reg = realloc (event_pool->reg,
-						   event_pool->count *
-						   sizeof (*event_pool->reg));
-
-			if (!event_pool->reg) {
-				gf_log ("epoll", GF_LOG_ERROR,
-					"event registry re-allocation failed");
-				goto unlock;
+		if (idx == -1) {
+			if (event_pool->count == event_pool->used) {
+				event_pool->count *= 2;
+
+				event_pool->reg = 
+					realloc (event_pool->reg,
+						 event_pool->count *
+						 sizeof (*event_pool->reg));
+
+				if (!event_pool->reg) {
+					gf_log ("epoll", GF_LOG_ERROR,
+						"event registry re-allocation "
+						"failed");
+					goto unlock;
+				}
 			}
-		}
 
-		idx = event_pool->used;
-		event_pool->used++;
+			idx = event_pool->used;
+			event_pool->used++;
+		}
 
 		event_pool->reg[idx].fd = fd;
 		event_pool->reg[idx].events = EPOLLPRI;
 		event_pool->reg[idx].handler = handler;
 		event_pool->reg[idx].data = data;
+		event_pool->reg[idx].in_handler = 0;
 
 		switch (poll_in) {
 		case 1:
@@ -589,7 +613,7 @@ event_register_epoll (struct event_pool *event_pool, int fd,
 
 		event_pool->changed = 1;
 
-		epoll_event.events = event_pool->reg[idx].events;
+		epoll_event.events = __event_epoll_events (event_pool, idx);
 		ev_data->fd = fd;
 		ev_data->idx = idx;
 
@@ -600,6 +624,7 @@ event_register_epoll (struct event_pool *event_pool, int fd,
 			gf_log ("epoll", GF_LOG_ERROR,
 				"failed to add fd(=%d) to epoll fd(=%d) (%s)",
 				fd, event_pool->fd, strerror (errno));
+			event_pool->reg[idx].fd = -1;
 			goto unlock;
 		}
 
@@ -608,7 +633,10 @@ event_register_epoll (struct event_pool *event_pool, int fd,
 unlock:
 	pthread_mutex_unlock (&event_pool->mutex);
 
-	return ret;
+	if (ret == -1)
+		return -1;
+
+	return idx;
 }
 
 
@@ -617,10 +645,7 @@ event_unregister_epoll (struct event_pool *event_pool, int fd, int idx_hint)
 {
 	int  idx = -1;
 	int  ret = -1;
-
-	struct epoll_event epoll_event = {0, };
-	struct event_data *ev_data = (void *)&epoll_event.data;
-	int                lastidx = -1;
+	int  lastidx = -1;
 
 	if (event_pool == NULL) {
 		gf_log ("event", GF_LOG_ERROR, "invalid argument");
@@ -648,6 +673,9 @@ event_unregister_epoll (struct event_pool *event_pool, int fd, int idx_hint)
 		 */
 
 		event_pool->reg[idx].fd = -1;
+		event_pool->reg[idx].data = NULL;
+		event_pool->reg[idx].handler = NULL;
+		event_pool->reg[idx].in_handler = 0;
 
 		if (ret == -1) {
 			gf_log ("epoll", GF_LOG_ERROR,
@@ -656,29 +684,13 @@ event_unregister_epoll (struct event_pool *event_pool, int fd, int idx_hint)
 			goto unlock;
 		}
 
+		/* the freed slot is reused by the next event_register,
+		   only trailing free slots are given back */
 		lastidx = event_pool->used - 1;
-		if (lastidx == idx) {
+		while ((lastidx >= 0) && (event_pool->reg[lastidx].fd == -1)) {
 			event_pool->used--;
-			goto unlock;
+			lastidx--;
 		}
-
-		epoll_event.events = event_pool->reg[lastidx].events;
-		ev_data->fd = event_pool->reg[lastidx].fd;
-		ev_data->idx = idx;
-
-		ret = epoll_ctl (event_pool->fd, EPOLL_CTL_MOD, ev_data->fd,
-				 &epoll_event);
-		if (ret == -1) {
-			gf_log ("epoll", GF_LOG_ERROR,
-				"fail to modify fd(=%d) index %d to %d (%s)",
-				ev_data->fd, event_pool->used, idx,
-				strerror (errno));
-			goto unlock;
-		}
-
-		/* just replace the unregistered idx by last one */
-		event_pool->reg[idx] = event_pool->reg[lastidx];
-		event_pool->used--;
 	}
 unlock:
 	pthread_mutex_unlock (&event_pool->mutex);
@@ -747,7 +759,15 @@ event_select_on_epoll (struct event_pool *event_pool, int fd, int idx_hint,
 			break;
 		}
 
-		epoll_event.events = event_pool->reg[idx].events;
+		/* the fd is re-armed with the new events once its
+		   handler returns. arming it now would let another
+		   thread handle it concurrently */
+		if (event_pool->reg[idx].in_handler) {
+			ret = 0;
+			goto unlock;
+		}
+
+		epoll_event.events = __event_epoll_events (event_pool, idx);
 		ev_data->fd = fd;
 		ev_data->idx = idx;
 
@@ -762,7 +782,47 @@ event_select_on_epoll (struct event_pool *event_pool, int fd, int idx_hint,
 unlock:
 	pthread_mutex_unlock (&event_pool->mutex);
 
-	return ret;
+	if (ret == -1)
+		return -1;
+
+	return idx;
+}
+
+
+static void
+event_dispatch_epoll_rearm (struct event_pool *event_pool, int fd,
+			    int idx_hint, void *data)
+{
+	int                 idx = -1;
+	int                 ret = -1;
+	struct epoll_event  epoll_event = {0, };
+	struct event_data  *ev_data = (void *)&epoll_event.data;
+
+	pthread_mutex_lock (&event_pool->mutex);
+	{
+		idx = __event_getindex (event_pool, fd, idx_hint);
+
+		/* unregistered (and maybe re-registered) by the handler
+		   or by another thread meanwhile */
+		if ((idx == -1) || (event_pool->reg[idx].data != data))
+			goto unlock;
+
+		event_pool->reg[idx].in_handler = 0;
+
+		epoll_event.events = __event_epoll_events (event_pool, idx);
+		ev_data->fd = fd;
+		ev_data->idx = idx;
+
+		ret = epoll_ctl (event_pool->fd, EPOLL_CTL_MOD, fd,
+				 &epoll_event);
+		if (ret == -1) {
+			gf_log ("epoll", GF_LOG_ERROR,
+				"failed to re-arm fd(=%d) (%s)",
+				fd, strerror (errno));
+		}
+	}
+unlock:
+	pthread_mutex_unlock (&event_pool->mutex);
 }
 
 
@@ -775,6 +835,7 @@ event_dispatch_epoll_handler (struct event_pool *event_pool,
 	void               *data = NULL;
 	int                 idx = -1;
 	int                 ret = -1;
+	int                 oneshot = 0;
 
 
 	event_data = (void *)&events[i].data;
@@ -796,33 +857,40 @@ event_dispatch_epoll_handler (struct event_pool *event_pool,
 
 		handler = event_pool->reg[idx].handler;
 		data = event_pool->reg[idx].data;
+
+		oneshot = event_pool->oneshot;
+		if (oneshot)
+			event_pool->reg[idx].in_handler = 1;
 	}
 unlock:
 	pthread_mutex_unlock (&event_pool->mutex);
 
 	if (handler)
-		ret = handler (event_data->fd, event_data->idx, data,
+		ret = handler (event_data->fd, idx, data,
 			       (events[i].events & (EPOLLIN|EPOLLPRI)),
 			       (events[i].events & (EPOLLOUT)),
 			       (events[i].events & (EPOLLERR|EPOLLHUP)));
+
+	if (handler && oneshot)
+		event_dispatch_epoll_rearm (event_pool, event_data->fd, idx,
+					    data);
+
 	return ret;
 }
 
 
-static int
-event_dispatch_epoll (struct event_pool *event_pool)
+static void *
+event_dispatch_epoll_worker (void *data)
 {
+	struct event_pool  *event_pool = NULL;
 	struct epoll_event *events = NULL;
+	struct epoll_event  event = {0, };
 	int                 size = 0;
 	int                 i = 0;
 	int                 ret = -1;
 
+	event_pool = data;
 
-	if (event_pool == NULL) {
-		gf_log ("event", GF_LOG_ERROR, "invalid argument");
-		return -1;
-	}
-  
 	while (1) {
 		pthread_mutex_lock (&event_pool->mutex);
 		{
@@ -830,25 +898,33 @@ event_dispatch_epoll (struct event_pool *event_pool)
 				pthread_cond_wait (&event_pool->cond,
 						   &event_pool->mutex);
 
-			if (event_pool->used > event_pool->evcache_size) {
-				if (event_pool->evcache)
-					free (event_pool->evcache);
-
-				event_pool->evcache = events = NULL;
-
-				event_pool->evcache_size =
-					event_pool->used + 256;
-
-				events = CALLOC (event_pool->evcache_size,
-						 sizeof (struct epoll_event));
-
-				event_pool->evcache = events;
+			if (event_pool->oneshot) {
+				/* one event at a time, so that ready fds
+				   spread over all the threads */
+				events = &event;
+				size = 1;
+			} else {
+				if (event_pool->used > 
+				    event_pool->evcache_size) {
+					if (event_pool->evcache)
+						free (event_pool->evcache);
+
+					event_pool->evcache = NULL;
+
+					event_pool->evcache_size =
+						event_pool->used + 256;
+
+					event_pool->evcache = 
+						CALLOC (event_pool->evcache_size,
+							sizeof (*events));
+				}
+				events = event_pool->evcache;
+				size = event_pool->evcache_size;
 			}
 		}
 		pthread_mutex_unlock (&event_pool->mutex);
 
-		ret = epoll_wait (event_pool->fd, event_pool->evcache,
-				  event_pool->evcache_size, -1);
+		ret = epoll_wait (event_pool->fd, events, size, -1);
 
 		if (ret == 0)
 			/* timeout */
@@ -869,6 +945,77 @@ event_dispatch_epoll (struct event_pool *event_pool)
 		}
 	}
 
+	return NULL;
+}
+
+
+static int
+event_dispatch_epoll (struct event_pool *event_pool)
+{
+	int                 i = 0;
+	int                 ret = -1;
+	int                 thread_count = 0;
+	pthread_t           thread;
+	struct epoll_event  epoll_event = {0, };
+	struct event_data  *ev_data = (void *)&epoll_event.data;
+
+
+	if (event_pool == NULL) {
+		gf_log ("event", GF_LOG_ERROR, "invalid argument");
+		return -1;
+	}
+
+	pthread_mutex_lock (&event_pool->mutex);
+	{
+		event_pool->dispatching = 1;
+
+		thread_count = event_pool->thread_count;
+		if (thread_count > 1) {
+			/* switch fds registered so far to one-shot */
+			event_pool->oneshot = 1;
+
+			for (i = 0; i < event_pool->used; i++) {
+				if (event_pool->reg[i].fd == -1)
+					continue;
+
+				epoll_event.events = 
+					__event_epoll_events (event_pool, i);
+				ev_data->fd  = event_pool->reg[i].fd;
+				ev_data->idx = i;
+
+				ret = epoll_ctl (event_pool->fd, EPOLL_CTL_MOD,
+						 ev_data->fd, &epoll_event);
+				if (ret == -1) {
+					gf_log ("epoll", GF_LOG_ERROR,
+						"failed to modify fd(=%d) "
+						"(%s)", ev_data->fd,
+						strerror (errno));
+				}
+			}
+		}
+	}
+	pthread_mutex_unlock (&event_pool->mutex);
+
+	for (i = 1; i < thread_count; i++) {
+		ret = pthread_create (&thread, NULL,
+				      event_dispatch_epoll_worker,
+				      event_pool);
+		if (ret != 0) {
+			gf_log ("epoll", GF_LOG_ERROR,
+				"failed to start event thread %d (%s)",
+				i, strerror (ret));
+			break;
+		}
+		pthread_detach (thread);
+	}
+
+	if (thread_count > 1) {
+		gf_log ("epoll", GF_LOG_DEBUG,
+			"dispatching events with %d threads", i);
+	}
+
+	event_dispatch_epoll_worker (event_pool);
+
 	return -1;
 }
 
@@ -976,3 +1123,42 @@ event_dispatch (struct event_pool *event_pool)
 
 	return ret;
 }
+
+
+/*
+ * event_pool_set_thread_count - number of threads event_dispatch () runs
+ *
+ * translators ask for threads at init time, the largest count asked for
+ * wins. it is fixed once dispatching has started. poll based pools are
+ * always dispatched by a single thread.
+ */
+int
+event_pool_set_thread_count (struct event_pool *event_pool, int count)
+{
+	int ret = -1;
+
+	if (event_pool == NULL || count < 1) {
+		gf_log ("event", GF_LOG_ERROR, "invalid argument");
+		return -1;
+	}
+
+	pthread_mutex_lock (&event_pool->mutex);
+	{
+		if (event_pool->dispatching) {
+			gf_log ("event", GF_LOG_WARNING,
+				"event threads can not be changed while "
+				"dispatching (requested %d, running %d)",
+				count, event_pool->thread_count);
+			goto unlock;
+		}
+
+		if (count > event_pool->thread_count)
+			event_pool->thread_count = count;
+
+		ret = 0;
+	}
+unlock:
+	pthread_mutex_unlock (&event_pool->mutex);
+
+	return ret;
+}
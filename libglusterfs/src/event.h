@@ -50,6 +50,7 @@ struct event_pool {
     int events;
     void *data;
     event_handler_t handler;
+    int in_handler;
   } *reg;
 
   int used;
@@ -61,6 +62,13 @@ struct event_pool {
 
   void *evcache;
   int evcache_size;
+
+  /* number of threads running event_dispatch (). with more than one,
+     fds are armed EPOLLONESHOT so that a fd is handled by only one
+     thread at a time, and re-armed once its handler returns */
+  int thread_count;
+  int dispatching;
+  int oneshot;
 };
 
 struct event_ops {
@@ -86,5 +94,6 @@ int event_register (struct event_pool *event_pool, int fd,
 		    void *data, int poll_in, int poll_out);
 int event_unregister (struct event_pool *event_pool, int fd, int idx);
 int event_dispatch (struct event_pool *event_pool);
+int event_pool_set_thread_count (struct event_pool *event_pool, int count);
 
 #endif /* _EVENT_H_ */
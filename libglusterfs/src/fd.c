@@ -29,83 +29,87 @@
 #endif
 
 
-static uint32_t 
+static int
 gf_fd_fdtable_expand (fdtable_t *fdtable, uint32_t nr);
 
 static fd_t *
 _fd_ref (fd_t *fd);
 
-/* 
-   Allocate in memory chunks of power of 2 starting from 1024B 
-   Assumes fdtable->lock is held
-*/
-static inline uint32_t 
-gf_roundup_power_of_two (uint32_t nr)
+/* initial number of slots, the table doubles from there */
+#define GF_FDTABLE_INITIAL_SIZE (1024 / sizeof (fd_t *))
+
+
+static inline void
+__gf_fd_free_link (fdtable_t *fdtable, int32_t slot)
 {
-	uint32_t result = nr;
+	fdentry_t *entry = &fdtable->fdentries[slot];
 
-	if (nr < 0) {
-		gf_log ("server-protocol/fd",
-			GF_LOG_ERROR,
-			"Negative number passed");
-		return -1;
-	}
+	entry->prev_free = GF_FDTABLE_END;
+	entry->next_free = fdtable->first_free;
+	if (fdtable->first_free != GF_FDTABLE_END)
+		fdtable->fdentries[fdtable->first_free].prev_free = slot;
+	fdtable->first_free = slot;
+}
 
-	switch (nr) {
-	case 0:
-	case 1: 
-		result = 1;
-		break;
 
-	default:
-	{
-		uint32_t cnt = 0, tmp = nr;
-		uint8_t remainder = 0;
-		while (tmp != 1){
-			if (tmp % 2)
-				remainder = 1;
-			tmp /= 2;
-			cnt++;
-		}
+static inline void
+__gf_fd_free_unlink (fdtable_t *fdtable, int32_t slot)
+{
+	fdentry_t *entry = &fdtable->fdentries[slot];
 
-		if (remainder)
-			result = 0x1 << (cnt + 1);
-		break;
-	}
-	}
+	if (entry->prev_free != GF_FDTABLE_END)
+		fdtable->fdentries[entry->prev_free].next_free =
+			entry->next_free;
+	else
+		fdtable->first_free = entry->next_free;
+
+	if (entry->next_free != GF_FDTABLE_END)
+		fdtable->fdentries[entry->next_free].prev_free =
+			entry->prev_free;
 
-	return result;
+	entry->next_free = GF_FDENTRY_ALLOCATED;
+	entry->prev_free = GF_FDENTRY_ALLOCATED;
 }
 
-static uint32_t 
+
+/* grow to at least nr slots, doubling. assumes fdtable->lock is held
+   for writing */
+static int
 gf_fd_fdtable_expand (fdtable_t *fdtable, uint32_t nr)
 {
-	fd_t **oldfds = NULL;
-	uint32_t oldmax_fds = -1;
-  
-	if (fdtable == NULL || nr < 0)
+	fdentry_t *fdentries = NULL;
+	uint32_t   newmax_fds = 0;
+	int32_t    i = 0;
+
+	if (fdtable == NULL)
 	{
 		gf_log ("fd", GF_LOG_ERROR, "invalid argument");
 		return EINVAL;
 	}
-  
-	nr /= (1024 / sizeof (fd_t *));
-	nr = gf_roundup_power_of_two (nr + 1);
-	nr *= (1024 / sizeof (fd_t *));
 
-	oldfds = fdtable->fds;
-	oldmax_fds = fdtable->max_fds;
+	newmax_fds = fdtable->max_fds ? fdtable->max_fds :
+		GF_FDTABLE_INITIAL_SIZE;
+	while (newmax_fds < nr)
+		newmax_fds *= 2;
 
-	fdtable->fds = CALLOC (nr, sizeof (fd_t *));
-	ERR_ABORT (fdtable->fds);
-	fdtable->max_fds = nr; 
+	if (newmax_fds <= fdtable->max_fds)
+		return 0;
 
-	if (oldfds) {
-		uint32_t cpy = oldmax_fds * sizeof (fd_t *);
-		memcpy (fdtable->fds, oldfds, cpy);
-	}
+	fdentries = realloc (fdtable->fdentries,
+			     newmax_fds * sizeof (*fdentries));
+	if (!fdentries)
+		return ENOMEM;
+
+	memset (&fdentries[fdtable->max_fds], 0,
+		(newmax_fds - fdtable->max_fds) * sizeof (*fdentries));
+	fdtable->fdentries = fdentries;
+
+	/* lowest new slot ends up first in the free list */
+	for (i = newmax_fds - 1; i >= (int32_t) fdtable->max_fds; i--)
+		__gf_fd_free_link (fdtable, i);
+
+	fdtable->max_fds = newmax_fds;
 
-	FREE (oldfds);
 	return 0;
 }
 
@@ -118,13 +122,14 @@ gf_fd_fdtable_alloc (void)
 	if (!fdtable) 
 		return NULL;
 
-	pthread_mutex_init (&fdtable->lock, NULL);
+	pthread_rwlock_init (&fdtable->lock, NULL);
+	fdtable->first_free = GF_FDTABLE_END;
 
-	pthread_mutex_lock (&fdtable->lock);
+	pthread_rwlock_wrlock (&fdtable->lock);
 	{
 		gf_fd_fdtable_expand (fdtable, 0);
 	}
-	pthread_mutex_unlock (&fdtable->lock);
+	pthread_rwlock_unlock (&fdtable->lock);
 
 	return fdtable;
 }
@@ -136,20 +141,20 @@ gf_fd_fdtable_destroy (fdtable_t *fdtable)
 	int32_t i = 0;
 
 	if (fdtable) {
-		pthread_mutex_lock (&fdtable->lock);
+		pthread_rwlock_wrlock (&fdtable->lock);
 		{
 			for (i=0; i < fdtable->max_fds; i++) {
-				if (fdtable->fds[i]) {
-					fd_t *fd = fdtable->fds[i];
+				if (fdtable->fdentries[i].fd) {
+					fd_t *fd = fdtable->fdentries[i].fd;
 						  
 					fd_unref (fd);
 				}
 			}
 
-			FREE (fdtable->fds);
+			FREE (fdtable->fdentries);
 		}
-		pthread_mutex_unlock (&fdtable->lock);
-		pthread_mutex_destroy (&fdtable->lock);
+		pthread_rwlock_unlock (&fdtable->lock);
+		pthread_rwlock_destroy (&fdtable->lock);
 		FREE (fdtable);
 	}
 }
@@ -158,6 +163,7 @@ int32_t
 gf_fd_unused_get2 (fdtable_t *fdtable, fd_t *fdptr, int32_t fd)
 {
 	int32_t ret = -1;
+	int     error = 0;
 	
 	if (fdtable == NULL || fdptr == NULL || fd < 0)
 	{
@@ -166,23 +172,21 @@ gf_fd_unused_get2 (fdtable_t *fdtable, fd_t *fdptr, int32_t fd)
 		return -1;
 	}
  
-	pthread_mutex_lock (&fdtable->lock);
+	pthread_rwlock_wrlock (&fdtable->lock);
 	{
-		while (fdtable->max_fds < fd) {
-			int error = 0;
-			error = gf_fd_fdtable_expand (fdtable, fdtable->max_fds + 1);
-			if (error) 
-			{
-				gf_log ("fd.c",
-					GF_LOG_ERROR,
-					"Cannot expand fdtable:%s", strerror (error));
-				goto err;
-			}
+		error = gf_fd_fdtable_expand (fdtable, fd + 1);
+		if (error) 
+		{
+			gf_log ("fd.c",
+				GF_LOG_ERROR,
+				"Cannot expand fdtable:%s", strerror (error));
+			goto err;
 		}
 		
-		if (!fdtable->fds[fd]) 
+		if (!fdtable->fdentries[fd].fd) 
 		{
-			fdtable->fds[fd] = fdptr;
+			__gf_fd_free_unlink (fdtable, fd);
+			fdtable->fdentries[fd].fd = fdptr;
 			fd_ref (fdptr);
 			ret = fd;
 		} 
@@ -194,7 +198,7 @@ gf_fd_unused_get2 (fdtable_t *fdtable, fd_t *fdptr, int32_t fd)
 		}
 	}
 err:
-	pthread_mutex_unlock (&fdtable->lock);
+	pthread_rwlock_unlock (&fdtable->lock);
 	
 	return ret;
 }
@@ -203,7 +207,8 @@ err:
 int32_t 
 gf_fd_unused_get (fdtable_t *fdtable, fd_t *fdptr)
 {
-	int32_t fd = -1, i = 0;
+	int32_t fd = -1;
+	int32_t error = 0;
   
 	if (fdtable == NULL || fdptr == NULL)
 	{
@@ -211,37 +216,31 @@ gf_fd_unused_get (fdtable_t *fdtable, fd_t *fdptr)
 		return EINVAL;
 	}
   
-	pthread_mutex_lock (&fdtable->lock);
+	pthread_rwlock_wrlock (&fdtable->lock);
 	{
-		for (i = 0; i<fdtable->max_fds; i++) 
-		{
-			if (!fdtable->fds[i])
-				break;
-		}
-
-		if (i < fdtable->max_fds) {
-			fdtable->fds[i] = fdptr;
-			fd = i;
-		} else {
-			int32_t error;
-			error = gf_fd_fdtable_expand (fdtable, fdtable->max_fds + 1);
+		if (fdtable->first_free == GF_FDTABLE_END) {
+			error = gf_fd_fdtable_expand (fdtable,
+						      fdtable->max_fds + 1);
 			if (error) {
 				gf_log ("server-protocol.c",
 					GF_LOG_ERROR,
 					"Cannot expand fdtable:%s", strerror (error));
-			} else {
-				fdtable->fds[i] = fdptr;
-				fd = i;
+				goto unlock;
 			}
 		}
+
+		fd = fdtable->first_free;
+		__gf_fd_free_unlink (fdtable, fd);
+		fdtable->fdentries[fd].fd = fdptr;
 	}
-	pthread_mutex_unlock (&fdtable->lock);
+unlock:
+	pthread_rwlock_unlock (&fdtable->lock);
 
 	return fd;
 }
 
 
-inline void 
+void
 gf_fd_put (fdtable_t *fdtable, int32_t fd)
 {
 	fd_t *fdptr = NULL;
@@ -251,18 +250,21 @@ gf_fd_put (fdtable_t *fdtable, int32_t fd)
 		return;
 	}
   
-	if (!(fd < fdtable->max_fds))
+	pthread_rwlock_wrlock (&fdtable->lock);
 	{
-		gf_log ("fd", GF_LOG_ERROR, "invalid argument");
-		return;
-	}
+		if (!(fd < fdtable->max_fds)) {
+			pthread_rwlock_unlock (&fdtable->lock);
+			gf_log ("fd", GF_LOG_ERROR, "invalid argument");
+			return;
+		}
 
-	pthread_mutex_lock (&fdtable->lock);
-	{
-		fdptr = fdtable->fds[fd];
-		fdtable->fds[fd] = NULL;
+		fdptr = fdtable->fdentries[fd].fd;
+		if (fdptr) {
+			fdtable->fdentries[fd].fd = NULL;
+			__gf_fd_free_link (fdtable, fd);
+		}
 	}
-	pthread_mutex_unlock (&fdtable->lock);
+	pthread_rwlock_unlock (&fdtable->lock);
 
 	if (fdptr) {
 		fd_unref (fdptr);
@@ -274,6 +276,7 @@ fd_t *
 gf_fd_fdptr_get (fdtable_t *fdtable, int64_t fd)
 {
 	fd_t *fdptr = NULL;
+	char  invalid = 0;
   
 	if (fdtable == NULL || fd < 0)
 	{
@@ -282,21 +285,25 @@ gf_fd_fdptr_get (fdtable_t *fdtable, int64_t fd)
 		return NULL;
 	}
   
-	if (!(fd < fdtable->max_fds))
+	/* lookups only exclude allocation and release of slots, not
+	   each other */
+	pthread_rwlock_rdlock (&fdtable->lock);
 	{
-		gf_log ("fd", GF_LOG_ERROR, "invalid argument");
-		errno = EINVAL;
-		return NULL;
+		if (fd < fdtable->max_fds) {
+			fdptr = fdtable->fdentries[fd].fd;
+			if (fdptr) {
+				fd_ref (fdptr);
+			}
+		} else {
+			invalid = 1;
+		}
 	}
+	pthread_rwlock_unlock (&fdtable->lock);
 
-	pthread_mutex_lock (&fdtable->lock);
-	{
-		fdptr = fdtable->fds[fd];
-		if (fdptr) {
-			fd_ref (fdptr);
-		}
+	if (invalid) {
+		gf_log ("fd", GF_LOG_ERROR, "invalid argument");
+		errno = EINVAL;
 	}
-	pthread_mutex_unlock (&fdtable->lock);
 
 	return fdptr;
 }
@@ -48,18 +48,31 @@ struct _fd {
 };
 typedef struct _fd fd_t;
 
+/* slots of an fdtable which are not in use are chained through
+   next_free/prev_free, so allocating a slot does not search the table */
+struct _fdentry {
+        fd_t           *fd;
+        int32_t         next_free;
+        int32_t         prev_free;
+};
+typedef struct _fdentry fdentry_t;
+
+#define GF_FDTABLE_END       -1
+#define GF_FDENTRY_ALLOCATED -2
+
 struct _fdtable {
-        int             refcount;
-        uint32_t        max_fds;
-        pthread_mutex_t lock;
-        fd_t          **fds;
+        int              refcount;
+        uint32_t         max_fds;
+        int32_t          first_free;
+        pthread_rwlock_t lock;   /* readers only look up slots */
+        fdentry_t       *fdentries;
 };
 typedef struct _fdtable fdtable_t;
 
 #include "logging.h"
 #include "xlator.h"
 
-inline void 
+void
 gf_fd_put (fdtable_t *fdtable, int32_t fd);
 
 fd_t *
@@ -30,6 +30,7 @@
 #include "compat.h"
 #include "xlator.h"
 #include "byte-order.h"
+#include "protocol.h"
 
 
 struct gf_dirent_nb {
@@ -41,6 +42,18 @@ struct gf_dirent_nb {
 } __attribute__((packed));
 
 
+/* readdirp entries, the attributes between the fixed fields and the
+   name */
+struct gf_direntp_nb {
+	uint64_t        d_ino;
+	uint64_t        d_off;
+	uint32_t        d_len;
+	uint32_t        d_type;
+	struct gf_stat  d_stat;
+	char            d_name[0];
+} __attribute__((packed));
+
+
 int
 gf_dirent_nb_size (gf_dirent_t *entries)
 {
@@ -155,3 +168,79 @@ gf_dirent_unserialize (gf_dirent_t *entries, const char *buf, size_t buf_size)
 
 	return count;
 }
+
+
+int
+gf_direntp_serialize (gf_dirent_t *entries, char *buf, size_t buf_size)
+{
+	struct gf_direntp_nb *entry_nb = NULL;
+	gf_dirent_t          *entry = NULL;
+	int                   size = 0;
+	int                   entry_size = 0;
+
+
+	list_for_each_entry (entry, &entries->list, list) {
+		entry_size = sizeof (*entry_nb) + strlen (entry->d_name) + 1;
+
+		if (buf && (size + entry_size <= buf_size)) {
+			entry_nb = (void *) (buf + size);
+
+			entry_nb->d_ino  = hton64 (entry->d_ino);
+			entry_nb->d_off  = hton64 (entry->d_off);
+			entry_nb->d_len  = hton32 (entry->d_len);
+			entry_nb->d_type = hton32 (entry->d_type);
+			gf_stat_from_stat (&entry_nb->d_stat, &entry->d_stat);
+
+			strcpy (entry_nb->d_name, entry->d_name);
+		}
+		size += entry_size;
+	}
+
+	return size;
+}
+
+
+int
+gf_direntp_unserialize (gf_dirent_t *entries, const char *buf,
+			size_t buf_size)
+{
+	struct gf_direntp_nb *entry_nb = NULL;
+	int                   remaining_size = 0;
+	int                   count = 0;
+	gf_dirent_t          *entry = NULL;
+	int                   entry_strlen = 0;
+	int                   entry_len = 0;
+
+
+	remaining_size = buf_size;
+
+	while (remaining_size >= (int) (sizeof (*entry_nb) + 2)) {
+		entry_nb = (void *)(buf + (buf_size - remaining_size));
+
+		entry_strlen = strnlen (entry_nb->d_name,
+					remaining_size - sizeof (*entry_nb));
+		if (entry_strlen == (remaining_size - sizeof (*entry_nb))) {
+			break;
+		}
+
+		entry_len = sizeof (gf_dirent_t) + entry_strlen + 1;
+		entry = CALLOC (1, entry_len);
+		if (!entry) {
+			break;
+		}
+
+		entry->d_ino  = ntoh64 (entry_nb->d_ino);
+		entry->d_off  = ntoh64 (entry_nb->d_off);
+		entry->d_len  = ntoh32 (entry_nb->d_len);
+		entry->d_type = ntoh32 (entry_nb->d_type);
+		gf_stat_to_stat (&entry_nb->d_stat, &entry->d_stat);
+		strcpy (entry->d_name, entry_nb->d_name);
+
+		list_add_tail (&entry->list, &entries->list);
+
+		remaining_size -= (sizeof (*entry_nb) + entry_strlen + 1);
+		count++;
+	}
+
+	return count;
+}
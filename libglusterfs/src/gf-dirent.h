@@ -48,6 +48,8 @@ struct _gf_dirent_t {
 	uint64_t                             d_off;
 	uint32_t                             d_len;
 	uint32_t                             d_type;
+	struct stat                          d_stat; /* readdirp only, all
+							0 if not known */
 	char                                 d_name[0];
 };
 
@@ -56,5 +58,8 @@ gf_dirent_t *gf_dirent_for_name (const char *name);
 void gf_dirent_free (gf_dirent_t *entries);
 int gf_dirent_serialize (gf_dirent_t *entries, char *buf, size_t size);
 int gf_dirent_unserialize (gf_dirent_t *entries, const char *buf, size_t size);
+int gf_direntp_serialize (gf_dirent_t *entries, char *buf, size_t size);
+int gf_direntp_unserialize (gf_dirent_t *entries, const char *buf,
+			    size_t size);
 
 #endif /* _GF_DIRENT_H */
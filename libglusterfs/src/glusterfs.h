@@ -67,6 +67,7 @@
 #define ZR_FILE_CONTENT_STRLEN 15
 
 #define GLUSTERFS_OPEN_FD_COUNT "glusterfs.open-fd-count"
+#define GLUSTERFS_CHANGE_COUNT  "glusterfs.change-count"
 
 #define ZR_FILE_CONTENT_REQUEST(key) (!strncmp(key, ZR_FILE_CONTENT_STR, \
 					       ZR_FILE_CONTENT_STRLEN))
@@ -124,6 +125,7 @@ typedef enum {
         GF_FOP_CHECKSUM,      
         GF_FOP_XATTROP,  /* 40 */
         GF_FOP_FXATTROP,
+        GF_FOP_READDIRP,
         GF_FOP_MAXVALUE,  
 } glusterfs_fop_t;
 
@@ -222,11 +224,14 @@ struct _cmd_args {
 	char            *run_id;
 	int              debug_mode;
 	struct list_head xlator_options;  /* list of xlator_option_t */
+	int              fop_stats;       /* keep per fop stats of every
+					     translator */
 
 	/* fuse options */
 	int              fuse_direct_io_mode_flag;
 	unsigned int     fuse_entry_timeout;
 	unsigned int     fuse_attribute_timeout;
+	unsigned int     fuse_reader_thread_count;
 	char            *volume_name;
 	int              non_local;       /* Used only by darwin os, 
 					     used for '-o local' option */
@@ -254,6 +259,7 @@ struct _glusterfs_ctx {
 	void              *graph;
 	void              *top; /* either fuse or server protocol */
 	void              *event_pool;
+	void              *iobuf_pool;
 	pthread_mutex_t    lock;
 	int                xl_count;
 };
@@ -73,18 +73,71 @@ hash_inode (ino_t ino,
 }
 
 
+/* the bucket an entry lives in: the old one while it is not migrated */
+
+static struct list_head *
+__inode_bucket (inode_table_t *table,
+                ino_t ino)
+{
+        int hash = 0;
+
+        if (table->old_hashsize) {
+                hash = hash_inode (ino, table->old_hashsize);
+                if (hash >= table->rehash_index)
+                        return &table->old_inode_hash[hash];
+        }
+
+        hash = hash_inode (ino, table->hashsize);
+
+        return &table->inode_hash[hash];
+}
+
+
+static struct list_head *
+__dentry_bucket (inode_table_t *table,
+                 ino_t par,
+                 const char *name)
+{
+        int hash = 0;
+
+        if (table->old_hashsize) {
+                hash = hash_name (par, name, table->old_hashsize);
+                if (hash >= table->rehash_index)
+                        return &table->old_name_hash[hash];
+        }
+
+        hash = hash_name (par, name, table->hashsize);
+
+        return &table->name_hash[hash];
+}
+
+
+/* a dentry of inode is about to change: drop every cached path which
+   may have been built through it, see inode_path () */
+
+static void
+__inode_path_invalidate (inode_t *inode)
+{
+        if (inode->path || !list_empty (&inode->child_list))
+                inode->dentry_gen = ++inode->table->path_gen;
+}
+
+
 static void
 __dentry_hash (dentry_t *dentry)
 {
         inode_table_t   *table = NULL;
-        int              hash = 0;
 
         table = dentry->inode->table;
-        hash = hash_name (dentry->parent->ino, dentry->name,
-                          table->hashsize);
+
+        __inode_path_invalidate (dentry->inode);
+
+        if (list_empty (&dentry->hash))
+                table->dentry_count++;
 
         list_del_init (&dentry->hash);
-        list_add (&dentry->hash, &table->name_hash[hash]);
+        list_add (&dentry->hash, __dentry_bucket (table, dentry->parent->ino,
+                                                  dentry->name));
 
         list_del_init (&dentry->parent_list);
         list_add (&dentry->parent_list, &dentry->parent->child_list);
@@ -105,6 +158,11 @@ __is_dentry_hashed (dentry_t *dentry)
 static void
 __dentry_unhash (dentry_t *dentry)
 {
+        __inode_path_invalidate (dentry->inode);
+
+        if (!list_empty (&dentry->hash))
+                dentry->inode->table->dentry_count--;
+
         list_del_init (&dentry->hash);
 	
 	gf_log (dentry->inode->table->name, GF_LOG_DEBUG,
@@ -140,6 +198,9 @@ __dentry_unset (dentry_t *dentry)
 static void
 __inode_unhash (inode_t *inode)
 {
+        if (!list_empty (&inode->hash))
+                inode->table->inode_count--;
+
         list_del_init (&inode->hash);
 }
 
@@ -155,27 +216,30 @@ static void
 __inode_hash (inode_t *inode)
 {
         inode_table_t *table = NULL;
-        int            hash = 0;
 
         table = inode->table;
-        hash = hash_inode (inode->ino, table->hashsize);
+
+        if (list_empty (&inode->hash))
+                table->inode_count++;
 
         list_del_init (&inode->hash);
-        list_add (&inode->hash, &table->inode_hash[hash]);
+        list_add (&inode->hash, __inode_bucket (table, inode->ino));
 }
 
 
+/* walk, if not NULL, is incremented by the number of entries looked at */
+
 static inode_t *
 __inode_search (inode_table_t *table,
-                ino_t ino)
+                ino_t ino,
+                uint64_t *walk)
 {
-        int  hash = 0;
         inode_t  *inode = NULL;
         inode_t  *tmp = NULL;
 
-        hash = hash_inode (ino, table->hashsize);
-
-        list_for_each_entry (tmp, &table->inode_hash[hash], hash) {
+        list_for_each_entry (tmp, __inode_bucket (table, ino), hash) {
+                if (walk)
+                        (*walk)++;
                 if (tmp->ino == ino) {
                         inode = tmp;
                         break;
@@ -208,15 +272,15 @@ __dentry_search_for_inode (inode_t *inode,
 static dentry_t *
 __dentry_search (inode_table_t *table,
                  ino_t par,
-                 const char *name)
+                 const char *name,
+                 uint64_t *walk)
 {
-        int       hash = 0;
         dentry_t *dentry = NULL;
         dentry_t *tmp = NULL;
 
-        hash = hash_name (par, name, table->hashsize);
-
-        list_for_each_entry (tmp, &table->name_hash[hash], hash) {
+        list_for_each_entry (tmp, __dentry_bucket (table, par, name), hash) {
+                if (walk)
+                        (*walk)++;
                 if (tmp->parent->ino == par && !strcmp (tmp->name, name)) {
                         dentry = tmp;
                         break;
@@ -227,6 +291,128 @@ __dentry_search (inode_table_t *table,
 }
 
 
+static struct list_head *
+__hash_buckets_new (size_t hashsize)
+{
+        struct list_head *buckets = NULL;
+        size_t            i = 0;
+
+        buckets = (void *)calloc (hashsize, sizeof (struct list_head));
+        if (!buckets)
+                return NULL;
+
+        for (i = 0; i < hashsize; i++) {
+                INIT_LIST_HEAD (&buckets[i]);
+        }
+
+        return buckets;
+}
+
+
+/* start doubling both hashes if either is over a load factor of 1 */
+
+static void
+__inode_table_grow (inode_table_t *table)
+{
+        struct list_head *inode_hash = NULL;
+        struct list_head *name_hash = NULL;
+        size_t            hashsize = 0;
+
+        if (table->old_hashsize)
+                return;
+
+        if (table->inode_count <= table->hashsize
+            && table->dentry_count <= table->hashsize)
+                return;
+
+        hashsize = table->hashsize * 2;
+
+        inode_hash = __hash_buckets_new (hashsize);
+        name_hash  = __hash_buckets_new (hashsize);
+        if (!inode_hash || !name_hash) {
+                gf_log (table->name, GF_LOG_ERROR,
+                        "out of memory growing hash to %"GF_PRI_SIZET
+                        " buckets", hashsize);
+                if (inode_hash)
+                        FREE (inode_hash);
+                if (name_hash)
+                        FREE (name_hash);
+                return;
+        }
+
+        gf_log (table->name, GF_LOG_DEBUG,
+                "rehashing %"PRIu32" inodes and %"PRIu32" dentries "
+                "from %"GF_PRI_SIZET" to %"GF_PRI_SIZET" buckets",
+                table->inode_count, table->dentry_count,
+                table->hashsize, hashsize);
+
+        table->old_inode_hash = table->inode_hash;
+        table->old_name_hash  = table->name_hash;
+        table->old_hashsize   = table->hashsize;
+        table->rehash_index   = 0;
+
+        table->inode_hash = inode_hash;
+        table->name_hash  = name_hash;
+        table->hashsize   = hashsize;
+
+        table->rehash_count++;
+}
+
+
+static void
+__inode_table_rehash_step (inode_table_t *table)
+{
+        inode_t  *inode = NULL;
+        inode_t  *itmp = NULL;
+        dentry_t *dentry = NULL;
+        dentry_t *dtmp = NULL;
+        size_t    index = 0;
+        int       hash = 0;
+        int       step = 0;
+
+        while (table->old_hashsize && step < GF_INODE_REHASH_STEP) {
+                index = table->rehash_index;
+
+                list_for_each_entry_safe (inode, itmp,
+                                          &table->old_inode_hash[index],
+                                          hash) {
+                        hash = hash_inode (inode->ino, table->hashsize);
+                        list_move (&inode->hash, &table->inode_hash[hash]);
+                }
+
+                list_for_each_entry_safe (dentry, dtmp,
+                                          &table->old_name_hash[index],
+                                          hash) {
+                        hash = hash_name (dentry->parent->ino, dentry->name,
+                                          table->hashsize);
+                        list_move (&dentry->hash, &table->name_hash[hash]);
+                }
+
+                table->rehash_index++;
+                step++;
+
+                if (table->rehash_index == table->old_hashsize) {
+                        FREE (table->old_inode_hash);
+                        FREE (table->old_name_hash);
+                        table->old_hashsize = 0;
+                        table->rehash_index = 0;
+
+                        gf_log (table->name, GF_LOG_DEBUG,
+                                "rehash to %"GF_PRI_SIZET" buckets done",
+                                table->hashsize);
+                }
+        }
+}
+
+
+static void
+__inode_table_maintain (inode_table_t *table)
+{
+        __inode_table_grow (table);
+        __inode_table_rehash_step (table);
+}
+
+
 static void
 __inode_destroy (inode_t *inode)
 {
@@ -275,6 +461,9 @@ noctx:
                 gf_log (inode->table->name, GF_LOG_DEBUG,
                         "destroy inode(%"PRId64") [@%p]", inode->ino, inode);
   
+        if (inode->path)
+                FREE (inode->path);
+
         LOCK_DESTROY (&inode->lock);
         //  memset (inode, 0xb, sizeof (*inode));
         FREE (inode);
@@ -384,14 +573,32 @@ inode_t *
 inode_unref (inode_t *inode)
 {
         inode_table_t *table = NULL;
+        int            last = 0;
 
         table = inode->table;
 
-        pthread_mutex_lock (&table->lock);
+        /* dropping the last ref passivates or retires the inode,
+           which touches the hashes and needs the write lock */
+        pthread_rwlock_rdlock (&table->lock);
         {
-                inode = __inode_unref (inode);
+                pthread_mutex_lock (&table->list_lock);
+                {
+                        if (inode->ref > 1 || inode->ino == 1)
+                                inode = __inode_unref (inode);
+                        else
+                                last = 1;
+                }
+                pthread_mutex_unlock (&table->list_lock);
+        }
+        pthread_rwlock_unlock (&table->lock);
+
+        if (last) {
+                pthread_rwlock_wrlock (&table->lock);
+                {
+                        inode = __inode_unref (inode);
+                }
+                pthread_rwlock_unlock (&table->lock);
         }
-        pthread_mutex_unlock (&table->lock);
 
         inode_table_prune (table);
 
@@ -406,11 +613,15 @@ inode_ref (inode_t *inode)
 
         table = inode->table;
 
-        pthread_mutex_lock (&table->lock);
+        pthread_rwlock_rdlock (&table->lock);
         {
-                inode = __inode_ref (inode);
+                pthread_mutex_lock (&table->list_lock);
+                {
+                        inode = __inode_ref (inode);
+                }
+                pthread_mutex_unlock (&table->list_lock);
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
         return inode;
 }
@@ -423,6 +634,8 @@ __dentry_create (inode_t *inode,
 {
         dentry_t      *newd = NULL;
 
+        __inode_path_invalidate (inode);
+
         newd = (void *) CALLOC (1, sizeof (*newd));
 
         INIT_LIST_HEAD (&newd->inode_list);
@@ -479,12 +692,17 @@ inode_new (inode_table_t *table)
 {
         inode_t *inode = NULL;
 
-        pthread_mutex_lock (&table->lock);
+        pthread_rwlock_rdlock (&table->lock);
         {
-                inode = __inode_create (table);
-                __inode_ref (inode);
+                pthread_mutex_lock (&table->list_lock);
+                {
+                        inode = __inode_create (table);
+                        if (inode)
+                                __inode_ref (inode);
+                }
+                pthread_mutex_unlock (&table->list_lock);
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
         return inode;
 }
@@ -520,22 +738,32 @@ inode_search (inode_table_t *table,
 {
         inode_t *inode = NULL;
         dentry_t *dentry = NULL;
+        uint64_t walk = 0;
 
-        pthread_mutex_lock (&table->lock);
+        pthread_rwlock_rdlock (&table->lock);
         {
                 if (!name) {
-                        inode = __inode_search (table, ino);
+                        inode = __inode_search (table, ino, &walk);
                 } else {
-                        dentry = __dentry_search (table, ino, name);
-      
+                        dentry = __dentry_search (table, ino, name, &walk);
+
                         if (dentry)
                                 inode = dentry->inode;
                 }
-    
-                if (inode)
-                        __inode_ref (inode);
+
+                pthread_mutex_lock (&table->list_lock);
+                {
+                        table->search_count++;
+                        table->search_walk += walk;
+
+                        if (inode)
+                                __inode_ref (inode);
+                        else
+                                table->search_miss++;
+                }
+                pthread_mutex_unlock (&table->list_lock);
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
         return inode;
 }
@@ -572,6 +800,9 @@ __adopt_children (inode_t *oldi, inode_t *newi)
 {
         dentry_t *dentry = NULL;
 
+        __inode_path_invalidate (oldi);
+        __inode_path_invalidate (newi);
+
         list_for_each_entry (dentry, &oldi->child_list, parent_list) {
                 assert (dentry->parent == oldi);
                 __inode_unref (dentry->parent);
@@ -624,7 +855,7 @@ __inode_link (inode_t *inode,
         inode->ino     = stbuf->st_ino;
         inode->st_mode = stbuf->st_mode;
 
-        old_inode = __inode_search (table, stbuf->st_ino);
+        old_inode = __inode_search (table, stbuf->st_ino, NULL);
 
         if (old_inode && old_inode != inode) {
                 __inode_ref (old_inode);
@@ -639,12 +870,16 @@ __inode_link (inode_t *inode,
                         dentry = __dentry_create (inode, parent, name);
                 }
 
-                old_dentry = __dentry_search (table, parent->ino, name);
-                if (old_dentry) {
-                        __dentry_unhash (old_dentry);
-                }
+                old_dentry = __dentry_search (table, parent->ino, name, NULL);
+
+                /* lookups relink the dentries they find, which changes
+                   nothing and must not drop cached paths */
+                if (old_dentry != dentry || !__is_dentry_hashed (dentry)) {
+                        if (old_dentry)
+                                __dentry_unhash (old_dentry);
 
-                __dentry_hash (dentry);
+                        __dentry_hash (dentry);
+                }
         } else if (inode->ino != 1) {
 		gf_log (table->name, GF_LOG_ERROR,
 			"child (%"PRId64") without a parent :O", inode->ino);
@@ -664,11 +899,12 @@ inode_link (inode_t *inode,
 
         table = inode->table;
 
-        pthread_mutex_lock (&table->lock);
+        pthread_rwlock_wrlock (&table->lock);
         {
                 inode = __inode_link (inode, parent, name, stbuf);
+                __inode_table_maintain (table);
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
         inode_table_prune (table);
 
@@ -685,15 +921,15 @@ inode_lookup (inode_t *inode)
         table = inode->table;
 	lookup_inode = inode;
 
-        pthread_mutex_lock (&table->lock);
+        pthread_rwlock_wrlock (&table->lock);
         {
 		if (!__is_inode_hashed (inode)) {
-			lookup_inode = __inode_search (table, inode->ino);
+			lookup_inode = __inode_search (table, inode->ino, NULL);
 		}
 
                 __inode_lookup (lookup_inode);
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
         return 0;
 }
@@ -708,15 +944,15 @@ inode_forget (inode_t *inode, uint64_t nlookup)
         table = inode->table;
 	forget_inode = inode;
 
-        pthread_mutex_lock (&table->lock);
+        pthread_rwlock_wrlock (&table->lock);
         {
 		if (!__is_inode_hashed (inode)) {
-			forget_inode = __inode_search (table, inode->ino);
+			forget_inode = __inode_search (table, inode->ino, NULL);
 		}
 
                  __inode_forget (forget_inode, nlookup);
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
         inode_table_prune (table);
 
@@ -750,15 +986,15 @@ inode_unlink (inode_t *inode,
         table = inode->table;
 	unlink_inode = inode;
 
-        pthread_mutex_lock (&table->lock);
+        pthread_rwlock_wrlock (&table->lock);
         {
 		if (!__is_inode_hashed (inode)) {
-			unlink_inode = __inode_search (table, inode->ino);
+			unlink_inode = __inode_search (table, inode->ino, NULL);
 		}
 
                 __inode_unlink (unlink_inode, parent, name);
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
         inode_table_prune (table);
 }
@@ -778,20 +1014,21 @@ inode_rename (inode_table_t *table,
 
 	rename_inode = inode;
 
-        pthread_mutex_lock (&table->lock);
+        pthread_rwlock_wrlock (&table->lock);
         {
 		if (!__is_inode_hashed (inode)) {
-			rename_inode = __inode_search (table, inode->ino);
+			rename_inode = __inode_search (table, inode->ino, NULL);
 		}
 
-		old_dst = __dentry_search (table, dstdir->ino, dstname);
+		old_dst = __dentry_search (table, dstdir->ino, dstname, NULL);
 		if (old_dst)
 			__dentry_unset (old_dst);
 
                 __inode_unlink (rename_inode, srcdir, srcname);
                 __inode_link (rename_inode, dstdir, dstname, stbuf);
+                __inode_table_maintain (table);
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
         inode_table_prune (table);
 
@@ -832,7 +1069,7 @@ inode_parent (inode_t *inode, ino_t par, const char *name)
 
         table = inode->table;
 
-        pthread_mutex_lock (&table->lock);
+        pthread_rwlock_rdlock (&table->lock);
         {
                 if (par && name) {
                         dentry = __dentry_search_for_inode (inode, par, name);
@@ -840,39 +1077,136 @@ inode_parent (inode_t *inode, ino_t par, const char *name)
                         dentry = __dentry_search_arbit (inode);
                 }
 
-                if (dentry)
-                        parent = __inode_ref (dentry->parent);
+                if (dentry) {
+                        pthread_mutex_lock (&table->list_lock);
+                        {
+                                parent = __inode_ref (dentry->parent);
+                        }
+                        pthread_mutex_unlock (&table->list_lock);
+                }
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
         return parent;
 }
 
 
+/* whether no inode from inode up to root had a dentry changed since
+   gen. with table->lock held */
+
+static int
+__inode_path_valid (inode_t *inode, uint64_t gen)
+{
+        dentry_t *dentry = NULL;
+
+        while (inode) {
+                if (inode->dentry_gen > gen)
+                        return 0;
+
+                dentry = __dentry_search_arbit (inode);
+                if (!dentry)
+                        break;
+
+                inode = dentry->parent;
+        }
+
+        return 1;
+}
+
+
+/* path of inode without a trailing '/', "" for an inode without any
+   dentry such as root. cached in the inode, the result stays valid as
+   long as table->lock is held. NULL if out of memory. */
+
+static const char *
+__inode_path_cached (inode_t *inode, size_t *lenp)
+{
+        inode_table_t *table = NULL;
+        dentry_t      *dentry = NULL;
+        const char    *ppath = NULL;
+        char          *path = NULL;
+        size_t         plen = 0;
+        size_t         nlen = 0;
+        uint64_t       gen = 0;
+
+        table = inode->table;
+
+        dentry = __dentry_search_arbit (inode);
+        if (!dentry) {
+                *lenp = 0;
+                return "";
+        }
+
+        LOCK (&inode->lock);
+        {
+                if (inode->path) {
+                        path = inode->path;
+                        *lenp = inode->path_len;
+                        gen = inode->path_gen;
+                }
+        }
+        UNLOCK (&inode->lock);
+
+        if (path && __inode_path_valid (inode, gen))
+                return path;
+
+        ppath = __inode_path_cached (dentry->parent, &plen);
+        if (!ppath)
+                return NULL;
+
+        nlen = strlen (dentry->name);
+        path = MALLOC (plen + nlen + 2);
+        if (!path)
+                return NULL;
+
+        memcpy (path, ppath, plen);
+        path[plen] = '/';
+        memcpy (path + plen + 1, dentry->name, nlen + 1);
+
+        LOCK (&inode->lock);
+        {
+                /* another reader may have filled it meanwhile and be
+                   using theirs already */
+                if (inode->path && inode->path_gen == table->path_gen) {
+                        FREE (path);
+                } else {
+                        if (inode->path)
+                                FREE (inode->path);
+                        inode->path     = path;
+                        inode->path_len = plen + nlen + 1;
+                        inode->path_gen = table->path_gen;
+                }
+
+                path  = inode->path;
+                *lenp = inode->path_len;
+        }
+        UNLOCK (&inode->lock);
+
+        return path;
+}
+
+
 int32_t
 inode_path (inode_t *inode, 
 	    const char *name, 
 	    char **bufp)
 {
         inode_table_t *table = NULL;
-        dentry_t      *trav = NULL;
-        size_t         i = 0, size = 0;
+        dentry_t      *dentry = NULL;
+        const char    *ppath = NULL;
+        const char    *tail = NULL;
+        size_t         plen = 0, tlen = 0;
         int64_t        ret = 0;
-        int            len = 0;
 	char          *buf = NULL;
 	
         table = inode->table;
 
-        pthread_mutex_lock (&table->lock);
+        pthread_rwlock_rdlock (&table->lock);
         {
-                for (trav = __dentry_search_arbit (inode); trav;
-                     trav = __dentry_search_arbit (trav->parent)) {
-                        i ++; /* "/" */
-                        i += strlen (trav->name);
-                }
-		
+                dentry = __dentry_search_arbit (inode);
+
 		if ((inode->ino != 1) &&
-		    (i == 0)) {
+		    (dentry == NULL)) {
 			gf_log (table->name, GF_LOG_DEBUG,
 				"no dentry for non-root inode %"PRId64,
 				inode->ino);
@@ -880,32 +1214,30 @@ inode_path (inode_t *inode,
 			goto unlock;
 		}
 
-                if (name) {
-                        i++;
-                        i += strlen (name);
+                /* files are built from the path of their parent so
+                   that only directories end up with a cached path */
+                if (name || S_ISDIR (inode->st_mode) || !dentry) {
+                        ppath = __inode_path_cached (inode, &plen);
+                        tail = name;
+                } else {
+                        ppath = __inode_path_cached (dentry->parent, &plen);
+                        tail = dentry->name;
                 }
 
-                ret = i;
-		size = i + 1;
-		buf = CALLOC (size, sizeof (char));
-                if (buf) {
-
-                        buf[size - 1] = 0;
+                if (ppath) {
+                        tlen = tail ? strlen (tail) + 1 : 0;
+                        buf = MALLOC (plen + tlen + 1);
+                }
 
-                        if (name) {
-                                len = strlen (name);
-                                strncpy (buf + (i - len), name, len);
-                                buf[i-len-1] = '/';
-                                i -= (len + 1);
+                if (buf) {
+                        memcpy (buf, ppath, plen);
+                        if (tail) {
+                                buf[plen] = '/';
+                                memcpy (buf + plen + 1, tail, tlen - 1);
                         }
+                        buf[plen + tlen] = 0;
 
-                        for (trav = __dentry_search_arbit (inode); trav;
-                             trav = __dentry_search_arbit (trav->parent)) {
-                                len = strlen (trav->name);
-                                strncpy (buf + (i - len), trav->name, len);
-                                buf[i-len-1] = '/';
-                                i -= (len + 1);
-                        }
+                        ret = plen + tlen;
 			*bufp = buf;
                 } else {
 			gf_log (table->name, GF_LOG_ERROR,
@@ -914,7 +1246,7 @@ inode_path (inode_t *inode,
 		}
         }
 unlock:
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
 	if (inode->ino == 1 && !name) {
 		ret = 1;
@@ -943,11 +1275,29 @@ inode_table_prune (inode_table_t *table)
 	inode_t          *del = NULL;
 	inode_t          *tmp = NULL;
 	inode_t          *entry = NULL;
+        int               busy = 0;
 
 
         INIT_LIST_HEAD (&purge);
 
-        pthread_mutex_lock (&table->lock);
+        /* called after every unref, only take the write lock when
+           there is something to do */
+        pthread_rwlock_rdlock (&table->lock);
+        {
+                pthread_mutex_lock (&table->list_lock);
+                {
+                        busy = ((table->lru_limit
+                                 && table->lru_size > table->lru_limit)
+                                || table->purge_size);
+                }
+                pthread_mutex_unlock (&table->list_lock);
+        }
+        pthread_rwlock_unlock (&table->lock);
+
+        if (!busy)
+                return 0;
+
+        pthread_rwlock_wrlock (&table->lock);
         {
                 while (table->lru_limit
                        && table->lru_size > (table->lru_limit)) {
@@ -963,7 +1313,7 @@ inode_table_prune (inode_table_t *table)
                 list_splice_init (&table->purge, &purge);
 		table->purge_size = 0;
         }
-        pthread_mutex_unlock (&table->lock);
+        pthread_rwlock_unlock (&table->lock);
 
         {
                 list_for_each_entry_safe (del, tmp, &purge, list) {
@@ -997,7 +1347,6 @@ inode_table_t *
 inode_table_new (size_t lru_limit, xlator_t *xl)
 {
         inode_table_t *new = NULL;
-        int            i = 0;
 
 
         new = (void *)calloc (1, sizeof (*new));
@@ -1011,46 +1360,131 @@ inode_table_new (size_t lru_limit, xlator_t *xl)
 
         new->lru_limit = lru_limit;
 
-        new->hashsize = 14057; /* TODO: Random Number?? */
+        new->hashsize = GF_INODE_TABLE_HASHSIZE;
 
-        new->inode_hash = (void *)calloc (new->hashsize,
-                                          sizeof (struct list_head));
+        new->inode_hash = __hash_buckets_new (new->hashsize);
         if (!new->inode_hash) {
                 FREE (new);
                 return NULL;
         }
 
-        new->name_hash = (void *)calloc (new->hashsize,
-                                         sizeof (struct list_head));
+        new->name_hash = __hash_buckets_new (new->hashsize);
         if (!new->name_hash) {
                 FREE (new->inode_hash);
                 FREE (new);
                 return NULL;
         }
 
-        for (i=0; i<new->hashsize; i++) {
-                INIT_LIST_HEAD (&new->inode_hash[i]);
-        }
-
-
-        for (i=0; i<new->hashsize; i++) {
-                INIT_LIST_HEAD (&new->name_hash[i]);
-        }
-
         INIT_LIST_HEAD (&new->active);
         INIT_LIST_HEAD (&new->lru);
         INIT_LIST_HEAD (&new->purge);
 
         asprintf (&new->name, "%s/inode", xl->name);
 
-	__inode_table_init_root (new);
+        pthread_rwlock_init (&new->lock, NULL);
+        pthread_mutex_init (&new->list_lock, NULL);
 
-        pthread_mutex_init (&new->lock, NULL);
+	__inode_table_init_root (new);
 
         return new;
 }
 
 
+static void
+__hash_chain_stats (struct list_head *buckets, size_t hashsize,
+                    inode_table_stats_t *stats)
+{
+        struct list_head *pos = NULL;
+        size_t            i = 0;
+        uint32_t          chain = 0;
+
+        for (i = 0; i < hashsize; i++) {
+                chain = 0;
+                list_for_each (pos, &buckets[i]) {
+                        chain++;
+                }
+
+                if (chain)
+                        stats->used_buckets++;
+                if (chain > stats->max_chain)
+                        stats->max_chain = chain;
+        }
+}
+
+
+/* walks every bucket to measure chains, meant for occasional dumps */
+
+int
+inode_table_stats (inode_table_t *table, inode_table_stats_t *stats)
+{
+        if (!table || !stats)
+                return -1;
+
+        memset (stats, 0, sizeof (*stats));
+
+        pthread_rwlock_rdlock (&table->lock);
+        {
+                stats->hashsize     = table->hashsize;
+                stats->old_hashsize = table->old_hashsize;
+                stats->inode_count  = table->inode_count;
+                stats->dentry_count = table->dentry_count;
+                stats->lru_limit    = table->lru_limit;
+                stats->purge_size   = table->purge_size;
+                stats->rehash_count = table->rehash_count;
+
+                __hash_chain_stats (table->inode_hash, table->hashsize,
+                                    stats);
+                __hash_chain_stats (table->name_hash, table->hashsize,
+                                    stats);
+                if (table->old_hashsize) {
+                        __hash_chain_stats (table->old_inode_hash,
+                                            table->old_hashsize, stats);
+                        __hash_chain_stats (table->old_name_hash,
+                                            table->old_hashsize, stats);
+                }
+
+                pthread_mutex_lock (&table->list_lock);
+                {
+                        stats->active_size  = table->active_size;
+                        stats->lru_size     = table->lru_size;
+                        stats->search_count = table->search_count;
+                        stats->search_miss  = table->search_miss;
+                        stats->search_walk  = table->search_walk;
+                }
+                pthread_mutex_unlock (&table->list_lock);
+        }
+        pthread_rwlock_unlock (&table->lock);
+
+        return 0;
+}
+
+
+void
+inode_table_log_stats (inode_table_t *table)
+{
+        inode_table_stats_t stats = {0, };
+
+        if (inode_table_stats (table, &stats) != 0)
+                return;
+
+        gf_log (table->name, GF_LOG_NORMAL,
+                "inode table: inodes=%"PRIu32" dentries=%"PRIu32
+                " active=%"PRIu32" lru=%"PRIu32"/%"PRIu32" purge=%"PRIu32,
+                stats.inode_count, stats.dentry_count, stats.active_size,
+                stats.lru_size, stats.lru_limit, stats.purge_size);
+        gf_log (table->name, GF_LOG_NORMAL,
+                "inode table: buckets=%"GF_PRI_SIZET" (rehashing from %"
+                GF_PRI_SIZET") used=%"PRIu32" max chain=%"PRIu32
+                " rehashes=%"PRIu64,
+                stats.hashsize, stats.old_hashsize, stats.used_buckets,
+                stats.max_chain, stats.rehash_count);
+        gf_log (table->name, GF_LOG_NORMAL,
+                "inode table: searches=%"PRIu64" misses=%"PRIu64
+                " entries walked=%"PRIu64,
+                stats.search_count, stats.search_miss, stats.search_walk);
+}
+
+
 inode_t *
 inode_from_path (inode_table_t *itable, const char *path)
 {
@@ -40,9 +40,31 @@ typedef struct _dentry dentry_t;
 #include "list.h"
 #include "xlator.h"
 
+#define GF_INODE_TABLE_HASHSIZE  14057 /* initial buckets of both hashes */
+#define GF_INODE_REHASH_STEP     64    /* old buckets migrated per update */
+
+
+/* lock is held for writing by anything which changes the hashes, the
+   dentries or takes an inode off the active list. lookups (inode_search,
+   inode_parent, inode_path) and plain ref/unref only read-hold it, and
+   take list_lock around the refcount and active/lru list updates.
+
+   both hashes double once either of them holds more entries than
+   buckets. the old buckets are moved over GF_INODE_REHASH_STEP at a
+   time by later updates, until then an entry is found in the old
+   bucket if that bucket has not been migrated yet.
+
+   inode_path() caches the path of directories in the inode, stamped
+   with the path_gen of the table it was built at. a dentry changing on
+   an inode with a cached path or with children moves path_gen on and
+   records it in the dentry_gen of that inode. a cached path is valid
+   while no inode it was built through, walking up from it, has a
+   dentry_gen newer than its stamp, so a rename or unlink only drops
+   the paths of its own subtree. */
 
 struct _inode_table {
-        pthread_mutex_t    lock;
+        pthread_rwlock_t   lock;
+        pthread_mutex_t    list_lock;   /* ref, active and lru under read lock */
         size_t             hashsize;    /* bucket size of inode hash and dentry hash */
         char              *name;        /* name of the inode table, just for gf_log() */
         inode_t           *root;        /* root directory inode, with number 1 */
@@ -50,6 +72,18 @@ struct _inode_table {
         uint32_t           lru_limit;   /* maximum LRU cache size */
         struct list_head  *inode_hash;  /* buckets for inode hash table */
         struct list_head  *name_hash;   /* buckets for dentry hash table */
+        size_t             old_hashsize;   /* non-zero while rehashing */
+        struct list_head  *old_inode_hash;
+        struct list_head  *old_name_hash;
+        size_t             rehash_index;   /* next old bucket to migrate */
+        uint32_t           inode_count;    /* inodes in the inode hash */
+        uint32_t           dentry_count;   /* dentries in the dentry hash */
+        uint64_t           rehash_count;
+        uint64_t           search_count;   /* inode_search() calls */
+        uint64_t           search_miss;
+        uint64_t           search_walk;    /* chain entries walked by them */
+        uint64_t           path_gen;       /* last dentry change, see
+                                              inode_path () */
         struct list_head   active;      /* list of inodes currently active (in an fop) */
         uint32_t           active_size; /* count of inodes in active list */
         struct list_head   lru;         /* list of inodes recently used.
@@ -69,6 +103,23 @@ struct _dentry {
         inode_t           *parent;       /* directory of the entry */
 };
 
+typedef struct {
+        size_t             hashsize;
+        size_t             old_hashsize;   /* non-zero while rehashing */
+        uint32_t           inode_count;
+        uint32_t           dentry_count;
+        uint32_t           used_buckets;   /* non-empty buckets, both hashes */
+        uint32_t           max_chain;      /* longest chain, both hashes */
+        uint32_t           active_size;
+        uint32_t           lru_size;
+        uint32_t           lru_limit;
+        uint32_t           purge_size;     /* retired, not yet destroyed */
+        uint64_t           rehash_count;
+        uint64_t           search_count;
+        uint64_t           search_miss;
+        uint64_t           search_walk;
+} inode_table_stats_t;
+
 //#define ZR_INODE_CTX_VALUE_LEN 2
 struct _inode_ctx {
 	uint64_t key;
@@ -92,6 +143,12 @@ struct _inode {
         struct list_head  list;          /* active/lru/purge */
 
 	struct _inode_ctx *_ctx;    /* replacement for dict_t *(inode->ctx) */
+
+        char             *path;          /* cached path of a directory, */
+        size_t            path_len;      /* under inode->lock */
+        uint64_t          path_gen;      /* table path_gen it was built at */
+        uint64_t          dentry_gen;    /* of the last change of its
+                                            dentries, under table->lock */
 };
 
 
@@ -101,6 +158,12 @@ inode_table_new (size_t lru_limit, xlator_t *xl);
 inode_t *
 inode_new (inode_table_t *table);
 
+int
+inode_table_stats (inode_table_t *table, inode_table_stats_t *stats);
+
+void
+inode_table_log_stats (inode_table_t *table);
+
 inode_t *
 inode_search (inode_table_t *table, ino_t ino, const char *name);
 
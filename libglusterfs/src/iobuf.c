@@ -0,0 +1,658 @@
+/*
+   Copyright (c) 2008 Z RESEARCH, Inc. <http://www.zresearch.com>
+   This file is part of GlusterFS.
+
+   GlusterFS is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   GlusterFS is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CONFIG_H
+#define _CONFIG_H
+#include "config.h"
+#endif
+
+#include "iobuf.h"
+#include "mem-pool.h"
+#include "logging.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+
+static void
+__iobuf_arena_destroy_iobufs (struct iobuf_arena *iobuf_arena)
+{
+	struct iobuf *iobuf = NULL;
+	int           iobuf_cnt = 0;
+	int           i = 0;
+
+	iobuf_cnt = iobuf_arena->iobuf_pool->arena_size /
+		iobuf_arena->iobuf_pool->page_size;
+
+	iobuf = iobuf_arena->iobufs;
+	for (i = 0; i < iobuf_cnt; i++) {
+		LOCK_DESTROY (&iobuf[i].lock);
+	}
+
+	FREE (iobuf_arena->iobufs);
+}
+
+
+static int
+__iobuf_arena_init_iobufs (struct iobuf_arena *iobuf_arena)
+{
+	struct iobuf_pool *iobuf_pool = NULL;
+	struct iobuf      *iobuf = NULL;
+	int                iobuf_cnt = 0;
+	size_t             offset = 0;
+	int                i = 0;
+
+	iobuf_pool = iobuf_arena->iobuf_pool;
+	iobuf_cnt  = iobuf_pool->arena_size / iobuf_pool->page_size;
+
+	iobuf_arena->iobufs = CALLOC (sizeof (*iobuf), iobuf_cnt);
+	if (!iobuf_arena->iobufs)
+		return -1;
+
+	iobuf = iobuf_arena->iobufs;
+	for (i = 0; i < iobuf_cnt; i++) {
+		INIT_LIST_HEAD (&iobuf[i].list);
+		LOCK_INIT (&iobuf[i].lock);
+
+		iobuf[i].iobuf_arena = iobuf_arena;
+		iobuf[i].iobuf_pool  = iobuf_pool;
+		iobuf[i].ptr  = iobuf_arena->mem_base + offset;
+		iobuf[i].size = iobuf_pool->page_size;
+
+		list_add (&iobuf[i].list, &iobuf_arena->passive.list);
+		iobuf_arena->passive_cnt++;
+
+		offset += iobuf_pool->page_size;
+	}
+
+	return 0;
+}
+
+
+static void
+__iobuf_arena_destroy (struct iobuf_arena *iobuf_arena)
+{
+	struct iobuf_pool *iobuf_pool = NULL;
+
+	iobuf_pool = iobuf_arena->iobuf_pool;
+
+	if (iobuf_arena->active_cnt)
+		gf_log ("iobuf", GF_LOG_WARNING,
+			"destroying arena %p with %d iobufs still in use",
+			iobuf_arena, iobuf_arena->active_cnt);
+
+	__iobuf_arena_destroy_iobufs (iobuf_arena);
+
+	if (iobuf_arena->mem_base && iobuf_arena->mem_base != MAP_FAILED)
+		munmap (iobuf_arena->mem_base, iobuf_pool->arena_size);
+
+	FREE (iobuf_arena);
+}
+
+
+static struct iobuf_arena *
+__iobuf_arena_alloc (struct iobuf_pool *iobuf_pool)
+{
+	struct iobuf_arena *iobuf_arena = NULL;
+
+	iobuf_arena = CALLOC (sizeof (*iobuf_arena), 1);
+	if (!iobuf_arena)
+		goto err;
+
+	INIT_LIST_HEAD (&iobuf_arena->list);
+	INIT_LIST_HEAD (&iobuf_arena->active.list);
+	INIT_LIST_HEAD (&iobuf_arena->passive.list);
+	iobuf_arena->iobuf_pool = iobuf_pool;
+
+	iobuf_arena->mem_base = mmap (NULL, iobuf_pool->arena_size,
+				      PROT_READ|PROT_WRITE,
+				      MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (iobuf_arena->mem_base == MAP_FAILED) {
+		gf_log ("iobuf", GF_LOG_ERROR,
+			"mmap of %"GF_PRI_SIZET" bytes failed (%s)",
+			iobuf_pool->arena_size, strerror (errno));
+		goto err;
+	}
+
+	if (__iobuf_arena_init_iobufs (iobuf_arena) != 0) {
+		gf_log ("iobuf", GF_LOG_ERROR,
+			"init of iobufs in arena failed");
+		goto err;
+	}
+
+	iobuf_pool->arena_cnt++;
+
+	return iobuf_arena;
+
+err:
+	if (iobuf_arena) {
+		if (iobuf_arena->mem_base &&
+		    iobuf_arena->mem_base != MAP_FAILED)
+			munmap (iobuf_arena->mem_base,
+				iobuf_pool->arena_size);
+		FREE (iobuf_arena);
+	}
+	return NULL;
+}
+
+
+struct iobuf_pool *
+iobuf_pool_new (size_t arena_size, size_t page_size)
+{
+	struct iobuf_pool  *iobuf_pool = NULL;
+	struct iobuf_arena *iobuf_arena = NULL;
+	size_t              sys_page_size = 0;
+
+	sys_page_size = sysconf (_SC_PAGESIZE);
+
+	if (!page_size || (page_size % sys_page_size) ||
+	    arena_size < page_size || (arena_size % page_size)) {
+		gf_log ("iobuf", GF_LOG_ERROR,
+			"invalid iobuf pool geometry (arena %"GF_PRI_SIZET
+			", page %"GF_PRI_SIZET")", arena_size, page_size);
+		return NULL;
+	}
+
+	iobuf_pool = CALLOC (sizeof (*iobuf_pool), 1);
+	if (!iobuf_pool)
+		return NULL;
+
+	pthread_mutex_init (&iobuf_pool->mutex, NULL);
+	INIT_LIST_HEAD (&iobuf_pool->arenas.list);
+	INIT_LIST_HEAD (&iobuf_pool->filled.list);
+
+	iobuf_pool->arena_size = arena_size;
+	iobuf_pool->page_size  = page_size;
+
+	/* preallocate the first arena, so that the common case never
+	   has to mmap () in the IO path */
+	iobuf_arena = __iobuf_arena_alloc (iobuf_pool);
+	if (!iobuf_arena) {
+		pthread_mutex_destroy (&iobuf_pool->mutex);
+		FREE (iobuf_pool);
+		return NULL;
+	}
+
+	list_add_tail (&iobuf_arena->list, &iobuf_pool->arenas.list);
+
+	return iobuf_pool;
+}
+
+
+void
+iobuf_pool_destroy (struct iobuf_pool *iobuf_pool)
+{
+	struct iobuf_arena *iobuf_arena = NULL;
+	struct iobuf_arena *tmp = NULL;
+
+	if (!iobuf_pool)
+		return;
+
+	list_for_each_entry_safe (iobuf_arena, tmp, &iobuf_pool->arenas.list,
+				  list) {
+		list_del_init (&iobuf_arena->list);
+		__iobuf_arena_destroy (iobuf_arena);
+	}
+
+	list_for_each_entry_safe (iobuf_arena, tmp, &iobuf_pool->filled.list,
+				  list) {
+		list_del_init (&iobuf_arena->list);
+		__iobuf_arena_destroy (iobuf_arena);
+	}
+
+	pthread_mutex_destroy (&iobuf_pool->mutex);
+	FREE (iobuf_pool);
+}
+
+
+static struct iobuf *
+__iobuf_get (struct iobuf_pool *iobuf_pool)
+{
+	struct iobuf_arena *iobuf_arena = NULL;
+	struct iobuf       *iobuf = NULL;
+
+	if (list_empty (&iobuf_pool->arenas.list)) {
+		iobuf_arena = __iobuf_arena_alloc (iobuf_pool);
+		if (!iobuf_arena)
+			return NULL;
+		list_add_tail (&iobuf_arena->list, &iobuf_pool->arenas.list);
+	}
+
+	iobuf_arena = list_entry (iobuf_pool->arenas.list.next,
+				  struct iobuf_arena, list);
+
+	iobuf = list_entry (iobuf_arena->passive.list.next,
+			    struct iobuf, list);
+
+	list_del (&iobuf->list);
+	iobuf_arena->passive_cnt--;
+
+	list_add (&iobuf->list, &iobuf_arena->active.list);
+	iobuf_arena->active_cnt++;
+
+	if (iobuf_arena->passive_cnt == 0) {
+		list_del (&iobuf_arena->list);
+		list_add (&iobuf_arena->list, &iobuf_pool->filled.list);
+	}
+
+	iobuf_pool->get_count++;
+
+	return iobuf;
+}
+
+
+static void
+__iobuf_put (struct iobuf *iobuf)
+{
+	struct iobuf_arena *iobuf_arena = NULL;
+	struct iobuf_pool  *iobuf_pool = NULL;
+
+	iobuf_arena = iobuf->iobuf_arena;
+	iobuf_pool  = iobuf_arena->iobuf_pool;
+
+	if (iobuf_arena->passive_cnt == 0) {
+		list_del (&iobuf_arena->list);
+		list_add_tail (&iobuf_arena->list, &iobuf_pool->arenas.list);
+	}
+
+	list_del_init (&iobuf->list);
+	iobuf_arena->active_cnt--;
+
+	/* most recently freed pages are handed out first, while they
+	   are still warm in the cache */
+	list_add (&iobuf->list, &iobuf_arena->passive.list);
+	iobuf_arena->passive_cnt++;
+}
+
+
+struct iobuf *
+iobuf_get (struct iobuf_pool *iobuf_pool)
+{
+	struct iobuf *iobuf = NULL;
+
+	if (!iobuf_pool) {
+		gf_log ("iobuf", GF_LOG_ERROR, "invalid argument");
+		return NULL;
+	}
+
+	pthread_mutex_lock (&iobuf_pool->mutex);
+	{
+		iobuf = __iobuf_get (iobuf_pool);
+	}
+	pthread_mutex_unlock (&iobuf_pool->mutex);
+
+	if (iobuf)
+		iobuf_ref (iobuf);
+
+	return iobuf;
+}
+
+
+/* iobuf not belonging to any arena, for requests larger than the
+   page size of the pool. freed on last unref. */
+static struct iobuf *
+iobuf_get_standalone (struct iobuf_pool *iobuf_pool, size_t size)
+{
+	struct iobuf *iobuf = NULL;
+	size_t        sys_page_size = 0;
+	int           ret = 0;
+
+	sys_page_size = sysconf (_SC_PAGESIZE);
+
+	iobuf = CALLOC (sizeof (*iobuf), 1);
+	if (!iobuf)
+		return NULL;
+
+	ret = posix_memalign (&iobuf->ptr, sys_page_size, size);
+	if (ret != 0) {
+		gf_log ("iobuf", GF_LOG_ERROR,
+			"allocation of %"GF_PRI_SIZET" bytes failed (%s)",
+			size, strerror (ret));
+		FREE (iobuf);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD (&iobuf->list);
+	LOCK_INIT (&iobuf->lock);
+	iobuf->iobuf_pool = iobuf_pool;
+	iobuf->size = size;
+
+	pthread_mutex_lock (&iobuf_pool->mutex);
+	{
+		iobuf_pool->standalone_count++;
+	}
+	pthread_mutex_unlock (&iobuf_pool->mutex);
+
+	iobuf_ref (iobuf);
+
+	return iobuf;
+}
+
+
+struct iobuf *
+iobuf_get2 (struct iobuf_pool *iobuf_pool, size_t size)
+{
+	if (!iobuf_pool) {
+		gf_log ("iobuf", GF_LOG_ERROR, "invalid argument");
+		return NULL;
+	}
+
+	if (size <= iobuf_pool->page_size)
+		return iobuf_get (iobuf_pool);
+
+	return iobuf_get_standalone (iobuf_pool, size);
+}
+
+
+/* iobuf around memory owned by someone else, e.g. the values of a
+   dict sent without copying them, so that an iobref can keep it
+   alive until the transport is done with it. @release is called
+   with @ptr and @data on last unref. */
+struct iobuf *
+iobuf_wrap (void *ptr, size_t size, void (*release) (void *ptr, void *data),
+	    void *data)
+{
+	struct iobuf *iobuf = NULL;
+
+	if (!release) {
+		gf_log ("iobuf", GF_LOG_ERROR, "invalid argument");
+		return NULL;
+	}
+
+	iobuf = CALLOC (sizeof (*iobuf), 1);
+	if (!iobuf)
+		return NULL;
+
+	INIT_LIST_HEAD (&iobuf->list);
+	LOCK_INIT (&iobuf->lock);
+	iobuf->ptr          = ptr;
+	iobuf->size         = size;
+	iobuf->release      = release;
+	iobuf->release_data = data;
+
+	iobuf_ref (iobuf);
+
+	return iobuf;
+}
+
+
+static void
+iobuf_put (struct iobuf *iobuf)
+{
+	struct iobuf_pool *iobuf_pool = NULL;
+
+	if (!iobuf->iobuf_arena) {
+		LOCK_DESTROY (&iobuf->lock);
+		if (iobuf->release)
+			iobuf->release (iobuf->ptr, iobuf->release_data);
+		else
+			free (iobuf->ptr);
+		FREE (iobuf);
+		return;
+	}
+
+	iobuf_pool = iobuf->iobuf_pool;
+
+	pthread_mutex_lock (&iobuf_pool->mutex);
+	{
+		__iobuf_put (iobuf);
+	}
+	pthread_mutex_unlock (&iobuf_pool->mutex);
+}
+
+
+struct iobuf *
+iobuf_ref (struct iobuf *iobuf)
+{
+	if (!iobuf)
+		return NULL;
+
+	LOCK (&iobuf->lock);
+	{
+		iobuf->ref++;
+	}
+	UNLOCK (&iobuf->lock);
+
+	return iobuf;
+}
+
+
+void
+iobuf_unref (struct iobuf *iobuf)
+{
+	int ref = 0;
+
+	if (!iobuf)
+		return;
+
+	LOCK (&iobuf->lock);
+	{
+		ref = --iobuf->ref;
+	}
+	UNLOCK (&iobuf->lock);
+
+	if (!ref)
+		iobuf_put (iobuf);
+}
+
+
+size_t
+iobuf_size (struct iobuf *iobuf)
+{
+	if (!iobuf)
+		return 0;
+
+	return iobuf->size;
+}
+
+
+struct iobref *
+iobref_new ()
+{
+	struct iobref *iobref = NULL;
+
+	iobref = CALLOC (sizeof (*iobref), 1);
+	if (!iobref)
+		return NULL;
+
+	iobref->iobrefs = CALLOC (sizeof (*iobref->iobrefs),
+				  GF_IOBREF_IOBUF_COUNT);
+	if (!iobref->iobrefs) {
+		FREE (iobref);
+		return NULL;
+	}
+
+	iobref->alloced = GF_IOBREF_IOBUF_COUNT;
+
+	LOCK_INIT (&iobref->lock);
+
+	iobref->ref++;
+
+	return iobref;
+}
+
+
+struct iobref *
+iobref_ref (struct iobref *iobref)
+{
+	if (!iobref)
+		return NULL;
+
+	LOCK (&iobref->lock);
+	{
+		iobref->ref++;
+	}
+	UNLOCK (&iobref->lock);
+
+	return iobref;
+}
+
+
+static void
+iobref_destroy (struct iobref *iobref)
+{
+	int i = 0;
+
+	for (i = 0; i < iobref->used; i++)
+		iobuf_unref (iobref->iobrefs[i]);
+
+	LOCK_DESTROY (&iobref->lock);
+
+	FREE (iobref->iobrefs);
+	FREE (iobref);
+}
+
+
+void
+iobref_unref (struct iobref *iobref)
+{
+	int ref = 0;
+
+	if (!iobref)
+		return;
+
+	LOCK (&iobref->lock);
+	{
+		ref = --iobref->ref;
+	}
+	UNLOCK (&iobref->lock);
+
+	if (!ref)
+		iobref_destroy (iobref);
+}
+
+
+static int
+__iobref_add (struct iobref *iobref, struct iobuf *iobuf)
+{
+	struct iobuf **iobrefs = NULL;
+	int            i = 0;
+
+	/* the same page is often added more than once, e.g. by
+	   read-ahead and io-cache replies spanning a page twice */
+	for (i = 0; i < iobref->used; i++) {
+		if (iobref->iobrefs[i] == iobuf)
+			return 0;
+	}
+
+	if (iobref->used == iobref->alloced) {
+		iobrefs = realloc (iobref->iobrefs,
+				   (iobref->alloced * 2) * sizeof (*iobrefs));
+		if (!iobrefs)
+			return -1;
+
+		iobref->iobrefs = iobrefs;
+		iobref->alloced *= 2;
+	}
+
+	iobref->iobrefs[iobref->used++] = iobuf_ref (iobuf);
+
+	return 0;
+}
+
+
+int
+iobref_add (struct iobref *iobref, struct iobuf *iobuf)
+{
+	int ret = -1;
+
+	if (!iobref || !iobuf)
+		return -1;
+
+	LOCK (&iobref->lock);
+	{
+		ret = __iobref_add (iobref, iobuf);
+	}
+	UNLOCK (&iobref->lock);
+
+	return ret;
+}
+
+
+/* the iobufs of from are taken out under its lock and added to to
+   after it is released, so that two merges in opposite directions
+   never hold both locks */
+int
+iobref_merge (struct iobref *to, struct iobref *from)
+{
+	struct iobuf  *onstack[GF_IOBREF_IOBUF_COUNT];
+	struct iobuf **iobufs = onstack;
+	int            count = 0;
+	int            ret = 0;
+	int            i = 0;
+
+	if (!to || !from)
+		return -1;
+
+	if (to == from)
+		return 0;
+
+	LOCK (&from->lock);
+	{
+		if (from->used > GF_IOBREF_IOBUF_COUNT)
+			iobufs = CALLOC (from->used, sizeof (*iobufs));
+
+		if (iobufs) {
+			for (i = 0; i < from->used; i++)
+				iobufs[i] = iobuf_ref (from->iobrefs[i]);
+			count = from->used;
+		}
+	}
+	UNLOCK (&from->lock);
+
+	if (!iobufs)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		if (ret == 0)
+			ret = iobref_add (to, iobufs[i]);
+		iobuf_unref (iobufs[i]);
+	}
+
+	if (iobufs != onstack)
+		FREE (iobufs);
+
+	return ret;
+}
+
+
+size_t
+iobref_size (struct iobref *iobref)
+{
+	size_t size = 0;
+	int    i = 0;
+
+	if (!iobref)
+		return 0;
+
+	LOCK (&iobref->lock);
+	{
+		for (i = 0; i < iobref->used; i++)
+			size += iobuf_size (iobref->iobrefs[i]);
+	}
+	UNLOCK (&iobref->lock);
+
+	return size;
+}
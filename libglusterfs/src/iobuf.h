@@ -0,0 +1,142 @@
+/*
+   Copyright (c) 2008 Z RESEARCH, Inc. <http://www.zresearch.com>
+   This file is part of GlusterFS.
+
+   GlusterFS is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   GlusterFS is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _IOBUF_H_
+#define _IOBUF_H_
+
+#include "list.h"
+#include "locking.h"
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define GF_IOBUF_PAGE_SIZE   (128 * 1024)
+#define GF_IOBUF_ARENA_SIZE  (8 * 1024 * 1024)
+
+#define GF_IOBREF_IOBUF_COUNT 16
+
+/* one allocatable unit of memory for the purpose of IO. iobufs are
+   carved out of page aligned, mmap()ed arenas of a pool, all of the
+   same size. requests for more than a page are served by a standalone
+   page aligned allocation which is not part of any arena. arenas
+   are only unmapped when the pool is destroyed, the pool grows to
+   the peak number of iobufs in flight.
+
+   an iobuf holds one ref on being handed out by iobuf_get(). whoever
+   needs the memory to outlive the caller holds a ref of its own,
+   mostly through an iobref. */
+
+struct iobuf_pool;
+struct iobuf_arena;
+
+struct iobuf {
+	union {
+		struct list_head      list;
+		struct {
+			struct iobuf *next;
+			struct iobuf *prev;
+		};
+	};
+	struct iobuf_arena *iobuf_arena; /* NULL for standalone iobufs */
+	struct iobuf_pool  *iobuf_pool;
+
+	gf_lock_t           lock;
+	int                 ref;
+
+	void               *ptr;         /* usable memory region */
+	size_t              size;
+
+	/* set for iobufs made by iobuf_wrap (), called on last unref
+	   instead of freeing ptr */
+	void              (*release) (void *ptr, void *data);
+	void               *release_data;
+};
+
+
+struct iobuf_arena {
+	union {
+		struct list_head            list;
+		struct {
+			struct iobuf_arena *next;
+			struct iobuf_arena *prev;
+		};
+	};
+	struct iobuf_pool  *iobuf_pool;
+
+	void               *mem_base;
+	struct iobuf       *iobufs;      /* allocated iobufs list */
+
+	int                 active_cnt;
+	struct iobuf        active;      /* head node iobuf
+					    (unused by itself) */
+	int                 passive_cnt;
+	struct iobuf        passive;     /* head node iobuf
+					    (unused by itself) */
+};
+
+
+struct iobuf_pool {
+	pthread_mutex_t     mutex;
+	size_t              page_size;   /* size of all iobufs in this pool */
+	size_t              arena_size;  /* this is multiple of page_size */
+
+	int                 arena_cnt;
+	struct iobuf_arena  arenas;      /* head node arena
+					    (unused by itself) */
+	struct iobuf_arena  filled;      /* arenas without free iobufs */
+
+	uint64_t            get_count;
+	uint64_t            standalone_count;
+};
+
+
+struct iobuf_pool *iobuf_pool_new (size_t arena_size, size_t page_size);
+void iobuf_pool_destroy (struct iobuf_pool *iobuf_pool);
+
+struct iobuf *iobuf_get (struct iobuf_pool *iobuf_pool);
+struct iobuf *iobuf_get2 (struct iobuf_pool *iobuf_pool, size_t size);
+struct iobuf *iobuf_ref (struct iobuf *iobuf);
+void iobuf_unref (struct iobuf *iobuf);
+size_t iobuf_size (struct iobuf *iobuf);
+struct iobuf *iobuf_wrap (void *ptr, size_t size,
+			  void (*release) (void *ptr, void *data), void *data);
+
+#define iobuf_ptr(iob) ((iob)->ptr)
+#define iobpool_default_pagesize(iobpool) ((iobpool)->page_size)
+
+
+/* a set of iobufs travelling together, e.g. all the pages making up
+   one readv reply. holding the iobref keeps every iobuf in it alive. */
+
+struct iobref {
+	gf_lock_t           lock;
+	int                 ref;
+	struct iobuf      **iobrefs;
+	int                 alloced;
+	int                 used;
+};
+
+struct iobref *iobref_new ();
+struct iobref *iobref_ref (struct iobref *iobref);
+void iobref_unref (struct iobref *iobref);
+int iobref_add (struct iobref *iobref, struct iobuf *iobuf);
+int iobref_merge (struct iobref *to, struct iobref *from);
+size_t iobref_size (struct iobref *iobref);
+
+#endif /* !_IOBUF_H_ */
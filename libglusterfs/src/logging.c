@@ -30,7 +30,79 @@
 #include <locale.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
 #include "logging.h"
+#include "list.h"
+
+/*
+ * every thread formats its messages into a ring of its own, which a
+ * writer thread drains into the logfile. the ring has one producer and
+ * one consumer, so a message costs a gettimeofday (), the formatting and
+ * a copy, and takes no lock. the writer merges the rings in timestamp
+ * order and does the localtime ()/strftime () once a second.
+ *
+ * a thread repeating the same message within GF_LOG_REPEAT_SEC logs it
+ * once, followed by how many times it was repeated. the count is written
+ * when the thread logs something else, or by the writer once the
+ * message is GF_LOG_REPEAT_SEC old if the thread logs nothing more.
+ * when a ring is full
+ * errors and worse are written synchronously, lesser messages are
+ * dropped and counted. messages too long for a slot, and all of them
+ * without atomic builtins, are written synchronously.
+ */
+
+#define GF_LOG_RING_SLOTS      256            /* power of two */
+#define GF_LOG_MSG_SIZE        512
+#define GF_LOG_REPEAT_SEC      5
+#define GF_LOG_WRITER_USEC     100000         /* drain at least this often */
+
+#if HAVE_SYNC_BUILTINS
+#define gf_log_barrier() __sync_synchronize ()
+#define gf_log_repeats_add(ring) __sync_fetch_and_add (&(ring)->repeats, 1)
+#else
+#define gf_log_barrier()                      /* no rings are used */
+#define gf_log_repeats_add(ring) ((ring)->repeats++)
+#endif
+
+struct gf_log_msg {
+	struct timeval     tv;
+	gf_loglevel_t      level;
+	uint32_t           dropped;     /* messages dropped before this one */
+	int                len;
+	char               text[GF_LOG_MSG_SIZE];
+};
+
+struct gf_log_ring {
+	struct list_head   list;        /* in gf_log_rings */
+	volatile uint32_t  head;        /* next slot to fill, by the owner */
+	volatile uint32_t  tail;        /* next slot to drain, by the writer */
+	volatile int       dead;        /* owner exited, free once drained */
+
+	/* counted by the owner, taken by whoever writes them out */
+	volatile uint32_t  repeats;
+	gf_loglevel_t      repeat_level;
+	struct timeval     repeat_tv;
+
+	/* owner only */
+	uint32_t           dropped;
+
+	struct gf_log_msg  slots[GF_LOG_RING_SLOTS];
+};
+
+
+/* the repeats counted so far, for the caller to write out */
+static uint32_t
+gf_log_repeats_take (struct gf_log_ring *ring)
+{
+#if HAVE_SYNC_BUILTINS
+	return __sync_lock_test_and_set (&ring->repeats, 0);
+#else
+	uint32_t repeats = ring->repeats;
+
+	ring->repeats = 0;
+	return repeats;
+#endif
+}
 
 
 static pthread_mutex_t  logfile_mutex;
@@ -43,15 +115,37 @@ static gf_loglevel_t    loglevel = GF_LOG_MAX;
 gf_loglevel_t           gf_log_loglevel; /* extern'd */
 FILE                   *gf_log_logfile;
 
+static pthread_key_t    ring_key;
+static pthread_mutex_t  ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head gf_log_rings = {&gf_log_rings, &gf_log_rings};
 
-void 
+static pthread_mutex_t  writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   writer_cond = PTHREAD_COND_INITIALIZER;
+static volatile int     writer_running = 0;
+static int              ring_key_created = 0;
+
+/* the writer's cached timestamp */
+static time_t           timestr_sec = -1;
+static char             timestr[256];
+
+static char *level_strings[] = {"N", /* NONE */
+				"T", /* TRACE */
+				"C", /* CRITICAL */
+				"E", /* ERROR */
+				"W", /* WARNING */
+				"N", /* TRACE (GF_LOG_NORMAL) */
+				"D", /* DEBUG */
+				""};
+
+
+void
 gf_log_logrotate (int signum)
 {
 	logrotate = 1;
 }
 
 
-gf_loglevel_t 
+gf_loglevel_t
 gf_log_get_loglevel (void)
 {
 	return loglevel;
@@ -65,9 +159,438 @@ gf_log_set_loglevel (gf_loglevel_t level)
 }
 
 
-void 
+/* with logfile_mutex held */
+static void
+__gf_log_reopen (void)
+{
+	FILE *new_logfile = NULL;
+
+	if (!logrotate)
+		return;
+
+	logrotate = 0;
+
+	new_logfile = fopen (filename, "a");
+	if (!new_logfile) {
+		fprintf (logfile, "failed to open logfile %s (%s)\n",
+			 filename, strerror (errno));
+		return;
+	}
+
+	fclose (logfile);
+	gf_log_logfile = logfile = new_logfile;
+}
+
+
+/* with logfile_mutex held */
+static void
+__gf_log_write (struct timeval *tv, gf_loglevel_t level, const char *text,
+		int len)
+{
+	struct tm tm;
+
+	if (tv->tv_sec != timestr_sec) {
+		localtime_r (&tv->tv_sec, &tm);
+		strftime (timestr, 256, "%Y-%m-%d %H:%M:%S", &tm);
+		timestr_sec = tv->tv_sec;
+	}
+
+	fprintf (logfile, "%s %s ", timestr, level_strings[level]);
+	fwrite (text, 1, len, logfile);
+	fputc ('\n', logfile);
+}
+
+
+static void
+gf_log_write_sync (struct timeval *tv, gf_loglevel_t level, const char *text,
+		   int len)
+{
+	pthread_mutex_lock (&logfile_mutex);
+	{
+		__gf_log_reopen ();
+		__gf_log_write (tv, level, text, len);
+		fflush (logfile);
+	}
+	pthread_mutex_unlock (&logfile_mutex);
+}
+
+
+/* with logfile_mutex held */
+static int
+__gf_log_repeats_write (struct gf_log_ring *ring)
+{
+	char     note[64];
+	uint32_t repeats = 0;
+	int      len = 0;
+
+	repeats = gf_log_repeats_take (ring);
+	if (!repeats)
+		return 0;
+
+	len = snprintf (note, sizeof (note),
+			"last message repeated %u times", repeats);
+	__gf_log_write (&ring->repeat_tv, ring->repeat_level, note, len);
+
+	return 1;
+}
+
+
+/* whether the owner of ring, with nothing queued, can no longer count
+   repeats of its last message */
+static int
+gf_log_repeats_stale (struct gf_log_ring *ring, struct timeval *now)
+{
+	struct gf_log_msg *last = NULL;
+
+	last = &ring->slots[(ring->head - 1) & (GF_LOG_RING_SLOTS - 1)];
+
+	return (now->tv_sec - last->tv.tv_sec >= GF_LOG_REPEAT_SEC);
+}
+
+
+/* write out everything queued in the rings, oldest first, then the
+   repeat counts of the rings drained whose owners will not write them
+   soon, or all of them. with logfile_mutex and ring_lock held. */
+static int
+__gf_log_drain (int all_repeats)
+{
+	struct gf_log_ring *ring = NULL;
+	struct gf_log_ring *tmp = NULL;
+	struct gf_log_ring *oldest = NULL;
+	struct gf_log_msg  *msg = NULL;
+	struct gf_log_msg  *first = NULL;
+	struct timeval      now = {0, };
+	char                note[64];
+	int                 written = 0;
+	int                 len = 0;
+
+	__gf_log_reopen ();
+
+	while (1) {
+		oldest = NULL;
+		first  = NULL;
+
+		list_for_each_entry (ring, &gf_log_rings, list) {
+			if (ring->tail == ring->head)
+				continue;
+
+			msg = &ring->slots[ring->tail & (GF_LOG_RING_SLOTS - 1)];
+			if (!first || timercmp (&msg->tv, &first->tv, <)) {
+				oldest = ring;
+				first  = msg;
+			}
+		}
+
+		if (!oldest)
+			break;
+
+		/* the slot was filled before head moved */
+		gf_log_barrier ();
+
+		if (first->dropped) {
+			len = snprintf (note, sizeof (note),
+					"%u log messages dropped",
+					first->dropped);
+			__gf_log_write (&first->tv, GF_LOG_WARNING, note, len);
+		}
+		__gf_log_write (&first->tv, first->level, first->text,
+				first->len);
+
+		/* the owner may reuse the slot once tail moves past it */
+		gf_log_barrier ();
+		oldest->tail++;
+		written++;
+	}
+
+	gettimeofday (&now, NULL);
+
+	list_for_each_entry_safe (ring, tmp, &gf_log_rings, list) {
+		if (ring->tail != ring->head)
+			continue;
+
+		if (ring->repeats
+		    && (all_repeats || ring->dead
+			|| gf_log_repeats_stale (ring, &now)))
+			written += __gf_log_repeats_write (ring);
+
+		if (ring->dead) {
+			list_del (&ring->list);
+			free (ring);
+		}
+	}
+
+	if (written)
+		fflush (logfile);
+
+	return written;
+}
+
+
+static void
+gf_log_drain (int all_repeats)
+{
+	if (!logfile)
+		return;
+
+	pthread_mutex_lock (&logfile_mutex);
+	pthread_mutex_lock (&ring_lock);
+	{
+		__gf_log_drain (all_repeats);
+	}
+	pthread_mutex_unlock (&ring_lock);
+	pthread_mutex_unlock (&logfile_mutex);
+}
+
+
+void
+gf_log_flush (void)
+{
+	gf_log_drain (1);
+}
+
+
+/* for signal handlers, which may have interrupted the holder of a lock */
+void
+gf_log_flush_nowait (void)
+{
+	if (!logfile)
+		return;
+
+	if (pthread_mutex_trylock (&logfile_mutex) != 0)
+		return;
+
+	if (pthread_mutex_trylock (&ring_lock) == 0) {
+		__gf_log_drain (1);
+		pthread_mutex_unlock (&ring_lock);
+	}
+
+	pthread_mutex_unlock (&logfile_mutex);
+}
+
+
+static void *
+gf_log_writer (void *arg)
+{
+	struct timeval  now = {0, };
+	struct timespec timeout = {0, };
+
+	while (1) {
+		gf_log_drain (0);
+
+		gettimeofday (&now, NULL);
+		now.tv_usec += GF_LOG_WRITER_USEC;
+		if (now.tv_usec >= 1000000) {
+			now.tv_sec++;
+			now.tv_usec -= 1000000;
+		}
+		timeout.tv_sec  = now.tv_sec;
+		timeout.tv_nsec = now.tv_usec * 1000;
+
+		pthread_mutex_lock (&writer_mutex);
+		{
+			pthread_cond_timedwait (&writer_cond, &writer_mutex,
+						&timeout);
+		}
+		pthread_mutex_unlock (&writer_mutex);
+	}
+
+	return NULL;
+}
+
+
+static int
+gf_log_writer_start (void)
+{
+	pthread_t thread;
+	int       ret = 0;
+
+	pthread_mutex_lock (&writer_mutex);
+	{
+		if (!writer_running) {
+			ret = pthread_create (&thread, NULL, gf_log_writer,
+					      NULL);
+			if (ret == 0) {
+				pthread_detach (thread);
+				writer_running = 1;
+			}
+		}
+	}
+	pthread_mutex_unlock (&writer_mutex);
+
+	return ret;
+}
+
+
+static void
+gf_log_ring_destroy (void *data)
+{
+	struct gf_log_ring *ring = data;
+
+	/* the writer frees it once it has drained it */
+	gf_log_barrier ();
+	ring->dead = 1;
+}
+
+
+static struct gf_log_ring *
+gf_log_ring_get (void)
+{
+	struct gf_log_ring *ring = NULL;
+
+	ring = pthread_getspecific (ring_key);
+	if (ring)
+		return ring;
+
+	ring = calloc (1, sizeof (*ring));
+	if (!ring)
+		return NULL;
+
+	if (pthread_setspecific (ring_key, ring) != 0) {
+		free (ring);
+		return NULL;
+	}
+
+	pthread_mutex_lock (&ring_lock);
+	{
+		list_add_tail (&ring->list, &gf_log_rings);
+	}
+	pthread_mutex_unlock (&ring_lock);
+
+	return ring;
+}
+
+
+/* 0 if the message went into the ring */
+static int
+gf_log_ring_put (struct gf_log_ring *ring, struct timeval *tv,
+		 gf_loglevel_t level, const char *text, int len)
+{
+	struct gf_log_msg *msg = NULL;
+	uint32_t           head = 0;
+
+	head = ring->head;
+	if (head - ring->tail >= GF_LOG_RING_SLOTS) {
+		if (level <= GF_LOG_ERROR)
+			return -1;
+
+		ring->dropped++;
+		return 0;
+	}
+
+	msg = &ring->slots[head & (GF_LOG_RING_SLOTS - 1)];
+	msg->tv      = *tv;
+	msg->level   = level;
+	msg->dropped = ring->dropped;
+	msg->len     = len;
+	memcpy (msg->text, text, len);
+
+	ring->dropped = 0;
+
+	/* the writer must see the slot before it sees head move */
+	gf_log_barrier ();
+	ring->head = head + 1;
+
+	if (head + 1 - ring->tail > GF_LOG_RING_SLOTS / 2
+	    || level <= GF_LOG_CRITICAL)
+		pthread_cond_signal (&writer_cond);
+
+	return 0;
+}
+
+
+/* whether text is the message the thread queued last, within
+   GF_LOG_REPEAT_SEC of when it was first queued */
+static int
+gf_log_ring_repeats (struct gf_log_ring *ring, struct timeval *tv,
+		     gf_loglevel_t level, const char *text, int len)
+{
+	struct gf_log_msg *last = NULL;
+
+	if (ring->head == 0)
+		return 0;
+
+	/* only the owner writes slots, the writer never changes them */
+	last = &ring->slots[(ring->head - 1) & (GF_LOG_RING_SLOTS - 1)];
+
+	if (last->level != level || last->len != len
+	    || tv->tv_sec - last->tv.tv_sec >= GF_LOG_REPEAT_SEC)
+		return 0;
+
+	return (memcmp (last->text, text, len) == 0);
+}
+
+
+static void
+gf_log_ring_repeats_flush (struct gf_log_ring *ring)
+{
+	char     note[64];
+	uint32_t repeats = 0;
+	int      len = 0;
+
+	if (!ring->repeats)
+		return;
+
+	/* unless the writer took them first */
+	repeats = gf_log_repeats_take (ring);
+	if (!repeats)
+		return;
+
+	len = snprintf (note, sizeof (note),
+			"last message repeated %u times", repeats);
+
+	if (gf_log_ring_put (ring, &ring->repeat_tv, ring->repeat_level,
+			     note, len) != 0)
+		gf_log_write_sync (&ring->repeat_tv, ring->repeat_level,
+				   note, len);
+}
+
+
+/* hold the logfile and the rings across fork, so that the child does
+   not inherit them locked by a thread it does not have */
+static void
+gf_log_atfork_prepare (void)
+{
+	gf_log_flush ();
+
+	pthread_mutex_lock (&logfile_mutex);
+	pthread_mutex_lock (&ring_lock);
+}
+
+
+static void
+gf_log_atfork_parent (void)
+{
+	pthread_mutex_unlock (&ring_lock);
+	pthread_mutex_unlock (&logfile_mutex);
+}
+
+
+/* only the forking thread lives on in the child, and no writer */
+static void
+gf_log_atfork_child (void)
+{
+	struct gf_log_ring *ring = NULL;
+	struct gf_log_ring *self = NULL;
+
+	pthread_mutex_unlock (&ring_lock);
+	pthread_mutex_unlock (&logfile_mutex);
+
+	pthread_mutex_init (&writer_mutex, NULL);
+	pthread_cond_init (&writer_cond, NULL);
+	writer_running = 0;
+
+	self = pthread_getspecific (ring_key);
+	list_for_each_entry (ring, &gf_log_rings, list) {
+		if (ring != self)
+			ring->dead = 1;
+	}
+}
+
+
+void
 gf_log_fini (void)
 {
+	gf_log_flush ();
 	pthread_mutex_destroy (&logfile_mutex);
 }
 
@@ -99,18 +622,32 @@ gf_log_init (const char *file)
 
 	gf_log_logfile = logfile;
 
+#if HAVE_SYNC_BUILTINS
+	if (!ring_key_created) {
+		if (pthread_key_create (&ring_key, gf_log_ring_destroy) != 0)
+			return 0;
+
+		ring_key_created = 1;
+		pthread_atfork (gf_log_atfork_prepare, gf_log_atfork_parent,
+				gf_log_atfork_child);
+		atexit (gf_log_flush);
+	}
+
+	gf_log_writer_start ();
+#endif
+
 	return 0;
 }
 
 
-void 
+void
 gf_log_lock (void)
 {
 	pthread_mutex_lock (&logfile_mutex);
 }
 
 
-void 
+void
 gf_log_unlock (void)
 {
 	pthread_mutex_unlock (&logfile_mutex);
@@ -128,80 +665,104 @@ int
 _gf_log (const char *domain, const char *file, const char *function, int line,
 	 gf_loglevel_t level, const char *fmt, ...)
 {
-	const char  *basename = NULL;
-	FILE        *new_logfile = NULL;
-	va_list      ap;
-	time_t       utime = 0;
-	struct tm   *tm = NULL;
-	char         timestr[256];
-	static char *level_strings[] = {"N", /* NONE */
-					"T", /* TRACE */
-					"C", /* CRITICAL */
-					"E", /* ERROR */
-					"W", /* WARNING */
-					"N", /* TRACE (GF_LOG_NORMAL) */
-					"D", /* DEBUG */
-					""};
-  
+	const char         *basename = NULL;
+	struct gf_log_ring *ring = NULL;
+	struct timeval      tv = {0, };
+	va_list             ap;
+	char                text[GF_LOG_MSG_SIZE];
+	char               *long_text = NULL;
+	int                 prefix = 0;
+	int                 len = 0;
+
+	if (level > loglevel)
+		return 0;
+
 	if (!domain || !file || !function || !fmt) {
-		fprintf (stderr, 
-			 "logging: %s:%s():%d: invalid argument\n", 
+		fprintf (stderr,
+			 "logging: %s:%s():%d: invalid argument\n",
 			 __FILE__, __PRETTY_FUNCTION__, __LINE__);
 		return -1;
 	}
-  
+
 	if (!logfile) {
 		fprintf (stderr, "no logfile set\n");
 		return (-1);
 	}
 
-	if (logrotate) {
-		logrotate = 0;
+	gettimeofday (&tv, NULL);
 
-		new_logfile = fopen (filename, "a");
-		if (!new_logfile) {
-			gf_log ("logrotate", GF_LOG_CRITICAL,
-				"failed to open logfile %s (%s)",
-				filename, strerror (errno));
-			goto log;
-		}
+	basename = strrchr (file, '/');
+	if (basename)
+		basename++;
+	else
+		basename = file;
 
-		fclose (logfile);
-		gf_log_logfile = logfile = new_logfile;
-	}
+	prefix = snprintf (text, sizeof (text), "[%s:%d:%s] %s: ",
+			   basename, line, function, domain);
+	if (prefix >= sizeof (text))
+		prefix = sizeof (text) - 1;
+
+	va_start (ap, fmt);
+	len = vsnprintf (text + prefix, sizeof (text) - prefix, fmt, ap);
+	va_end (ap);
 
-log:
-	utime = time (NULL);
-	tm    = localtime (&utime);
+	if (len < 0)
+		return -1;
 
-	if (level > loglevel) {
+	if (prefix + len >= sizeof (text)) {
+		/* too long for a slot, write it out on its own */
+		long_text = malloc (prefix + len + 1);
+		if (!long_text) {
+			len = sizeof (text) - 1;
+			goto sync;
+		}
+
+		memcpy (long_text, text, prefix);
+		va_start (ap, fmt);
+		vsnprintf (long_text + prefix, len + 1, fmt, ap);
+		va_end (ap);
+
+		if (ring_key_created) {
+			ring = pthread_getspecific (ring_key);
+			if (ring)
+				gf_log_ring_repeats_flush (ring);
+		}
+		gf_log_flush ();
+		gf_log_write_sync (&tv, level, long_text, prefix + len);
+		free (long_text);
 		goto out;
 	}
+	len += prefix;
 
-	pthread_mutex_lock (&logfile_mutex);
-	{
-		va_start (ap, fmt);
+#if HAVE_SYNC_BUILTINS
+	if (!ring_key_created)
+		goto sync;
 
-		strftime (timestr, 256, "%Y-%m-%d %H:%M:%S", tm); 
+	if (!writer_running && gf_log_writer_start () != 0)
+		goto sync;
 
-		basename = strrchr (file, '/');
-		if (basename)
-			basename++;
-		else
-			basename = file;
+	ring = gf_log_ring_get ();
+	if (!ring)
+		goto sync;
 
-		fprintf (logfile, "%s %s [%s:%d:%s] %s: ",
-			 timestr, level_strings[level],
-			 basename, line, function,
-			 domain);
-      
-		vfprintf (logfile, fmt, ap);
-		va_end (ap);
-		fprintf (logfile, "\n");
-		fflush (logfile);
+	if (gf_log_ring_repeats (ring, &tv, level, text, len)) {
+		ring->repeat_level = level;
+		ring->repeat_tv = tv;
+		gf_log_repeats_add (ring);
+		goto out;
 	}
-	pthread_mutex_unlock (&logfile_mutex);
 
+	gf_log_ring_repeats_flush (ring);
+
+	if (gf_log_ring_put (ring, &tv, level, text, len) == 0)
+		goto out;
+#endif
+
+sync:
+	/* keep it behind what the thread queued before */
+	if (ring)
+		gf_log_flush ();
+	gf_log_write_sync (&tv, level, text, len);
 out:
 	return (0);
 }
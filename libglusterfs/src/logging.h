@@ -80,10 +80,19 @@ typedef enum {
 
 #define GF_LOG_MAX GF_LOG_DEBUG
 
+/* the most verbose level compiled in. calls above it are removed by the
+   compiler along with the evaluation of their arguments, whatever the
+   level set at runtime. build with e.g. -DGF_LOG_COMPILE_LEVEL=GF_LOG_INFO
+   to drop the debug calls from hot paths. */
+#ifndef GF_LOG_COMPILE_LEVEL
+#define GF_LOG_COMPILE_LEVEL GF_LOG_MAX
+#endif
+
 extern gf_loglevel_t gf_log_loglevel;
 
 #define gf_log(dom, levl, fmt...) do {					\
-		if (levl <= gf_log_loglevel)				\
+		if ((levl) <= GF_LOG_COMPILE_LEVEL &&			\
+		    (levl) <= gf_log_loglevel)				\
 			_gf_log (dom, __FILE__, __FUNCTION__, __LINE__, \
 				 levl, ##fmt);				\
 		if (0) {						\
@@ -109,6 +118,9 @@ _gf_log (const char *domain, const char *file, const char *function,
 void gf_log_lock (void);
 void gf_log_unlock (void);
 
+void gf_log_flush (void);
+void gf_log_flush_nowait (void);
+
 gf_loglevel_t 
 gf_log_get_loglevel (void);
 void 
@@ -20,6 +20,7 @@
 #include "mem-pool.h"
 #include "logging.h"
 #include <stdlib.h>
+#include <string.h>
 
 
 #define GF_MEM_POOL_PAD_BOUNDRY    16
@@ -51,13 +52,17 @@ mem_pool_new_fn (unsigned long sizeof_type,
 
 	LOCK_INIT (&mem_pool->lock);
 	INIT_LIST_HEAD (&mem_pool->list);
+	INIT_LIST_HEAD (&mem_pool->thread_caches);
 
 	mem_pool->padded_sizeof_type = padded_sizeof_type;
 	mem_pool->cold_count = count;
 
 	pool = CALLOC (count, sizeof_type + pad);
-	if (!pool)
+	if (!pool) {
+		LOCK_DESTROY (&mem_pool->lock);
+		FREE (mem_pool);
 		return NULL;
+	}
 
 	for (i = 0; i < count; i++) {
 		list = pool + (i * (sizeof_type + pad));
@@ -72,28 +77,200 @@ mem_pool_new_fn (unsigned long sizeof_type,
 }
 
 
+static int
+__is_member (struct mem_pool *pool, void *ptr)
+{
+	if (!pool || !ptr) {
+		gf_log ("mem-pool", GF_LOG_ERROR, "invalid argument");
+		return -1;
+	}
+  
+	if (ptr < pool->pool || ptr >= pool->pool_end)
+		return 0;
+
+	if ((ptr - pool->pool) % pool->padded_sizeof_type)
+		return -1;
+
+	return 1;
+}
+
+
+static void
+__mem_pool_put (struct mem_pool *pool, void *ptr)
+{
+	struct list_head *list = NULL;
+
+	list = ptr;
+
+	pool->hot_count--;
+
+	switch (__is_member (pool, ptr))
+	{
+	case 1:
+		pool->cold_count++;
+		list_add (list, &pool->list);
+		break;
+	case -1:
+		/* log error */
+		abort ();
+		break;
+	case 0:
+		free (ptr);
+		break;
+	default:
+		/* log error */
+		break;
+	}
+}
+
+
+static void
+mem_pool_thread_cache_destroy (void *data)
+{
+	struct mem_pool_thread_cache *cache = NULL;
+	struct mem_pool              *pool = NULL;
+	struct list_head             *list = NULL;
+
+	cache = data;
+	pool  = cache->pool;
+
+	LOCK (&pool->lock);
+	{
+		list_del_init (&cache->caches);
+
+		while (!list_empty (&cache->list)) {
+			list = cache->list.next;
+			list_del (list);
+			__mem_pool_put (pool, list);
+		}
+
+		pool->get_count += cache->get_count;
+		pool->put_count += cache->put_count;
+		pool->hit_count += cache->hit_count;
+	}
+	UNLOCK (&pool->lock);
+
+	free (cache);
+}
+
+
+int
+mem_pool_thread_cache_init (struct mem_pool *pool, int size)
+{
+	int ret = -1;
+
+	if (!pool || (size <= 0)) {
+		gf_log ("mem-pool", GF_LOG_ERROR, "invalid argument");
+		return -1;
+	}
+
+	ret = pthread_key_create (&pool->thread_cache_key,
+				  mem_pool_thread_cache_destroy);
+	if (ret != 0) {
+		gf_log ("mem-pool", GF_LOG_ERROR,
+			"pthread_key_create failed (%d)", ret);
+		return -1;
+	}
+
+	pool->thread_cache_size = size;
+
+	return 0;
+}
+
+
+static struct mem_pool_thread_cache *
+mem_pool_thread_cache (struct mem_pool *pool)
+{
+	struct mem_pool_thread_cache *cache = NULL;
+
+	cache = pthread_getspecific (pool->thread_cache_key);
+	if (cache)
+		return cache;
+
+	cache = CALLOC (1, sizeof (*cache));
+	if (!cache)
+		return NULL;
+
+	INIT_LIST_HEAD (&cache->list);
+	INIT_LIST_HEAD (&cache->caches);
+	cache->pool = pool;
+
+	LOCK (&pool->lock);
+	{
+		list_add (&cache->caches, &pool->thread_caches);
+	}
+	UNLOCK (&pool->lock);
+
+	if (pthread_setspecific (pool->thread_cache_key, cache) != 0) {
+		mem_pool_thread_cache_destroy (cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+
 void *
 mem_get (struct mem_pool *mem_pool)
 {
-	struct list_head *list = NULL;
-	void             *ptr = NULL;
+	struct mem_pool_thread_cache *cache = NULL;
+	struct list_head             *list = NULL;
+	void                         *ptr = NULL;
+	int                           batch = 0;
   
 	if (!mem_pool) {
 		gf_log ("mem-pool", GF_LOG_ERROR, "invalid argument");
 		return NULL;
 	}
 
+	if (mem_pool->thread_cache_size) {
+		cache = mem_pool_thread_cache (mem_pool);
+		if (cache) {
+			cache->get_count++;
+
+			if (cache->count) {
+				list = cache->list.next;
+				list_del (list);
+				cache->count--;
+				cache->hit_count++;
+
+				return list;
+			}
+
+			/* refill half the cache under the same lock, so
+			   that a thread which only allocates does not
+			   take pool->lock on every call */
+			batch = mem_pool->thread_cache_size / 2;
+		}
+	}
+
 	LOCK (&mem_pool->lock);
 	{
+		if (!cache)
+			mem_pool->get_count++;
+
 		if (mem_pool->cold_count) {
 			list = mem_pool->list.next;
 			list_del (list);
 
 			mem_pool->hot_count++;
 			mem_pool->cold_count--;
+			mem_pool->hit_count++;
 
 			ptr = list;
 		}
+
+		while (batch && mem_pool->cold_count) {
+			list = mem_pool->list.next;
+			list_del (list);
+
+			mem_pool->hot_count++;
+			mem_pool->cold_count--;
+
+			list_add (list, &cache->list);
+			cache->count++;
+			batch--;
+		}
 	}
 	UNLOCK (&mem_pool->lock);
 
@@ -107,6 +284,7 @@ mem_get (struct mem_pool *mem_pool)
 		LOCK (&mem_pool->lock);
 		{
 			mem_pool->hot_count ++;
+			mem_pool->miss_count++;
 		}
 		UNLOCK (&mem_pool->lock);
 	}
@@ -115,60 +293,88 @@ mem_get (struct mem_pool *mem_pool)
 }
 
 
-static int
-__is_member (struct mem_pool *pool, void *ptr)
+void
+mem_put (struct mem_pool *pool, void *ptr)
 {
+	struct mem_pool_thread_cache *cache = NULL;
+	struct list_head             *list = NULL;
+	int                           batch = 0;
+  
 	if (!pool || !ptr) {
 		gf_log ("mem-pool", GF_LOG_ERROR, "invalid argument");
-		return -1;
+		return;
 	}
   
-	if (ptr < pool->pool || ptr >= pool->pool_end)
-		return 0;
+	list = ptr;
 
-	if ((ptr - pool->pool) % pool->padded_sizeof_type)
-		return -1;
+	if (pool->thread_cache_size) {
+		cache = mem_pool_thread_cache (pool);
+		if (cache) {
+			cache->put_count++;
 
-	return 1;
+			if (cache->count < pool->thread_cache_size) {
+				list_add (list, &cache->list);
+				cache->count++;
+
+				return;
+			}
+
+			/* cache is full, hand half of it back along
+			   with @ptr */
+			batch = pool->thread_cache_size / 2;
+		}
+	}
+  
+	LOCK (&pool->lock);
+	{
+		if (!cache)
+			pool->put_count++;
+
+		__mem_pool_put (pool, ptr);
+
+		while (batch--) {
+			list = cache->list.next;
+			list_del (list);
+			cache->count--;
+
+			__mem_pool_put (pool, list);
+		}
+	}
+	UNLOCK (&pool->lock);
 }
 
 
 void
-mem_put (struct mem_pool *pool, void *ptr)
+mem_pool_get_stats (struct mem_pool *pool, struct mem_pool_stats *stats)
 {
-	struct list_head *list = NULL;
-  
-	if (!pool || !ptr) {
+	struct mem_pool_thread_cache *cache = NULL;
+
+	if (!pool || !stats) {
 		gf_log ("mem-pool", GF_LOG_ERROR, "invalid argument");
 		return;
 	}
-  
-	list = ptr;
-  
+
+	memset (stats, 0, sizeof (*stats));
+
 	LOCK (&pool->lock);
 	{
-		pool->hot_count--;
+		stats->get_count  = pool->get_count;
+		stats->put_count  = pool->put_count;
+		stats->hit_count  = pool->hit_count;
+		stats->miss_count = pool->miss_count;
+		stats->cold_count = pool->cold_count;
 
-		switch (__is_member (pool, ptr))
-		{
-		case 1:
-			pool->cold_count++;
-			list_add (list, &pool->list);
-			break;
-		case -1:
-			/* log error */
-			abort ();
-			break;
-		case 0:
-			free (ptr);
-			break;
-		default:
-			/* log error */
-			break;
+		/* counters of live caches are read without their owners
+		   stopping, so the sum is only a close approximation */
+		list_for_each_entry (cache, &pool->thread_caches, caches) {
+			stats->get_count  += cache->get_count;
+			stats->put_count  += cache->put_count;
+			stats->hit_count  += cache->hit_count;
+			stats->cold_count += cache->count;
+			stats->thread_caches++;
 		}
 	}
 	UNLOCK (&pool->lock);
 
-	if (ptr)
-		free (ptr);
+	stats->outstanding = stats->get_count - stats->put_count;
 }
@@ -22,6 +22,8 @@
 
 #include "list.h"
 #include "locking.h"
+#include <stdint.h>
+#include <pthread.h>
 
 
 #define MALLOC(size) malloc(size)
@@ -41,6 +43,41 @@ struct mem_pool {
 	unsigned long     padded_sizeof_type;
 	void             *pool;
 	void             *pool_end;
+
+	/* per-thread caches, enabled by mem_pool_thread_cache_init () */
+	int               thread_cache_size;
+	pthread_key_t     thread_cache_key;
+	struct list_head  thread_caches;
+
+	/* counters of the locked path, and of exited threads' caches */
+	uint64_t          get_count;
+	uint64_t          put_count;
+	uint64_t          hit_count;
+	uint64_t          miss_count;
+};
+
+/* objects freed by a thread are kept in its cache (upto
+   pool->thread_cache_size of them) and handed out again by mem_get()
+   of the same thread without touching pool->lock. the counters are
+   only ever written by the owning thread. */
+struct mem_pool_thread_cache {
+	struct list_head  list;
+	struct list_head  caches;
+	struct mem_pool  *pool;
+	int               count;
+	uint64_t          get_count;
+	uint64_t          put_count;
+	uint64_t          hit_count;
+};
+
+struct mem_pool_stats {
+	uint64_t          get_count;
+	uint64_t          put_count;
+	uint64_t          hit_count;    /* served from the arena or a cache */
+	uint64_t          miss_count;   /* had to fall back to malloc */
+	int64_t           outstanding;  /* get_count - put_count */
+	int               cold_count;
+	int               thread_caches;
 };
 
 struct mem_pool *
@@ -48,6 +85,9 @@ mem_pool_new_fn (unsigned long sizeof_type, unsigned long count);
 
 #define mem_pool_new(type,count) mem_pool_new_fn (sizeof(type), count)
 
+int mem_pool_thread_cache_init (struct mem_pool *pool, int size);
+void mem_pool_get_stats (struct mem_pool *pool, struct mem_pool_stats *stats);
+
 void mem_put (struct mem_pool *pool, void *ptr);
 void *mem_get (struct mem_pool *pool);
 
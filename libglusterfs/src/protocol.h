@@ -34,6 +34,7 @@
 #include <fcntl.h>
 
 #include "byte-order.h"
+#include "compat.h"
 
 
 struct gf_stat {
@@ -72,7 +73,10 @@ gf_stat_to_stat (struct gf_stat *gf_stat, struct stat *stat)
 	stat->st_atime        = ntoh32 (gf_stat->atime);
 	stat->st_mtime        = ntoh32 (gf_stat->mtime);
 	stat->st_ctime        = ntoh32 (gf_stat->ctime);
-	/* TODO: handle nsec */
+
+	ST_ATIM_NSEC_SET (stat, ntoh32 (gf_stat->atime_nsec));
+	ST_MTIM_NSEC_SET (stat, ntoh32 (gf_stat->mtime_nsec));
+	ST_CTIM_NSEC_SET (stat, ntoh32 (gf_stat->ctime_nsec));
 }
 
 
@@ -92,7 +96,10 @@ gf_stat_from_stat (struct gf_stat *gf_stat, struct stat *stat)
 	gf_stat->atime       = hton32 (stat->st_atime);
 	gf_stat->mtime       = hton32 (stat->st_mtime);
 	gf_stat->ctime       = hton32 (stat->st_ctime);
-	/* TODO: handle nsec */
+
+	gf_stat->atime_nsec  = hton32 (ST_ATIM_NSEC (stat));
+	gf_stat->mtime_nsec  = hton32 (ST_MTIM_NSEC (stat));
+	gf_stat->ctime_nsec  = hton32 (ST_CTIM_NSEC (stat));
 }
 
 
@@ -475,6 +482,18 @@ typedef struct {
 } __attribute__((packed)) gf_fop_readdir_rsp_t;
 
 
+typedef struct {
+	uint64_t ino;
+	int64_t  fd;
+	uint64_t offset;
+	uint32_t size;
+} __attribute__((packed)) gf_fop_readdirp_req_t;
+typedef struct {
+	uint32_t size;   /* of buf, gf_direntp_serialize () of the entries */
+	char     buf[0];
+} __attribute__((packed)) gf_fop_readdirp_rsp_t;
+
+
 typedef struct  {
 	uint64_t ino;
 	uint32_t mask;
@@ -746,6 +765,27 @@ typedef struct {
 } __attribute__ ((packed)) gf_hdr_common_t;
 
 
+/* the top byte of gf_hdr_common_t.type tells where the dict of a
+   message is. 0 (GF_DICT_FORMAT_INLINE) is the dict serialized into
+   the header after the fixed fields, which is all that peers not
+   knowing of it send or get. GF_DICT_FORMAT_PAYLOAD is only sent to
+   a peer which announced "dict-format" in SETVOLUME: the dict is the
+   payload of the message, serialized the same way, with dict_len of
+   the header still giving its length. */
+
+#define GF_HDR_FORMAT_SHIFT     24
+#define GF_HDR_TYPE_MASK        ((1 << GF_HDR_FORMAT_SHIFT) - 1)
+
+#define GF_DICT_FORMAT_INLINE   0
+#define GF_DICT_FORMAT_PAYLOAD  1
+#define GF_DICT_FORMAT_MAX      GF_DICT_FORMAT_PAYLOAD
+
+#define gf_hdr_type(type)       ((type) & GF_HDR_TYPE_MASK)
+#define gf_hdr_format(type)     (((uint32_t) (type)) >> GF_HDR_FORMAT_SHIFT)
+#define gf_hdr_type_format(type, format)                \
+	((type) | ((format) << GF_HDR_FORMAT_SHIFT))
+
+
 static inline gf_hdr_common_t *
 __gf_hdr_new (int size)
 {
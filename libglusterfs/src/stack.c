@@ -0,0 +1,127 @@
+/*
+  Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CONFIG_H
+#define _CONFIG_H
+#include "config.h"
+#endif
+
+#include "stack.h"
+#include "logging.h"
+
+
+/* arena sizes of the frame and stack pools. a request typically
+   winds through as many frames as the graph is deep */
+#define GF_CALL_POOL_FRAME_COUNT     4096
+#define GF_CALL_POOL_STACK_COUNT     1024
+#define GF_CALL_POOL_THREAD_CACHE    64
+
+
+call_pool_t *
+call_pool_new (void)
+{
+	call_pool_t *pool = NULL;
+
+	pool = CALLOC (1, sizeof (*pool));
+	if (!pool)
+		return NULL;
+
+	LOCK_INIT (&pool->lock);
+	INIT_LIST_HEAD (&pool->all_frames);
+
+	pool->frame_mem_pool = mem_pool_new (call_frame_t,
+					     GF_CALL_POOL_FRAME_COUNT);
+	pool->stack_mem_pool = mem_pool_new (call_stack_t,
+					     GF_CALL_POOL_STACK_COUNT);
+
+	if (!pool->frame_mem_pool || !pool->stack_mem_pool) {
+		gf_log ("stack", GF_LOG_ERROR,
+			"out of memory for frame pools");
+		/* arenas are not released, mem_pool has no destructor */
+		LOCK_DESTROY (&pool->lock);
+		FREE (pool);
+		return NULL;
+	}
+
+	mem_pool_thread_cache_init (pool->frame_mem_pool,
+				    GF_CALL_POOL_THREAD_CACHE);
+	mem_pool_thread_cache_init (pool->stack_mem_pool,
+				    GF_CALL_POOL_THREAD_CACHE);
+
+	return pool;
+}
+
+
+void
+call_pool_get_stats (call_pool_t *pool, call_pool_stats_t *stats)
+{
+	if (!pool || !stats) {
+		gf_log ("stack", GF_LOG_ERROR, "invalid argument");
+		return;
+	}
+
+	memset (stats, 0, sizeof (*stats));
+
+	LOCK (&pool->lock);
+	{
+		stats->stacks = pool->cnt;
+	}
+	UNLOCK (&pool->lock);
+
+	if (pool->frame_mem_pool)
+		mem_pool_get_stats (pool->frame_mem_pool, &stats->frame);
+	if (pool->stack_mem_pool)
+		mem_pool_get_stats (pool->stack_mem_pool, &stats->stack);
+}
+
+
+static void
+__call_pool_log_mem_pool (const char *name, struct mem_pool_stats *stats)
+{
+	uint64_t hit_pct = 0;
+
+	if (stats->get_count)
+		hit_pct = (stats->hit_count * 100) / stats->get_count;
+
+	gf_log ("stack", GF_LOG_NORMAL,
+		"%s pool: outstanding=%"PRId64" cached=%d gets=%"PRIu64
+		" hits=%"PRIu64" (%"PRIu64"%%) misses=%"PRIu64
+		" thread-caches=%d",
+		name, stats->outstanding, stats->cold_count,
+		stats->get_count, stats->hit_count, hit_pct,
+		stats->miss_count, stats->thread_caches);
+}
+
+
+void
+call_pool_log_stats (call_pool_t *pool)
+{
+	call_pool_stats_t stats = {0, };
+
+	if (!pool)
+		return;
+
+	call_pool_get_stats (pool, &stats);
+
+	gf_log ("stack", GF_LOG_NORMAL,
+		"call pool: outstanding stacks=%"PRId64, stats.stacks);
+
+	__call_pool_log_mem_pool ("frame", &stats.frame);
+	__call_pool_log_mem_pool ("stack", &stats.stack);
+}
@@ -36,11 +36,14 @@ struct _call_frame_t;
 typedef struct _call_frame_t call_frame_t;
 struct _call_pool_t;
 typedef struct _call_pool_t call_pool_t;
+struct gf_fop_stats;
 
 #include "xlator.h"
 #include "dict.h"
 #include "list.h"
 #include "common-utils.h"
+#include "mem-pool.h"
+#include "iobuf.h"
 
 
 typedef int32_t (*ret_fn_t) (call_frame_t *frame,
@@ -60,8 +63,17 @@ struct _call_pool_t {
 	};
 	int64_t                     cnt;
 	gf_lock_t                   lock;
+	struct mem_pool            *frame_mem_pool;
+	struct mem_pool            *stack_mem_pool;
 };
 
+struct _call_pool_stats {
+	int64_t                     stacks;  /* outstanding call stacks */
+	struct mem_pool_stats       frame;
+	struct mem_pool_stats       stack;
+};
+typedef struct _call_pool_stats call_pool_stats_t;
+
 struct _call_frame_t {
 	call_stack_t *root;        /* stack root */
 	call_frame_t *parent;      /* previous BP */
@@ -73,6 +85,10 @@ struct _call_frame_t {
 	int32_t       ref_count;
 	gf_lock_t     lock;
 	void         *cookie;      /* unique cookie */
+
+	struct gf_fop_stats *fop_stats; /* where the call is counted, if
+					   this->fop_stats is kept */
+	struct timeval       wound_at;
 };
 
 struct _call_stack_t {
@@ -91,14 +107,48 @@ struct _call_stack_t {
 	gid_t                         gid;
 	pid_t                         pid;
 	call_frame_t                  frames;
-	dict_t                       *req_refs;
-	dict_t                       *rsp_refs;
+	struct iobref                *req_refs; /* payload of writev */
+	struct iobref                *rsp_refs; /* payload of readv_cbk */
 
 	int32_t                       op;
 	int8_t                        type;
 };
 
 
+call_pool_t *call_pool_new (void);
+void call_pool_get_stats (call_pool_t *pool, call_pool_stats_t *stats);
+void call_pool_log_stats (call_pool_t *pool);
+
+
+/* frames and stacks come out of the per-thread caches of the call
+   pool's mem_pools. pools set up by hand (without call_pool_new)
+   have no mem_pools and fall back to calloc/free */
+static inline void *
+__call_pool_get (struct mem_pool *mem_pool, size_t size)
+{
+	void *ptr = NULL;
+
+	if (!mem_pool)
+		return CALLOC (1, size);
+
+	ptr = mem_get (mem_pool);
+	if (ptr)
+		memset (ptr, 0, size);
+
+	return ptr;
+}
+
+
+static inline void
+__call_pool_put (struct mem_pool *mem_pool, void *ptr)
+{
+	if (mem_pool)
+		mem_put (mem_pool, ptr);
+	else
+		FREE (ptr);
+}
+
+
 static inline void
 FRAME_DESTROY (call_frame_t *frame)
 {
@@ -109,7 +159,7 @@ FRAME_DESTROY (call_frame_t *frame)
 	if (frame->local)
 		FREE (frame->local);
 	LOCK_DESTROY (&frame->lock);
-	FREE (frame);
+	__call_pool_put (frame->root->pool->frame_mem_pool, frame);
 }
 
 
@@ -131,19 +181,27 @@ STACK_DESTROY (call_stack_t *stack)
 	while (stack->frames.next) {
 		FRAME_DESTROY (stack->frames.next);
 	}
-	FREE (stack);
+	__call_pool_put (stack->pool->stack_mem_pool, stack);
 }
 
 
 #define cbk(x) cbk_##x
 
 
+void xlator_fop_stats_wind (call_frame_t *frame, xlator_t *xl, void *fn);
+void xlator_fop_stats_unwind (call_frame_t *frame, int32_t op_ret);
+
+/* the op_ret of STACK_UNWIND's params */
+#define __STACK_UNWIND_OP_RET(op_ret, params ...) (op_ret)
+
+
 /* make a call */
 #define STACK_WIND(frame, rfn, obj, fn, params ...)			\
 	do {								\
 		call_frame_t *_new = NULL;				\
 		                                                        \
-                _new = CALLOC (1, sizeof (call_frame_t));	        \
+		_new = __call_pool_get (frame->root->pool->frame_mem_pool, \
+					sizeof (call_frame_t));		\
 		ERR_ABORT (_new);					\
 		typeof(fn##_cbk) tmp_cbk = rfn;				\
 		_new->root = frame->root;				\
@@ -158,6 +216,9 @@ STACK_DESTROY (call_stack_t *stack)
 		_new->cookie = _new;					\
 		LOCK_INIT (&_new->lock);				\
 		frame->ref_count++;					\
+		_new->fop_stats = NULL;					\
+		if ((obj)->fop_stats)					\
+			xlator_fop_stats_wind (_new, (obj), &(fn));	\
 									\
 		fn (_new, obj, params);					\
 	} while (0)
@@ -166,8 +227,10 @@ STACK_DESTROY (call_stack_t *stack)
 /* make a call with a cookie */
 #define STACK_WIND_COOKIE(frame, rfn, cky, obj, fn, params ...)		\
 	do {								\
-		call_frame_t *_new = CALLOC (1,				\
-					     sizeof (call_frame_t));	\
+		call_frame_t *_new = NULL;				\
+									\
+		_new = __call_pool_get (frame->root->pool->frame_mem_pool, \
+					sizeof (call_frame_t));		\
 		ERR_ABORT (_new);					\
 		typeof(fn##_cbk) tmp_cbk = rfn;				\
 		_new->root = frame->root;				\
@@ -183,6 +246,9 @@ STACK_DESTROY (call_stack_t *stack)
 		LOCK_INIT (&_new->lock);				\
 		frame->ref_count++;					\
 		fn##_cbk = rfn;						\
+		_new->fop_stats = NULL;					\
+		if ((obj)->fop_stats)					\
+			xlator_fop_stats_wind (_new, (obj), &(fn));	\
 									\
 		fn (_new, obj, params);					\
 	} while (0)
@@ -193,6 +259,9 @@ STACK_DESTROY (call_stack_t *stack)
 	do {								\
 		ret_fn_t fn = frame->ret;				\
 		call_frame_t *_parent = frame->parent;			\
+		if (frame->fop_stats)					\
+			xlator_fop_stats_unwind (frame,			\
+				__STACK_UNWIND_OP_RET (params));	\
 		_parent->ref_count--;					\
 		fn (_parent, frame->cookie, _parent->this, params);	\
 	} while (0)
@@ -208,8 +277,11 @@ copy_frame (call_frame_t *frame)
 		return NULL;
 	}
 
-	newstack = (void *) CALLOC (1, sizeof (*newstack));
 	oldstack = frame->root;
+	newstack = __call_pool_get (oldstack->pool->stack_mem_pool,
+				    sizeof (*newstack));
+	if (!newstack)
+		return NULL;
 
 	newstack->uid = oldstack->uid;
 	newstack->gid = oldstack->gid;
@@ -242,7 +314,7 @@ create_frame (xlator_t *xl, call_pool_t *pool)
 		return NULL;
 	}
 
-	stack = CALLOC (1, sizeof (*stack));
+	stack = __call_pool_get (pool->stack_mem_pool, sizeof (*stack));
 	if (!stack)
 		return NULL;
 
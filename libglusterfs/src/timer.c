@@ -22,12 +22,65 @@
 #include "config.h"
 #endif
 
+#include <time.h>
+
 #include "timer.h"
 #include "logging.h"
 #include "common-utils.h"
 
 #define TS(tv) ((((unsigned long long) tv.tv_sec) * 1000000) + (tv.tv_usec))
 
+
+/* timers run off the monotonic clock, so that stepping the wall clock
+   neither stalls them nor fires them all at once */
+static inline void
+gf_timer_now (struct timeval *tv)
+{
+#if defined (HAVE_CLOCK_GETTIME) && defined (CLOCK_MONOTONIC)
+        struct timespec ts;
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        tv->tv_sec = ts.tv_sec;
+        tv->tv_usec = ts.tv_nsec / 1000;
+#else
+        gettimeofday (tv, NULL);
+#endif
+}
+
+
+static inline void
+__gf_timer_unlink (gf_timer_t *event)
+{
+        event->next->prev = event->prev;
+        event->prev->next = event->next;
+}
+
+
+static inline void
+__gf_timer_add_tail (gf_timer_t *event, gf_timer_t *head)
+{
+        event->next = head;
+        event->prev = head->prev;
+        event->next->prev = event;
+        event->prev->next = event;
+}
+
+
+/* tick at which a timer due at @at has to fire, counted from reg->base */
+static inline unsigned long long
+__gf_timer_tick (gf_timer_registry_t *reg, struct timeval *at)
+{
+        unsigned long long usec = 0;
+
+        if (TS ((*at)) <= TS (reg->base))
+                return 0;
+
+        usec = TS ((*at)) - TS (reg->base);
+
+        return (usec + GF_TIMER_TICK_USEC - 1) / GF_TIMER_TICK_USEC;
+}
+
+
 gf_timer_t *
 gf_timer_call_after (glusterfs_ctx_t *ctx,
                      struct timeval delta,
@@ -36,8 +89,7 @@ gf_timer_call_after (glusterfs_ctx_t *ctx,
 {
         gf_timer_registry_t *reg = NULL;
         gf_timer_t *event = NULL;
-        gf_timer_t *trav = NULL;
-        unsigned long long at = 0L;
+        unsigned long long tick = 0;
   
         if (ctx == NULL)
         {
@@ -57,25 +109,21 @@ gf_timer_call_after (glusterfs_ctx_t *ctx,
                 gf_log ("timer", GF_LOG_CRITICAL, "Not enough memory");
                 return NULL;
         }
-        gettimeofday (&event->at, NULL);
-        event->at.tv_usec = ((event->at.tv_usec + delta.tv_usec) % 1000000);
+        gf_timer_now (&event->at);
         event->at.tv_sec += ((event->at.tv_usec + delta.tv_usec) / 1000000);
+        event->at.tv_usec = ((event->at.tv_usec + delta.tv_usec) % 1000000);
         event->at.tv_sec += delta.tv_sec;
-        at = TS (event->at);
         event->cbk = cbk;
         event->data = data;
         pthread_mutex_lock (&reg->lock);
         {
-                trav = reg->active.prev;
-                while (trav != &reg->active) {
-                        if (TS (trav->at) < at)
-                                break;
-                        trav = trav->prev;
-                }
-                event->prev = trav;
-                event->next = event->prev->next;
-                event->prev->next = event;
-                event->next->prev = event;
+                tick = __gf_timer_tick (reg, &event->at);
+                if (tick < reg->current_tick)
+                        tick = reg->current_tick;
+
+                event->tick = tick;
+                __gf_timer_add_tail (event, 
+                                     &reg->wheel[tick % GF_TIMER_WHEEL_SIZE]);
         }
         pthread_mutex_unlock (&reg->lock);
         return event;
@@ -91,12 +139,8 @@ gf_timer_call_stale (gf_timer_registry_t *reg,
                 return 0;
         }
   
-        event->next->prev = event->prev;
-        event->prev->next = event->next;
-        event->next = &reg->stale;
-        event->prev = event->next->prev;
-        event->next->prev = event;
-        event->prev->next = event;
+        __gf_timer_unlink (event);
+        __gf_timer_add_tail (event, &reg->stale);
 
         return 0;
 }
@@ -121,8 +165,7 @@ gf_timer_call_cancel (glusterfs_ctx_t *ctx,
 
         pthread_mutex_lock (&reg->lock);
         {
-                event->next->prev = event->prev;
-                event->prev->next = event->next;
+                __gf_timer_unlink (event);
         }
         pthread_mutex_unlock (&reg->lock);
 
@@ -130,10 +173,66 @@ gf_timer_call_cancel (glusterfs_ctx_t *ctx,
         return 0;
 }
 
+
+/* fire timers of the slot of reg->current_tick which are due in this
+   lap. they are moved to a private list first, so that the slot is
+   walked only once however many of its timers belong to later laps */
+static void
+gf_timer_proc_tick (gf_timer_registry_t *reg)
+{
+        gf_timer_t  expired;
+        gf_timer_t *event = NULL;
+        gf_timer_t *next = NULL;
+        gf_timer_t *slot = NULL;
+
+        expired.next = &expired;
+        expired.prev = &expired;
+
+        pthread_mutex_lock (&reg->lock);
+        {
+                slot = &reg->wheel[reg->current_tick % GF_TIMER_WHEEL_SIZE];
+
+                for (event = slot->next; event != slot; event = next) {
+                        next = event->next;
+
+                        if (event->tick > reg->current_tick)
+                                continue;
+
+                        __gf_timer_unlink (event);
+                        __gf_timer_add_tail (event, &expired);
+                }
+
+                reg->current_tick++;
+        }
+        pthread_mutex_unlock (&reg->lock);
+
+        while (1) {
+                event = NULL;
+
+                /* a callback may cancel timers still on @expired */
+                pthread_mutex_lock (&reg->lock);
+                {
+                        if (expired.next != &expired) {
+                                event = expired.next;
+                                gf_timer_call_stale (reg, event);
+                        }
+                }
+                pthread_mutex_unlock (&reg->lock);
+
+                if (!event)
+                        break;
+
+                event->cbk (event->data);
+        }
+}
+
+
 void *
 gf_timer_proc (void *ctx)
 {
         gf_timer_registry_t *reg = NULL;
+        gf_timer_t          *event = NULL;
+        int                  i = 0;
   
         if (ctx == NULL)
         {
@@ -148,43 +247,42 @@ gf_timer_proc (void *ctx)
         }
 
         while (!reg->fin) {
-                unsigned long long now;
                 struct timeval now_tv;
-                gf_timer_t *event = NULL;
-
-                gettimeofday (&now_tv, NULL);
-                now = TS (now_tv);
-                while (1) {
-                        unsigned long long at;
-                        char need_cbk = 0;
-
-                        pthread_mutex_lock (&reg->lock);
-                        {
-                                event = reg->active.next;
-                                at = TS (event->at);
-                                if (event != &reg->active && now >= at) {
-                                        need_cbk = 1;
-                                        gf_timer_call_stale (reg, event);
-                                }
-                        }
-                        pthread_mutex_unlock (&reg->lock);
-                        if (need_cbk)
-                                event->cbk (event->data);
+                unsigned long long now_tick = 0;
+                unsigned long long next_usec = 0;
 
-                        else
-                                break;
-                }
-                usleep (1000000);
+                gf_timer_now (&now_tv);
+                if (TS (now_tv) > TS (reg->base))
+                        now_tick = (TS (now_tv) - TS (reg->base)) 
+                                / GF_TIMER_TICK_USEC;
+
+                while (reg->current_tick <= now_tick)
+                        gf_timer_proc_tick (reg);
+
+                /* sleep till the start of the next tick */
+                gf_timer_now (&now_tv);
+                next_usec = TS (reg->base) 
+                        + (reg->current_tick * GF_TIMER_TICK_USEC);
+                if (next_usec > TS (now_tv) + GF_TIMER_TICK_USEC)
+                        next_usec = TS (now_tv) + GF_TIMER_TICK_USEC;
+                if (next_usec > TS (now_tv))
+                        usleep (next_usec - TS (now_tv));
         }
 
         pthread_mutex_lock (&reg->lock);
         {
-                while (reg->active.next != &reg->active) {
-                        gf_timer_call_cancel (ctx, reg->active.next);
+                for (i = 0; i < GF_TIMER_WHEEL_SIZE; i++) {
+                        while (reg->wheel[i].next != &reg->wheel[i]) {
+                                event = reg->wheel[i].next;
+                                __gf_timer_unlink (event);
+                                FREE (event);
+                        }
                 }
 
                 while (reg->stale.next != &reg->stale) {
-                        gf_timer_call_cancel (ctx, reg->stale.next);
+                        event = reg->stale.next;
+                        __gf_timer_unlink (event);
+                        FREE (event);
                 }
         }
         pthread_mutex_unlock (&reg->lock);
@@ -197,6 +295,8 @@ gf_timer_proc (void *ctx)
 gf_timer_registry_t *
 gf_timer_registry_init (glusterfs_ctx_t *ctx)
 {
+        int i = 0;
+
         if (ctx == NULL)
         {
                 gf_log ("timer", GF_LOG_ERROR, "invalid argument");
@@ -209,11 +309,17 @@ gf_timer_registry_init (glusterfs_ctx_t *ctx)
                 ctx->timer = reg = CALLOC (1, sizeof (*reg));
                 ERR_ABORT (reg);
                 pthread_mutex_init (&reg->lock, NULL);
-                reg->active.next = &reg->active;
-                reg->active.prev = &reg->active;
                 reg->stale.next = &reg->stale;
                 reg->stale.prev = &reg->stale;
 
+                for (i = 0; i < GF_TIMER_WHEEL_SIZE; i++) {
+                        reg->wheel[i].next = &reg->wheel[i];
+                        reg->wheel[i].prev = &reg->wheel[i];
+                }
+
+                gf_timer_now (&reg->base);
+                reg->current_tick = 0;
+
                 pthread_create (&reg->th, NULL, gf_timer_proc, ctx);
         }
         return ctx->timer;
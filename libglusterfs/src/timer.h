@@ -31,19 +31,28 @@
 
 typedef void (*gf_timer_cbk_t) (void *);
 
+/* timers are kept in a hashed wheel of GF_TIMER_WHEEL_SIZE slots, one
+   slot per tick of GF_TIMER_TICK_USEC. a timer due in more than one
+   lap of the wheel stays in its slot until the lap it expires in */
+#define GF_TIMER_TICK_USEC    100000
+#define GF_TIMER_WHEEL_SIZE   1024
+
 struct _gf_timer {
   struct _gf_timer *next, *prev;
-  struct timeval at;
+  struct timeval at;                  /* on the monotonic clock */
   gf_timer_cbk_t cbk;
   void *data;
+  unsigned long long tick;
 };
 
 struct _gf_timer_registry {
   pthread_t th;
   char fin;
   struct _gf_timer stale;
-  struct _gf_timer active;
   pthread_mutex_t lock;
+  struct timeval base;
+  unsigned long long current_tick;
+  struct _gf_timer wheel[GF_TIMER_WHEEL_SIZE];
 };
 
 typedef struct _gf_timer gf_timer_t;
@@ -33,6 +33,7 @@ typedef struct transport transport_t;
 #include "xlator.h"
 #include "dict.h"
 #include "compat.h"
+#include "iobuf.h"
 
 typedef struct peer_info {
 	struct sockaddr_storage sockaddr;
@@ -57,11 +58,16 @@ struct transport {
 	peer_info_t     myinfo;
 };
 
+/* receive hands over a ref on the payload iobuf (if any) to the caller.
+   the header stays owned by the transport and is valid only until the
+   next message is read from it, i.e. for the duration of the POLLIN
+   notification. */
 struct transport_ops {
 	int32_t (*receive)    (transport_t *this, char **hdr_p, size_t *hdrlen_p,
-			   char **buf_p, size_t *buflen_p);
+			   struct iobuf **iobuf_p, size_t *buflen_p);
 	int32_t (*submit)     (transport_t *this, char *buf, int len,
-			   struct iovec *vector, int count, dict_t *refs);
+			   struct iovec *vector, int count,
+			   struct iobref *iobref);
 	int32_t (*connect)    (transport_t *this);
 	int32_t (*listen)     (transport_t *this);
 	int32_t (*disconnect) (transport_t *this);
@@ -73,9 +79,10 @@ int32_t transport_connect    (transport_t *this);
 int32_t transport_disconnect (transport_t *this);
 int32_t transport_notify     (transport_t *this, int event);
 int32_t transport_submit     (transport_t *this, char *buf, int len,
-			  struct iovec *vector, int count, dict_t *refs);
+			  struct iovec *vector, int count,
+			  struct iobref *iobref);
 int32_t transport_receive    (transport_t *this, char **hdr_p, size_t *hdrlen_p,
-			  char **buf_p, size_t *buflen_p);
+			  struct iobuf **iobuf_p, size_t *buflen_p);
 int32_t transport_destroy    (transport_t *this);
 
 transport_t *transport_load  (dict_t *options, xlator_t *xl);
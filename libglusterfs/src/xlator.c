@@ -26,6 +26,8 @@
 #include <dlfcn.h>
 #include <netdb.h>
 #include <fnmatch.h>
+#include <stddef.h>
+#include <sys/time.h>
 #include "defaults.h"
 
 
@@ -53,6 +55,12 @@ fill_defaults (xlator_t *xl)
 		return;
 	}
 
+	/* an xlator with a readdir of its own but no readdirp would have
+	   readdirp skip it, answer it with its readdir instead (entries
+	   without attributes) */
+	if (!xl->fops->readdirp && xl->fops->readdir)
+		xl->fops->readdirp = default_readdirp_readdir;
+
 	SET_DEFAULT_FOP (create);
 	SET_DEFAULT_FOP (open);
 	SET_DEFAULT_FOP (stat);
@@ -95,6 +103,7 @@ fill_defaults (xlator_t *xl)
 	SET_DEFAULT_FOP (checksum);
 	SET_DEFAULT_FOP (xattrop);
 	SET_DEFAULT_FOP (fxattrop);
+	SET_DEFAULT_FOP (readdirp);
 
 	SET_DEFAULT_MOP (stats);
 
@@ -726,3 +735,375 @@ loc_copy (loc_t *dst, loc_t *src)
 out:
 	return ret;
 }
+
+
+/* the fop a STACK_WIND makes, by the slot of the callee's fops or mops
+   it takes the function from */
+static int fop_slot_op[sizeof (struct xlator_fops) / sizeof (void *)];
+static int mop_slot_op[sizeof (struct xlator_mops) / sizeof (void *)];
+
+#define FOP_SLOT(fn) (offsetof (struct xlator_fops, fn) / sizeof (void *))
+#define MOP_SLOT(fn) (offsetof (struct xlator_mops, fn) / sizeof (void *))
+
+#if !HAVE_SYNC_BUILTINS
+static pthread_mutex_t fop_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+static void
+fop_slots_init (void)
+{
+	static int done = 0;
+	int        i = 0;
+
+	if (done)
+		return;
+
+	for (i = 0; i < sizeof (fop_slot_op) / sizeof (int); i++)
+		fop_slot_op[i] = -1;
+	for (i = 0; i < sizeof (mop_slot_op) / sizeof (int); i++)
+		mop_slot_op[i] = -1;
+
+	fop_slot_op[FOP_SLOT (lookup)]      = GF_FOP_LOOKUP;
+	fop_slot_op[FOP_SLOT (stat)]        = GF_FOP_STAT;
+	fop_slot_op[FOP_SLOT (fstat)]       = GF_FOP_FSTAT;
+	fop_slot_op[FOP_SLOT (chmod)]       = GF_FOP_CHMOD;
+	fop_slot_op[FOP_SLOT (fchmod)]      = GF_FOP_FCHMOD;
+	fop_slot_op[FOP_SLOT (chown)]       = GF_FOP_CHOWN;
+	fop_slot_op[FOP_SLOT (fchown)]      = GF_FOP_FCHOWN;
+	fop_slot_op[FOP_SLOT (truncate)]    = GF_FOP_TRUNCATE;
+	fop_slot_op[FOP_SLOT (ftruncate)]   = GF_FOP_FTRUNCATE;
+	fop_slot_op[FOP_SLOT (utimens)]     = GF_FOP_UTIMENS;
+	fop_slot_op[FOP_SLOT (access)]      = GF_FOP_ACCESS;
+	fop_slot_op[FOP_SLOT (readlink)]    = GF_FOP_READLINK;
+	fop_slot_op[FOP_SLOT (mknod)]       = GF_FOP_MKNOD;
+	fop_slot_op[FOP_SLOT (mkdir)]       = GF_FOP_MKDIR;
+	fop_slot_op[FOP_SLOT (unlink)]      = GF_FOP_UNLINK;
+	fop_slot_op[FOP_SLOT (rmdir)]       = GF_FOP_RMDIR;
+	fop_slot_op[FOP_SLOT (symlink)]     = GF_FOP_SYMLINK;
+	fop_slot_op[FOP_SLOT (rename)]      = GF_FOP_RENAME;
+	fop_slot_op[FOP_SLOT (link)]        = GF_FOP_LINK;
+	fop_slot_op[FOP_SLOT (create)]      = GF_FOP_CREATE;
+	fop_slot_op[FOP_SLOT (open)]        = GF_FOP_OPEN;
+	fop_slot_op[FOP_SLOT (readv)]       = GF_FOP_READ;
+	fop_slot_op[FOP_SLOT (writev)]      = GF_FOP_WRITE;
+	fop_slot_op[FOP_SLOT (flush)]       = GF_FOP_FLUSH;
+	fop_slot_op[FOP_SLOT (fsync)]       = GF_FOP_FSYNC;
+	fop_slot_op[FOP_SLOT (opendir)]     = GF_FOP_OPENDIR;
+	fop_slot_op[FOP_SLOT (readdir)]     = GF_FOP_READDIR;
+	fop_slot_op[FOP_SLOT (fsyncdir)]    = GF_FOP_FSYNCDIR;
+	fop_slot_op[FOP_SLOT (statfs)]      = GF_FOP_STATFS;
+	fop_slot_op[FOP_SLOT (setxattr)]    = GF_FOP_SETXATTR;
+	fop_slot_op[FOP_SLOT (getxattr)]    = GF_FOP_GETXATTR;
+	fop_slot_op[FOP_SLOT (removexattr)] = GF_FOP_REMOVEXATTR;
+	fop_slot_op[FOP_SLOT (lk)]          = GF_FOP_LK;
+	fop_slot_op[FOP_SLOT (inodelk)]     = GF_FOP_INODELK;
+	fop_slot_op[FOP_SLOT (finodelk)]    = GF_FOP_FINODELK;
+	fop_slot_op[FOP_SLOT (entrylk)]     = GF_FOP_ENTRYLK;
+	fop_slot_op[FOP_SLOT (fentrylk)]    = GF_FOP_FENTRYLK;
+	fop_slot_op[FOP_SLOT (setdents)]    = GF_FOP_SETDENTS;
+	fop_slot_op[FOP_SLOT (getdents)]    = GF_FOP_GETDENTS;
+	fop_slot_op[FOP_SLOT (checksum)]    = GF_FOP_CHECKSUM;
+	fop_slot_op[FOP_SLOT (xattrop)]     = GF_FOP_XATTROP;
+	fop_slot_op[FOP_SLOT (fxattrop)]    = GF_FOP_FXATTROP;
+	fop_slot_op[FOP_SLOT (readdirp)]    = GF_FOP_READDIRP;
+
+	mop_slot_op[MOP_SLOT (stats)]   = GF_FOP_MAXVALUE + GF_MOP_STATS;
+	mop_slot_op[MOP_SLOT (getspec)] = GF_FOP_MAXVALUE + GF_MOP_GETSPEC;
+
+	done = 1;
+}
+
+
+/* keep fop_stats for every xlator of the graph. to be called before the
+   graph is initialized */
+int
+xlator_fop_stats_enable (xlator_t *xl)
+{
+	xlator_t *trav = NULL;
+
+	fop_slots_init ();
+
+	trav = xl;
+	while (trav->prev)
+		trav = trav->prev;
+
+	while (trav) {
+		if (!trav->fop_stats) {
+			trav->fop_stats = CALLOC (GF_FOP_STATS_COUNT,
+						  sizeof (gf_fop_stats_t));
+			if (!trav->fop_stats) {
+				gf_log (trav->name, GF_LOG_ERROR,
+					"out of memory");
+				return -1;
+			}
+		}
+		trav = trav->next;
+	}
+
+	return 0;
+}
+
+
+void
+xlator_fop_stats_wind (call_frame_t *frame, xlator_t *xl, void *fn)
+{
+	gf_fop_stats_t *stats = NULL;
+	char           *slot = fn;
+	int             op = -1;
+
+	if (slot >= (char *)xl->fops
+	    && slot < (char *)xl->fops + sizeof (*xl->fops))
+		op = fop_slot_op[(slot - (char *)xl->fops) / sizeof (void *)];
+	else if (slot >= (char *)xl->mops
+		 && slot < (char *)xl->mops + sizeof (*xl->mops))
+		op = mop_slot_op[(slot - (char *)xl->mops) / sizeof (void *)];
+
+	/* a fop taken from another xlator's table */
+	if (op < 0)
+		return;
+
+	stats = &xl->fop_stats[op];
+
+#if HAVE_SYNC_BUILTINS
+	__sync_fetch_and_add (&stats->inflight, 1);
+#else
+	pthread_mutex_lock (&fop_stats_mutex);
+	stats->inflight++;
+	pthread_mutex_unlock (&fop_stats_mutex);
+#endif
+
+	gettimeofday (&frame->wound_at, NULL);
+	frame->fop_stats = stats;
+}
+
+
+void
+xlator_fop_stats_unwind (call_frame_t *frame, int32_t op_ret)
+{
+	gf_fop_stats_t *stats = frame->fop_stats;
+	struct timeval  now = {0, };
+	int64_t         usec = 0;
+	uint64_t        max = 0;
+	int             bucket = 0;
+
+	gettimeofday (&now, NULL);
+	usec = (now.tv_sec - frame->wound_at.tv_sec) * 1000000LL
+		+ (now.tv_usec - frame->wound_at.tv_usec);
+	if (usec < 0)
+		usec = 0;
+
+	while (bucket < GF_FOP_STATS_BUCKETS - 1
+	       && usec >= (1LL << bucket))
+		bucket++;
+
+#if HAVE_SYNC_BUILTINS
+	__sync_fetch_and_add (&stats->calls, 1);
+	if (op_ret < 0)
+		__sync_fetch_and_add (&stats->errors, 1);
+	__sync_fetch_and_sub (&stats->inflight, 1);
+	__sync_fetch_and_add (&stats->total_usec, usec);
+	__sync_fetch_and_add (&stats->hist[bucket], 1);
+
+	max = stats->max_usec;
+	while (usec > max) {
+		max = __sync_val_compare_and_swap (&stats->max_usec, max,
+						   usec);
+	}
+#else
+	pthread_mutex_lock (&fop_stats_mutex);
+	{
+		stats->calls++;
+		if (op_ret < 0)
+			stats->errors++;
+		stats->inflight--;
+		stats->total_usec += usec;
+		stats->hist[bucket]++;
+		if (usec > stats->max_usec)
+			stats->max_usec = usec;
+	}
+	pthread_mutex_unlock (&fop_stats_mutex);
+#endif
+
+	frame->fop_stats = NULL;
+}
+
+
+static int
+fop_stats_line (xlator_t *xl, int op, char *buf, size_t size)
+{
+	gf_fop_stats_t *stats = &xl->fop_stats[op];
+	const char     *name = NULL;
+	uint64_t        calls = 0;
+	size_t          len = 0;
+	int             i = 0;
+
+	if (op < GF_FOP_MAXVALUE)
+		name = gf_fop_list[op];
+	else
+		name = gf_mop_list[op - GF_FOP_MAXVALUE];
+
+	calls = stats->calls;
+
+	len = snprintf (buf, size, "%s %s: calls %"PRIu64" errors %"PRIu64
+			" inflight %"PRId64" avg %"PRIu64"us max %"PRIu64"us",
+			xl->name, name ? name : "?", calls, stats->errors,
+			stats->inflight,
+			calls ? stats->total_usec / calls : 0,
+			stats->max_usec);
+
+	for (i = 0; i < GF_FOP_STATS_BUCKETS && len < size; i++) {
+		if (!stats->hist[i])
+			continue;
+
+		if (i < GF_FOP_STATS_BUCKETS - 1)
+			len += snprintf (buf + len, size - len,
+					 " <%"PRIu64"us:%"PRIu64,
+					 (uint64_t)1 << i, stats->hist[i]);
+		else
+			len += snprintf (buf + len, size - len,
+					 " >=%"PRIu64"us:%"PRIu64,
+					 (uint64_t)1 << (i - 1),
+					 stats->hist[i]);
+	}
+
+	return (len < size) ? len : size - 1;
+}
+
+
+/* the fop_stats of the graph of xl, a line per fop called, into buf.
+   returns the length written, -1 when the graph keeps no fop_stats */
+int
+xlator_fop_stats_dump (xlator_t *xl, char *buf, size_t size)
+{
+	xlator_t *trav = NULL;
+	size_t    len = 0;
+	int       op = 0;
+	int       kept = 0;
+
+	if (!size)
+		return 0;
+	buf[0] = '\0';
+
+	trav = xl;
+	while (trav->prev)
+		trav = trav->prev;
+
+	for (; trav && len < size - 1; trav = trav->next) {
+		if (!trav->fop_stats)
+			continue;
+		kept = 1;
+
+		for (op = 0; op < GF_FOP_STATS_COUNT && len < size - 1; op++) {
+			if (!trav->fop_stats[op].calls
+			    && !trav->fop_stats[op].inflight)
+				continue;
+
+			len += fop_stats_line (trav, op, buf + len,
+					       size - len);
+			if (len < size - 1)
+				buf[len++] = '\n';
+			buf[len] = '\0';
+		}
+	}
+
+	if (!kept)
+		return -1;
+
+	return len;
+}
+
+
+/* from the SIGUSR1 thread, not the handler. the lines of each xlator
+   are flushed before the next one's, a graph's worth would overflow the
+   log ring of the thread and lose all but errors. */
+void
+xlator_fop_stats_log (xlator_t *xl)
+{
+	xlator_t *trav = NULL;
+	char      line[1024];
+	int       op = 0;
+
+	trav = xl;
+	while (trav->prev)
+		trav = trav->prev;
+
+	for (; trav; trav = trav->next) {
+		if (!trav->fop_stats)
+			continue;
+
+		for (op = 0; op < GF_FOP_STATS_COUNT; op++) {
+			if (!trav->fop_stats[op].calls
+			    && !trav->fop_stats[op].inflight)
+				continue;
+
+			fop_stats_line (trav, op, line, sizeof (line));
+			gf_log ("stats", GF_LOG_NORMAL, "%s", line);
+		}
+
+		gf_log_flush ();
+	}
+}
+
+
+/* unwind the getxattr of name, which starts with prefix, with the value
+   of the counter it names */
+int32_t
+xlator_counters_getxattr (call_frame_t *frame, const char *prefix,
+			  const char *name, xlator_counter_t *counters)
+{
+	dict_t  *dict = NULL;
+	int32_t  op_errno = ENODATA;
+	const char *key = NULL;
+
+	key = name + strlen (prefix);
+
+	for (; counters->name; counters++) {
+		if (!strcmp (key, counters->name))
+			break;
+	}
+
+	if (!counters->name)
+		goto err;
+
+	dict = dict_new ();
+	if (!dict) {
+		op_errno = ENOMEM;
+		goto err;
+	}
+
+	if (dict_set_uint64 (dict, (char *) name, counters->value) != 0) {
+		op_errno = ENOMEM;
+		goto err;
+	}
+
+	STACK_UNWIND (frame, 0, 0, dict);
+	dict_unref (dict);
+	return 0;
+
+err:
+	if (dict)
+		dict_unref (dict);
+	STACK_UNWIND (frame, -1, op_errno, NULL);
+	return 0;
+}
+
+
+void
+xlator_counters_log (xlator_t *xl, xlator_counter_t *counters)
+{
+	char line[1024];
+	int  len = 0;
+
+	line[0] = '\0';
+
+	for (; counters->name; counters++) {
+		len += snprintf (line + len, sizeof (line) - len,
+				 "%s%s %"PRIu64, (len ? ", " : ""),
+				 counters->name, counters->value);
+		if (len >= (int) sizeof (line))
+			break;
+	}
+
+	gf_log (xl->name, GF_LOG_DEBUG, "%s", line);
+}
@@ -402,6 +402,13 @@ typedef int32_t (*fop_readdir_cbk_t) (call_frame_t *frame,
 				      int32_t op_errno,
 				      gf_dirent_t *entries);
 
+typedef int32_t (*fop_readdirp_cbk_t) (call_frame_t *frame,
+				       void *cookie,
+				       xlator_t *this,
+				       int32_t op_ret,
+				       int32_t op_errno,
+				       gf_dirent_t *entries);
+
 typedef int32_t (*fop_xattrop_cbk_t) (call_frame_t *frame,
 				      void *cookie,
 				      xlator_t *this,
@@ -623,6 +630,12 @@ typedef int32_t (*fop_readdir_t) (call_frame_t *frame,
 				  size_t size,
 				  off_t offset);
 
+typedef int32_t (*fop_readdirp_t) (call_frame_t *frame,
+				   xlator_t *this,
+				   fd_t *fd,
+				   size_t size,
+				   off_t offset);
+
 typedef int32_t (*fop_xattrop_t) (call_frame_t *frame,
 				  xlator_t *this,
 				  loc_t *loc,
@@ -678,6 +691,7 @@ struct xlator_fops {
 	fop_checksum_t       checksum;
 	fop_xattrop_t        xattrop;
 	fop_fxattrop_t        fxattrop;
+	fop_readdirp_t       readdirp;
 
 	/* these entries are used for a typechecking hack in STACK_WIND _only_ */
 	fop_lookup_cbk_t         lookup_cbk;
@@ -722,6 +736,7 @@ struct xlator_fops {
 	fop_checksum_cbk_t       checksum_cbk;
 	fop_xattrop_cbk_t        xattrop_cbk;
 	fop_fxattrop_cbk_t       fxattrop_cbk;
+	fop_readdirp_cbk_t       readdirp_cbk;
 };
 
 typedef int32_t (*cbk_forget_t) (xlator_t *this,
@@ -775,6 +790,29 @@ typedef struct vol_opt_list {
 	volume_option_t  *given_opt;
 } volume_opt_list_t;
 
+#define GF_FOP_STATS_BUCKETS 32
+
+/* counts of the calls wound to an xlator, per fop (GF_FOP_*, then
+   GF_FOP_MAXVALUE + GF_MOP_*). latencies are in microseconds, from the
+   STACK_WIND into the xlator to its STACK_UNWIND */
+typedef struct gf_fop_stats {
+	uint64_t calls;
+	uint64_t errors;                /* unwound with op_ret < 0 */
+	int64_t  inflight;
+	uint64_t total_usec;
+	uint64_t max_usec;
+	uint64_t hist[GF_FOP_STATS_BUCKETS]; /* hist[i]: under 2^i usec */
+} gf_fop_stats_t;
+
+#define GF_FOP_STATS_COUNT (GF_FOP_MAXVALUE + GF_MOP_MAXVALUE)
+
+/* a counter of an xlator, read as the xattr <prefix><name> through
+   xlator_counters_getxattr. arrays of them end with a NULL name. */
+typedef struct xlator_counter {
+	const char *name;
+	uint64_t    value;
+} xlator_counter_t;
+
 struct _xlator {
 	/* Built during parsing */
 	char          *name;
@@ -802,6 +840,8 @@ struct _xlator {
 	char              trace;
 	char              init_succeeded;
 	void             *private;
+	gf_fop_stats_t   *fop_stats;   /* GF_FOP_STATS_COUNT of them, kept
+					  after xlator_fop_stats_enable */
 };
 
 int validate_xlator_volume_options (xlator_t *xl, volume_option_t *opt);
@@ -826,6 +866,14 @@ xlator_t *xlator_search_by_name (xlator_t *any, const char *name);
 
 void inode_destroy_notify (inode_t *inode, const char *xlname);
 
+int xlator_fop_stats_enable (xlator_t *xl);
+int xlator_fop_stats_dump (xlator_t *xl, char *buf, size_t size);
+void xlator_fop_stats_log (xlator_t *xl);
+
+int32_t xlator_counters_getxattr (call_frame_t *frame, const char *prefix,
+				  const char *name, xlator_counter_t *counters);
+void xlator_counters_log (xlator_t *xl, xlator_counter_t *counters);
+
 int loc_copy (loc_t *dst, loc_t *src);
 #define loc_dup(src, dst) loc_copy(dst, src)
 void loc_wipe (loc_t *loc);
@@ -112,11 +112,11 @@ typedef struct {
                 call_frame_t *frame = get_call_frame_for_req (ctx, 1);  \
                 xlator_t *xl = frame->this->children ?                  \
                         frame->this->children->xlator : NULL;           \
-                dict_t *refs = frame->root->req_refs;                   \
+                struct iobref *refs = frame->root->req_refs;            \
                 frame->root->state = ctx;                               \
                 frame->local = local;                                   \
                 STACK_WIND (frame, ret_fn, xl, xl->fops->op, args);     \
-                dict_unref (refs);                                      \
+                iobref_unref (refs);                                    \
         } while (0)
 
 #define LIBGF_CLIENT_FOP(ctx, stub, op, local, args ...)                \
@@ -124,7 +124,7 @@ typedef struct {
                 call_frame_t *frame = get_call_frame_for_req (ctx, 1);  \
                 xlator_t *xl = frame->this->children ?                  \
                         frame->this->children->xlator : NULL;           \
-                dict_t *refs = frame->root->req_refs;                   \
+                struct iobref *refs = frame->root->req_refs;            \
                 if (!local) {                                           \
                         local = CALLOC (1, sizeof (*local));            \
                 }                                                       \
@@ -134,7 +134,7 @@ typedef struct {
                 pthread_cond_init (&local->reply_cond, NULL);           \
                 pthread_mutex_init (&local->lock, NULL);                \
                 LIBGF_STACK_WIND_AND_WAIT (frame, libgf_client_##op##_cbk, xl, xl->fops->op, args); \
-                dict_unref (refs);                                      \
+                iobref_unref (refs);                                    \
                 stub = local->reply_stub;                               \
                 FREE (frame->local);                                    \
                 frame->local = NULL;                                    \
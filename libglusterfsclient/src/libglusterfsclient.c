@@ -315,7 +315,7 @@ get_call_frame_for_req (libglusterfs_client_ctx_t *ctx, char d)
         frame->root->unique = ctx->counter++;
   
         if (d) {
-                frame->root->req_refs = dict_ref (get_new_dict ());
+                frame->root->req_refs = iobref_new ();
                 /*
                   TODO
                   dict_set (frame->root->req_refs, NULL, priv->buf);
@@ -398,15 +398,20 @@ glusterfs_init (glusterfs_init_ctx_t *init_ctx)
 
         pthread_mutex_init (&ctx->gf_ctx.lock, NULL);
   
-        pool = ctx->gf_ctx.pool = CALLOC (1, sizeof (call_pool_t));
+        pool = ctx->gf_ctx.pool = call_pool_new ();
         if (!pool) {
                 errno = ENOMEM;
                 FREE (ctx);
                 return NULL;
         }
 
-        LOCK_INIT (&pool->lock);
-        INIT_LIST_HEAD (&pool->all_frames);
+        ctx->gf_ctx.iobuf_pool = iobuf_pool_new (GF_IOBUF_ARENA_SIZE,
+                                                 GF_IOBUF_PAGE_SIZE);
+        if (!ctx->gf_ctx.iobuf_pool) {
+                errno = ENOMEM;
+                FREE (ctx);
+                return NULL;
+        }
 
         ctx->gf_ctx.event_pool = event_pool_new (16384);
 
@@ -2554,7 +2559,7 @@ libglusterfs_readv_async_cbk (call_frame_t *frame,
         buf->op_errno = op_errno;
 
 	if (frame->root->rsp_refs) {
-		buf->ref = dict_ref (frame->root->rsp_refs);
+		buf->ref = iobref_ref (frame->root->rsp_refs);
 	}
 
         if (op_ret > 0) {
@@ -2585,7 +2590,7 @@ glusterfs_free (glusterfs_read_buf_t *buf)
 {
         //iov_free (buf->vector, buf->count);
         FREE (buf->vector);
-        dict_unref ((dict_t *) buf->ref);
+        iobref_unref ((struct iobref *) buf->ref);
         FREE (buf);
 }
 
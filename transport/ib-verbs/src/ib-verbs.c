@@ -176,8 +176,8 @@ static void
 __ib_verbs_ioq_entry_free (ib_verbs_ioq_t *entry)
 {
         list_del_init (&entry->list);
-        if (entry->refs)
-                dict_unref (entry->refs);
+        if (entry->iobref)
+                iobref_unref (entry->iobref);
 
         /* TODO: use mem-pool */
         free (entry->buf);
@@ -414,7 +414,7 @@ unlock:
 
 static ib_verbs_ioq_t *
 ib_verbs_ioq_new (char *buf, int len, struct iovec *vector, 
-                  int count, dict_t *refs)
+                  int count, struct iobref *iobref)
 {
         ib_verbs_ioq_t *entry = NULL;
 
@@ -444,8 +444,8 @@ ib_verbs_ioq_new (char *buf, int len, struct iovec *vector,
                 entry->count += count;
         }
 
-        if (refs)
-                entry->refs = dict_ref (refs);
+        if (iobref)
+                entry->iobref = iobref_ref (iobref);
 
         entry->buf = buf;
 
@@ -457,12 +457,12 @@ ib_verbs_ioq_new (char *buf, int len, struct iovec *vector,
 
 static int32_t
 ib_verbs_submit (transport_t *this, char *buf, int32_t len,
-                 struct iovec *vector, int count, dict_t *refs)
+                 struct iovec *vector, int count, struct iobref *iobref)
 {
         int32_t ret = 0;
         ib_verbs_ioq_t *entry = NULL;
   
-        entry = ib_verbs_ioq_new (buf, len, vector, count, refs);
+        entry = ib_verbs_ioq_new (buf, len, vector, count, iobref);
         ret = ib_verbs_writev (this, entry);
 
         if (ret > 0) {
@@ -474,7 +474,7 @@ ib_verbs_submit (transport_t *this, char *buf, int32_t len,
 
 static int
 ib_verbs_receive (transport_t *this, char **hdr_p, size_t *hdrlen_p,
-                  char **buf_p, size_t *buflen_p)
+                  struct iobuf **iobuf_p, size_t *buflen_p)
 {
         ib_verbs_private_t *priv = this->private;
         /* TODO: return error if !priv->connected, check with locks */
@@ -482,7 +482,8 @@ ib_verbs_receive (transport_t *this, char **hdr_p, size_t *hdrlen_p,
         char *copy_from = NULL;
         ib_verbs_header_t *header = NULL;
         uint32_t size1, size2, data_len = 0;
-        char *hdr = NULL, *buf = NULL;
+        char *hdr = NULL;
+        struct iobuf *iobuf = NULL;
         int32_t ret = 0;
 
         pthread_mutex_lock (&priv->recv_mutex);
@@ -523,7 +524,19 @@ ib_verbs_receive (transport_t *this, char **hdr_p, size_t *hdrlen_p,
         copy_from += sizeof (*header);
 
         if (size1) {
-                hdr = CALLOC (1, size1);
+                if (size1 > priv->hdr_buf_size) {
+                        hdr = realloc (priv->hdr_buf, size1);
+                        if (!hdr) {
+                                gf_log ("transport/ib-verbs", GF_LOG_ERROR,
+                                        "%s: unable to allocate header of "
+                                        "%d bytes", this->xl->name, size1);
+                                ret = -1;
+                                goto err;
+                        }
+                        priv->hdr_buf = hdr;
+                        priv->hdr_buf_size = size1;
+                }
+                hdr = priv->hdr_buf;
                 memcpy (hdr, copy_from, size1);
                 copy_from += size1;
                 *hdr_p = hdr;
@@ -531,9 +544,16 @@ ib_verbs_receive (transport_t *this, char **hdr_p, size_t *hdrlen_p,
         *hdrlen_p = size1;
 
         if (size2) {
-                buf = CALLOC (1, size2);
-                memcpy (buf, copy_from, size2);
-                *buf_p = buf;
+                iobuf = iobuf_get2 (this->xl->ctx->iobuf_pool, size2);
+                if (!iobuf) {
+                        gf_log ("transport/ib-verbs", GF_LOG_ERROR,
+                                "%s: unable to allocate iobuf of %d bytes",
+                                this->xl->name, size2);
+                        ret = -1;
+                        goto err;
+                }
+                memcpy (iobuf_ptr (iobuf), copy_from, size2);
+                *iobuf_p = iobuf;
         }
         *buflen_p = size2;
 
@@ -2326,6 +2346,7 @@ fini (struct transport *this)
         gf_log (this->xl->name, GF_LOG_CRITICAL,
                 "called fini on transport: %p",
                 this);
+        FREE (priv->hdr_buf);
         free (priv);
         return;
 }
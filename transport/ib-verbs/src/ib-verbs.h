@@ -70,7 +70,7 @@ struct _ib_verbs_ioq {
         struct iovec       vector[MAX_IOVEC];
         int                count;
         char              *buf;
-        dict_t            *refs;
+        struct iobref     *iobref;
 };
 typedef struct _ib_verbs_ioq ib_verbs_ioq_t;
 
@@ -192,6 +192,10 @@ struct _ib_verbs_private {
         int32_t data_offset;
         int32_t data_len;
 
+        /* headers handed out by receive, reused for every message */
+        char *hdr_buf;
+        size_t hdr_buf_size;
+
         /* Mutex */
         pthread_mutex_t read_mutex;
         pthread_mutex_t write_mutex;
@@ -35,6 +35,7 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
 
 
 #define GF_LOG_ERRNO(errno) ((errno == ENOTCONN) ? GF_LOG_DEBUG : GF_LOG_ERROR)
@@ -69,6 +70,7 @@ __socket_rwv (transport_t *this, struct iovec *vector, int count,
 
         while (opcount) {
                 if (write) {
+                        priv->stats.writev_count++;
                         ret = writev (sock, opvector, opcount);
 
                         if (ret == 0 || (ret == -1 && errno == EAGAIN)) {
@@ -254,13 +256,11 @@ __socket_reset (transport_t *this)
 
         priv = this->private;
 
-        /* TODO: use mem-pool on incoming data */
+        /* incoming.hdr_p points into cache.hdr_buf, which is kept
+           for the lifetime of the transport */
 
-        if (priv->incoming.hdr_p)
-                free (priv->incoming.hdr_p);
-
-        if (priv->incoming.buf_p)
-                free (priv->incoming.buf_p);
+        if (priv->incoming.iobuf)
+                iobuf_unref (priv->incoming.iobuf);
 
         memset (&priv->incoming, 0, sizeof (priv->incoming));
 
@@ -274,15 +274,29 @@ __socket_reset (transport_t *this)
 
 struct ioq *
 __socket_ioq_new (transport_t *this, char *buf, int len,
-                  struct iovec *vector, int count, dict_t *refs)
+                  struct iovec *vector, int count, struct iobref *iobref)
 {
         socket_private_t *priv = NULL;
         struct ioq       *entry = NULL;
 
         priv = this->private;
 
-        /* TODO: use mem-pool */
-        entry = CALLOC (1, sizeof (*entry));
+        priv->stats.ioq_alloc++;
+
+        if (priv->cache.ioq_free_count) {
+                entry = list_entry (priv->cache.ioq_free.next,
+                                    struct ioq, list);
+                list_del (&entry->list);
+                priv->cache.ioq_free_count--;
+
+                memset (entry, 0, sizeof (*entry));
+        } else {
+                priv->stats.ioq_miss++;
+
+                entry = CALLOC (1, sizeof (*entry));
+                if (!entry)
+                        return NULL;
+        }
 
         assert (count <= (MAX_IOVEC-2));
 
@@ -309,8 +323,8 @@ __socket_ioq_new (transport_t *this, char *buf, int len,
         entry->pending_vector = entry->vector;
         entry->pending_count  = entry->count;
 
-        if (refs)
-                entry->refs = dict_ref (refs);
+        if (iobref)
+                entry->iobref = iobref_ref (iobref);
 
         entry->buf = buf;
 
@@ -321,16 +335,25 @@ __socket_ioq_new (transport_t *this, char *buf, int len,
 
 
 void
-__socket_ioq_entry_free (struct ioq *entry)
+__socket_ioq_entry_free (transport_t *this, struct ioq *entry)
 {
+        socket_private_t *priv = NULL;
+
+        priv = this->private;
+
         list_del_init (&entry->list);
-        if (entry->refs)
-                dict_unref (entry->refs);
+        if (entry->iobref)
+                iobref_unref (entry->iobref);
 
         /* TODO: use mem-pool */
         free (entry->buf);
 
-        /* TODO: use mem-pool */
+        if (priv->cache.ioq_free_count < SOCKET_IOQ_CACHE_SIZE) {
+                list_add (&entry->list, &priv->cache.ioq_free);
+                priv->cache.ioq_free_count++;
+                return;
+        }
+
         free (entry);
 }
 
@@ -345,7 +368,7 @@ __socket_ioq_flush (transport_t *this)
 
         while (!list_empty (&priv->ioq)) {
                 entry = priv->ioq_next;
-                __socket_ioq_entry_free (entry);
+                __socket_ioq_entry_free (this, entry);
         }
 
         return;
@@ -365,7 +388,92 @@ __socket_ioq_churn_entry (transport_t *this, struct ioq *entry)
         if (ret == 0) {
                 /* current entry was completely written */
                 assert (entry->pending_count == 0);
-                __socket_ioq_entry_free (entry);
+                __socket_ioq_entry_free (this, entry);
+        }
+
+        return ret;
+}
+
+
+static void
+__socket_ioq_entry_advance (struct ioq *entry, size_t size)
+{
+        while (size && entry->pending_count) {
+                if (size >= entry->pending_vector[0].iov_len) {
+                        size -= entry->pending_vector[0].iov_len;
+                        entry->pending_vector++;
+                        entry->pending_count--;
+                } else {
+                        entry->pending_vector[0].iov_base += size;
+                        entry->pending_vector[0].iov_len  -= size;
+                        size = 0;
+                }
+        }
+}
+
+
+/* write as many queued entries as fit in SOCKET_GATHER_IOVEC_MAX vectors
+   and SOCKET_GATHER_BYTES_MAX bytes with a single writev (), so that a
+   burst of small replies does not cost a syscall each. the head entry is
+   always taken, even if it alone exceeds the byte budget. */
+int
+__socket_ioq_churn_gather (transport_t *this)
+{
+        socket_private_t *priv = NULL;
+        struct iovec      vector[SOCKET_GATHER_IOVEC_MAX];
+        struct iovec     *pending_vector = NULL;
+        int               pending_count = 0;
+        int               count = 0;
+        int               entries = 0;
+        size_t            total = 0;
+        size_t            written = 0;
+        size_t            size = 0;
+        struct ioq       *entry = NULL;
+        struct ioq       *tmp = NULL;
+        int               ret = -1;
+
+        priv = this->private;
+
+        list_for_each_entry (entry, &priv->ioq, list) {
+                if (entries
+                    && ((count + entry->pending_count
+                         > SOCKET_GATHER_IOVEC_MAX)
+                        || (total >= SOCKET_GATHER_BYTES_MAX)))
+                        break;
+
+                memcpy (&vector[count], entry->pending_vector,
+                        entry->pending_count * sizeof (*vector));
+                count += entry->pending_count;
+                total += iov_length (entry->pending_vector,
+                                     entry->pending_count);
+                entries++;
+        }
+
+        if (entries == 1)
+                return __socket_ioq_churn_entry (this, priv->ioq_next);
+
+        priv->stats.gather_count++;
+
+        ret = __socket_writev (this, vector, count,
+                               &pending_vector, &pending_count);
+        if (ret == -1)
+                return ret;
+
+        written = total;
+        if (ret > 0)
+                written -= iov_length (pending_vector, pending_count);
+
+        list_for_each_entry_safe (entry, tmp, &priv->ioq, list) {
+                size = iov_length (entry->pending_vector,
+                                   entry->pending_count);
+                if (written < size) {
+                        __socket_ioq_entry_advance (entry, written);
+                        break;
+                }
+
+                written -= size;
+                entry->pending_count = 0;
+                __socket_ioq_entry_free (this, entry);
         }
 
         return ret;
@@ -377,15 +485,11 @@ __socket_ioq_churn (transport_t *this)
 {
         socket_private_t *priv = NULL;
         int               ret = 0;
-        struct ioq       *entry = NULL;
 
         priv = this->private;
 
         while (!list_empty (&priv->ioq)) {
-                /* pick next entry */
-                entry = priv->ioq_next;
-
-                ret = __socket_ioq_churn_entry (this, entry);
+                ret = __socket_ioq_churn_gather (this);
 
                 if (ret != 0)
                         break;
@@ -499,6 +603,31 @@ __socket_proto_validate_header (transport_t *this,
 
 
 
+static int
+__socket_hdr_buf_grow (transport_t *this, size_t size)
+{
+        socket_private_t *priv = NULL;
+        char             *hdr_buf = NULL;
+
+        priv = this->private;
+
+        priv->stats.hdr_miss++;
+
+        hdr_buf = realloc (priv->cache.hdr_buf, size);
+        if (!hdr_buf) {
+                gf_log (this->xl->name, GF_LOG_ERROR,
+                        "unable to allocate header buffer of %"GF_PRI_SIZET
+                        " bytes (%s)", size, this->peerinfo.identifier);
+                return -1;
+        }
+
+        priv->cache.hdr_buf      = hdr_buf;
+        priv->cache.hdr_buf_size = size;
+
+        return 0;
+}
+
+
 /* socket protocol state machine */
 
 int
@@ -506,6 +635,7 @@ __socket_proto_state_machine (transport_t *this)
 {
         int                   ret = -1;
         socket_private_t     *priv = NULL;
+        struct iobuf_pool    *iobuf_pool = NULL;
         size_t                size1 = 0;
 	size_t                size2 = 0;
         int                   previous_state = -1;
@@ -513,6 +643,7 @@ __socket_proto_state_machine (transport_t *this)
 
 
         priv = this->private;
+        iobuf_pool = this->xl->ctx->iobuf_pool;
 
 	while (priv->incoming.state != SOCKET_PROTO_STATE_COMPLETE) {
 		/* debug check against infinite loops */
@@ -587,10 +718,36 @@ __socket_proto_state_machine (transport_t *this)
                                 priv->incoming.hdrlen = size1;
                                 priv->incoming.buflen = size2;
 
-                                /* TODO: use mem-pool */
-                                priv->incoming.hdr_p  = MALLOC (size1);
-                                if (size2)
-                                        priv->incoming.buf_p = MALLOC (size2);
+                                priv->stats.hdr_count++;
+                                if (size1 > priv->cache.hdr_buf_size) {
+                                        ret = __socket_hdr_buf_grow (this,
+                                                                     size1);
+                                        if (ret == -1)
+                                                goto unlock;
+                                }
+                                priv->incoming.hdr_p = priv->cache.hdr_buf;
+
+                                /* payload is read straight into an iobuf,
+                                   which is handed up the stack without
+                                   copying */
+                                if (size2) {
+                                        priv->stats.payload_count++;
+                                        if (size2 > iobpool_default_pagesize (iobuf_pool))
+                                                priv->stats.payload_miss++;
+
+                                        priv->incoming.iobuf =
+                                                iobuf_get2 (iobuf_pool, size2);
+                                        if (!priv->incoming.iobuf) {
+                                                gf_log (this->xl->name,
+                                                        GF_LOG_ERROR,
+                                                        "unable to allocate "
+                                                        "iobuf of %"GF_PRI_SIZET
+                                                        " bytes (%s)", size2,
+                                                        this->peerinfo.identifier);
+                                                ret = -1;
+                                                goto unlock;
+                                        }
+                                }
 
                                 priv->incoming.vector[0].iov_base =
 					priv->incoming.hdr_p;
@@ -598,7 +755,9 @@ __socket_proto_state_machine (transport_t *this)
                                 priv->incoming.vector[0].iov_len  = size1;
 
                                 priv->incoming.vector[1].iov_base =
-					priv->incoming.buf_p;
+					(priv->incoming.iobuf ?
+                                         iobuf_ptr (priv->incoming.iobuf) :
+                                         NULL);
 
                                 priv->incoming.vector[1].iov_len  = size2;
                                 priv->incoming.count = size2 ? 2 : 1;
@@ -689,14 +848,83 @@ int
 socket_event_poll_in (transport_t *this)
 {
         int ret = -1;
+        int msgs = 0;
+
+        /* keep reading while complete messages are available, so that
+           the replies they generate can be written out together */
+        do {
+                ret = socket_proto_state_machine (this);
+
+                /* call POLLIN on xlator even if complete block is not
+                   received, just to keep the last_received timestamp
+                   ticking */
+
+                if (ret == 0)
+                        ret = this->xl->notify (this->xl, GF_EVENT_POLLIN,
+                                                this);
+        } while (ret == 0 && ++msgs < SOCKET_POLLIN_MSGS_MAX);
+
+        /* ran out of data after having processed some messages */
+        if (ret > 0 && msgs)
+                ret = 0;
+
+        return ret;
+}
+
+
+void
+socket_cork (transport_t *this)
+{
+        socket_private_t *priv = NULL;
+
+        priv = this->private;
+
+        if (!priv->cork)
+                return;
+
+        pthread_mutex_lock (&priv->lock);
+        {
+                priv->corked = 1;
+        }
+        pthread_mutex_unlock (&priv->lock);
+}
+
+
+/* flush everything queued while corked in as few writev ()s as
+   possible */
+int
+socket_uncork (transport_t *this)
+{
+        socket_private_t *priv = NULL;
+        glusterfs_ctx_t  *ctx = NULL;
+        int               ret = 0;
+
+        priv = this->private;
+        ctx  = this->xl->ctx;
+
+        if (!priv->cork)
+                return 0;
 
-        ret = socket_proto_state_machine (this);
+        pthread_mutex_lock (&priv->lock);
+        {
+                priv->corked = 0;
+
+                if (priv->connected == 1 && !list_empty (&priv->ioq)) {
+                        ret = __socket_ioq_churn (this);
 
-        /* call POLLIN on xlator even if complete block is not received,
-           just to keep the last_received timestamp ticking */
+                        if (ret > 0) {
+                                /* continue writing on POLLOUT */
+                                priv->idx = event_select_on (ctx->event_pool,
+                                                             priv->sock,
+                                                             priv->idx, -1, 1);
+                        }
 
-        if (ret == 0)
-                ret = this->xl->notify (this->xl, GF_EVENT_POLLIN, this);
+                        if (ret == -1) {
+                                __socket_disconnect (this);
+                        }
+                }
+        }
+        pthread_mutex_unlock (&priv->lock);
 
         return ret;
 }
@@ -795,7 +1023,10 @@ socket_event_handler (int fd, int idx, void *data,
         }
 
         if (!ret && poll_in) {
+                socket_cork (this);
                 ret = socket_event_poll_in (this);
+                if (socket_uncork (this) == -1)
+                        ret = -1;
         }
 
         if (ret < 0 || poll_err) {
@@ -1148,7 +1379,7 @@ unlock:
 
 int
 socket_receive (transport_t *this, char **hdr_p, size_t *hdrlen_p,
-                char **buf_p, size_t *buflen_p)
+                struct iobuf **iobuf_p, size_t *buflen_p)
 {
         socket_private_t *priv = NULL;
         int               ret = -1;
@@ -1163,17 +1394,17 @@ socket_receive (transport_t *this, char **hdr_p, size_t *hdrlen_p,
                         goto unlock;
                 }
 
-                if (!hdr_p || !hdrlen_p || !buf_p || !buflen_p) {
+                if (!hdr_p || !hdrlen_p || !iobuf_p || !buflen_p) {
                         gf_log (this->xl->name, GF_LOG_ERROR,
                                 "bad parameters %p %p %p %p",
-                                hdr_p, hdrlen_p, buf_p, buflen_p);
+                                hdr_p, hdrlen_p, iobuf_p, buflen_p);
                         goto unlock;
                 }
 
                 if (priv->incoming.state == SOCKET_PROTO_STATE_COMPLETE) {
                         *hdr_p    = priv->incoming.hdr_p;
                         *hdrlen_p = priv->incoming.hdrlen;
-                        *buf_p    = priv->incoming.buf_p;
+                        *iobuf_p  = priv->incoming.iobuf;
                         *buflen_p = priv->incoming.buflen;
 
                         memset (&priv->incoming, 0, sizeof (priv->incoming));
@@ -1193,7 +1424,7 @@ unlock:
 int
 socket_submit (transport_t *this, char *buf, int len,
                struct iovec *vector, int count,
-               dict_t *refs)
+               struct iobref *iobref)
 {
         socket_private_t *priv = NULL;
         int               ret = -1;
@@ -1218,9 +1449,14 @@ socket_submit (transport_t *this, char *buf, int len,
                 }
 
                 priv->submit_log = 0;
-                entry = __socket_ioq_new (this, buf, len, vector, count, refs);
+                entry = __socket_ioq_new (this, buf, len, vector, count, iobref);
+                if (!entry) {
+                        gf_log (this->xl->name, GF_LOG_ERROR,
+                                "out of memory");
+                        goto unlock;
+                }
 
-                if (list_empty (&priv->ioq)) {
+                if (list_empty (&priv->ioq) && !priv->corked) {
                         ret = __socket_ioq_churn_entry (this, entry);
 
                         if (ret == 0)
@@ -1284,6 +1520,17 @@ socket_init (transport_t *this)
         priv->connected = -1;
 
         INIT_LIST_HEAD (&priv->ioq);
+        INIT_LIST_HEAD (&priv->cache.ioq_free);
+
+        priv->cache.hdr_buf = MALLOC (SOCKET_HDR_BUF_SIZE);
+        if (!priv->cache.hdr_buf) {
+                gf_log (this->xl->name, GF_LOG_ERROR,
+                        "malloc (%d) returned NULL", SOCKET_HDR_BUF_SIZE);
+                pthread_mutex_destroy (&priv->lock);
+                FREE (priv);
+                return -1;
+        }
+        priv->cache.hdr_buf_size = SOCKET_HDR_BUF_SIZE;
 
         if (dict_get (this->xl->options, "non-blocking-io")) {
                 gf_boolean_t tmp_bool = 0;
@@ -1304,6 +1551,20 @@ socket_init (transport_t *this)
                 }
         }
 
+        if (dict_get (this->xl->options, "transport.socket.cork")) {
+                gf_boolean_t tmp_bool = 0;
+                char *cork = data_to_str (dict_get (this->xl->options,
+                                                    "transport.socket.cork"));
+
+                if (gf_string2boolean (cork, &tmp_bool) == -1) {
+                        gf_log (this->xl->name, GF_LOG_ERROR,
+                                "'transport.socket.cork' takes only boolean "
+                                "options, not taking any action");
+                        tmp_bool = 0;
+                }
+                priv->cork = tmp_bool;
+        }
+
         this->private = priv;
 
         return 0;
@@ -1314,9 +1575,31 @@ void
 fini (transport_t *this)
 {
         socket_private_t *priv = this->private;
+        struct ioq       *entry = NULL;
+        struct ioq       *tmp = NULL;
+
         gf_log (this->xl->name, GF_LOG_DEBUG,
                 "transport %p destroyed", this);
 
+        gf_log (this->xl->name, GF_LOG_DEBUG,
+                "%s: ioq entries %"PRIu64" (%"PRIu64" allocated), "
+                "headers %"PRIu64" (%"PRIu64" grew buffer to %"GF_PRI_SIZET
+                "), payloads %"PRIu64" (%"PRIu64" larger than a page), "
+                "writev calls %"PRIu64" (%"PRIu64" gathered)",
+                this->peerinfo.identifier,
+                priv->stats.ioq_alloc, priv->stats.ioq_miss,
+                priv->stats.hdr_count, priv->stats.hdr_miss,
+                priv->cache.hdr_buf_size,
+                priv->stats.payload_count, priv->stats.payload_miss,
+                priv->stats.writev_count, priv->stats.gather_count);
+
+        list_for_each_entry_safe (entry, tmp, &priv->cache.ioq_free, list) {
+                list_del_init (&entry->list);
+                free (entry);
+        }
+
+        FREE (priv->cache.hdr_buf);
+
         pthread_mutex_destroy (&priv->lock);
         FREE (priv);
 }
@@ -1364,6 +1647,9 @@ struct volume_options options[] = {
                     "unix", "inet-sdp" },
           .type  = GF_OPTION_TYPE_STR 
         },
+        { .key   = {"transport.socket.cork"},
+          .type  = GF_OPTION_TYPE_BOOL
+        },
 
         { .key = {NULL} }
 };
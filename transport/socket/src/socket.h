@@ -31,6 +31,7 @@
 #include "logging.h"
 #include "dict.h"
 #include "mem-pool.h"
+#include "iobuf.h"
 
 #ifndef MAX_IOVEC
 #define MAX_IOVEC 16
@@ -38,6 +39,26 @@
 
 #define GF_DEFAULT_SOCKET_LISTEN_PORT 6996
 
+/* free ioq entries kept for reuse, per connection */
+#define SOCKET_IOQ_CACHE_SIZE   64
+
+/* initial size of the per connection buffer incoming headers are read
+   into. it grows to the largest header seen on the connection. */
+#define SOCKET_HDR_BUF_SIZE     1024
+
+/* limits on how much of the queued ioq entries are gathered into a
+   single writev () */
+#ifdef IOV_MAX
+#define SOCKET_GATHER_IOVEC_MAX IOV_MAX
+#else
+#define SOCKET_GATHER_IOVEC_MAX 1024
+#endif
+#define SOCKET_GATHER_BYTES_MAX (1024 * 1024)
+
+/* complete messages processed per POLLIN event before returning to
+   epoll */
+#define SOCKET_POLLIN_MSGS_MAX  16
+
 typedef enum {
         SOCKET_PROTO_STATE_NADA = 0,
         SOCKET_PROTO_STATE_HEADER_COMING,
@@ -69,7 +90,7 @@ struct ioq {
         struct iovec      *pending_vector;
         int                pending_count;
         char              *buf;
-        dict_t            *refs;
+        struct iobref     *iobref;
 };
 
 
@@ -80,6 +101,10 @@ typedef struct {
         char                   bio;
         char                   connect_finish_log;
         char                   submit_log;
+        char                   cork;        /* option: batch replies per
+                                               POLLIN event */
+        char                   corked;      /* inside a corked POLLIN
+                                               event, submit only queues */
         union {
                 struct list_head     ioq;
                 struct {
@@ -87,12 +112,31 @@ typedef struct {
                         struct ioq        *ioq_prev;
                 };
         };
+        struct {
+                struct list_head     ioq_free;    /* cached ioq entries */
+                int                  ioq_free_count;
+                char                *hdr_buf;
+                size_t               hdr_buf_size;
+        } cache;
+        struct {
+                uint64_t             ioq_alloc;
+                uint64_t             ioq_miss;     /* had to calloc () */
+                uint64_t             hdr_count;
+                uint64_t             hdr_miss;     /* had to grow hdr_buf */
+                uint64_t             payload_count;
+                uint64_t             payload_miss; /* larger than an iobuf
+                                                      page */
+                uint64_t             writev_count; /* writev () syscalls */
+                uint64_t             gather_count; /* ioq writes which
+                                                      gathered more than
+                                                      one entry */
+        } stats;
         struct {
                 int                  state;
                 struct socket_header header;
                 char                *hdr_p;
                 size_t               hdrlen;
-                char                *buf_p;
+                struct iobuf        *iobuf;
                 size_t               buflen;
                 struct iovec         vector[2];
                 int                  count;
@@ -142,7 +142,7 @@ out:
  * - if we have failed due to ENOTCONN:
  *     try the next child
  *
- * Applicable to: readdir
+ * Applicable to: readdir, readdirp
  */
 
 int32_t
@@ -173,11 +173,18 @@ afr_readdir_cbk (call_frame_t *frame, void *cookie,
 		this_try = ++local->cont.readdir.last_tried;
 		unwind = 0;
 
-		STACK_WIND (frame, afr_readdir_cbk,
-			    children[this_try],
-			    children[this_try]->fops->readdir,
-			    local->fd, local->cont.readdir.size,
-			    local->cont.readdir.offset);
+		if (local->cont.readdir.whichop == GF_FOP_READDIRP)
+			STACK_WIND (frame, afr_readdir_cbk,
+				    children[this_try],
+				    children[this_try]->fops->readdirp,
+				    local->fd, local->cont.readdir.size,
+				    local->cont.readdir.offset);
+		else
+			STACK_WIND (frame, afr_readdir_cbk,
+				    children[this_try],
+				    children[this_try]->fops->readdir,
+				    local->fd, local->cont.readdir.size,
+				    local->cont.readdir.offset);
 	}
 
 out:
@@ -189,9 +196,9 @@ out:
 }
 
 
-int32_t
-afr_readdir (call_frame_t *frame, xlator_t *this,
-	     fd_t *fd, size_t size, off_t offset)
+static int32_t
+afr_do_readdir (call_frame_t *frame, xlator_t *this,
+		fd_t *fd, size_t size, off_t offset, int whichop)
 {
 	afr_private_t * priv       = NULL;
 	xlator_t **     children   = NULL;
@@ -232,10 +239,18 @@ afr_readdir (call_frame_t *frame, xlator_t *this,
 	local->fd                  = fd_ref (fd);
 	local->cont.readdir.size   = size;
 	local->cont.readdir.offset = offset;
+	local->cont.readdir.whichop = whichop;
 
-	STACK_WIND (frame, afr_readdir_cbk,
-		    children[call_child], children[call_child]->fops->readdir,
-		    fd, size, offset);
+	if (whichop == GF_FOP_READDIRP)
+		STACK_WIND (frame, afr_readdir_cbk,
+			    children[call_child],
+			    children[call_child]->fops->readdirp,
+			    fd, size, offset);
+	else
+		STACK_WIND (frame, afr_readdir_cbk,
+			    children[call_child],
+			    children[call_child]->fops->readdir,
+			    fd, size, offset);
 
 	op_ret = 0;
 out:
@@ -246,6 +261,24 @@ out:
 }
 
 
+int32_t
+afr_readdir (call_frame_t *frame, xlator_t *this,
+	     fd_t *fd, size_t size, off_t offset)
+{
+	afr_do_readdir (frame, this, fd, size, offset, GF_FOP_READDIR);
+	return 0;
+}
+
+
+int32_t
+afr_readdirp (call_frame_t *frame, xlator_t *this,
+	      fd_t *fd, size_t size, off_t offset)
+{
+	afr_do_readdir (frame, this, fd, size, offset, GF_FOP_READDIRP);
+	return 0;
+}
+
+
 int32_t
 afr_getdents_cbk (call_frame_t *frame, void *cookie,
 		  xlator_t *this, int32_t op_ret, int32_t op_errno,
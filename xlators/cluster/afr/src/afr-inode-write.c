@@ -957,9 +957,9 @@ afr_writev_done (call_frame_t *frame, xlator_t *this)
 
 	local = frame->local;
 
-	if (local->cont.writev.refs)
-		dict_unref (local->cont.writev.refs);
-	local->cont.writev.refs = NULL;
+	if (local->cont.writev.iobref)
+		iobref_unref (local->cont.writev.iobref);
+	local->cont.writev.iobref = NULL;
 
 	local->transaction.unwind (frame, this);
 
@@ -1012,7 +1012,7 @@ afr_writev (call_frame_t *frame, xlator_t *this, fd_t *fd,
 	local->cont.writev.ino     = fd->inode->ino;
 
 	if (frame->root->req_refs)
-		local->cont.writev.refs = dict_ref (frame->root->req_refs);
+		local->cont.writev.iobref = iobref_ref (frame->root->req_refs);
 
 	local->transaction.fop    = afr_writev_wind;
 	local->transaction.done   = afr_writev_done;
@@ -2275,6 +2275,7 @@ struct xlator_fops fops = {
 	/* dir read */
 	.opendir     = afr_opendir,
 	.readdir     = afr_readdir,
+	.readdirp    = afr_readdirp,
 	.getdents    = afr_getdents,
 
 	/* dir write */
@@ -209,6 +209,7 @@ typedef struct _afr_local {
 			int32_t op_errno;
 			size_t size;
 			off_t offset;
+			int whichop;
 
 			int last_tried;
 		} readdir;
@@ -259,7 +260,7 @@ typedef struct _afr_local {
 			int32_t op_ret;
 
 			struct iovec *vector;
-			dict_t *refs;
+			struct iobref *iobref;
 			int32_t count;
 			off_t offset;
 		} writev;
@@ -2106,8 +2106,96 @@ unwind:
 
 
 int
-dht_readdir (call_frame_t *frame, xlator_t *this,
-	     fd_t *fd, size_t size, off_t yoff)
+dht_readdirp_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		  int op_ret, int op_errno, gf_dirent_t *orig_entries)
+{
+	dht_local_t  *local = NULL;
+	gf_dirent_t   entries;
+	gf_dirent_t  *orig_entry = NULL;
+	gf_dirent_t  *entry = NULL;
+	call_frame_t *prev = NULL;
+	xlator_t     *subvol = NULL;
+	xlator_t     *next = NULL;
+	dht_layout_t *layout = NULL;
+	int           count = 0;
+
+
+	INIT_LIST_HEAD (&entries.list);
+	prev = cookie;
+	local = frame->local;
+
+	if (op_ret < 0)
+		goto done;
+
+	layout = dht_layout_get (this, local->fd->inode);
+
+	list_for_each_entry (orig_entry, &orig_entries->list, list) {
+		subvol = dht_layout_search (this, layout, orig_entry->d_name);
+
+		if (!subvol || subvol == prev->this) {
+			entry = gf_dirent_for_name (orig_entry->d_name);
+			if (!entry) {
+				gf_log (this->name, GF_LOG_ERROR,
+					"memory allocation failed :(");
+				goto unwind;
+			}
+
+			dht_itransform (this, subvol, orig_entry->d_ino,
+					&entry->d_ino);
+			dht_itransform (this, subvol, orig_entry->d_off,
+					&entry->d_off);
+
+			entry->d_type = orig_entry->d_type;
+			entry->d_len  = orig_entry->d_len;
+
+			/* files are what lookup would return. linkfiles
+			   stand for a file on another subvolume, directory
+			   attributes are merged from all of them: left
+			   for lookup to find out */
+			if (orig_entry->d_stat.st_ino &&
+			    !check_is_dir (NULL, (&orig_entry->d_stat), NULL) &&
+			    !check_is_linkfile (NULL, (&orig_entry->d_stat),
+						NULL)) {
+				entry->d_stat = orig_entry->d_stat;
+				dht_itransform (this, prev->this,
+						orig_entry->d_stat.st_ino,
+						(uint64_t *) &entry->d_stat.st_ino);
+			}
+
+			list_add_tail (&entry->list, &entries.list);
+			count++;
+		}
+	}
+	op_ret = count;
+
+done:
+	if (count == 0) {
+		next = dht_subvol_next (this, prev->this);
+		if (!next) {
+			goto unwind;
+		}
+
+		STACK_WIND (frame, dht_readdirp_cbk,
+			    next, next->fops->readdirp,
+			    local->fd, local->size, 0);
+		return 0;
+	}
+
+unwind:
+	if (op_ret < 0)
+		op_ret = 0;
+
+	DHT_STACK_UNWIND (frame, op_ret, op_errno, &entries);
+
+	gf_dirent_free (&entries);
+
+        return 0;
+}
+
+
+static int
+dht_do_readdir (call_frame_t *frame, xlator_t *this,
+		fd_t *fd, size_t size, off_t yoff, int whichop)
 {
 	dht_local_t  *local  = NULL;
 	dht_conf_t   *conf = NULL;
@@ -2136,9 +2224,14 @@ dht_readdir (call_frame_t *frame, xlator_t *this,
 	dht_deitransform (this, yoff, &xvol, (uint64_t *)&xoff);
 
 	/* TODO: do proper readdir */
-	STACK_WIND (frame, dht_readdir_cbk,
-		    xvol, xvol->fops->readdir,
-		    fd, size, xoff);
+	if (whichop == GF_FOP_READDIRP)
+		STACK_WIND (frame, dht_readdirp_cbk,
+			    xvol, xvol->fops->readdirp,
+			    fd, size, xoff);
+	else
+		STACK_WIND (frame, dht_readdir_cbk,
+			    xvol, xvol->fops->readdir,
+			    fd, size, xoff);
 
 	return 0;
 
@@ -2150,6 +2243,22 @@ err:
 }
 
 
+int
+dht_readdir (call_frame_t *frame, xlator_t *this,
+	     fd_t *fd, size_t size, off_t yoff)
+{
+	return dht_do_readdir (frame, this, fd, size, yoff, GF_FOP_READDIR);
+}
+
+
+int
+dht_readdirp (call_frame_t *frame, xlator_t *this,
+	      fd_t *fd, size_t size, off_t yoff)
+{
+	return dht_do_readdir (frame, this, fd, size, yoff, GF_FOP_READDIRP);
+}
+
+
 int
 dht_fsyncdir_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 		  int op_ret, int op_errno)
@@ -2117,6 +2117,54 @@ stripe_opendir (call_frame_t *frame,
 }
 
 
+/**
+ * stripe_readdirp_cbk - the first child only holds the first stripe of
+ * every regular file, so its size and blocks are not those of the file.
+ * clear them and let the caller lookup those entries.
+ */
+int32_t
+stripe_readdirp_cbk (call_frame_t *frame,
+		     void *cookie,
+		     xlator_t *this,
+		     int32_t op_ret,
+		     int32_t op_errno,
+		     gf_dirent_t *entries)
+{
+	gf_dirent_t *entry = NULL;
+
+	if (op_ret > 0) {
+		list_for_each_entry (entry, &entries->list, list) {
+			if (S_ISREG (entry->d_stat.st_mode))
+				memset (&entry->d_stat, 0,
+					sizeof (entry->d_stat));
+		}
+	}
+
+	STACK_UNWIND (frame, op_ret, op_errno, entries);
+	return 0;
+}
+
+
+/**
+ * stripe_readdirp - 
+ */
+int32_t
+stripe_readdirp (call_frame_t *frame,
+		 xlator_t *this,
+		 fd_t *fd,
+		 size_t size,
+		 off_t offset)
+{
+	STACK_WIND (frame,
+		    stripe_readdirp_cbk,
+		    FIRST_CHILD(this),
+		    FIRST_CHILD(this)->fops->readdirp,
+		    fd, size, offset);
+
+	return 0;
+}
+
+
 /**
  * stripe_getxattr_cbk - 
  */
@@ -2623,8 +2671,8 @@ stripe_readv_cbk (call_frame_t *frame,
 				iov_dup (vector, count);
 
 			if (frame->root->rsp_refs)
-				dict_copy (frame->root->rsp_refs, 
-					   main_frame->root->rsp_refs);
+				iobref_merge (main_frame->root->rsp_refs,
+					      frame->root->rsp_refs);
 		}
 		callcnt = ++main_local->call_count;
 	}
@@ -2634,7 +2682,7 @@ stripe_readv_cbk (call_frame_t *frame,
 		int32_t final_count = 0;
 		struct iovec *final_vec = NULL;
 		struct stat tmp_stbuf = {0,};
-		dict_t *refs = main_frame->root->rsp_refs;
+		struct iobref *refs = main_frame->root->rsp_refs;
 
 		op_ret = 0;
 		memcpy (&tmp_stbuf, &main_local->replies[0].stbuf, 
@@ -2684,7 +2732,7 @@ stripe_readv_cbk (call_frame_t *frame,
 		STACK_UNWIND (main_frame, op_ret, op_errno, 
 			      final_vec, final_count, &tmp_stbuf);
 
-		dict_unref (refs);
+		iobref_unref (refs);
 		if (final_vec)
 			free (final_vec);
 	}
@@ -2735,7 +2783,7 @@ stripe_readv (call_frame_t *frame,
 	ERR_ABORT (local);
 	local->wind_count = num_stripe;
 	frame->local = local;
-	frame->root->rsp_refs = dict_ref (get_new_dict ());
+	frame->root->rsp_refs = iobref_new ();
 	
 	/* This is where all the vectors should be copied. */
 	local->replies = CALLOC (1, num_stripe * 
@@ -3257,6 +3305,7 @@ struct xlator_fops fops = {
 	.rmdir       = stripe_rmdir,
 	.lk          = stripe_lk,
 	.opendir     = stripe_opendir,
+	.readdirp    = stripe_readdirp,
 	.fsyncdir    = stripe_fsyncdir,
 	.fchmod      = stripe_fchmod,
 	.fchown      = stripe_fchown,
@@ -2565,6 +2565,53 @@ unify_readdir (call_frame_t *frame,
 }
 
 
+/**
+ * unify_readdirp_cbk - regular files in the namespace are empty
+ * placeholders, clear their attributes so that they get looked up on
+ * the storage node which holds them.
+ */
+int32_t
+unify_readdirp_cbk (call_frame_t *frame,
+		    void *cookie,
+		    xlator_t *this,
+		    int32_t op_ret,
+		    int32_t op_errno,
+		    gf_dirent_t *buf)
+{
+	gf_dirent_t *entry = NULL;
+
+	if (op_ret > 0) {
+		list_for_each_entry (entry, &buf->list, list) {
+			if (S_ISREG (entry->d_stat.st_mode))
+				memset (&entry->d_stat, 0,
+					sizeof (entry->d_stat));
+		}
+	}
+
+	STACK_UNWIND (frame, op_ret, op_errno, buf);
+
+	return 0;
+}
+
+/**
+ * unify_readdirp - read the entries from the namespace.
+ */
+int32_t
+unify_readdirp (call_frame_t *frame,
+		xlator_t *this,
+		fd_t *fd,
+		size_t size,
+		off_t offset)
+{
+	UNIFY_CHECK_FD_AND_UNWIND_ON_ERR (fd);
+
+	STACK_WIND (frame, unify_readdirp_cbk, NS(this),
+		    NS(this)->fops->readdirp, fd, size, offset);
+
+	return 0;
+}
+
+
 /**
  * unify_fsyncdir_cbk - 
  */
@@ -4413,6 +4460,7 @@ struct xlator_fops fops = {
 	.removexattr = unify_removexattr,
 	.opendir     = unify_opendir,
 	.readdir     = unify_readdir,
+	.readdirp    = unify_readdirp,
 	.fsyncdir    = unify_fsyncdir,
 	.access      = unify_access,
 	.ftruncate   = unify_ftruncate,
@@ -36,7 +36,7 @@ struct quota_local {
 	off_t          offset;
 	int32_t        count;
 	struct iovec  *vector;
-	dict_t        *refs;
+	struct iobref *iobref;
 	loc_t          loc;
 };
 
@@ -683,7 +683,7 @@ quota_writev_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 						   local->stbuf.st_blocks) * 512);
 		}
 		fd_unref (local->fd);
-		dict_unref (local->refs);
+		iobref_unref (local->iobref);
 	}
 
 	STACK_UNWIND (frame, op_ret, op_errno, stbuf);
@@ -709,7 +709,7 @@ quota_writev_fstat_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 
 			if (iovlen > (buf->st_blksize - (buf->st_size % buf->st_blksize))) {
 				fd_unref (local->fd);
-				dict_unref (local->refs);
+				iobref_unref (local->iobref);
 				STACK_UNWIND (frame, -1, ENOSPC, NULL);
 				return 0;
 			}
@@ -746,7 +746,7 @@ quota_writev (call_frame_t *frame, xlator_t *this, fd_t *fd,
 	if (priv->disk_usage_limit) {
 		local = CALLOC (1, sizeof (struct quota_local));
 		local->fd     = fd_ref (fd);
-		local->refs   = dict_ref (frame->root->req_refs);
+		local->iobref = iobref_ref (frame->root->req_refs);
 		local->vector = vector;
 		local->count  = count;
 		local->offset = off;
@@ -58,6 +58,13 @@
 
 #define BIG_FUSE_CHANNEL_SIZE 1048576
 
+/* number of request buffers in one arena of the fuse iobuf pool */
+#define FUSE_IOBUF_ARENA_PAGES 16
+
+/* threads reading requests from /dev/fuse */
+#define FUSE_READER_THREAD_COUNT_DEFAULT 1
+#define FUSE_READER_THREAD_COUNT_MAX     64
+
 struct fuse_private {
         int                  fd;
         struct fuse         *fuse;
@@ -66,8 +73,13 @@ struct fuse_private {
         char                *volfile;
         size_t               volfile_size;
         char                *mount_point;
-        data_t              *buf;
-        pthread_t            fuse_thread;
+        struct iobuf_pool   *iobuf_pool;
+        pthread_key_t        iobuf_key;   /* request being processed by
+                                             the calling reader thread */
+        pthread_t           *reader_threads;
+        uint32_t             reader_thread_count;
+        uint32_t             reader_thread_active;
+        pthread_mutex_t      reader_mutex;
         char                 fuse_thread_started;
         uint32_t             direct_io_mode;
         uint32_t             entry_timeout;
@@ -85,11 +97,11 @@ typedef struct fuse_private fuse_private_t;
                 call_frame_t *frame = get_call_frame_for_req (state, 1); \
                 xlator_t *xl = frame->this->children ?                  \
                         frame->this->children->xlator : NULL;           \
-                dict_t *refs = frame->root->req_refs;                   \
+                struct iobref *refs = frame->root->req_refs;            \
                 frame->root->state = state;                             \
                 frame->root->op   = op_num;				\
                 STACK_WIND (frame, ret, xl, xl->fops->fop, args);       \
-                dict_unref (refs);                                      \
+                iobref_unref (refs);                                    \
         } while (0)
 
 
@@ -177,6 +189,7 @@ get_call_frame_for_req (fuse_state_t *state, char d)
 	call_frame_t *frame = NULL;
         xlator_t *this = NULL;
         fuse_private_t *priv = NULL;
+        struct iobuf *iobuf = NULL;
 
 
 	if (req) {
@@ -198,8 +211,12 @@ get_call_frame_for_req (fuse_state_t *state, char d)
         }
 
         if (d) {
-                frame->root->req_refs = dict_ref (get_new_dict ());
-                dict_set (frame->root->req_refs, NULL, priv->buf);
+                /* the payload of writes points into the request
+                   buffer, hold it for as long as the fop needs it */
+                iobuf = pthread_getspecific (priv->iobuf_key);
+                frame->root->req_refs = iobref_new ();
+                if (frame->root->req_refs && iobuf)
+                        iobref_add (frame->root->req_refs, iobuf);
         }
 
         frame->root->type = GF_OP_TYPE_FOP_REQUEST;
@@ -1824,8 +1841,12 @@ fuse_readdir (fuse_req_t req,
                 "%"PRId64": READDIR (%p, size=%"GF_PRI_SIZET", offset=%"PRId64")",
                 req_callid (req), fd, size, off);
 
-        FUSE_FOP (state, fuse_readdir_cbk, GF_FOP_READDIR,
-                  readdir, fd, size, off);
+        /* readdirp, for the attribute caches below (stat-prefetch) to
+           answer the lookups of the listed entries which they have seen
+           a lookup of before. fuse does not keep the attributes itself,
+           every lookup is wound. */
+        FUSE_FOP (state, fuse_readdir_cbk, GF_FOP_READDIRP,
+                  readdirp, fd, size, off);
 }
 
 
@@ -2178,6 +2199,38 @@ fuse_xattr_cbk (call_frame_t *frame,
 }
 
 
+/* the fop stats of the translators of this client, see --fop-stats */
+static void
+fuse_getxattr_fop_stats (fuse_req_t req, size_t size)
+{
+	xlator_t *this = NULL;
+	char     *buf = NULL;
+	int       len = 0;
+
+	this = fuse_req_userdata (req);
+
+	buf = CALLOC (1, GLUSTERFS_XATTR_LEN_MAX);
+	if (!buf) {
+		fuse_reply_err (req, ENOMEM);
+		return;
+	}
+
+	len = xlator_fop_stats_dump (this, buf, GLUSTERFS_XATTR_LEN_MAX);
+
+	/* not mounted with --fop-stats */
+	if (len < 0)
+		fuse_reply_err (req, ENODATA);
+	else if (!size)
+		fuse_reply_xattr (req, len);
+	else if (size < len)
+		fuse_reply_err (req, ERANGE);
+	else
+		fuse_reply_buf (req, buf, len);
+
+	FREE (buf);
+}
+
+
 static void
 fuse_getxattr (fuse_req_t req,
                fuse_ino_t ino,
@@ -2187,6 +2240,11 @@ fuse_getxattr (fuse_req_t req,
         fuse_state_t *state;
 	int32_t ret = -1;
 
+	if (!strcmp (name, "user.glusterfs-fop-stats")) {
+		fuse_getxattr_fop_stats (req, size);
+		return;
+	}
+
 #ifdef DISABLE_POSIX_ACL
 	if (!strncmp (name, "system.", 7)) {
 		fuse_reply_err (req, ENODATA);
@@ -2472,6 +2530,9 @@ static struct fuse_lowlevel_ops fuse_ops = {
 };
 
 
+/* each of the reader threads receives into an iobuf of its own and
+   processes the request in place, the last one to see the session
+   exit tears it down */
 static void *
 fuse_thread_proc (void *data)
 {
@@ -2479,58 +2540,60 @@ fuse_thread_proc (void *data)
         xlator_t *this = data;
         fuse_private_t *priv = this->private;
         int32_t res = 0;
-        data_t *buf = priv->buf;
-        int32_t ref = 0;
+        struct iobuf *iobuf = NULL;
         size_t chan_size = fuse_chan_bufsize (priv->ch);
-        char *recvbuf = CALLOC (1, chan_size);
-        ERR_ABORT (recvbuf);
+        uint32_t active = 0;
 
         while (!fuse_session_exited (priv->se)) {
 
+                /* requests are read straight into a fresh iobuf, the
+                   payload of writes is passed down from there */
+                iobuf = iobuf_get2 (priv->iobuf_pool, chan_size);
+                if (!iobuf) {
+                        gf_log ("glusterfs-fuse", GF_LOG_ERROR,
+                                "out of memory");
+                        sleep (1);
+                        continue;
+                }
 
                 res = fuse_chan_receive (priv->ch,
-                                         recvbuf,
+                                         iobuf_ptr (iobuf),
                                          chan_size);
 
                 if (res == -1) {
+                        iobuf_unref (iobuf);
                         if (errno != EINTR) {
                                 gf_log ("glusterfs-fuse", GF_LOG_ERROR,
                                         "fuse_chan_receive() returned -1 (%d)", errno);
                         }
-                        if (errno == ENODEV)
+                        if (errno == ENODEV) {
+                                fuse_session_exit (priv->se);
                                 break;
+                        }
                         continue;
                 }
 
-                buf = priv->buf;
-
-                if (res && res != -1) {
-                        if (buf->len < (res)) {
-                                if (buf->data) {
-                                        FREE (buf->data);
-                                        buf->data = NULL;
-                                }
-                                buf->data = CALLOC (1, res);
-                                ERR_ABORT (buf->data);
-                                buf->len = res;
-                        }
-                        memcpy (buf->data, recvbuf, res); // evil evil
-
+                if (res) {
+                        pthread_setspecific (priv->iobuf_key, iobuf);
                         fuse_session_process (priv->se,
-                                              buf->data,
+                                              iobuf_ptr (iobuf),
                                               res,
                                               priv->ch);
+                        pthread_setspecific (priv->iobuf_key, NULL);
                 }
 
-                LOCK (&buf->lock);
-                ref = buf->refcount;
-                UNLOCK (&buf->lock);
-                if (1) {
-                        data_unref (buf);
+                iobuf_unref (iobuf);
+        }
 
-                        priv->buf = data_ref (data_from_dynptr (NULL, 0));
-                }
+        pthread_mutex_lock (&priv->reader_mutex);
+        {
+                active = --priv->reader_thread_active;
         }
+        pthread_mutex_unlock (&priv->reader_mutex);
+
+        if (active)
+                return NULL;
+
 	if (dict_get (this->options, ZR_MOUNTPOINT_OPT))
 		mount_point = data_to_str (dict_get (this->options, 
 						     ZR_MOUNTPOINT_OPT));
@@ -2579,18 +2642,29 @@ notify (xlator_t *this, int32_t event,
         {
                 fuse_private_t *private = this->private;
                 int32_t ret = 0;
+                uint32_t i = 0;
 
                 if (!private->fuse_thread_started)
                 {
                         private->fuse_thread_started = 1;
+                        private->reader_thread_active =
+                                private->reader_thread_count;
 
-                        ret = pthread_create (&private->fuse_thread, NULL,
-                                              fuse_thread_proc, this);
+                        for (i = 0; i < private->reader_thread_count; i++) {
+                                ret = pthread_create (&private->reader_threads[i],
+                                                      NULL, fuse_thread_proc,
+                                                      this);
 
-                        if (ret != 0)
-                                gf_log ("glusterfs-fuse", GF_LOG_ERROR,
-                                        "pthread_create() failed (%s)", strerror (errno));
-                        assert (ret == 0);
+                                if (ret != 0)
+                                        gf_log ("glusterfs-fuse", GF_LOG_ERROR,
+                                                "pthread_create() failed (%s)",
+                                                strerror (ret));
+                                assert (ret == 0);
+                        }
+
+                        gf_log ("glusterfs-fuse", GF_LOG_DEBUG,
+                                "started %u reader thread(s)",
+                                private->reader_thread_count);
                 }
                 break;
         }
@@ -2736,6 +2810,29 @@ init (xlator_t *this_xl)
 	if (value_string) {
 		ret = gf_string2boolean (value_string, &priv->direct_io_mode);
 	}
+
+	ret = dict_get_uint32 (options, "reader-thread-count",
+			       &priv->reader_thread_count);
+	if (!priv->reader_thread_count)
+		priv->reader_thread_count = FUSE_READER_THREAD_COUNT_DEFAULT;
+	if (priv->reader_thread_count > FUSE_READER_THREAD_COUNT_MAX) {
+		gf_log ("glusterfs-fuse", GF_LOG_WARNING,
+			"reader-thread-count %u is too large, using %d",
+			priv->reader_thread_count,
+			FUSE_READER_THREAD_COUNT_MAX);
+		priv->reader_thread_count = FUSE_READER_THREAD_COUNT_MAX;
+	}
+
+	priv->reader_threads = CALLOC (priv->reader_thread_count,
+				       sizeof (*priv->reader_threads));
+	ERR_ABORT (priv->reader_threads);
+	pthread_mutex_init (&priv->reader_mutex, NULL);
+	ret = pthread_key_create (&priv->iobuf_key, NULL);
+	if (ret != 0) {
+		gf_log ("glusterfs-fuse", GF_LOG_ERROR,
+			"pthread_key_create() failed (%s)", strerror (ret));
+		goto cleanup_exit;
+	}
 	
         priv->ch = fuse_mount (priv->mount_point, &args);
         if (priv->ch == NULL) {
@@ -2786,7 +2883,21 @@ init (xlator_t *this_xl)
         fuse_session_add_chan (priv->se, priv->ch);
         
         priv->fd = fuse_chan_fd (priv->ch);
-        priv->buf = data_ref (data_from_dynptr (NULL, 0));
+
+        {
+                size_t page_size = 0;
+
+                page_size = fuse_chan_bufsize (priv->ch);
+                page_size = roof (page_size, sysconf (_SC_PAGESIZE));
+
+                priv->iobuf_pool = iobuf_pool_new (FUSE_IOBUF_ARENA_PAGES *
+                                                   page_size, page_size);
+                if (!priv->iobuf_pool) {
+                        gf_log ("glusterfs-fuse", GF_LOG_ERROR,
+                                "could not create iobuf pool for requests");
+                        goto umount_exit;
+                }
+        }
 
         this_xl->ctx->top = this_xl;
         return 0;
@@ -2796,6 +2907,7 @@ umount_exit:
 cleanup_exit:
         fuse_opt_free_args (&args);
         FREE (priv->mount_point);
+        FREE (priv->reader_threads);
         FREE (priv);
         return -1;
 }
@@ -2855,5 +2967,10 @@ struct volume_options options[] = {
 	  .min  = 0, 
 	  .max  = 3600 
 	},
+	{ .key  = {"reader-thread-count"},
+	  .type = GF_OPTION_TYPE_INT,
+	  .min  = 1,
+	  .max  = FUSE_READER_THREAD_COUNT_MAX
+	},
 	{ .key = {NULL} },
 };
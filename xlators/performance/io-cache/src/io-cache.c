@@ -81,6 +81,10 @@ ioc_inode_need_revalidate (ioc_inode_t *ioc_inode)
 	int32_t ret = -1;
 	ioc_table_t *table = ioc_inode->table;
 
+	/* the change count is checked on each lookup instead */
+	if (table->change_count && ioc_inode->has_change_count)
+		return 0;
+
 	ret = gettimeofday (&tv, NULL);
 
 	if (time_elapsed (&tv, &ioc_inode->tv) >= table->cache_timeout)
@@ -200,7 +204,7 @@ ioc_lookup_cbk (call_frame_t *frame,
 	ioc_local_t *local = frame->local;
 	ioc_table_t *table = this->private;
 	ioc_page_t  *page = NULL;
-	data_t      *page_data = NULL;
+	struct iobuf *iobuf = NULL;
 	data_t      *content_data = NULL;
 	char        *src = NULL;
 	char        *dst = NULL;
@@ -218,8 +222,15 @@ ioc_lookup_cbk (call_frame_t *frame,
 	inode_ctx_get (inode, this, &tmp_ioc_inode);
 	ioc_inode = (ioc_inode_t *)(long)tmp_ioc_inode;
 	if (ioc_inode) {
-		cache_still_valid = ioc_cache_still_valid (ioc_inode, 
-							   stbuf);
+		ioc_inode_lock (ioc_inode);
+		{
+			cache_still_valid = ioc_cache_still_valid (ioc_inode, 
+								   stbuf);
+			if (table->change_count &&
+			    !ioc_change_count_still_valid (ioc_inode, dict))
+				cache_still_valid = 0;
+		}
+		ioc_inode_unlock (ioc_inode);
 		
 		if (!cache_still_valid) {
 			ioc_inode_flush (ioc_inode);
@@ -227,6 +238,7 @@ ioc_lookup_cbk (call_frame_t *frame,
 		/* update the time-stamp of revalidation */
 		ioc_inode_lock (ioc_inode);
 		{
+			ioc_inode_set_stat (ioc_inode, stbuf);
 			gettimeofday (&ioc_inode->tv, NULL);
 		}
 		ioc_inode_unlock (ioc_inode);
@@ -257,7 +269,7 @@ ioc_lookup_cbk (call_frame_t *frame,
 			
 			if (content_data) {
 				if (page) {
-					dict_unref (page->ref);
+					iobref_unref (page->iobref);
 					free (page->vector);
 					page->vector = NULL;
 					
@@ -271,11 +283,15 @@ ioc_lookup_cbk (call_frame_t *frame,
 					page = ioc_page_create (ioc_inode, 0);
 				}
 				
-				dst = CALLOC (1, stbuf->st_size);
-				page->ref = dict_ref (get_new_dict ());
-				page_data = data_from_dynptr (dst, 
-							      stbuf->st_size);
-				dict_set (page->ref, NULL, page_data);
+				iobuf = iobuf_get2 (this->ctx->iobuf_pool,
+						    stbuf->st_size);
+				ERR_ABORT (iobuf);
+				dst = iobuf_ptr (iobuf);
+
+				page->iobref = iobref_new ();
+				ERR_ABORT (page->iobref);
+				iobref_add (page->iobref, iobuf);
+				iobuf_unref (iobuf);
 				
 				src = data_to_ptr (content_data);
 				memcpy (dst, src, stbuf->st_size);
@@ -333,14 +349,14 @@ ioc_lookup_cbk (call_frame_t *frame,
 							    stbuf->st_size));
 			}
 
-			ioc_inode->mtime = stbuf->st_mtime;
+			ioc_inode_set_stat (ioc_inode, stbuf);
 			gettimeofday (&ioc_inode->tv, NULL);
 		}
 		ioc_inode_unlock (ioc_inode);
 		
 		if (content_data && 
 		    ioc_need_prune (ioc_inode->table)) {
-			ioc_prune (ioc_inode->table);
+			ioc_prune_wakeup (ioc_inode->table);
 		}
 	}
 
@@ -360,7 +376,22 @@ ioc_lookup (call_frame_t *frame,
 	    loc_t *loc,
 	    dict_t *xattr_req)
 {
+	ioc_table_t *table = this->private;
 	uint64_t content_limit = 0;
+	int32_t  ret = 0;
+
+	if (table->change_count) {
+		if (xattr_req)
+			xattr_req = dict_ref (xattr_req);
+		else
+			xattr_req = dict_new ();
+
+		ret = dict_set_uint64 (xattr_req, GLUSTERFS_CHANGE_COUNT, 0);
+		if (ret < 0)
+			gf_log (this->name, GF_LOG_DEBUG,
+				"asking the change count of %s failed",
+				loc->path);
+	}
 
 	if (GF_FILE_CONTENT_REQUESTED(xattr_req, &content_limit)) {
 		uint64_t     tmp_ioc_inode = 0;
@@ -396,6 +427,10 @@ ioc_lookup (call_frame_t *frame,
 		    FIRST_CHILD (this)->fops->lookup,
 		    loc,
 		    xattr_req);
+
+	if (table->change_count)
+		dict_unref (xattr_req);
+
 	return 0;
 }
 
@@ -461,7 +496,7 @@ ioc_cache_validate_cbk (call_frame_t *frame,
 		{
 			destroy_size = __ioc_inode_flush (ioc_inode);
 			if (op_ret >= 0)
-				ioc_inode->mtime = stbuf->st_mtime;
+				ioc_inode_set_stat (ioc_inode, stbuf);
 		}
 		ioc_inode_unlock (ioc_inode);
 		local_stbuf = NULL;
@@ -850,11 +885,8 @@ ioc_need_prune (ioc_table_t *table)
 {
 	int64_t cache_difference = 0;
   
-	ioc_table_lock (table);
-	{
-		cache_difference = table->cache_used - table->cache_size;
-	}
-	ioc_table_unlock (table);
+	/* a stale value only delays or repeats a wakeup of the pruner */
+	cache_difference = table->cache_used - table->cache_size;
 
 	if (cache_difference > 0)
 		return 1;
@@ -977,7 +1009,7 @@ dispatch_requests (call_frame_t *frame,
 	ioc_frame_return (frame);
 
 	if (ioc_need_prune (ioc_inode->table)) {
-		ioc_prune (ioc_inode->table);
+		ioc_prune_wakeup (ioc_inode->table);
 	}
 
 	return;
@@ -1004,7 +1036,6 @@ ioc_readv (call_frame_t *frame,
 	uint64_t     tmp_ioc_inode = 0;
 	ioc_inode_t *ioc_inode = NULL;
 	ioc_local_t *local = NULL;
-	uint32_t     weight = 0;
 
 	inode_ctx_get (fd->inode, this, &tmp_ioc_inode);
 	ioc_inode = (ioc_inode_t *)(long)tmp_ioc_inode;
@@ -1047,14 +1078,8 @@ ioc_readv (call_frame_t *frame,
 		"NEW REQ (%p) offset = %"PRId64" && size = %"GF_PRI_SIZET"", 
 		frame, offset, size);
 
-	weight = ioc_inode->weight;
-
-	ioc_table_lock (ioc_inode->table);
-	{
-		list_move_tail (&ioc_inode->inode_lru, 
-				&ioc_inode->table->inode_lru[weight]);
-	}
-	ioc_table_unlock (ioc_inode->table);
+	/* the pruner moves it along the lru, see ioc_prune */
+	ioc_inode->referenced = 1;
 
 	dispatch_requests (frame, ioc_inode, fd, offset, size);
   
@@ -1391,6 +1416,19 @@ init (xlator_t *this)
 			table->cache_timeout);
 	}
 
+	if (dict_get (options, "change-count")) {
+		if (gf_string2boolean (data_to_str (dict_get (options,
+							      "change-count")),
+				       &table->change_count) == -1) {
+			gf_log (this->name, GF_LOG_ERROR,
+				"'change-count' takes only boolean options");
+			return -1;
+		}
+		if (table->change_count)
+			gf_log (this->name, GF_LOG_DEBUG,
+				"revalidating cache on change count");
+	}
+
 	INIT_LIST_HEAD (&table->priority_list);
 	if (dict_get (options, "priority")) {
 		char *option_list = data_to_str (dict_get (options, 
@@ -1413,6 +1451,17 @@ init (xlator_t *this)
 		INIT_LIST_HEAD (&table->inode_lru[index]);
 
 	pthread_mutex_init (&table->table_lock, NULL);
+
+	pthread_mutex_init (&table->prune_lock, NULL);
+	pthread_cond_init (&table->prune_cond, NULL);
+	if (pthread_create (&table->prune_thread, NULL, ioc_prune_thread,
+			    table) != 0) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"could not start the pruner thread (%s)",
+			strerror (errno));
+		return -1;
+	}
+
 	this->private = table;
 	return 0;
 }
@@ -1428,6 +1477,16 @@ fini (xlator_t *this)
 {
 	ioc_table_t *table = this->private;
 
+	pthread_mutex_lock (&table->prune_lock);
+	{
+		table->prune_exit = 1;
+		pthread_cond_signal (&table->prune_cond);
+	}
+	pthread_mutex_unlock (&table->prune_lock);
+	pthread_join (table->prune_thread, NULL);
+
+	pthread_cond_destroy (&table->prune_cond);
+	pthread_mutex_destroy (&table->prune_lock);
 	pthread_mutex_destroy (&table->table_lock);
 	FREE (table);
 
@@ -1474,5 +1533,8 @@ struct volume_options options[] = {
 	  .min  = 4 * GF_UNIT_MB, 
 	  .max  = 6 * GF_UNIT_GB 
 	},
+	{ .key  = {"change-count"}, 
+	  .type = GF_OPTION_TYPE_BOOL 
+	},
 	{ .key = {NULL} },
 };
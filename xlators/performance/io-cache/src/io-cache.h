@@ -39,6 +39,7 @@
 
 #define IOC_PAGE_SIZE    (1024 * 128)   /* 128KB */
 #define IOC_CACHE_SIZE   (32 * 1024 * 1024)
+#define IOC_PAGE_HASH_MIN 16            /* buckets of a new page index */
 
 struct ioc_table;
 struct ioc_local;
@@ -75,7 +76,7 @@ struct ioc_fill {
 	size_t size;           
 	struct iovec *vector;  
 	int32_t count;
-	dict_t *refs;
+	struct iobref *iobref;
 };
 
 struct ioc_local {
@@ -106,29 +107,41 @@ struct ioc_local {
 struct ioc_page {
 	struct list_head pages;
 	struct list_head page_lru;
+	struct list_head page_hash;  /* in a bucket of inode->page_hash */
 	struct ioc_inode *inode;   /* inode this page belongs to */
 	struct ioc_priority *priority;
 	char dirty;
 	char ready;
+	char referenced;           /* read since the pruner last passed it */
 	struct iovec *vector;
 	int32_t count;
 	off_t offset;
 	size_t size;
 	struct ioc_waitq *waitq;
-	dict_t *ref;
+	struct iobref *iobref;
 	pthread_mutex_t page_lock;
 };
 
 struct ioc_inode {
 	struct ioc_table *table;
 	struct list_head pages;      /* list of pages of this inode */
+	struct list_head *page_hash; /* the pages by offset */
+	uint32_t page_hash_size;     /* power of two */
+	uint32_t page_count;
 	struct list_head inode_list; /* list of inodes, maintained by io-cache translator */
 	struct list_head inode_lru;
 	struct list_head page_lru;
 	struct ioc_waitq *waitq;
 	pthread_mutex_t inode_lock;
 	uint32_t weight;             /* weight of the inode, increases on each read */
+	char referenced;             /* read since the pruner last passed it */
 	time_t mtime;             /* mtime of the server file when last cached */
+	uint32_t mtime_nsec;
+	time_t ctime;
+	uint32_t ctime_nsec;
+	off_t size;
+	uint64_t change_count;       /* GLUSTERFS_CHANGE_COUNT at last lookup */
+	char has_change_count;       /* the server keeps a change count */
 	struct timeval tv;           /* time-stamp at last re-validate */
 };
 
@@ -146,6 +159,14 @@ struct ioc_table {
 	uint32_t inode_count;
 	int32_t cache_timeout;
 	int32_t max_pri;
+	gf_boolean_t change_count;   /* revalidate only when the change
+					count of a file moves */
+
+	pthread_t prune_thread;      /* prunes off the read path */
+	pthread_mutex_t prune_lock;
+	pthread_cond_t prune_cond;
+	char prune_pending;
+	char prune_exit;
 };
 
 typedef struct ioc_table ioc_table_t;
@@ -321,9 +342,23 @@ int8_t
 ioc_cache_still_valid (ioc_inode_t *ioc_inode,
 		       struct stat *stbuf);
 
+void
+ioc_inode_set_stat (ioc_inode_t *ioc_inode,
+		    struct stat *stbuf);
+
+int8_t
+ioc_change_count_still_valid (ioc_inode_t *ioc_inode,
+			      dict_t *xattr);
+
 int32_t
 ioc_prune (ioc_table_t *table);
 
+void *
+ioc_prune_thread (void *data);
+
+void
+ioc_prune_wakeup (ioc_table_t *table);
+
 int32_t
 ioc_need_prune (ioc_table_t *table);
 
@@ -194,6 +194,7 @@ ioc_inode_destroy (ioc_inode_t *ioc_inode)
 	ioc_table_unlock (table);
   
 	ioc_inode_flush (ioc_inode);
+	FREE (ioc_inode->page_hash);
 
 	pthread_mutex_destroy (&ioc_inode->inode_lock);
 	free (ioc_inode);
@@ -30,36 +30,77 @@
 #include <assert.h>
 #include <sys/time.h>
 
+static inline struct list_head *
+ioc_page_bucket (ioc_inode_t *ioc_inode,
+		 off_t rounded_offset)
+{
+	uint64_t index = rounded_offset / ioc_inode->table->page_size;
+
+	return &ioc_inode->page_hash[index & (ioc_inode->page_hash_size - 1)];
+}
+
+
+/*
+ * __ioc_page_hash_grow - double the buckets of the page index of an inode
+ *
+ * @ioc_inode:
+ *
+ * assumes ioc_inode is locked
+ */
+static int
+__ioc_page_hash_grow (ioc_inode_t *ioc_inode)
+{
+	struct list_head *page_hash = NULL;
+	ioc_page_t       *page = NULL;
+	uint32_t          size = 0;
+	uint32_t          i = 0;
+
+	size = ioc_inode->page_hash_size * 2;
+	if (!size)
+		size = IOC_PAGE_HASH_MIN;
+
+	page_hash = CALLOC (size, sizeof (*page_hash));
+	if (!page_hash)
+		return -1;
+
+	for (i = 0; i < size; i++)
+		INIT_LIST_HEAD (&page_hash[i]);
+
+	FREE (ioc_inode->page_hash);
+	ioc_inode->page_hash = page_hash;
+	ioc_inode->page_hash_size = size;
+
+	list_for_each_entry (page, &ioc_inode->pages, pages) {
+		list_add (&page->page_hash,
+			  ioc_page_bucket (ioc_inode, page->offset));
+	}
+
+	return 0;
+}
+
+
 ioc_page_t *
 ioc_page_get (ioc_inode_t *ioc_inode,
 	      off_t offset)
 {
-	int8_t       found = 0;
 	ioc_page_t  *page = NULL;
 	ioc_table_t *table = ioc_inode->table;
 	off_t        rounded_offset = floor (offset, table->page_size);
 
-	if (list_empty (&ioc_inode->pages)) {
+	if (!ioc_inode->page_count) {
 		return NULL;
 	}
 
-	list_for_each_entry (page, &ioc_inode->pages, pages) {
+	list_for_each_entry (page, ioc_page_bucket (ioc_inode, rounded_offset),
+			     page_hash) {
 		if (page->offset == rounded_offset) {
-			found = 1;
-			break;
+			/* the pruner gives it another round in the lru */
+			page->referenced = 1;
+			return page;
 		}
 	}
 
-	/* was previously returning ioc_inode itself.., 
-	 * 1st of its type and found one more downstairs :O */
-	if (!found){
-		page = NULL;
-	} else {
-		/* push the page to the end of the lru list */
-		list_move_tail (&page->page_lru, &ioc_inode->page_lru);
-	}
-
-	return page;
+	return NULL;
 }
 
 
@@ -83,6 +124,8 @@ ioc_page_destroy (ioc_page_t *page)
 
 		list_del (&page->pages);
 		list_del (&page->page_lru);
+		list_del (&page->page_hash);
+		page->inode->page_count--;
     
 		gf_log (page->inode->table->xl->name, GF_LOG_DEBUG,
 			"destroying page = %p, offset = %"PRId64" "
@@ -90,7 +133,7 @@ ioc_page_destroy (ioc_page_t *page)
 			page, page->offset, page->inode);
     
 		if (page->vector){
-			dict_unref (page->ref);
+			iobref_unref (page->iobref);
 			free (page->vector);
 			page->vector = NULL;
 		}
@@ -108,80 +151,184 @@ ioc_page_destroy (ioc_page_t *page)
 }
 
 /*
- * ioc_prune - prune the cache. we have a limit to the number of pages we
- *             can have in-memory.
+ * __ioc_inode_prune - prune pages of an inode, least recently used first
+ *
+ * @ioc_inode:
+ * @size_to_prune: bytes to prune at most
+ * @spare: spare the pages read since the last call, and clear their mark
+ * @pages_pruned: incremented per page pruned
+ *
+ * assumes table and ioc_inode are locked, returns the bytes pruned
+ */
+static uint64_t
+__ioc_inode_prune (ioc_inode_t *ioc_inode,
+		   uint64_t size_to_prune,
+		   int32_t spare,
+		   uint32_t *pages_pruned)
+{
+	ioc_page_t *page = NULL, *next = NULL;
+	struct list_head spared;
+	uint64_t size_pruned = 0;
+	int64_t ret = -1;
+
+	INIT_LIST_HEAD (&spared);
+
+	list_for_each_entry_safe (page, next, &ioc_inode->page_lru, page_lru) {
+		if (size_pruned >= size_to_prune)
+			break;
+
+		if (spare && page->referenced) {
+			page->referenced = 0;
+			list_move_tail (&page->page_lru, &spared);
+			continue;
+		}
+
+		ret = ioc_page_destroy (page);
+		if (ret != -1) {
+			size_pruned += ret;
+			(*pages_pruned)++;
+		}
+	}
+
+	list_splice (&spared, ioc_inode->page_lru.prev);
+
+	return size_pruned;
+}
+
+
+/*
+ * ioc_prune - prune the cache down to cache-size. the lru lists are swept
+ *             as a clock: inodes and pages read since the last sweep are
+ *             moved to the tail for another round instead of being pruned,
+ *             so that reads only have to mark them.
  *
  * @table: ioc_table_t of this translator
  *
+ * called by the pruner thread, see ioc_prune_wakeup
  */
 int32_t
 ioc_prune (ioc_table_t *table)
 {
 	ioc_inode_t *curr = NULL, *next_ioc_inode = NULL;
-	ioc_page_t *page = NULL, *next = NULL;
-	int32_t ret = -1;
+	struct list_head spared;
 	int32_t index = 0;
+	int32_t sweep = 0;
 	uint64_t size_to_prune = 0;
 	uint64_t size_pruned = 0;
+	uint64_t ret = 0;
+	uint32_t pages_pruned = 0;
+
+	INIT_LIST_HEAD (&spared);
 
 	ioc_table_lock (table);
 	{
-		size_to_prune = table->cache_used - table->cache_size;
-		/* take out the least recently used inode */
-		for (index=0; index < table->max_pri; index++) {
-			list_for_each_entry_safe (curr, next_ioc_inode, 
-						  &table->inode_lru[index], 
-						  inode_lru) {
-				/* prune page-by-page for this inode, till 
-				 * we reach the equilibrium */
-				ioc_inode_lock (curr);
-				/* { */
-
-				list_for_each_entry_safe (page, next, 
-							  &curr->page_lru, 
-							  page_lru) {
-					/* done with all pages, and not 
-					 * reached equilibrium yet??
-					 * continue with next inode in 
-					 * lru_list */
-					size_pruned += page->size;
-					ret = ioc_page_destroy (page);
-
-					if (ret != -1)
-						table->cache_used -= ret;
-	    
-					gf_log (table->xl->name,
-						GF_LOG_DEBUG,
-						"index = %d && table->cache_"
-						"used = %"PRIu64" && table->"
-						"cache_size = %"PRIu64, 
-						index, table->cache_used, 
-						table->cache_size);
-	    
-					if (size_pruned >= size_to_prune)
-						break;
-				} /* list_for_each_entry_safe(page...) */
-				if (list_empty (&curr->pages)) {
-					list_del_init (&curr->inode_lru);
-				}
+		if (table->cache_used > table->cache_size)
+			size_to_prune = table->cache_used - table->cache_size;
 
-				/* } */ 
-				ioc_inode_unlock (curr);
-	
+		/* the second sweep prunes even what was read again since
+		   the first one, so that a busy cache still shrinks */
+		for (sweep = 0; sweep < 2; sweep++) {
+			for (index = 0; index < table->max_pri; index++) {
 				if (size_pruned >= size_to_prune)
 					break;
-			} /* list_for_each_entry_safe (curr...) */
-      
-			if (size_pruned >= size_to_prune)
-				break;
-		} /* for(index=0;...) */
 
-	} /* ioc_inode_table locked region end */
+				list_for_each_entry_safe (curr, next_ioc_inode,
+							  &table->inode_lru[index],
+							  inode_lru) {
+					if (size_pruned >= size_to_prune)
+						break;
+
+					if (!sweep && curr->referenced) {
+						curr->referenced = 0;
+						list_move_tail (&curr->inode_lru,
+								&spared);
+						continue;
+					}
+
+					/* elsewhere the inode lock is taken
+					   before the table lock */
+					if (pthread_mutex_trylock (&curr->inode_lock))
+						continue;
+
+					ret = __ioc_inode_prune (curr,
+								 size_to_prune -
+								 size_pruned,
+								 !sweep,
+								 &pages_pruned);
+					pthread_mutex_unlock (&curr->inode_lock);
+
+					table->cache_used -= ret;
+					size_pruned += ret;
+				}
+
+				list_splice_init (&spared,
+						  table->inode_lru[index].prev);
+			}
+		}
+	}
 	ioc_table_unlock (table);
 
+	gf_log (table->xl->name, GF_LOG_DEBUG,
+		"pruned %u pages (%"PRIu64" bytes) of %"PRIu64" to prune",
+		pages_pruned, size_pruned, size_to_prune);
+
 	return 0;
 }
 
+
+/*
+ * ioc_prune_thread - prune the cache whenever ioc_prune_wakeup asks to
+ *
+ * @data: ioc_table_t of this translator
+ *
+ */
+void *
+ioc_prune_thread (void *data)
+{
+	ioc_table_t *table = data;
+
+	while (1) {
+		pthread_mutex_lock (&table->prune_lock);
+		{
+			while (!table->prune_pending && !table->prune_exit)
+				pthread_cond_wait (&table->prune_cond,
+						   &table->prune_lock);
+
+			table->prune_pending = 0;
+		}
+		pthread_mutex_unlock (&table->prune_lock);
+
+		if (table->prune_exit)
+			break;
+
+		ioc_prune (table);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ioc_prune_wakeup - have the pruner thread prune the cache
+ *
+ * @table: ioc_table_t of this translator
+ *
+ */
+void
+ioc_prune_wakeup (ioc_table_t *table)
+{
+	/* already asked */
+	if (table->prune_pending)
+		return;
+
+	pthread_mutex_lock (&table->prune_lock);
+	{
+		table->prune_pending = 1;
+		pthread_cond_signal (&table->prune_cond);
+	}
+	pthread_mutex_unlock (&table->prune_lock);
+}
+
 /*
  * ioc_page_create - create a new page. 
  *
@@ -205,12 +352,22 @@ ioc_page_create (ioc_inode_t *ioc_inode,
 		return NULL;
 	}
    
+	if (ioc_inode->page_count >= ioc_inode->page_hash_size
+	    && __ioc_page_hash_grow (ioc_inode) != 0
+	    && !ioc_inode->page_hash) {
+		free (newpage);
+		return NULL;
+	}
+
 	newpage->offset = rounded_offset;
 	newpage->inode = ioc_inode;
 	pthread_mutex_init (&newpage->page_lock, NULL);
 
 	list_add_tail (&newpage->page_lru, &ioc_inode->page_lru);
 	list_add_tail (&newpage->pages, &ioc_inode->pages);
+	list_add (&newpage->page_hash,
+		  ioc_page_bucket (ioc_inode, rounded_offset));
+	ioc_inode->page_count++;
 
 	page = newpage;
 
@@ -275,17 +432,15 @@ ioc_cache_still_valid (ioc_inode_t *ioc_inode,
 {
 	int8_t cache_still_valid = 1;
   
-#if 0
+	/* mtime alone misses writes within its granularity, the size and
+	   ctime catch most of those */
 	if (!stbuf || (stbuf->st_mtime != ioc_inode->mtime) || 
-	    (stbuf->st_mtim.tv_nsec != ioc_inode->stbuf.st_mtim.tv_nsec))
-		cache_still_valid = 0;
-
-#else
-	if (!stbuf || (stbuf->st_mtime != ioc_inode->mtime))
+	    (ST_MTIM_NSEC (stbuf) != ioc_inode->mtime_nsec) ||
+	    (stbuf->st_ctime != ioc_inode->ctime) ||
+	    (ST_CTIM_NSEC (stbuf) != ioc_inode->ctime_nsec) ||
+	    (stbuf->st_size != ioc_inode->size))
 		cache_still_valid = 0;
 
-#endif
-
 #if 0
 	/* talk with avati@zresearch.com to enable this section */
 	if (!ioc_inode->mtime && stbuf) {
@@ -298,6 +453,63 @@ ioc_cache_still_valid (ioc_inode_t *ioc_inode,
 }
 
 
+/*
+ * ioc_inode_set_stat - remember the stbuf the cached pages of ioc_inode
+ *                      are valid against, see ioc_cache_still_valid
+ *
+ * @ioc_inode:
+ * @stbuf:
+ *
+ * assumes ioc_inode is locked
+ */
+void
+ioc_inode_set_stat (ioc_inode_t *ioc_inode,
+		    struct stat *stbuf)
+{
+	ioc_inode->mtime = stbuf->st_mtime;
+	ioc_inode->mtime_nsec = ST_MTIM_NSEC (stbuf);
+	ioc_inode->ctime = stbuf->st_ctime;
+	ioc_inode->ctime_nsec = ST_CTIM_NSEC (stbuf);
+	ioc_inode->size = stbuf->st_size;
+}
+
+
+/*
+ * ioc_change_count_still_valid - see if cached pages of ioc_inode are still
+ * valid against the change count the server returned in a lookup, and
+ * remember it
+ *
+ * @ioc_inode:
+ * @xattr: dict of the lookup reply
+ *
+ * assumes ioc_inode is locked
+ */
+int8_t
+ioc_change_count_still_valid (ioc_inode_t *ioc_inode,
+			      dict_t *xattr)
+{
+	uint64_t change_count = 0;
+	int8_t   cache_still_valid = 1;
+
+	if (!xattr ||
+	    dict_get_uint64 (xattr, GLUSTERFS_CHANGE_COUNT,
+			     &change_count) != 0) {
+		/* the server (or the volume on the way) does not keep it */
+		ioc_inode->has_change_count = 0;
+		return 1;
+	}
+
+	if (ioc_inode->has_change_count &&
+	    ioc_inode->change_count != change_count)
+		cache_still_valid = 0;
+
+	ioc_inode->change_count = change_count;
+	ioc_inode->has_change_count = 1;
+
+	return cache_still_valid;
+}
+
+
 void
 ioc_waitq_return (ioc_waitq_t *waitq)
 {
@@ -351,7 +563,7 @@ ioc_fault_cbk (call_frame_t *frame,
 		} 
     
 		if (op_ret >= 0)
-			ioc_inode->mtime = stbuf->st_mtime;
+			ioc_inode_set_stat (ioc_inode, stbuf);
     
 		gettimeofday (&ioc_inode->tv, NULL);
     
@@ -374,7 +586,7 @@ ioc_fault_cbk (call_frame_t *frame,
 					table->page_size, ioc_inode);
 			} else {
 				if (page->vector) {
-					dict_unref (page->ref);
+					iobref_unref (page->iobref);
 					free (page->vector);
 					page->vector = NULL;
 				}
@@ -383,8 +595,8 @@ ioc_fault_cbk (call_frame_t *frame,
 				page->vector = iov_dup (vector, count);
 				page->count = count;
 				if (frame->root->rsp_refs) {
-					dict_ref (frame->root->rsp_refs);
-					page->ref = frame->root->rsp_refs;
+					page->iobref = iobref_ref (
+						frame->root->rsp_refs);
 				} else {
 					/* TODO: we have got a response to 
 					 * our request and no data */
@@ -433,7 +645,7 @@ ioc_fault_cbk (call_frame_t *frame,
 	}
 
 	if (ioc_need_prune (ioc_inode->table)) {
-		ioc_prune (ioc_inode->table);
+		ioc_prune_wakeup (ioc_inode->table);
 	}
 
 	gf_log (this->name, GF_LOG_DEBUG, "fault frame %p returned", frame);
@@ -500,15 +712,14 @@ ioc_frame_fill (ioc_page_t *page,
 	off_t src_offset = 0;
 	off_t dst_offset = 0;
 	ssize_t copy_size = 0;
-	ioc_inode_t *ioc_inode = page->inode;
   
 	gf_log (frame->this->name, GF_LOG_DEBUG,
 		"frame (%p) offset = %"PRId64" && size = %"GF_PRI_SIZET" "
 		"&& page->size = %"GF_PRI_SIZET" && wait_count = %d", 
 		frame, offset, size, page->size, local->wait_count);
 
-	/* immediately move this page to the end of the page_lru list */
-	list_move_tail (&page->page_lru, &ioc_inode->page_lru);
+	/* keep this page in the cache a while longer */
+	page->referenced = 1;
 	/* fill local->pending_size bytes from local->pending_offset */
 	if (local->op_ret != -1 && page->size) {
 		if (offset > page->offset)
@@ -543,7 +754,7 @@ ioc_frame_fill (ioc_page_t *page,
 			ERR_ABORT (new);
 			new->offset = page->offset;
 			new->size = copy_size;
-			new->refs = dict_ref (page->ref);
+			new->iobref = iobref_ref (page->iobref);
 			new->count = iov_subset (page->vector,
 						 page->count,
 						 src_offset,
@@ -609,12 +820,12 @@ ioc_frame_unwind (call_frame_t *frame)
 	int32_t count = 0;
 	struct iovec *vector = NULL;
 	int32_t copied = 0;
-	dict_t *refs = NULL;
+	struct iobref *iobref = NULL;
 	struct stat stbuf = {0,};
 	int32_t op_ret = 0;
 
 	//  ioc_local_lock (local);
-	refs = get_new_dict ();
+	iobref = iobref_new ();
 
 	frame->local = NULL;
 
@@ -639,15 +850,16 @@ ioc_frame_unwind (call_frame_t *frame)
     
 		copied += (fill->count * sizeof (*vector));
 
-		dict_copy (fill->refs, refs);
+		if (fill->iobref)
+			iobref_merge (iobref, fill->iobref);
 
 		list_del (&fill->list);
-		dict_unref (fill->refs);
+		iobref_unref (fill->iobref);
 		free (fill->vector);
 		free (fill);
 	}
   
-	frame->root->rsp_refs = dict_ref (refs);
+	frame->root->rsp_refs = iobref;
   
 	op_ret = iov_length (vector, count);
 	gf_log (frame->this->name, GF_LOG_DEBUG,
@@ -662,7 +874,7 @@ ioc_frame_unwind (call_frame_t *frame)
 		      count,
 		      &stbuf);
 
-	dict_unref (refs);
+	iobref_unref (iobref);
     
 	pthread_mutex_destroy (&local->local_lock);
 	free (local);
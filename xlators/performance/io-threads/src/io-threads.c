@@ -30,29 +30,59 @@
 #include "io-threads.h"
 
 static void
-iot_queue (iot_worker_t *worker,
+iot_queue (xlator_t *this,
+           iot_file_t *file,
            call_stub_t *stub);
 
-static call_stub_t *
-iot_dequeue (iot_worker_t *worker);
-
 static iot_worker_t * 
 iot_schedule (iot_conf_t *conf,
               iot_file_t *file,
               ino_t ino)
 {
-	int32_t cnt = (ino % conf->thread_count);
-	iot_worker_t *trav = conf->workers.next;
+	iot_worker_t *trav = &conf->workers[ino % conf->thread_count];
 
-	for (; cnt; cnt--)
-		trav = trav->next;
-  
-	if (file)
+	if (file) {
 		file->worker = trav;
+		pthread_mutex_init (&file->lock, NULL);
+		INIT_LIST_HEAD (&file->pending);
+	}
 	trav->fd_count++;
 	return trav;
 }
 
+static iot_file_t *
+iot_file_from_fd (xlator_t *this,
+                  fd_t *fd)
+{
+	uint64_t tmp_file = 0;
+
+	if (fd_ctx_get (fd, this, &tmp_file))
+		return NULL;
+
+	return (iot_file_t *)(long)tmp_file;
+}
+
+static void
+iot_file_new (xlator_t *this,
+              fd_t *fd)
+{
+	iot_conf_t *conf = this->private;
+	iot_file_t *file = CALLOC (1, sizeof (*file));
+	ERR_ABORT (file);
+
+	iot_schedule (conf, file, fd->inode->ino);
+	file->fd = fd;
+
+	fd_ctx_set (fd, this, (uint64_t)(long)file);
+
+	pthread_mutex_lock (&conf->files_lock);
+	file->next = &conf->files;
+	file->prev = file->next->prev;
+	file->next->prev = file;
+	file->prev->next = file;
+	pthread_mutex_unlock (&conf->files_lock);
+}
+
 int32_t
 iot_open_cbk (call_frame_t *frame,
               void *cookie,
@@ -61,34 +91,19 @@ iot_open_cbk (call_frame_t *frame,
               int32_t op_errno,
               fd_t *fd)
 {
-	iot_conf_t *conf = this->private;
-
-	if (op_ret >= 0) {
-		iot_file_t *file = CALLOC (1, sizeof (*file));
-		ERR_ABORT (file);
-
-		iot_schedule (conf, file, fd->inode->ino);
-		file->fd = fd;
-
-		fd_ctx_set (fd, this, (uint64_t)(long)file);
+	if (op_ret >= 0)
+		iot_file_new (this, fd);
 
-		pthread_mutex_lock (&conf->files_lock);
-		file->next = &conf->files;
-		file->prev = file->next->prev;
-		file->next->prev = file;
-		file->prev->next = file;
-		pthread_mutex_unlock (&conf->files_lock);
-	}
 	STACK_UNWIND (frame, op_ret, op_errno, fd);
 	return 0;
 }
 
-int32_t
-iot_open (call_frame_t *frame,
-          xlator_t *this,
-          loc_t *loc,
-          int32_t flags,
-	  fd_t *fd)
+static int32_t
+iot_open_wrapper (call_frame_t *frame,
+                  xlator_t *this,
+                  loc_t *loc,
+                  int32_t flags,
+                  fd_t *fd)
 {
 	STACK_WIND (frame,
 		    iot_open_cbk,
@@ -100,6 +115,32 @@ iot_open (call_frame_t *frame,
 	return 0;
 }
 
+int32_t
+iot_open (call_frame_t *frame,
+          xlator_t *this,
+          loc_t *loc,
+          int32_t flags,
+	  fd_t *fd)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_open_stub (frame, iot_open_wrapper, loc, flags, fd);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_open call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
 
 int32_t
 iot_create_cbk (call_frame_t *frame,
@@ -111,35 +152,20 @@ iot_create_cbk (call_frame_t *frame,
 		inode_t *inode,
 		struct stat *stbuf)
 {
-	iot_conf_t *conf = this->private;
+	if (op_ret >= 0)
+		iot_file_new (this, fd);
 
-	if (op_ret >= 0) {
-		iot_file_t *file = CALLOC (1, sizeof (*file));
-		ERR_ABORT (file);
-
-		iot_schedule (conf, file, fd->inode->ino);
-		file->fd = fd;
-
-		fd_ctx_set (fd, this, (uint64_t)(long)file);
-
-		pthread_mutex_lock (&conf->files_lock);
-		file->next = &conf->files;
-		file->prev = file->next->prev;
-		file->next->prev = file;
-		file->prev->next = file;
-		pthread_mutex_unlock (&conf->files_lock);
-	}
 	STACK_UNWIND (frame, op_ret, op_errno, fd, inode, stbuf);
 	return 0;
 }
 
-int32_t
-iot_create (call_frame_t *frame,
-            xlator_t *this,
-	    loc_t *loc,
-            int32_t flags,
-            mode_t mode,
-	    fd_t *fd)
+static int32_t
+iot_create_wrapper (call_frame_t *frame,
+                    xlator_t *this,
+                    loc_t *loc,
+                    int32_t flags,
+                    mode_t mode,
+                    fd_t *fd)
 {
 	STACK_WIND (frame,
 		    iot_create_cbk,
@@ -152,6 +178,34 @@ iot_create (call_frame_t *frame,
 	return 0;
 }
 
+int32_t
+iot_create (call_frame_t *frame,
+            xlator_t *this,
+	    loc_t *loc,
+            int32_t flags,
+            mode_t mode,
+	    fd_t *fd)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_create_stub (frame, iot_create_wrapper, loc, flags, mode,
+				fd);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_create call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL, NULL, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
 
 
 int32_t
@@ -164,10 +218,6 @@ iot_readv_cbk (call_frame_t *frame,
                int32_t count,
 	       struct stat *stbuf)
 {
-	iot_local_t *local = frame->local;
-
-	local->frame_size = 0; //iov_length (vector, count);
-
 	STACK_UNWIND (frame, op_ret, op_errno, vector, count, stbuf);
 
 	return 0;
@@ -200,7 +250,6 @@ iot_readv (call_frame_t *frame,
 	call_stub_t *stub;
 	iot_local_t *local = NULL;
 	iot_file_t *file = NULL;
-	iot_worker_t *worker = NULL;
 	uint64_t tmp_file = 0;
 
 	if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -211,7 +260,6 @@ iot_readv (call_frame_t *frame,
 	}
 
 	file = (iot_file_t *)(long)tmp_file;
-	worker = file->worker;
 
 	local = CALLOC (1, sizeof (*local));
 	ERR_ABORT (local);
@@ -229,7 +277,7 @@ iot_readv (call_frame_t *frame,
 		return 0;
 	}
 
-	iot_queue (worker, stub);
+	iot_queue (this, file, stub);
 
 	return 0;
 }
@@ -266,7 +314,6 @@ iot_flush (call_frame_t *frame,
 	call_stub_t *stub;
 	iot_local_t *local = NULL;
 	iot_file_t *file = NULL;
-	iot_worker_t *worker = NULL;
 	uint64_t tmp_file = 0;
 
 	if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -277,7 +324,6 @@ iot_flush (call_frame_t *frame,
 	}
 
 	file = (iot_file_t *)(long)tmp_file;
-	worker = file->worker;
 
 	local = CALLOC (1, sizeof (*local));
 	ERR_ABORT (local);
@@ -292,7 +338,7 @@ iot_flush (call_frame_t *frame,
 		STACK_UNWIND (frame, -1, ENOMEM);
 		return 0;
 	}
-	iot_queue (worker, stub);
+	iot_queue (this, file, stub);
 
 	return 0;
 }
@@ -332,7 +378,6 @@ iot_fsync (call_frame_t *frame,
 	call_stub_t *stub;
 	iot_local_t *local = NULL;
 	iot_file_t *file = NULL;
-	iot_worker_t *worker = NULL;
 	uint64_t tmp_file = 0;
 
 	if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -343,7 +388,6 @@ iot_fsync (call_frame_t *frame,
 	}
 
 	file = (iot_file_t *)(long)tmp_file;
-	worker = file->worker;
 
 	local = CALLOC (1, sizeof (*local));
 	ERR_ABORT (local);
@@ -359,7 +403,7 @@ iot_fsync (call_frame_t *frame,
 		STACK_UNWIND (frame, -1, ENOMEM);
 		return 0;
 	}
-	iot_queue (worker, stub);
+	iot_queue (this, file, stub);
 
 	return 0;
 }
@@ -372,10 +416,6 @@ iot_writev_cbk (call_frame_t *frame,
                 int32_t op_errno,
 		struct stat *stbuf)
 {
-	iot_local_t *local = frame->local;
-
-	local->frame_size = 0; /* hehe, caught me! */
-
 	STACK_UNWIND (frame, op_ret, op_errno, stbuf);
 	return 0;
 }
@@ -410,7 +450,6 @@ iot_writev (call_frame_t *frame,
 	call_stub_t *stub;
 	iot_local_t *local = NULL;
 	iot_file_t *file = NULL;
-	iot_worker_t *worker = NULL;
 	uint64_t tmp_file = 0;
 
 	if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -421,15 +460,9 @@ iot_writev (call_frame_t *frame,
 	}
 
 	file = (iot_file_t *)(long)tmp_file;
-	worker = file->worker;
 
 	local = CALLOC (1, sizeof (*local));
 	ERR_ABORT (local);
-
-	if (frame->root->req_refs)
-		local->frame_size = dict_serialized_length (frame->root->req_refs);
-	else
-		local->frame_size = iov_length (vector, count);
 	frame->local = local;
   
 	stub = fop_writev_stub (frame, iot_writev_wrapper,
@@ -441,7 +474,7 @@ iot_writev (call_frame_t *frame,
 		return 0;
 	}
 
-	iot_queue (worker, stub);
+	iot_queue (this, file, stub);
 
 	return 0;
 }
@@ -488,7 +521,6 @@ iot_lk (call_frame_t *frame,
 	call_stub_t *stub;
 	iot_local_t *local = NULL;
 	iot_file_t *file = NULL;
-	iot_worker_t *worker = NULL;
 	uint64_t tmp_file = 0;
 
 	if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -499,7 +531,6 @@ iot_lk (call_frame_t *frame,
 	}
 
 	file = (iot_file_t *)(long)tmp_file;
-	worker = file->worker;
 
 	local = CALLOC (1, sizeof (*local));
 	ERR_ABORT (local);
@@ -514,7 +545,7 @@ iot_lk (call_frame_t *frame,
 		return 0;
 	}
     
-	iot_queue (worker, stub);
+	iot_queue (this, file, stub);
 
 	return 0;
 }
@@ -553,40 +584,33 @@ iot_stat (call_frame_t *frame,
 {
 	call_stub_t *stub;
 	iot_local_t *local = NULL;
-	iot_worker_t *worker = NULL;
-	iot_conf_t *conf;
+	iot_file_t *file = NULL;
 	fd_t *fd = NULL;
 
-	conf = this->private;
-
 	local = CALLOC (1, sizeof (*local));
 	ERR_ABORT (local);
 	frame->local = local;
 
 	fd = fd_lookup (loc->inode, frame->root->pid);
 
-	if (fd == NULL) {
-		STACK_WIND(frame,
-			   iot_stat_cbk,
-			   FIRST_CHILD(this),
-			   FIRST_CHILD(this)->fops->stat,
-			   loc);
-		return 0;
-	} 
-  
-	fd_unref (fd);
-
-	worker = iot_schedule (conf, NULL, loc->inode->ino);
+	/* without an fd open on the inode it goes to a worker of its
+	   class like the other path based fops */
+	if (fd)
+		file = iot_file_from_fd (this, fd);
 
 	stub = fop_stat_stub (frame,
 			      iot_stat_wrapper,
 			      loc);
 	if (!stub) {
+		if (fd)
+			fd_unref (fd);
 		gf_log (this->name, GF_LOG_ERROR, "cannot get fop_stat call stub");
 		STACK_UNWIND (frame, -1, ENOMEM, NULL);
 		return 0;
 	}
-	iot_queue (worker, stub);
+	iot_queue (this, file, stub);
+	if (fd)
+		fd_unref (fd);
 
 	return 0;
 }
@@ -625,7 +649,6 @@ iot_fstat (call_frame_t *frame,
 	call_stub_t *stub;
 	iot_local_t *local = NULL;
 	iot_file_t *file = NULL;
-	iot_worker_t *worker = NULL;
 	uint64_t tmp_file = 0;
 
 	if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -636,7 +659,6 @@ iot_fstat (call_frame_t *frame,
 	}
 
 	file = (iot_file_t *)(long)tmp_file;
-	worker = file->worker;
 
 	local = CALLOC (1, sizeof (*local));
 	ERR_ABORT (local);
@@ -650,7 +672,7 @@ iot_fstat (call_frame_t *frame,
 		return 0;
 	}
 
-	iot_queue (worker, stub);
+	iot_queue (this, file, stub);
 
 	return 0;
 }
@@ -690,41 +712,32 @@ iot_truncate (call_frame_t *frame,
 {
 	call_stub_t *stub;
 	iot_local_t *local = NULL;
-	iot_worker_t *worker = NULL;
-	iot_conf_t *conf;
+	iot_file_t *file = NULL;
 	fd_t *fd = NULL;
   
-	conf = this->private;
 	local = CALLOC (1, sizeof (*local));
 	ERR_ABORT (local);
 	frame->local = local;
 
 	fd = fd_lookup (loc->inode, frame->root->pid);
 
-	if (fd == NULL) {
-		STACK_WIND(frame,
-			   iot_truncate_cbk,
-			   FIRST_CHILD(this),
-			   FIRST_CHILD(this)->fops->truncate,
-			   loc,
-			   offset);
-		return 0;
-	} 
-  
-	fd_unref (fd);
-
-	worker = iot_schedule (conf, NULL, loc->inode->ino);
+	if (fd)
+		file = iot_file_from_fd (this, fd);
 
 	stub = fop_truncate_stub (frame,
 				  iot_truncate_wrapper,
 				  loc,
 				  offset);
 	if (!stub) {
+		if (fd)
+			fd_unref (fd);
 		gf_log (this->name, GF_LOG_ERROR, "cannot get fop_stat call stub");
 		STACK_UNWIND (frame, -1, ENOMEM, NULL);
 		return 0;
 	}
-	iot_queue (worker, stub);
+	iot_queue (this, file, stub);
+	if (fd)
+		fd_unref (fd);
 
 	return 0;
 }
@@ -765,7 +778,6 @@ iot_ftruncate (call_frame_t *frame,
 	call_stub_t *stub;
 	iot_local_t *local = NULL;
 	iot_file_t *file = NULL;
-	iot_worker_t *worker = NULL;
 	uint64_t tmp_file = 0;
 
 	if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -776,7 +788,6 @@ iot_ftruncate (call_frame_t *frame,
 	}
 
 	file = (iot_file_t *)(long)tmp_file;
-	worker = file->worker;
 
 	local = CALLOC (1, sizeof (*local));
 	ERR_ABORT (local);
@@ -791,7 +802,7 @@ iot_ftruncate (call_frame_t *frame,
 		STACK_UNWIND (frame, -1, ENOMEM, NULL);
 		return 0;
 	}
-	iot_queue (worker, stub);
+	iot_queue (this, file, stub);
 
 	return 0;
 }
@@ -832,42 +843,32 @@ iot_utimens (call_frame_t *frame,
 {
 	call_stub_t *stub;
 	iot_local_t *local = NULL;
-	iot_worker_t *worker = NULL;
-	iot_conf_t *conf;
+	iot_file_t *file = NULL;
 	fd_t *fd = NULL;
   
-	conf = this->private;
-
 	local = CALLOC (1, sizeof (*local));
 	ERR_ABORT (local);
 	frame->local = local;
   
 	fd = fd_lookup (loc->inode, frame->root->pid);
 
-	if (fd == NULL) {
-		STACK_WIND(frame,
-			   iot_utimens_cbk,
-			   FIRST_CHILD(this),
-			   FIRST_CHILD(this)->fops->utimens,
-			   loc,
-			   tv);
-		return 0;
-	} 
-  
-	fd_unref (fd);
-
-	worker = iot_schedule (conf, NULL, loc->inode->ino);
+	if (fd)
+		file = iot_file_from_fd (this, fd);
 
 	stub = fop_utimens_stub (frame,
 				 iot_utimens_wrapper,
 				 loc,
 				 tv);
 	if (!stub) {
+		if (fd)
+			fd_unref (fd);
 		gf_log (this->name, GF_LOG_ERROR, "cannot get fop_utimens call stub");
 		STACK_UNWIND (frame, -1, ENOMEM, NULL);
 		return 0;
 	}
-	iot_queue (worker, stub);
+	iot_queue (this, file, stub);
+	if (fd)
+		fd_unref (fd);
 
 	return 0;
 }
@@ -910,16 +911,11 @@ iot_checksum (call_frame_t *frame,
 {
 	call_stub_t *stub = NULL;
 	iot_local_t *local = NULL;
-	iot_worker_t *worker = NULL;
-	iot_conf_t *conf = NULL;
   
-	conf = this->private;
-
 	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
 	frame->local = local;
 
-	worker = iot_schedule (conf, NULL, conf->misc_thread_index++);
-
 	stub = fop_checksum_stub (frame,
 				  iot_checksum_wrapper,
 				  loc,
@@ -929,7 +925,7 @@ iot_checksum (call_frame_t *frame,
 		STACK_UNWIND (frame, -1, ENOMEM, NULL, NULL);
 		return 0;
 	}
-	iot_queue (worker, stub);
+	iot_queue (this, NULL, stub);
 
 	return 0;
 }
@@ -967,147 +963,1963 @@ iot_unlink (call_frame_t *frame,
 {
 	call_stub_t *stub = NULL;
 	iot_local_t *local = NULL;
-	iot_worker_t *worker = NULL;
-	iot_conf_t *conf = NULL;
-
-	conf = this->private;
 
 	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
 	frame->local = local;
 
-	worker = iot_schedule (conf, NULL, conf->misc_thread_index++);
-
 	stub = fop_unlink_stub (frame, iot_unlink_wrapper, loc);
 	if (!stub) {
 		gf_log (this->name, GF_LOG_ERROR, "cannot get fop_unlink call stub");
 		STACK_UNWIND (frame, -1, ENOMEM);
 		return 0;
 	}
-	iot_queue (worker, stub);
+	iot_queue (this, NULL, stub);
 
 	return 0;
 }
 
 int32_t
-iot_release (xlator_t *this,
-	     fd_t *fd)
+iot_lookup_cbk (call_frame_t *frame,
+                void *cookie,
+                xlator_t *this,
+                int32_t op_ret,
+                int32_t op_errno,
+                inode_t *inode,
+                struct stat *buf,
+                dict_t *xattr)
 {
-	iot_file_t *file = NULL;
-	iot_conf_t *conf = NULL;
-	uint64_t tmp_file = 0;
-	int ret = 0;
-
-	conf = this->private;
-	ret = fd_ctx_del (fd, this, &tmp_file);
-	if (ret)
-		return 0;
-
-	file = (iot_file_t *)(long)tmp_file;
-
-	pthread_mutex_lock (&conf->files_lock);
-	{
-		(file->prev)->next = file->next;
-		(file->next)->prev = file->prev;
-	}
-	pthread_mutex_unlock (&conf->files_lock);
-
-	FREE (file);
+	STACK_UNWIND (frame, op_ret, op_errno, inode, buf, xattr);
 	return 0;
 }
 
-
-static void
-iot_queue (iot_worker_t *worker,
-           call_stub_t *stub)
+static int32_t
+iot_lookup_wrapper (call_frame_t *frame,
+                    xlator_t *this,
+                    loc_t *loc,
+                    dict_t *xattr_req)
 {
-	iot_queue_t *queue;
-	iot_conf_t *conf = worker->conf;
-	iot_local_t *local = stub->frame->local;
-	size_t frame_size = local->frame_size;
+	STACK_WIND (frame,
+		    iot_lookup_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->lookup,
+		    loc,
+		    xattr_req);
+	return 0;
+}
 
-	queue = CALLOC (1, sizeof (*queue));
-	ERR_ABORT (queue);
-	queue->stub = stub;
+int32_t
+iot_lookup (call_frame_t *frame,
+            xlator_t *this,
+            loc_t *loc,
+            dict_t *xattr_req)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
 
-	pthread_mutex_lock (&conf->lock);
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
 
-	/*
-	  while (worker->queue_size >= worker->queue_limit)
-	  pthread_cond_wait (&worker->q_cond, &worker->lock);
-	*/
-	if (conf->cache_size) {
-		while (frame_size && (conf->current_size >= conf->cache_size))
-			pthread_cond_wait (&conf->q_cond, &conf->lock);
+	stub = fop_lookup_stub (frame, iot_lookup_wrapper, loc, xattr_req);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_lookup call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL, NULL, NULL);
+		return 0;
 	}
+	iot_queue (this, NULL, stub);
 
-	queue->next = &worker->queue;
-	queue->prev = worker->queue.prev;
-
-	queue->next->prev = queue;
-	queue->prev->next = queue;
-
-	/* dq_cond */
-	worker->queue_size++;
-	worker->q++;
+	return 0;
+}
 
-	conf->current_size += local->frame_size;
 
-	pthread_cond_broadcast (&worker->dq_cond);
+int32_t
+iot_chmod_cbk (call_frame_t *frame,
+               void *cookie,
+               xlator_t *this,
+               int32_t op_ret,
+               int32_t op_errno,
+               struct stat *buf)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, buf);
+	return 0;
+}
 
-	pthread_mutex_unlock (&conf->lock);
+static int32_t
+iot_chmod_wrapper (call_frame_t *frame,
+                   xlator_t *this,
+                   loc_t *loc,
+                   mode_t mode)
+{
+	STACK_WIND (frame,
+		    iot_chmod_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->chmod,
+		    loc,
+		    mode);
+	return 0;
 }
 
-static call_stub_t *
-iot_dequeue (iot_worker_t *worker)
+int32_t
+iot_chmod (call_frame_t *frame,
+           xlator_t *this,
+           loc_t *loc,
+           mode_t mode)
 {
 	call_stub_t *stub = NULL;
-	iot_queue_t *queue = NULL;
-	iot_conf_t *conf = worker->conf;
 	iot_local_t *local = NULL;
 
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
 
-	pthread_mutex_lock (&conf->lock);
+	stub = fop_chmod_stub (frame, iot_chmod_wrapper, loc, mode);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_chmod call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
 
-	while (!worker->queue_size)
-		/*
-		  pthread_cond_wait (&worker->dq_cond, &worker->lock);
-		*/
-		pthread_cond_wait (&worker->dq_cond, &conf->lock);
+	return 0;
+}
 
-	queue = worker->queue.next;
 
-	queue->next->prev = queue->prev;
-	queue->prev->next = queue->next;
+int32_t
+iot_fchmod_cbk (call_frame_t *frame,
+                void *cookie,
+                xlator_t *this,
+                int32_t op_ret,
+                int32_t op_errno,
+                struct stat *buf)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, buf);
+	return 0;
+}
 
-	stub = queue->stub;
-	local = stub->frame->local;
+static int32_t
+iot_fchmod_wrapper (call_frame_t *frame,
+                    xlator_t *this,
+                    fd_t *fd,
+                    mode_t mode)
+{
+	STACK_WIND (frame,
+		    iot_fchmod_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->fchmod,
+		    fd,
+		    mode);
+	return 0;
+}
 
-	worker->queue_size--;
-	worker->dq++;
+int32_t
+iot_fchmod (call_frame_t *frame,
+            xlator_t *this,
+            fd_t *fd,
+            mode_t mode)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
 
-	/* q_cond */
-	conf->current_size -= local->frame_size;
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
 
-	pthread_cond_broadcast (&conf->q_cond);
+	stub = fop_fchmod_stub (frame, iot_fchmod_wrapper, fd, mode);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_fchmod call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
 
-	pthread_mutex_unlock (&conf->lock);
+	return 0;
+}
 
-	FREE (queue);
 
-	return stub;
+int32_t
+iot_chown_cbk (call_frame_t *frame,
+               void *cookie,
+               xlator_t *this,
+               int32_t op_ret,
+               int32_t op_errno,
+               struct stat *buf)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, buf);
+	return 0;
+}
+
+static int32_t
+iot_chown_wrapper (call_frame_t *frame,
+                   xlator_t *this,
+                   loc_t *loc,
+                   uid_t uid,
+                   gid_t gid)
+{
+	STACK_WIND (frame,
+		    iot_chown_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->chown,
+		    loc,
+		    uid,
+		    gid);
+	return 0;
+}
+
+int32_t
+iot_chown (call_frame_t *frame,
+           xlator_t *this,
+           loc_t *loc,
+           uid_t uid,
+           gid_t gid)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_chown_stub (frame, iot_chown_wrapper, loc, uid, gid);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_chown call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_fchown_cbk (call_frame_t *frame,
+                void *cookie,
+                xlator_t *this,
+                int32_t op_ret,
+                int32_t op_errno,
+                struct stat *buf)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, buf);
+	return 0;
+}
+
+static int32_t
+iot_fchown_wrapper (call_frame_t *frame,
+                    xlator_t *this,
+                    fd_t *fd,
+                    uid_t uid,
+                    gid_t gid)
+{
+	STACK_WIND (frame,
+		    iot_fchown_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->fchown,
+		    fd,
+		    uid,
+		    gid);
+	return 0;
+}
+
+int32_t
+iot_fchown (call_frame_t *frame,
+            xlator_t *this,
+            fd_t *fd,
+            uid_t uid,
+            gid_t gid)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_fchown_stub (frame, iot_fchown_wrapper, fd, uid, gid);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_fchown call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_access_cbk (call_frame_t *frame,
+                void *cookie,
+                xlator_t *this,
+                int32_t op_ret,
+                int32_t op_errno)
+{
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
+}
+
+static int32_t
+iot_access_wrapper (call_frame_t *frame,
+                    xlator_t *this,
+                    loc_t *loc,
+                    int32_t mask)
+{
+	STACK_WIND (frame,
+		    iot_access_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->access,
+		    loc,
+		    mask);
+	return 0;
+}
+
+int32_t
+iot_access (call_frame_t *frame,
+            xlator_t *this,
+            loc_t *loc,
+            int32_t mask)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_access_stub (frame, iot_access_wrapper, loc, mask);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_access call stub");
+		STACK_UNWIND (frame, -1, ENOMEM);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_readlink_cbk (call_frame_t *frame,
+                  void *cookie,
+                  xlator_t *this,
+                  int32_t op_ret,
+                  int32_t op_errno,
+                  const char *path)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, path);
+	return 0;
+}
+
+static int32_t
+iot_readlink_wrapper (call_frame_t *frame,
+                      xlator_t *this,
+                      loc_t *loc,
+                      size_t size)
+{
+	STACK_WIND (frame,
+		    iot_readlink_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->readlink,
+		    loc,
+		    size);
+	return 0;
+}
+
+int32_t
+iot_readlink (call_frame_t *frame,
+              xlator_t *this,
+              loc_t *loc,
+              size_t size)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_readlink_stub (frame, iot_readlink_wrapper, loc, size);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_readlink call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_mknod_cbk (call_frame_t *frame,
+               void *cookie,
+               xlator_t *this,
+               int32_t op_ret,
+               int32_t op_errno,
+               inode_t *inode,
+               struct stat *buf)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, inode, buf);
+	return 0;
+}
+
+static int32_t
+iot_mknod_wrapper (call_frame_t *frame,
+                   xlator_t *this,
+                   loc_t *loc,
+                   mode_t mode,
+                   dev_t rdev)
+{
+	STACK_WIND (frame,
+		    iot_mknod_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->mknod,
+		    loc,
+		    mode,
+		    rdev);
+	return 0;
+}
+
+int32_t
+iot_mknod (call_frame_t *frame,
+           xlator_t *this,
+           loc_t *loc,
+           mode_t mode,
+           dev_t rdev)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_mknod_stub (frame, iot_mknod_wrapper, loc, mode, rdev);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_mknod call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_mkdir_cbk (call_frame_t *frame,
+               void *cookie,
+               xlator_t *this,
+               int32_t op_ret,
+               int32_t op_errno,
+               inode_t *inode,
+               struct stat *buf)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, inode, buf);
+	return 0;
+}
+
+static int32_t
+iot_mkdir_wrapper (call_frame_t *frame,
+                   xlator_t *this,
+                   loc_t *loc,
+                   mode_t mode)
+{
+	STACK_WIND (frame,
+		    iot_mkdir_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->mkdir,
+		    loc,
+		    mode);
+	return 0;
+}
+
+int32_t
+iot_mkdir (call_frame_t *frame,
+           xlator_t *this,
+           loc_t *loc,
+           mode_t mode)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_mkdir_stub (frame, iot_mkdir_wrapper, loc, mode);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_mkdir call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_rmdir_cbk (call_frame_t *frame,
+               void *cookie,
+               xlator_t *this,
+               int32_t op_ret,
+               int32_t op_errno)
+{
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
+}
+
+static int32_t
+iot_rmdir_wrapper (call_frame_t *frame,
+                   xlator_t *this,
+                   loc_t *loc)
+{
+	STACK_WIND (frame,
+		    iot_rmdir_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->rmdir,
+		    loc);
+	return 0;
+}
+
+int32_t
+iot_rmdir (call_frame_t *frame,
+           xlator_t *this,
+           loc_t *loc)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_rmdir_stub (frame, iot_rmdir_wrapper, loc);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_rmdir call stub");
+		STACK_UNWIND (frame, -1, ENOMEM);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_symlink_cbk (call_frame_t *frame,
+                 void *cookie,
+                 xlator_t *this,
+                 int32_t op_ret,
+                 int32_t op_errno,
+                 inode_t *inode,
+                 struct stat *buf)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, inode, buf);
+	return 0;
+}
+
+static int32_t
+iot_symlink_wrapper (call_frame_t *frame,
+                     xlator_t *this,
+                     const char *linkname,
+                     loc_t *loc)
+{
+	STACK_WIND (frame,
+		    iot_symlink_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->symlink,
+		    linkname,
+		    loc);
+	return 0;
+}
+
+int32_t
+iot_symlink (call_frame_t *frame,
+             xlator_t *this,
+             const char *linkname,
+             loc_t *loc)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_symlink_stub (frame, iot_symlink_wrapper, linkname, loc);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_symlink call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_rename_cbk (call_frame_t *frame,
+                void *cookie,
+                xlator_t *this,
+                int32_t op_ret,
+                int32_t op_errno,
+                struct stat *buf)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, buf);
+	return 0;
+}
+
+static int32_t
+iot_rename_wrapper (call_frame_t *frame,
+                    xlator_t *this,
+                    loc_t *oldloc,
+                    loc_t *newloc)
+{
+	STACK_WIND (frame,
+		    iot_rename_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->rename,
+		    oldloc,
+		    newloc);
+	return 0;
+}
+
+int32_t
+iot_rename (call_frame_t *frame,
+            xlator_t *this,
+            loc_t *oldloc,
+            loc_t *newloc)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_rename_stub (frame, iot_rename_wrapper, oldloc, newloc);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_rename call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_link_cbk (call_frame_t *frame,
+              void *cookie,
+              xlator_t *this,
+              int32_t op_ret,
+              int32_t op_errno,
+              inode_t *inode,
+              struct stat *buf)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, inode, buf);
+	return 0;
+}
+
+static int32_t
+iot_link_wrapper (call_frame_t *frame,
+                  xlator_t *this,
+                  loc_t *oldloc,
+                  loc_t *newloc)
+{
+	STACK_WIND (frame,
+		    iot_link_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->link,
+		    oldloc,
+		    newloc);
+	return 0;
+}
+
+int32_t
+iot_link (call_frame_t *frame,
+          xlator_t *this,
+          loc_t *oldloc,
+          loc_t *newloc)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_link_stub (frame, iot_link_wrapper, oldloc, newloc);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_link call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_opendir_cbk (call_frame_t *frame,
+                 void *cookie,
+                 xlator_t *this,
+                 int32_t op_ret,
+                 int32_t op_errno,
+                 fd_t *fd)
+{
+	if (op_ret >= 0)
+		iot_file_new (this, fd);
+
+	STACK_UNWIND (frame, op_ret, op_errno, fd);
+	return 0;
+}
+
+static int32_t
+iot_opendir_wrapper (call_frame_t *frame,
+                     xlator_t *this,
+                     loc_t *loc,
+                     fd_t *fd)
+{
+	STACK_WIND (frame,
+		    iot_opendir_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->opendir,
+		    loc,
+		    fd);
+	return 0;
+}
+
+int32_t
+iot_opendir (call_frame_t *frame,
+             xlator_t *this,
+             loc_t *loc,
+             fd_t *fd)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_opendir_stub (frame, iot_opendir_wrapper, loc, fd);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_opendir call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_readdir_cbk (call_frame_t *frame,
+                 void *cookie,
+                 xlator_t *this,
+                 int32_t op_ret,
+                 int32_t op_errno,
+                 gf_dirent_t *entries)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, entries);
+	return 0;
+}
+
+static int32_t
+iot_readdir_wrapper (call_frame_t *frame,
+                     xlator_t *this,
+                     fd_t *fd,
+                     size_t size,
+                     off_t offset)
+{
+	STACK_WIND (frame,
+		    iot_readdir_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->readdir,
+		    fd,
+		    size,
+		    offset);
+	return 0;
+}
+
+int32_t
+iot_readdir (call_frame_t *frame,
+             xlator_t *this,
+             fd_t *fd,
+             size_t size,
+             off_t offset)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_readdir_stub (frame, iot_readdir_wrapper, fd, size, offset);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_readdir call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_readdirp_cbk (call_frame_t *frame,
+                  void *cookie,
+                  xlator_t *this,
+                  int32_t op_ret,
+                  int32_t op_errno,
+                  gf_dirent_t *entries)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, entries);
+	return 0;
+}
+
+static int32_t
+iot_readdirp_wrapper (call_frame_t *frame,
+                      xlator_t *this,
+                      fd_t *fd,
+                      size_t size,
+                      off_t offset)
+{
+	STACK_WIND (frame,
+		    iot_readdirp_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->readdirp,
+		    fd,
+		    size,
+		    offset);
+	return 0;
+}
+
+int32_t
+iot_readdirp (call_frame_t *frame,
+              xlator_t *this,
+              fd_t *fd,
+              size_t size,
+              off_t offset)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_readdirp_stub (frame, iot_readdirp_wrapper, fd, size,
+				  offset);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_readdirp call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_fsyncdir_cbk (call_frame_t *frame,
+                  void *cookie,
+                  xlator_t *this,
+                  int32_t op_ret,
+                  int32_t op_errno)
+{
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
+}
+
+static int32_t
+iot_fsyncdir_wrapper (call_frame_t *frame,
+                      xlator_t *this,
+                      fd_t *fd,
+                      int32_t datasync)
+{
+	STACK_WIND (frame,
+		    iot_fsyncdir_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->fsyncdir,
+		    fd,
+		    datasync);
+	return 0;
+}
+
+int32_t
+iot_fsyncdir (call_frame_t *frame,
+              xlator_t *this,
+              fd_t *fd,
+              int32_t datasync)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_fsyncdir_stub (frame, iot_fsyncdir_wrapper, fd, datasync);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_fsyncdir call stub");
+		STACK_UNWIND (frame, -1, ENOMEM);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_statfs_cbk (call_frame_t *frame,
+                void *cookie,
+                xlator_t *this,
+                int32_t op_ret,
+                int32_t op_errno,
+                struct statvfs *buf)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, buf);
+	return 0;
+}
+
+static int32_t
+iot_statfs_wrapper (call_frame_t *frame,
+                    xlator_t *this,
+                    loc_t *loc)
+{
+	STACK_WIND (frame,
+		    iot_statfs_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->statfs,
+		    loc);
+	return 0;
+}
+
+int32_t
+iot_statfs (call_frame_t *frame,
+            xlator_t *this,
+            loc_t *loc)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_statfs_stub (frame, iot_statfs_wrapper, loc);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_statfs call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_setxattr_cbk (call_frame_t *frame,
+                  void *cookie,
+                  xlator_t *this,
+                  int32_t op_ret,
+                  int32_t op_errno)
+{
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
+}
+
+static int32_t
+iot_setxattr_wrapper (call_frame_t *frame,
+                      xlator_t *this,
+                      loc_t *loc,
+                      dict_t *dict,
+                      int32_t flags)
+{
+	STACK_WIND (frame,
+		    iot_setxattr_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->setxattr,
+		    loc,
+		    dict,
+		    flags);
+	return 0;
+}
+
+int32_t
+iot_setxattr (call_frame_t *frame,
+              xlator_t *this,
+              loc_t *loc,
+              dict_t *dict,
+              int32_t flags)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_setxattr_stub (frame, iot_setxattr_wrapper, loc, dict,
+				  flags);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_setxattr call stub");
+		STACK_UNWIND (frame, -1, ENOMEM);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_getxattr_cbk (call_frame_t *frame,
+                  void *cookie,
+                  xlator_t *this,
+                  int32_t op_ret,
+                  int32_t op_errno,
+                  dict_t *dict)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, dict);
+	return 0;
+}
+
+static int32_t
+iot_getxattr_wrapper (call_frame_t *frame,
+                      xlator_t *this,
+                      loc_t *loc,
+                      const char *name)
+{
+	STACK_WIND (frame,
+		    iot_getxattr_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->getxattr,
+		    loc,
+		    name);
+	return 0;
+}
+
+int32_t
+iot_getxattr (call_frame_t *frame,
+              xlator_t *this,
+              loc_t *loc,
+              const char *name)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_getxattr_stub (frame, iot_getxattr_wrapper, loc, name);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_getxattr call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_removexattr_cbk (call_frame_t *frame,
+                     void *cookie,
+                     xlator_t *this,
+                     int32_t op_ret,
+                     int32_t op_errno)
+{
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
+}
+
+static int32_t
+iot_removexattr_wrapper (call_frame_t *frame,
+                         xlator_t *this,
+                         loc_t *loc,
+                         const char *name)
+{
+	STACK_WIND (frame,
+		    iot_removexattr_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->removexattr,
+		    loc,
+		    name);
+	return 0;
+}
+
+int32_t
+iot_removexattr (call_frame_t *frame,
+                 xlator_t *this,
+                 loc_t *loc,
+                 const char *name)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_removexattr_stub (frame, iot_removexattr_wrapper, loc,
+				     name);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_removexattr call stub");
+		STACK_UNWIND (frame, -1, ENOMEM);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_inodelk_cbk (call_frame_t *frame,
+                 void *cookie,
+                 xlator_t *this,
+                 int32_t op_ret,
+                 int32_t op_errno)
+{
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
+}
+
+static int32_t
+iot_inodelk_wrapper (call_frame_t *frame,
+                     xlator_t *this,
+                     loc_t *loc,
+                     int32_t cmd,
+                     struct flock *flock)
+{
+	STACK_WIND (frame,
+		    iot_inodelk_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->inodelk,
+		    loc,
+		    cmd,
+		    flock);
+	return 0;
+}
+
+int32_t
+iot_inodelk (call_frame_t *frame,
+             xlator_t *this,
+             loc_t *loc,
+             int32_t cmd,
+             struct flock *flock)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_inodelk_stub (frame, iot_inodelk_wrapper, loc, cmd, flock);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_inodelk call stub");
+		STACK_UNWIND (frame, -1, ENOMEM);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_finodelk_cbk (call_frame_t *frame,
+                  void *cookie,
+                  xlator_t *this,
+                  int32_t op_ret,
+                  int32_t op_errno)
+{
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
+}
+
+static int32_t
+iot_finodelk_wrapper (call_frame_t *frame,
+                      xlator_t *this,
+                      fd_t *fd,
+                      int32_t cmd,
+                      struct flock *flock)
+{
+	STACK_WIND (frame,
+		    iot_finodelk_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->finodelk,
+		    fd,
+		    cmd,
+		    flock);
+	return 0;
+}
+
+int32_t
+iot_finodelk (call_frame_t *frame,
+              xlator_t *this,
+              fd_t *fd,
+              int32_t cmd,
+              struct flock *flock)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_finodelk_stub (frame, iot_finodelk_wrapper, fd, cmd, flock);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_finodelk call stub");
+		STACK_UNWIND (frame, -1, ENOMEM);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_entrylk_cbk (call_frame_t *frame,
+                 void *cookie,
+                 xlator_t *this,
+                 int32_t op_ret,
+                 int32_t op_errno)
+{
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
+}
+
+static int32_t
+iot_entrylk_wrapper (call_frame_t *frame,
+                     xlator_t *this,
+                     loc_t *loc,
+                     const char *basename,
+                     entrylk_cmd cmd,
+                     entrylk_type type)
+{
+	STACK_WIND (frame,
+		    iot_entrylk_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->entrylk,
+		    loc,
+		    basename,
+		    cmd,
+		    type);
+	return 0;
+}
+
+int32_t
+iot_entrylk (call_frame_t *frame,
+             xlator_t *this,
+             loc_t *loc,
+             const char *basename,
+             entrylk_cmd cmd,
+             entrylk_type type)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_entrylk_stub (frame, iot_entrylk_wrapper, loc, basename,
+				 cmd, type);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_entrylk call stub");
+		STACK_UNWIND (frame, -1, ENOMEM);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_fentrylk_cbk (call_frame_t *frame,
+                  void *cookie,
+                  xlator_t *this,
+                  int32_t op_ret,
+                  int32_t op_errno)
+{
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
+}
+
+static int32_t
+iot_fentrylk_wrapper (call_frame_t *frame,
+                      xlator_t *this,
+                      fd_t *fd,
+                      const char *basename,
+                      entrylk_cmd cmd,
+                      entrylk_type type)
+{
+	STACK_WIND (frame,
+		    iot_fentrylk_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->fentrylk,
+		    fd,
+		    basename,
+		    cmd,
+		    type);
+	return 0;
+}
+
+int32_t
+iot_fentrylk (call_frame_t *frame,
+              xlator_t *this,
+              fd_t *fd,
+              const char *basename,
+              entrylk_cmd cmd,
+              entrylk_type type)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_fentrylk_stub (frame, iot_fentrylk_wrapper, fd, basename,
+				  cmd, type);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_fentrylk call stub");
+		STACK_UNWIND (frame, -1, ENOMEM);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_setdents_cbk (call_frame_t *frame,
+                  void *cookie,
+                  xlator_t *this,
+                  int32_t op_ret,
+                  int32_t op_errno)
+{
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
+}
+
+static int32_t
+iot_setdents_wrapper (call_frame_t *frame,
+                      xlator_t *this,
+                      fd_t *fd,
+                      int32_t flags,
+                      dir_entry_t *entries,
+                      int32_t count)
+{
+	STACK_WIND (frame,
+		    iot_setdents_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->setdents,
+		    fd,
+		    flags,
+		    entries,
+		    count);
+	return 0;
+}
+
+int32_t
+iot_setdents (call_frame_t *frame,
+              xlator_t *this,
+              fd_t *fd,
+              int32_t flags,
+              dir_entry_t *entries,
+              int32_t count)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_setdents_stub (frame, iot_setdents_wrapper, fd, flags,
+				  entries, count);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_setdents call stub");
+		STACK_UNWIND (frame, -1, ENOMEM);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_getdents_cbk (call_frame_t *frame,
+                  void *cookie,
+                  xlator_t *this,
+                  int32_t op_ret,
+                  int32_t op_errno,
+                  dir_entry_t *entries,
+                  int32_t count)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, entries, count);
+	return 0;
+}
+
+static int32_t
+iot_getdents_wrapper (call_frame_t *frame,
+                      xlator_t *this,
+                      fd_t *fd,
+                      size_t size,
+                      off_t offset,
+                      int32_t flag)
+{
+	STACK_WIND (frame,
+		    iot_getdents_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->getdents,
+		    fd,
+		    size,
+		    offset,
+		    flag);
+	return 0;
+}
+
+int32_t
+iot_getdents (call_frame_t *frame,
+              xlator_t *this,
+              fd_t *fd,
+              size_t size,
+              off_t offset,
+              int32_t flag)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_getdents_stub (frame, iot_getdents_wrapper, fd, size,
+				  offset, flag);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_getdents call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL, 0);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_xattrop_cbk (call_frame_t *frame,
+                 void *cookie,
+                 xlator_t *this,
+                 int32_t op_ret,
+                 int32_t op_errno,
+                 dict_t *xattr)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, xattr);
+	return 0;
+}
+
+static int32_t
+iot_xattrop_wrapper (call_frame_t *frame,
+                     xlator_t *this,
+                     loc_t *loc,
+                     gf_xattrop_flags_t optype,
+                     dict_t *xattr)
+{
+	STACK_WIND (frame,
+		    iot_xattrop_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->xattrop,
+		    loc,
+		    optype,
+		    xattr);
+	return 0;
+}
+
+int32_t
+iot_xattrop (call_frame_t *frame,
+             xlator_t *this,
+             loc_t *loc,
+             gf_xattrop_flags_t optype,
+             dict_t *xattr)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_xattrop_stub (frame, iot_xattrop_wrapper, loc, optype,
+				 xattr);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_xattrop call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, NULL, stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_fxattrop_cbk (call_frame_t *frame,
+                  void *cookie,
+                  xlator_t *this,
+                  int32_t op_ret,
+                  int32_t op_errno,
+                  dict_t *xattr)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, xattr);
+	return 0;
+}
+
+static int32_t
+iot_fxattrop_wrapper (call_frame_t *frame,
+                      xlator_t *this,
+                      fd_t *fd,
+                      gf_xattrop_flags_t optype,
+                      dict_t *xattr)
+{
+	STACK_WIND (frame,
+		    iot_fxattrop_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->fxattrop,
+		    fd,
+		    optype,
+		    xattr);
+	return 0;
+}
+
+int32_t
+iot_fxattrop (call_frame_t *frame,
+              xlator_t *this,
+              fd_t *fd,
+              gf_xattrop_flags_t optype,
+              dict_t *xattr)
+{
+	call_stub_t *stub = NULL;
+	iot_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	ERR_ABORT (local);
+	frame->local = local;
+
+	stub = fop_fxattrop_stub (frame, iot_fxattrop_wrapper, fd, optype,
+				  xattr);
+	if (!stub) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"cannot get fop_fxattrop call stub");
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+	iot_queue (this, iot_file_from_fd (this, fd), stub);
+
+	return 0;
+}
+
+
+int32_t
+iot_release (xlator_t *this,
+	     fd_t *fd)
+{
+	iot_file_t *file = NULL;
+	iot_conf_t *conf = NULL;
+	uint64_t tmp_file = 0;
+	int ret = 0;
+
+	conf = this->private;
+	ret = fd_ctx_del (fd, this, &tmp_file);
+	if (ret)
+		return 0;
+
+	file = (iot_file_t *)(long)tmp_file;
+
+	pthread_mutex_lock (&conf->files_lock);
+	{
+		(file->prev)->next = file->next;
+		(file->next)->prev = file->prev;
+	}
+	pthread_mutex_unlock (&conf->files_lock);
+
+	pthread_mutex_destroy (&file->lock);
+	FREE (file);
+	return 0;
+}
+
+
+#define IOT_SERVES(worker, pri) ((worker)->index < \
+				 (worker)->conf->class_threads[pri])
+
+static void
+iot_worker_enqueue (iot_worker_t *worker,
+                    iot_local_t *local)
+{
+	iot_conf_t *conf = worker->conf;
+	iot_worker_t *idle = NULL;
+	char woken = 0;
+	int32_t i = 0;
+
+	pthread_mutex_lock (&worker->lock);
+	{
+		list_add_tail (&local->list, &worker->rq[local->pri]);
+		worker->rq_depth++;
+		worker->queued[local->pri]++;
+		if (worker->rq_depth > worker->max_depth)
+			worker->max_depth = worker->rq_depth;
+
+		if (worker->idle) {
+			worker->wakeup = 1;
+			pthread_cond_signal (&worker->cond);
+			woken = 1;
+		}
+	}
+	pthread_mutex_unlock (&worker->lock);
+
+	if (woken)
+		return;
+
+	/* owner is busy, let one idle worker of the class steal it. idle
+	   workers announce themselves before looking for work to steal,
+	   so either they find this request or it finds them idle. */
+	for (i = 1; i < conf->thread_count; i++) {
+		idle = &conf->workers[(worker->index + i) % conf->thread_count];
+		if (!idle->idle || !IOT_SERVES (idle, local->pri))
+			continue;
+
+		pthread_mutex_lock (&idle->lock);
+		{
+			if (idle->idle) {
+				idle->wakeup = 1;
+				pthread_cond_signal (&idle->cond);
+				woken = 1;
+			}
+		}
+		pthread_mutex_unlock (&idle->lock);
+
+		if (woken)
+			break;
+	}
+}
+
+
+/* highest class request of worker's run queues that taker serves */
+static iot_local_t *
+__iot_worker_pick (iot_worker_t *worker,
+                   iot_worker_t *taker)
+{
+	iot_local_t *local = NULL;
+	int pri = 0;
+
+	for (pri = 0; pri < IOT_PRI_MAX; pri++) {
+		if (!IOT_SERVES (taker, pri))
+			continue;
+		if (list_empty (&worker->rq[pri]))
+			continue;
+
+		local = list_entry (worker->rq[pri].next, iot_local_t, list);
+		list_del_init (&local->list);
+		worker->rq_depth--;
+		break;
+	}
+
+	return local;
+}
+
+
+static iot_local_t *
+iot_steal (iot_worker_t *thief)
+{
+	iot_conf_t *conf = thief->conf;
+	iot_worker_t *victim = NULL;
+	iot_local_t *local = NULL;
+	int32_t i = 0;
+
+	for (i = 1; i < conf->thread_count && !local; i++) {
+		victim = &conf->workers[(thief->index + i) % conf->thread_count];
+
+		pthread_mutex_lock (&victim->lock);
+		{
+			if (victim->rq_depth)
+				local = __iot_worker_pick (victim, thief);
+		}
+		pthread_mutex_unlock (&victim->lock);
+	}
+
+	return local;
+}
+
+
+static iot_local_t *
+iot_dequeue (iot_worker_t *worker)
+{
+	iot_local_t *local = NULL;
+
+	pthread_mutex_lock (&worker->lock);
+
+	while (1) {
+		if (worker->rq_depth) {
+			local = __iot_worker_pick (worker, worker);
+			if (local)
+				break;
+		}
+
+		worker->idle = 1;
+		pthread_mutex_unlock (&worker->lock);
+
+		local = iot_steal (worker);
+
+		pthread_mutex_lock (&worker->lock);
+
+		if (local) {
+			worker->stolen++;
+			break;
+		}
+
+		while (!worker->wakeup && !worker->rq_depth)
+			pthread_cond_wait (&worker->cond, &worker->lock);
+
+		worker->idle = 0;
+		worker->wakeup = 0;
+	}
+
+	worker->idle = 0;
+	worker->wakeup = 0;
+
+	pthread_mutex_unlock (&worker->lock);
+
+	return local;
+}
+
+
+/* move requests of file which are allowed to run now to the run
+   queue of its worker */
+static void
+__iot_file_dispatch (iot_file_t *file)
+{
+	iot_local_t *local = NULL;
+	iot_worker_t *worker = NULL;
+
+	while (!list_empty (&file->pending)) {
+		local = list_entry (file->pending.next, iot_local_t, list);
+
+		if (file->exclusive_inflight)
+			break;
+		if (local->exclusive && file->inflight)
+			break;
+
+		list_del_init (&local->list);
+		file->pending_ops--;
+
+		file->inflight++;
+		file->exclusive_inflight = local->exclusive;
+
+		worker = file->worker;
+		if (!IOT_SERVES (worker, local->pri))
+			worker = &worker->conf->workers[worker->index %
+					worker->conf->class_threads[local->pri]];
+
+		iot_worker_enqueue (worker, local);
+	}
+}
+
+
+static void
+iot_file_done (iot_file_t *file,
+               char exclusive)
+{
+	fd_t *fd = file->fd;
+
+	pthread_mutex_lock (&file->lock);
+	{
+		file->inflight--;
+		if (exclusive)
+			file->exclusive_inflight = 0;
+
+		__iot_file_dispatch (file);
+	}
+	pthread_mutex_unlock (&file->lock);
+
+	/* taken in iot_queue. might release fd, and free file with it */
+	fd_unref (fd);
+}
+
+
+/* class of a request, and whether it has to be wound alone among the
+   requests on its fd */
+static iot_pri_t
+iot_classify (call_stub_t *stub,
+              char *exclusive)
+{
+	*exclusive = 0;
+
+	switch (stub->fop) {
+	case GF_FOP_LOOKUP:
+	case GF_FOP_ACCESS:
+	case GF_FOP_READLINK:
+	case GF_FOP_OPEN:
+	case GF_FOP_OPENDIR:
+	case GF_FOP_STATFS:
+	case GF_FOP_STAT:
+	case GF_FOP_FSTAT:
+	case GF_FOP_READDIR:
+	case GF_FOP_READDIRP:
+	case GF_FOP_GETDENTS:
+		return IOT_PRI_HI;
+
+	case GF_FOP_READ:
+	case GF_FOP_CHECKSUM:
+		return IOT_PRI_LO;
+
+	case GF_FOP_WRITE:
+	case GF_FOP_FSYNC:
+	case GF_FOP_FSYNCDIR:
+	case GF_FOP_TRUNCATE:
+	case GF_FOP_FTRUNCATE:
+	case GF_FOP_FXATTROP:
+		*exclusive = 1;
+		return IOT_PRI_LO;
+
+	case GF_FOP_XATTROP:
+		return IOT_PRI_LO;
+
+	case GF_FOP_FLUSH:
+	case GF_FOP_LK:
+	case GF_FOP_FINODELK:
+	case GF_FOP_FENTRYLK:
+	case GF_FOP_FCHMOD:
+	case GF_FOP_FCHOWN:
+	case GF_FOP_UTIMENS:
+	case GF_FOP_SETDENTS:
+		*exclusive = 1;
+		return IOT_PRI_NORMAL;
+
+	default:
+		return IOT_PRI_NORMAL;
+	}
+}
+
+
+static void
+iot_queue (xlator_t *this,
+           iot_file_t *file,
+           call_stub_t *stub)
+{
+	iot_conf_t *conf = this->private;
+	iot_local_t *local = stub->frame->local;
+	iot_worker_t *worker = NULL;
+	uint32_t index = 0;
+
+	INIT_LIST_HEAD (&local->list);
+	local->stub = stub;
+	local->file = file;
+	local->pri = iot_classify (stub, &local->exclusive);
+	gettimeofday (&local->queued_at, NULL);
+
+	if (!file) {
+		index = (uint32_t) conf->misc_thread_index++;
+		worker = &conf->workers[index % conf->class_threads[local->pri]];
+		iot_worker_enqueue (worker, local);
+		return;
+	}
+
+	/* keep fd, and file with it, around till the request is wound */
+	fd_ref (file->fd);
+
+	pthread_mutex_lock (&file->lock);
+	{
+		list_add_tail (&local->list, &file->pending);
+		file->pending_ops++;
+
+		__iot_file_dispatch (file);
+	}
+	pthread_mutex_unlock (&file->lock);
 }
 
+
 static void *
 iot_worker (void *arg)
 {
 	iot_worker_t *worker = arg;
+	iot_local_t *local = NULL;
+	iot_file_t *file = NULL;
+	char exclusive = 0;
+	struct timeval now = {0, };
 
 	while (1) {
-		call_stub_t *stub;
+		local = iot_dequeue (worker);
 
-		stub = iot_dequeue (worker);
-		call_resume (stub);
+		gettimeofday (&now, NULL);
+		worker->wait_usec += (now.tv_sec - local->queued_at.tv_sec)
+			* 1000000 + (now.tv_usec - local->queued_at.tv_usec);
+		worker->executed++;
+
+		/* local goes away with the frame, which may already have
+		   happened when call_resume () returns */
+		file = local->file;
+		exclusive = local->exclusive;
+
+		call_resume (local->stub);
+
+		if (file)
+			iot_file_done (file, exclusive);
 	}
+
+	return NULL;
 }
 
 #if 0
@@ -1132,43 +2944,67 @@ workers_init (iot_conf_t *conf)
 {
 	int i;
 
-	conf->workers.next = &conf->workers;
-	conf->workers.prev = &conf->workers;
+	conf->workers = CALLOC (conf->thread_count, sizeof (*conf->workers));
+	ERR_ABORT (conf->workers);
 
 	for (i=0; i<conf->thread_count; i++) {
 
-		iot_worker_t *worker = CALLOC (1, sizeof (*worker));
-		ERR_ABORT (worker);
-
-		worker->next = &conf->workers;
-		worker->prev = conf->workers.prev;
-		worker->next->prev = worker;
-		worker->prev->next = worker;
+		iot_worker_t *worker = &conf->workers[i];
+		int pri = 0;
 
-		worker->queue.next = &worker->queue;
-		worker->queue.prev = &worker->queue;
+		for (pri = 0; pri < IOT_PRI_MAX; pri++)
+			INIT_LIST_HEAD (&worker->rq[pri]);
+		pthread_mutex_init (&worker->lock, NULL);
+		pthread_cond_init (&worker->cond, NULL);
 
-		/*
-		  pthread_mutex_init (&worker->lock, NULL);
-		  pthread_cond_init (&worker->q_cond, NULL);
-		*/
-		pthread_cond_init (&worker->dq_cond, NULL);
+		worker->conf = conf;
+		worker->index = i;
+	}
 
-		/*
-		  worker->queue_limit = conf->queue_limit;
-		*/
+	/* start threads only once every worker can be stolen from */
+	for (i=0; i<conf->thread_count; i++)
+		pthread_create (&conf->workers[i].thread, NULL, iot_worker,
+				&conf->workers[i]);
+}
 
-		worker->conf = conf;
 
-		pthread_create (&worker->thread, NULL, iot_worker, worker);
+static void
+iot_stats_log (xlator_t *this)
+{
+	iot_conf_t *conf = this->private;
+	iot_worker_t *worker = NULL;
+	int i = 0;
+
+	for (i = 0; i < conf->thread_count; i++) {
+		worker = &conf->workers[i];
+
+		gf_log (this->name, GF_LOG_DEBUG,
+			"worker %d: queued %"PRIu64"/%"PRIu64"/%"PRIu64
+			" (hi/normal/lo), executed %"PRIu64
+			" (%"PRIu64" stolen), queue depth %d (max %d), "
+			"average wait %"PRIu64" usec",
+			i, worker->queued[IOT_PRI_HI],
+			worker->queued[IOT_PRI_NORMAL],
+			worker->queued[IOT_PRI_LO],
+			worker->executed, worker->stolen,
+			worker->rq_depth, worker->max_depth,
+			worker->executed ?
+			worker->wait_usec / worker->executed : 0);
 	}
 }
 
+static char *iot_class_options[IOT_PRI_MAX] = {
+	[IOT_PRI_HI]     = "high-prio-threads",
+	[IOT_PRI_NORMAL] = "normal-prio-threads",
+	[IOT_PRI_LO]     = "low-prio-threads",
+};
+
 int32_t 
 init (xlator_t *this)
 {
 	iot_conf_t *conf;
 	dict_t *options = this->options;
+	int pri = 0;
 
 	if (!this->children || this->children->next) {
 		gf_log ("io-threads",
@@ -1196,8 +3032,23 @@ init (xlator_t *this)
 			conf->thread_count);
 	}
 
-	pthread_mutex_init (&conf->lock, NULL);
-	pthread_cond_init (&conf->q_cond, NULL);
+	for (pri = 0; pri < IOT_PRI_MAX; pri++) {
+		conf->class_threads[pri] = conf->thread_count;
+
+		if (dict_get (options, iot_class_options[pri]))
+			conf->class_threads[pri] =
+				data_to_int32 (dict_get (options,
+							 iot_class_options[pri]));
+
+		if ((conf->class_threads[pri] < 1)
+		    || (conf->class_threads[pri] > conf->thread_count)) {
+			gf_log (this->name, GF_LOG_WARNING,
+				"%s must be between 1 and thread-count (%d), "
+				"using %d", iot_class_options[pri],
+				conf->thread_count, conf->thread_count);
+			conf->class_threads[pri] = conf->thread_count;
+		}
+	}
 
 	conf->files.next = &conf->files;
 	conf->files.prev = &conf->files;
@@ -1214,6 +3065,8 @@ fini (xlator_t *this)
 {
 	iot_conf_t *conf = this->private;
 
+	iot_stats_log (this);
+
 	FREE (conf);
 
 	this->private = NULL;
@@ -1221,27 +3074,57 @@ fini (xlator_t *this)
 }
 
 struct xlator_fops fops = {
-	.open        = iot_open,
+	.lookup      = iot_lookup,
+	.stat        = iot_stat,
+	.fstat       = iot_fstat,
+	.chmod       = iot_chmod,
+	.fchmod      = iot_fchmod,
+	.chown       = iot_chown,
+	.fchown      = iot_fchown,
+	.truncate    = iot_truncate,
+	.ftruncate   = iot_ftruncate,
+	.utimens     = iot_utimens,
+	.access      = iot_access,
+	.readlink    = iot_readlink,
+	.mknod       = iot_mknod,
+	.mkdir       = iot_mkdir,
+	.unlink      = iot_unlink,
+	.rmdir       = iot_rmdir,
+	.symlink     = iot_symlink,
+	.rename      = iot_rename,
+	.link        = iot_link,
 	.create      = iot_create,
+	.open        = iot_open,
 	.readv       = iot_readv,
 	.writev      = iot_writev,
 	.flush       = iot_flush,
 	.fsync       = iot_fsync,
+	.opendir     = iot_opendir,
+	.readdir     = iot_readdir,
+	.readdirp    = iot_readdirp,
+	.fsyncdir    = iot_fsyncdir,
+	.statfs      = iot_statfs,
+	.setxattr    = iot_setxattr,
+	.getxattr    = iot_getxattr,
+	.removexattr = iot_removexattr,
 	.lk          = iot_lk,
-	.stat        = iot_stat,
-	.fstat       = iot_fstat,
-	.truncate    = iot_truncate,
-	.ftruncate   = iot_ftruncate,
-	.utimens     = iot_utimens,
+	.inodelk     = iot_inodelk,
+	.finodelk    = iot_finodelk,
+	.entrylk     = iot_entrylk,
+	.fentrylk    = iot_fentrylk,
+	.setdents    = iot_setdents,
+	.getdents    = iot_getdents,
 	.checksum    = iot_checksum,
-	.unlink      = iot_unlink,
+	.xattrop     = iot_xattrop,
+	.fxattrop    = iot_fxattrop,
 };
 
 struct xlator_mops mops = {
 };
 
 struct xlator_cbks cbks = {
-	.release = iot_release,
+	.release    = iot_release,
+	.releasedir = iot_release,
 };
 
 struct volume_options options[] = {
@@ -1250,5 +3133,20 @@ struct volume_options options[] = {
 	  .min  = 1, 
 	  .max  = 32
 	},
+	{ .key  = {"high-prio-threads"},
+	  .type = GF_OPTION_TYPE_INT,
+	  .min  = 1,
+	  .max  = 32
+	},
+	{ .key  = {"normal-prio-threads"},
+	  .type = GF_OPTION_TYPE_INT,
+	  .min  = 1,
+	  .max  = 32
+	},
+	{ .key  = {"low-prio-threads"},
+	  .type = GF_OPTION_TYPE_INT,
+	  .min  = 1,
+	  .max  = 32
+	},
 	{ .key  = {NULL} },
 };
@@ -32,68 +32,93 @@
 #include "dict.h"
 #include "xlator.h"
 #include "common-utils.h"
+#include "list.h"
+#include <sys/time.h>
 
 #define min(a,b) ((a)<(b)?(a):(b))
 #define max(a,b) ((a)>(b)?(a):(b))
 
+/* request classes, in the order workers look for work. metadata ops
+   should not wait behind streaming reads and writes. */
+typedef enum {
+  IOT_PRI_HI = 0,             /* lookup, stat, open, readdir, ... */
+  IOT_PRI_NORMAL,             /* entry and attribute changes, locks */
+  IOT_PRI_LO,                 /* data transfer and syncs */
+  IOT_PRI_MAX,
+} iot_pri_t;
+
 struct iot_conf;
 struct iot_worker;
-struct iot_queue;
 struct iot_local;
 struct iot_file;
 
+/* every queued request is the frame->local of its stub, so queueing
+   does not allocate */
 struct iot_local {
-  struct iot_file *file;
-  size_t frame_size;
-};
-
-struct iot_queue {
-  struct iot_queue *next, *prev;
+  struct list_head list;      /* in a worker's run queue, or in the
+                                 pending list of its file */
   call_stub_t *stub;
+  struct iot_file *file;      /* NULL for requests not tied to an fd */
+  char exclusive;             /* must not overlap other requests on file */
+  iot_pri_t pri;
+  struct timeval queued_at;
 };
 
+/* each worker has its own run queues, one per class, and lock.
+   requests are queued to the worker the file is scheduled on, idle
+   workers steal from the others. only the first <class>-prio-threads
+   workers serve a class. everything in a run queue can be wound in any
+   order, ordering between requests on one fd is kept by iot_file before
+   they get there. */
 struct iot_worker {
-  struct iot_worker *next, *prev;
-  struct iot_queue queue;
+  struct list_head rq[IOT_PRI_MAX];
+  int32_t rq_depth;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  char idle;                  /* waiting on cond */
+  char wakeup;                /* someone queued work while idle */
   struct iot_conf *conf;
-  int64_t q,dq;
-  pthread_cond_t dq_cond;
-  /*
-    pthread_cond_t q_cond;
-    pthread_mutex_t lock;
-  */
+  int32_t index;
   int32_t fd_count;
-  int32_t queue_size;
-  /*
-    int32_t queue_limit;
-  */
   pthread_t thread;
+
+  /* under lock */
+  uint64_t queued[IOT_PRI_MAX]; /* requests queued to this worker */
+  int32_t max_depth;
+  /* only touched by the worker thread itself */
+  uint64_t executed;
+  uint64_t stolen;            /* taken from the run queue of others */
+  uint64_t wait_usec;         /* time spent queued by executed requests */
 };
 
+/* requests on an fd leave for the run queues in arrival order. shared
+   requests (reads, stats) may be wound concurrently with each other,
+   an exclusive one (writes, truncates, syncs, locks) is only wound
+   once everything queued before it has been wound, and nothing behind
+   it is wound before it. */
 struct iot_file {
   struct iot_file *next, *prev; /* all open files via this xlator */
   struct iot_worker *worker;
   fd_t *fd;
+  pthread_mutex_t lock;
+  struct list_head pending;   /* waiting for the file to allow them */
   int32_t pending_ops;
+  int32_t inflight;           /* in run queues or being wound */
+  char exclusive_inflight;
 };
 
 struct iot_conf {
   int32_t thread_count;
   int32_t misc_thread_index;  /* Used to schedule the miscellaneous calls like checksum */
-  struct iot_worker workers;
+  struct iot_worker *workers;
+  int32_t class_threads[IOT_PRI_MAX]; /* workers serving each class */
   struct iot_file files;
   pthread_mutex_t files_lock;
-
-  uint64_t cache_size;
-  off_t current_size;
-  pthread_cond_t q_cond;
-  pthread_mutex_t lock;
 };
 
 typedef struct iot_file iot_file_t;
 typedef struct iot_conf iot_conf_t;
 typedef struct iot_local iot_local_t;
 typedef struct iot_worker iot_worker_t;
-typedef struct iot_queue iot_queue_t;
 
 #endif /* __IOT_H */
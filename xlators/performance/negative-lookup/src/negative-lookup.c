@@ -0,0 +1,720 @@
+/*
+   Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+   This file is part of GlusterFS.
+
+   GlusterFS is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   GlusterFS is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CONFIG_H
+#define _CONFIG_H
+#include "config.h"
+#endif
+
+#include "negative-lookup.h"
+
+/*
+ * negative-lookup remembers the names a lookup did not find, per parent
+ * directory, and fails the lookups of them which follow with ENOENT
+ * without winding them. include paths and module search paths make
+ * compilers and interpreters probe the same missing names over and
+ * over, each probe otherwise costs a lookup on the hashed subvolume of
+ * distribute, or on all of them with lookup-unhashed.
+ *
+ * the names are hashed on (parent inode, name), the directory context
+ * lists them so that they go with the directory. they expire after
+ * cache-timeout seconds and an LRU keeps them within cache-size bytes.
+ * creating an entry under a name, by any fop, drops the name.
+ */
+
+
+static uint32_t
+nl_hash (inode_t *parent, const char *name)
+{
+	return SuperFastHash (name, strlen (name)) ^
+		(uint32_t)((unsigned long) parent >> 6);
+}
+
+
+static nl_dir_t *
+nl_dir_get (xlator_t *this, inode_t *inode)
+{
+	uint64_t tmp = 0;
+
+	if (inode_ctx_get (inode, this, &tmp) != 0)
+		return NULL;
+
+	return (nl_dir_t *)(long) tmp;
+}
+
+
+static nl_entry_t *
+__nl_search (nl_conf_t *conf, inode_t *parent, const char *name,
+	     uint32_t hashval)
+{
+	nl_entry_t *entry = NULL;
+
+	list_for_each_entry (entry, &conf->hash[hashval & (conf->hash_size - 1)],
+			     hash) {
+		if (entry->hashval == hashval && entry->parent == parent
+		    && !strcmp (entry->name, name))
+			return entry;
+	}
+
+	return NULL;
+}
+
+
+static void
+__nl_entry_destroy (nl_conf_t *conf, nl_entry_t *entry)
+{
+	list_del (&entry->hash);
+	list_del (&entry->lru);
+	list_del (&entry->dir_list);
+
+	conf->size -= entry->size;
+	conf->count--;
+
+	FREE (entry);
+}
+
+
+/* 0 if the name was found missing under parent within cache-timeout */
+static int
+nl_search (xlator_t *this, inode_t *parent, const char *name)
+{
+	nl_conf_t      *conf = this->private;
+	nl_entry_t     *entry = NULL;
+	uint32_t        hashval = 0;
+	struct timeval  now = {0, };
+	int64_t         age = 0;
+	int             ret = -1;
+
+	hashval = nl_hash (parent, name);
+	gettimeofday (&now, NULL);
+
+	LOCK (&conf->lock);
+	{
+		entry = __nl_search (conf, parent, name, hashval);
+		if (!entry)
+			goto unlock;
+
+		age = (now.tv_sec - entry->cached_at.tv_sec) * 1000000LL
+			+ (now.tv_usec - entry->cached_at.tv_usec);
+
+		if (age < 0 || age >= conf->timeout * 1000000LL) {
+			__nl_entry_destroy (conf, entry);
+			goto unlock;
+		}
+
+		list_move (&entry->lru, &conf->lru);
+		ret = 0;
+	}
+unlock:
+	if (ret == 0)
+		conf->hits++;
+	else
+		conf->misses++;
+	UNLOCK (&conf->lock);
+
+	return ret;
+}
+
+
+static void
+nl_insert (xlator_t *this, inode_t *parent, const char *name, uint64_t gen)
+{
+	nl_conf_t      *conf = this->private;
+	nl_dir_t       *dir = NULL;
+	nl_entry_t     *entry = NULL;
+	nl_entry_t     *victim = NULL;
+	uint32_t        hashval = 0;
+	size_t          size = 0;
+	uint64_t        tmp = 0;
+
+	hashval = nl_hash (parent, name);
+	size = sizeof (*entry) + strlen (name) + 1;
+
+	LOCK (&conf->lock);
+	{
+		if (inode_ctx_get (parent, this, &tmp) == 0) {
+			dir = (nl_dir_t *)(long) tmp;
+		} else {
+			dir = CALLOC (1, sizeof (*dir));
+			if (!dir)
+				goto unlock;
+
+			INIT_LIST_HEAD (&dir->entries);
+			dir->gen = conf->gen;
+			if (inode_ctx_put (parent, this,
+					   (uint64_t)(long) dir) != 0) {
+				FREE (dir);
+				goto unlock;
+			}
+		}
+
+		/* an entry was created in the directory since the lookup
+		   was wound */
+		if (dir->gen > gen)
+			goto unlock;
+
+		entry = __nl_search (conf, parent, name, hashval);
+		if (entry) {
+			gettimeofday (&entry->cached_at, NULL);
+			list_move (&entry->lru, &conf->lru);
+			goto unlock;
+		}
+
+		entry = CALLOC (1, size);
+		if (!entry)
+			goto unlock;
+
+		entry->parent  = parent;
+		entry->hashval = hashval;
+		entry->size    = size;
+		strcpy (entry->name, name);
+		gettimeofday (&entry->cached_at, NULL);
+
+		list_add (&entry->hash,
+			  &conf->hash[hashval & (conf->hash_size - 1)]);
+		list_add (&entry->lru, &conf->lru);
+		list_add (&entry->dir_list, &dir->entries);
+
+		conf->size += size;
+		conf->count++;
+		conf->fills++;
+
+		while (conf->size > conf->size_limit) {
+			victim = list_entry (conf->lru.prev, nl_entry_t, lru);
+			__nl_entry_destroy (conf, victim);
+			conf->evictions++;
+		}
+	}
+unlock:
+	UNLOCK (&conf->lock);
+}
+
+
+/* name is about to exist under parent, or just came to. lookups wound
+   before this must not cache it as missing. */
+static void
+nl_invalidate (xlator_t *this, inode_t *parent, const char *name)
+{
+	nl_conf_t  *conf = this->private;
+	nl_dir_t   *dir = NULL;
+	nl_entry_t *entry = NULL;
+	uint32_t    hashval = 0;
+
+	if (!parent || !name)
+		return;
+
+	dir = nl_dir_get (this, parent);
+	hashval = nl_hash (parent, name);
+
+	LOCK (&conf->lock);
+	{
+		conf->gen++;
+		if (!dir)
+			goto unlock;
+
+		dir->gen = conf->gen;
+
+		entry = __nl_search (conf, parent, name, hashval);
+		if (entry) {
+			__nl_entry_destroy (conf, entry);
+			conf->invalidations++;
+		}
+	}
+unlock:
+	UNLOCK (&conf->lock);
+}
+
+
+static nl_local_t *
+nl_local_new (call_frame_t *frame, inode_t *parent, const char *name)
+{
+	nl_local_t *local = NULL;
+
+	local = CALLOC (1, sizeof (*local));
+	if (!local)
+		return NULL;
+
+	local->name = strdup (name);
+	if (!local->name) {
+		FREE (local);
+		return NULL;
+	}
+	local->parent = inode_ref (parent);
+
+	frame->local = local;
+	return local;
+}
+
+
+static void
+nl_local_wipe (nl_local_t *local)
+{
+	if (!local)
+		return;
+
+	inode_unref (local->parent);
+	local->parent = NULL;
+	FREE (local->name);
+}
+
+
+/* loc is about to be created. a lookup of it wound before the fop
+   returns may still come back with ENOENT, so nl_local_done drops the
+   name a second time and bumps the parent's gen past that lookup */
+static void
+nl_local_invalidate (call_frame_t *frame, xlator_t *this, loc_t *loc)
+{
+	if (!loc->parent || !loc->name)
+		return;
+
+	nl_invalidate (this, loc->parent, loc->name);
+	nl_local_new (frame, loc->parent, loc->name);
+}
+
+
+static void
+nl_local_done (call_frame_t *frame, xlator_t *this)
+{
+	nl_local_t *local = frame->local;
+
+	if (!local)
+		return;
+
+	nl_invalidate (this, local->parent, local->name);
+	nl_local_wipe (local);
+}
+
+
+int32_t
+nl_lookup_cbk (call_frame_t *frame,
+	       void *cookie,
+	       xlator_t *this,
+	       int32_t op_ret,
+	       int32_t op_errno,
+	       inode_t *inode,
+	       struct stat *buf,
+	       dict_t *dict)
+{
+	nl_local_t *local = frame->local;
+
+	if (local) {
+		if (op_ret == -1 && op_errno == ENOENT)
+			nl_insert (this, local->parent, local->name,
+				   local->gen);
+		else if (op_ret == 0)
+			nl_invalidate (this, local->parent, local->name);
+
+		nl_local_wipe (local);
+	}
+
+	STACK_UNWIND (frame, op_ret, op_errno, inode, buf, dict);
+	return 0;
+}
+
+
+int32_t
+nl_lookup (call_frame_t *frame,
+	   xlator_t *this,
+	   loc_t *loc,
+	   dict_t *xattr_req)
+{
+	nl_conf_t  *conf = this->private;
+	nl_local_t *local = NULL;
+
+	/* the root, lookups by inode number, and revalidates of inodes
+	   known to exist go down */
+	if (!loc->parent || !loc->name || (loc->inode && loc->inode->ino))
+		goto wind;
+
+	if (nl_search (this, loc->parent, loc->name) == 0) {
+		STACK_UNWIND (frame, -1, ENOENT, NULL, NULL, NULL);
+		return 0;
+	}
+
+	local = nl_local_new (frame, loc->parent, loc->name);
+	if (local) {
+		LOCK (&conf->lock);
+		{
+			local->gen = conf->gen;
+		}
+		UNLOCK (&conf->lock);
+	}
+
+wind:
+	STACK_WIND (frame, nl_lookup_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->lookup,
+		    loc, xattr_req);
+	return 0;
+}
+
+
+int32_t
+nl_inode_cbk (call_frame_t *frame,
+	      void *cookie,
+	      xlator_t *this,
+	      int32_t op_ret,
+	      int32_t op_errno,
+	      inode_t *inode,
+	      struct stat *buf)
+{
+	nl_local_done (frame, this);
+
+	STACK_UNWIND (frame, op_ret, op_errno, inode, buf);
+	return 0;
+}
+
+
+int32_t
+nl_create_cbk (call_frame_t *frame,
+	       void *cookie,
+	       xlator_t *this,
+	       int32_t op_ret,
+	       int32_t op_errno,
+	       fd_t *fd,
+	       inode_t *inode,
+	       struct stat *buf)
+{
+	nl_local_done (frame, this);
+
+	STACK_UNWIND (frame, op_ret, op_errno, fd, inode, buf);
+	return 0;
+}
+
+
+int32_t
+nl_rename_cbk (call_frame_t *frame,
+	       void *cookie,
+	       xlator_t *this,
+	       int32_t op_ret,
+	       int32_t op_errno,
+	       struct stat *buf)
+{
+	nl_local_done (frame, this);
+
+	STACK_UNWIND (frame, op_ret, op_errno, buf);
+	return 0;
+}
+
+
+int32_t
+nl_create (call_frame_t *frame,
+	   xlator_t *this,
+	   loc_t *loc,
+	   int32_t flags,
+	   mode_t mode,
+	   fd_t *fd)
+{
+	nl_local_invalidate (frame, this, loc);
+
+	STACK_WIND (frame, nl_create_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->create,
+		    loc, flags, mode, fd);
+	return 0;
+}
+
+
+int32_t
+nl_mknod (call_frame_t *frame,
+	  xlator_t *this,
+	  loc_t *loc,
+	  mode_t mode,
+	  dev_t rdev)
+{
+	nl_local_invalidate (frame, this, loc);
+
+	STACK_WIND (frame, nl_inode_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->mknod,
+		    loc, mode, rdev);
+	return 0;
+}
+
+
+int32_t
+nl_mkdir (call_frame_t *frame,
+	  xlator_t *this,
+	  loc_t *loc,
+	  mode_t mode)
+{
+	nl_local_invalidate (frame, this, loc);
+
+	STACK_WIND (frame, nl_inode_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->mkdir,
+		    loc, mode);
+	return 0;
+}
+
+
+int32_t
+nl_symlink (call_frame_t *frame,
+	    xlator_t *this,
+	    const char *linkname,
+	    loc_t *loc)
+{
+	nl_local_invalidate (frame, this, loc);
+
+	STACK_WIND (frame, nl_inode_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->symlink,
+		    linkname, loc);
+	return 0;
+}
+
+
+int32_t
+nl_link (call_frame_t *frame,
+	 xlator_t *this,
+	 loc_t *oldloc,
+	 loc_t *newloc)
+{
+	nl_local_invalidate (frame, this, newloc);
+
+	STACK_WIND (frame, nl_inode_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->link,
+		    oldloc, newloc);
+	return 0;
+}
+
+
+int32_t
+nl_rename (call_frame_t *frame,
+	   xlator_t *this,
+	   loc_t *oldloc,
+	   loc_t *newloc)
+{
+	nl_local_invalidate (frame, this, newloc);
+
+	STACK_WIND (frame, nl_rename_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->rename,
+		    oldloc, newloc);
+	return 0;
+}
+
+
+int32_t
+nl_getxattr_cbk (call_frame_t *frame,
+		 void *cookie,
+		 xlator_t *this,
+		 int32_t op_ret,
+		 int32_t op_errno,
+		 dict_t *dict)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, dict);
+	return 0;
+}
+
+
+static void
+nl_stats_get (xlator_t *this, xlator_counter_t *counters)
+{
+	nl_conf_t *conf = this->private;
+
+	LOCK (&conf->lock);
+	{
+		counters[0].value = conf->hits;
+		counters[1].value = conf->misses;
+		counters[2].value = conf->fills;
+		counters[3].value = conf->invalidations;
+		counters[4].value = conf->evictions;
+		counters[5].value = conf->count;
+		counters[6].value = conf->size;
+	}
+	UNLOCK (&conf->lock);
+}
+
+
+int32_t
+nl_getxattr (call_frame_t *frame,
+	     xlator_t *this,
+	     loc_t *loc,
+	     const char *name)
+{
+	xlator_counter_t counters[] = NL_STATS_COUNTERS;
+
+	if (name && !strncmp (name, NL_STATS_XATTR,
+			      strlen (NL_STATS_XATTR))) {
+		nl_stats_get (this, counters);
+		return xlator_counters_getxattr (frame, NL_STATS_XATTR, name,
+						 counters);
+	}
+
+	STACK_WIND (frame, nl_getxattr_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->getxattr,
+		    loc, name);
+	return 0;
+}
+
+
+int32_t
+nl_forget (xlator_t *this,
+	   inode_t *inode)
+{
+	nl_conf_t  *conf = this->private;
+	nl_dir_t   *dir = NULL;
+	nl_entry_t *entry = NULL;
+	nl_entry_t *tmp = NULL;
+
+	dir = nl_dir_get (this, inode);
+	if (!dir)
+		return 0;
+
+	LOCK (&conf->lock);
+	{
+		list_for_each_entry_safe (entry, tmp, &dir->entries,
+					  dir_list) {
+			__nl_entry_destroy (conf, entry);
+		}
+	}
+	UNLOCK (&conf->lock);
+
+	FREE (dir);
+	return 0;
+}
+
+
+int32_t
+init (xlator_t *this)
+{
+	nl_conf_t *conf = NULL;
+	dict_t    *options = this->options;
+	data_t    *data = NULL;
+	uint32_t   i = 0;
+
+	if (!this->children || this->children->next) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"FATAL: translator %s does not have exactly one "
+			"child node", this->name);
+		return -1;
+	}
+
+	if (!this->parents) {
+		gf_log (this->name, GF_LOG_WARNING,
+			"dangling volume. check volfile ");
+	}
+
+	conf = CALLOC (1, sizeof (*conf));
+	if (!conf) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"out of memory");
+		return -1;
+	}
+
+	conf->timeout    = NL_CACHE_TIMEOUT;
+	conf->size_limit = NL_CACHE_SIZE;
+
+	data = dict_get (options, "cache-timeout");
+	if (data) {
+		conf->timeout = data_to_uint32 (data);
+		gf_log (this->name, GF_LOG_DEBUG,
+			"using cache-timeout %u", conf->timeout);
+	}
+
+	data = dict_get (options, "cache-size");
+	if (data) {
+		if (gf_string2bytesize (data->data, &conf->size_limit) != 0) {
+			gf_log (this->name, GF_LOG_ERROR,
+				"invalid number format \"%s\" of "
+				"\"option cache-size\"", data->data);
+			FREE (conf);
+			return -1;
+		}
+		gf_log (this->name, GF_LOG_DEBUG,
+			"using cache-size %"PRIu64, conf->size_limit);
+	}
+
+	/* about one bucket for every 64 bytes of names */
+	conf->hash_size = NL_HASH_MIN;
+	while (conf->hash_size < conf->size_limit / 64)
+		conf->hash_size <<= 1;
+
+	conf->hash = CALLOC (conf->hash_size, sizeof (*conf->hash));
+	if (!conf->hash) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"out of memory");
+		FREE (conf);
+		return -1;
+	}
+
+	for (i = 0; i < conf->hash_size; i++)
+		INIT_LIST_HEAD (&conf->hash[i]);
+
+	LOCK_INIT (&conf->lock);
+	INIT_LIST_HEAD (&conf->lru);
+
+	this->private = conf;
+	return 0;
+}
+
+
+void
+fini (xlator_t *this)
+{
+	nl_conf_t        *conf = this->private;
+	nl_entry_t       *entry = NULL;
+	nl_entry_t       *tmp = NULL;
+	xlator_counter_t  counters[] = NL_STATS_COUNTERS;
+
+	if (!conf)
+		return;
+
+	nl_stats_get (this, counters);
+	xlator_counters_log (this, counters);
+
+	list_for_each_entry_safe (entry, tmp, &conf->lru, lru) {
+		__nl_entry_destroy (conf, entry);
+	}
+
+	LOCK_DESTROY (&conf->lock);
+	FREE (conf->hash);
+	FREE (conf);
+
+	this->private = NULL;
+	return;
+}
+
+
+struct xlator_fops fops = {
+	.lookup      = nl_lookup,
+	.create      = nl_create,
+	.mknod       = nl_mknod,
+	.mkdir       = nl_mkdir,
+	.symlink     = nl_symlink,
+	.link        = nl_link,
+	.rename      = nl_rename,
+	.getxattr    = nl_getxattr,
+};
+
+struct xlator_mops mops = {
+};
+
+struct xlator_cbks cbks = {
+	.forget      = nl_forget,
+};
+
+struct volume_options options[] = {
+	{ .key  = {"cache-timeout"},
+	  .type = GF_OPTION_TYPE_INT,
+	  .min  = 0,
+	  .max  = 3600
+	},
+	{ .key  = {"cache-size"},
+	  .type = GF_OPTION_TYPE_SIZET,
+	  .min  = 64 * GF_UNIT_KB,
+	  .max  = 1 * GF_UNIT_GB
+	},
+	{ .key  = {NULL} },
+};
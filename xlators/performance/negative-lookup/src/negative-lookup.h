@@ -0,0 +1,101 @@
+/*
+   Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+   This file is part of GlusterFS.
+
+   GlusterFS is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   GlusterFS is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _NEGATIVE_LOOKUP_H_
+#define _NEGATIVE_LOOKUP_H_
+
+#ifndef _CONFIG_H
+#define _CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/time.h>
+#include "glusterfs.h"
+#include "logging.h"
+#include "dict.h"
+#include "xlator.h"
+#include "list.h"
+#include "locking.h"
+#include "common-utils.h"
+#include "hashfn.h"
+
+#define NL_CACHE_TIMEOUT      5                   /* seconds */
+#define NL_CACHE_SIZE         (1 * GF_UNIT_MB)
+#define NL_HASH_MIN           1024
+
+#define NL_STATS_XATTR        "glusterfs.negative-lookup."
+
+/* in the order nl_stats_get fills them */
+#define NL_STATS_COUNTERS     {{"hits", 0}, {"misses", 0}, {"fills", 0}, \
+			       {"invalidations", 0}, {"evictions", 0},  \
+			       {"entries", 0}, {"size", 0}, {NULL, 0}}
+
+/*
+ * nl_dir - the context of a directory with names cached as missing
+ *
+ * @entries: its nl_entries
+ * @gen:     nl_conf.gen at the last entry created in it, a lookup wound
+ *           before that must not cache its ENOENT
+ */
+typedef struct nl_dir {
+	struct list_head  entries;
+	uint64_t          gen;
+} nl_dir_t;
+
+/*
+ * nl_entry - a name looked up in a directory and not found
+ */
+typedef struct nl_entry {
+	struct list_head  hash;         /* in a bucket of nl_conf.hash */
+	struct list_head  lru;          /* in nl_conf.lru */
+	struct list_head  dir_list;     /* in nl_dir.entries */
+	inode_t          *parent;       /* not ref'd, the entry goes with
+					   the parent's context */
+	struct timeval    cached_at;
+	uint32_t          hashval;
+	size_t            size;         /* accounted in nl_conf.size */
+	char              name[0];
+} nl_entry_t;
+
+typedef struct nl_conf {
+	gf_lock_t         lock;
+	struct list_head *hash;
+	uint32_t          hash_size;    /* power of two */
+	struct list_head  lru;          /* most recently used first */
+	uint64_t          size;
+	uint64_t          size_limit;
+	uint32_t          count;
+	uint32_t          timeout;      /* seconds */
+	uint64_t          gen;
+
+	uint64_t          hits;
+	uint64_t          misses;
+	uint64_t          fills;
+	uint64_t          invalidations;
+	uint64_t          evictions;
+} nl_conf_t;
+
+/* a lookup which may cache its ENOENT, or an entry creating fop */
+typedef struct nl_local {
+	inode_t          *parent;
+	char             *name;
+	uint64_t          gen;
+} nl_local_t;
+
+#endif /* _NEGATIVE_LOOKUP_H_ */
@@ -28,6 +28,15 @@
 #include "xlator.h"
 #include "read-ahead.h"
 #include <assert.h>
+#include <sys/time.h>
+
+
+static inline struct list_head *
+ra_page_bucket (ra_file_t *file, off_t rounded_offset)
+{
+	return &file->page_hash[(rounded_offset / file->page_size)
+				% RA_PAGE_HASH];
+}
 
 
 ra_page_t *
@@ -37,16 +46,15 @@ ra_page_get (ra_file_t *file,
 	ra_page_t *page = NULL;
 	off_t      rounded_offset = 0;
 
-	page = file->pages.next;
 	rounded_offset = floor (offset, file->page_size);
 
-	while (page != &file->pages && page->offset < rounded_offset)
-		page = page->next;
-
-	if (page == &file->pages || page->offset != rounded_offset)
-		page = NULL;
+	list_for_each_entry (page, ra_page_bucket (file, rounded_offset),
+			     hash) {
+		if (page->offset == rounded_offset)
+			return page;
+	}
 
-	return page;
+	return NULL;
 }
 
 
@@ -57,28 +65,47 @@ ra_page_create (ra_file_t *file, off_t offset)
 	off_t      rounded_offset = 0;
 	ra_page_t *newpage   = NULL;
 
-	page           = file->pages.next;
 	rounded_offset = floor (offset, file->page_size);
 
-	while (page != &file->pages && page->offset < rounded_offset)
+	page = ra_page_get (file, rounded_offset);
+	if (page)
+		return page;
+
+	/* pages are mostly created next to one another, find where this
+	   one goes in the sorted list from a neighbour if possible */
+	if (rounded_offset >= file->page_size
+	    && (page = ra_page_get (file, rounded_offset - file->page_size)))
 		page = page->next;
+	else if (!(page = ra_page_get (file,
+				       rounded_offset + file->page_size))) {
+		page = file->pages.next;
+		while (page != &file->pages && page->offset < rounded_offset)
+			page = page->next;
+	}
 
-	if (page == &file->pages || page->offset != rounded_offset) {
-		newpage = CALLOC (1, sizeof (*newpage));
-		if (!newpage)
-			return NULL;
+	newpage = CALLOC (1, sizeof (*newpage));
+	if (!newpage)
+		return NULL;
 
-		newpage->offset = rounded_offset;
-		newpage->prev = page->prev;
-		newpage->next = page;
-		newpage->file = file;
-		page->prev->next = newpage;
-		page->prev = newpage;
+	newpage->offset = rounded_offset;
+	newpage->prev = page->prev;
+	newpage->next = page;
+	newpage->file = file;
+	newpage->stream = -1;
+	page->prev->next = newpage;
+	page->prev = newpage;
 
-		page = newpage;
+	list_add (&newpage->hash, ra_page_bucket (file, rounded_offset));
+	list_add_tail (&newpage->lru, &file->page_lru);
+	file->pages_cached++;
+
+	ra_conf_lock (file->conf);
+	{
+		file->conf->pages_cached++;
 	}
+	ra_conf_unlock (file->conf);
 
-	return page;
+	return newpage;
 }
 
 
@@ -126,6 +153,72 @@ ra_waitq_return (ra_waitq_t *waitq)
 }
 
 
+/*
+ * ra_subvolume_sample - account a page fault reply in the bandwidth and
+ * round trip time of the subvolume
+ *
+ * the fault time is min-filtered and the delivery rate max-filtered, both
+ * slowly forgetting, so that they follow the link and not the load
+ */
+static void
+ra_subvolume_sample (ra_conf_t *conf, struct timeval *now,
+		     uint64_t fault_usec, uint64_t bytes)
+{
+	uint64_t elapsed = 0;
+	uint64_t rate = 0;
+
+	ra_conf_lock (conf);
+	{
+		conf->inflight--;
+		conf->sample_bytes += bytes;
+
+		if (!conf->rtt_usec || fault_usec < conf->rtt_usec)
+			conf->rtt_usec = fault_usec;
+		else
+			conf->rtt_usec += (fault_usec - conf->rtt_usec) / 64;
+
+		elapsed = (now->tv_sec - conf->sample_start.tv_sec) * 1000000
+			+ (now->tv_usec - conf->sample_start.tv_usec);
+
+		if (elapsed && (elapsed >= RA_BW_SAMPLE_USEC
+				|| !conf->inflight)) {
+			rate = conf->sample_bytes * 1000000 / elapsed;
+			conf->bandwidth = max (rate, conf->bandwidth
+					       - conf->bandwidth / 8);
+			conf->sample_start = *now;
+			conf->sample_bytes = 0;
+		}
+	}
+	ra_conf_unlock (conf);
+}
+
+
+/*
+ * ra_bdp_pages - pages a stream keeps in flight with bdp-window: twice
+ * the bandwidth-delay product of the subvolume, so that a window which
+ * limits the bandwidth measured grows until the link does
+ */
+uint32_t
+ra_bdp_pages (ra_conf_t *conf)
+{
+	uint64_t bdp = 0;
+	uint64_t pages = 0;
+
+	ra_conf_lock (conf);
+	{
+		bdp = conf->bandwidth * conf->rtt_usec / 1000000;
+	}
+	ra_conf_unlock (conf);
+
+	pages = 2 * roof (bdp, conf->page_size) / conf->page_size;
+
+	if (conf->memory_limit)
+		pages = min (pages, conf->memory_limit / conf->page_size);
+
+	return max (pages, 1);
+}
+
+
 int
 ra_fault_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 	      int32_t op_ret, int32_t op_errno, struct iovec *vector,
@@ -141,6 +234,8 @@ ra_fault_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 	fd_t         *fd = NULL;
 	int           ret = 0;
 	uint64_t      tmp_file = 0;
+	struct timeval now = {0, };
+	uint64_t      fault_usec = 0;
 
 	local = frame->local;
 	fd  = local->fd;
@@ -152,11 +247,25 @@ ra_fault_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 	trav_offset    = pending_offset;  
 	payload_size   = op_ret;
 
+	gettimeofday (&now, NULL);
+	fault_usec = (now.tv_sec - local->fault_time.tv_sec) * 1000000
+		+ (now.tv_usec - local->fault_time.tv_usec);
+
+	ra_subvolume_sample (this->private, &now, fault_usec,
+			     (op_ret > 0) ? op_ret : 0);
+
 	ra_file_lock (file);
 	{
 		if (op_ret >= 0)
 			file->stbuf = *stbuf;
 
+		/* smoothed over the last eight or so */
+		if (file->fault_usec)
+			file->fault_usec = (file->fault_usec * 7
+					    + fault_usec) / 8;
+		else
+			file->fault_usec = fault_usec;
+
 		if (op_ret < 0) {
 			page = ra_page_get (file, pending_offset);
 			if (page)
@@ -173,13 +282,13 @@ ra_fault_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 		}
 
 		if (page->vector) {
-			dict_unref (page->ref);
+			iobref_unref (page->iobref);
 			free (page->vector);
 		}
 
 		page->vector = iov_dup (vector, count);
 		page->count = count;
-		page->ref = dict_ref (frame->root->rsp_refs);
+		page->iobref = iobref_ref (frame->root->rsp_refs);
 		page->ready = 1;
 
 		page->size = iov_length (vector, count);
@@ -217,6 +326,17 @@ ra_page_fault (ra_file_t *file,
 	fault_local->pending_size = file->page_size;
 
 	fault_local->fd = fd_ref (file->fd);
+	gettimeofday (&fault_local->fault_time, NULL);
+
+	ra_conf_lock (file->conf);
+	{
+		/* bandwidth is sampled while faults are in flight */
+		if (file->conf->inflight++ == 0) {
+			file->conf->sample_start = fault_local->fault_time;
+			file->conf->sample_bytes = 0;
+		}
+	}
+	ra_conf_unlock (file->conf);
 
 	STACK_WIND (fault_frame, ra_fault_cbk,
 		    FIRST_CHILD (fault_frame->this),
@@ -239,6 +359,11 @@ ra_frame_fill (ra_page_t *page, call_frame_t *frame)
 	local = frame->local;
 	fill  = &local->fill;
 
+	if (!page->used) {
+		page->used = 1;
+		list_move_tail (&page->lru, &page->file->page_lru);
+	}
+
 	if (local->op_ret != -1 && page->size) {
 		if (local->offset > page->offset)
 			src_offset = local->offset - page->offset;
@@ -266,7 +391,7 @@ ra_frame_fill (ra_page_t *page, call_frame_t *frame)
 
 		new->offset = page->offset;
 		new->size = copy_size;
-		new->refs = dict_ref (page->ref);
+		new->iobref = iobref_ref (page->iobref);
 		new->count = iov_subset (page->vector, page->count,
 					 src_offset, src_offset+copy_size,
 					 NULL);
@@ -294,7 +419,7 @@ ra_frame_unwind (call_frame_t *frame)
 	int32_t       count = 0;
 	struct iovec *vector;
 	int32_t       copied = 0;
-	dict_t       *refs = NULL;
+	struct iobref *iobref = NULL;
 	ra_fill_t    *next = NULL;
 	fd_t         *fd = NULL;
 	ra_file_t    *file = NULL;
@@ -304,7 +429,7 @@ ra_frame_unwind (call_frame_t *frame)
 	local = frame->local;
 	fill  = local->fill.next;
 
-	refs  = get_new_dict ();
+	iobref = iobref_new ();
 
 	frame->local = NULL;
 
@@ -324,19 +449,20 @@ ra_frame_unwind (call_frame_t *frame)
 			fill->count * sizeof (*vector));
 
 		copied += (fill->count * sizeof (*vector));
-		dict_copy (fill->refs, refs);
+		if (fill->iobref)
+			iobref_merge (iobref, fill->iobref);
 
 		fill->next->prev = fill->prev;
 		fill->prev->next = fill->prev;
 
-		dict_unref (fill->refs);
+		iobref_unref (fill->iobref);
 		free (fill->vector);
 		free (fill);
 
 		fill = next;
 	}
 
-	frame->root->rsp_refs = dict_ref (refs);
+	frame->root->rsp_refs = iobref;
 
 	fd = local->fd;
 	ret = fd_ctx_get (fd, frame->this, &tmp_file);
@@ -345,7 +471,7 @@ ra_frame_unwind (call_frame_t *frame)
 	STACK_UNWIND (frame, local->op_ret, local->op_errno,
 		      vector, count, &file->stbuf);
   
-	dict_unref (refs);
+	iobref_unref (iobref);
 	pthread_mutex_destroy (&local->local_lock);
 	free (local);
 	free (vector);
@@ -410,11 +536,29 @@ ra_page_wakeup (ra_page_t *page)
 void
 ra_page_purge (ra_page_t *page)
 {
+	ra_file_t   *file = page->file;
+	ra_stream_t *stream = NULL;
+
+	if (page->stream >= 0 && !page->used) {
+		stream = &file->streams[page->stream];
+		stream->wasted++;
+		stream->adapt_wasted++;
+	}
+
 	page->prev->next = page->next;
 	page->next->prev = page->prev;
+	list_del (&page->hash);
+	list_del (&page->lru);
+	file->pages_cached--;
 
-	if (page->ref) {
-		dict_unref (page->ref);
+	ra_conf_lock (file->conf);
+	{
+		file->conf->pages_cached--;
+	}
+	ra_conf_unlock (file->conf);
+
+	if (page->iobref) {
+		iobref_unref (page->iobref);
 	}
 	free (page->vector);
 	free (page);
@@ -485,3 +629,55 @@ ra_file_destroy (ra_file_t *file)
 	free (file);
 }
 
+
+
+/*
+ * ra_file_init - set up the page lists of a new file
+ * @file:
+ *
+ */
+void
+ra_file_init (ra_file_t *file)
+{
+	int i = 0;
+
+	file->pages.next = &file->pages;
+	file->pages.prev = &file->pages;
+	file->pages.offset = (unsigned long long) 0;
+	file->pages.file = file;
+
+	for (i = 0; i < RA_PAGE_HASH; i++)
+		INIT_LIST_HEAD (&file->page_hash[i]);
+	INIT_LIST_HEAD (&file->page_lru);
+}
+
+
+/*
+ * ra_file_prune - purge the least recently used pages of a file beyond
+ * what its streams read ahead, pages read by no stream are not purged
+ * otherwise
+ * @file:
+ *
+ * assumes file is locked
+ */
+void
+ra_file_prune (ra_file_t *file)
+{
+	ra_page_t *page = NULL;
+	ra_page_t *next = NULL;
+	uint32_t   limit = RA_MAX_STREAMS;
+	int        i = 0;
+
+	for (i = 0; i < RA_MAX_STREAMS; i++) {
+		if (file->streams[i].active)
+			limit += file->streams[i].window;
+	}
+
+	list_for_each_entry_safe (page, next, &file->page_lru, lru) {
+		if (file->pages_cached <= limit)
+			break;
+
+		if (page->ready && !page->waitq)
+			ra_page_purge (page);
+	}
+}
@@ -40,7 +40,8 @@
 
 static void
 read_ahead (call_frame_t *frame,
-            ra_file_t *file);
+            ra_file_t *file,
+            ra_stream_t *stream);
 
 
 int
@@ -77,12 +78,8 @@ ra_open_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 	if ((fd->flags & O_DIRECT) || (fd->flags & O_WRONLY))
 		file->disabled = 1;
 
-	file->offset = (unsigned long long) 0;
 	file->conf = conf;
-	file->pages.next = &file->pages;
-	file->pages.prev = &file->pages;
-	file->pages.offset = (unsigned long long) 0;
-	file->pages.file = file;
+	ra_file_init (file);
 
 	ra_conf_lock (conf);
 	{
@@ -98,10 +95,6 @@ ra_open_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 	file->page_size = conf->page_size;
 	pthread_mutex_init (&file->file_lock, NULL);
 
-	if (!file->disabled) {
-		file->page_count = 1;
-	}
-
 unwind:
 	STACK_UNWIND (frame, op_ret, op_errno, fd);
 
@@ -144,13 +137,9 @@ ra_create_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 	if ((fd->flags & O_DIRECT) || (fd->flags & O_WRONLY))
 			file->disabled = 1;
 
-	file->offset = (unsigned long long) 0;
 	//file->size = fd->inode->buf.st_size;
 	file->conf = conf;
-	file->pages.next = &file->pages;
-	file->pages.prev = &file->pages;
-	file->pages.offset = (unsigned long long) 0;
-	file->pages.file = file;
+	ra_file_init (file);
 
 	ra_conf_lock (conf);
 	{
@@ -246,71 +235,291 @@ ra_release (xlator_t *this,
 }
 
 
-void
-read_ahead (call_frame_t *frame, ra_file_t *file)
+/*
+ * __ra_stream_victim - whether stream should be replaced before victim:
+ * free streams first, then the ones which never followed a stride, then
+ * the least recently used
+ */
+static inline int
+__ra_stream_victim (ra_stream_t *stream, ra_stream_t *victim)
 {
-	off_t      ra_offset = 0;
-	size_t     ra_size = 0;
-	off_t      trav_offset = 0;
-	ra_page_t *trav = NULL;
-	off_t      cap = 0;
-	char       fault = 0;
+	if (!victim)
+		return 1;
+	if (!stream->active || !victim->active)
+		return !stream->active && victim->active;
+	if (!stream->confirmed != !victim->confirmed)
+		return !stream->confirmed;
+	return stream->used < victim->used;
+}
 
-	if (!file->page_count)
-		return;
 
-	ra_size   = file->page_size * file->page_count;
-	ra_offset = floor (file->offset, file->page_size);
-	cap       = file->size ? file->size : file->offset + ra_size;
+/*
+ * __ra_stream_get - the stream a read continues, or a new one for it
+ *
+ * a read continues a stream when it starts where the last read of the
+ * stream ended or a stride away from where it started. otherwise it
+ * starts a new stream, which takes its distance from the nearest stream
+ * as the stride to try.
+ *
+ * assumes file is locked
+ */
+static ra_stream_t *
+__ra_stream_get (ra_file_t *file, off_t offset, size_t size)
+{
+	ra_stream_t    *stream = NULL;
+	ra_stream_t    *nearest = NULL;
+	ra_stream_t    *victim = NULL;
+	off_t           distance = 0;
+	off_t           closest = 0;
+	struct timeval  now = {0, };
+	uint64_t        interval = 0;
+	int             i = 0;
+
+	gettimeofday (&now, NULL);
+	file->reads++;
+
+	for (i = 0; i < RA_MAX_STREAMS; i++) {
+		stream = &file->streams[i];
+
+		if (__ra_stream_victim (stream, victim))
+			victim = stream;
+
+		if (!stream->active)
+			continue;
+
+		if (offset == stream->offset)
+			/* read again */
+			goto found;
+
+		if (offset == stream->offset + stream->size
+		    || (stream->stride
+			&& offset == stream->offset + stream->stride)) {
+			stream->confirmed++;
+			goto follow;
+		}
 
-	while (ra_offset < min (file->offset + ra_size, cap)) {
+		distance = offset - stream->offset;
+		if (distance < 0)
+			distance = -distance;
 
-		ra_file_lock (file);
-		{
-			trav = ra_page_get (file, ra_offset);
+		if (distance <= file->page_size * RA_MAX_STRIDE_PAGES
+		    && (!nearest || distance < closest)) {
+			nearest = stream;
+			closest = distance;
 		}
-		ra_file_unlock (file);
-
-		if (!trav)
-			break;
+	}
 
-		ra_offset += file->page_size;
+	/* the nearest stream stays where it is, it may well be followed
+	   by reads of its own */
+	if (nearest)
+		distance = offset - nearest->offset;
+
+	stream = victim;
+	memset (stream, 0, sizeof (*stream));
+	stream->active = 1;
+	stream->window = min (2, file->page_count);
+	stream->offset = offset;
+	stream->size = size;
+	if (nearest)
+		stream->stride = distance;
+	goto found;
+
+follow:
+	stream->stride = offset - stream->offset;
+	stream->offset = offset;
+	stream->size = size;
+
+found:
+	if (stream->last_read.tv_sec) {
+		interval = (now.tv_sec - stream->last_read.tv_sec) * 1000000
+			+ (now.tv_usec - stream->last_read.tv_usec);
+		if (stream->interval_usec)
+			stream->interval_usec = (stream->interval_usec * 7
+						 + interval) / 8;
+		else
+			stream->interval_usec = interval;
 	}
+	stream->last_read = now;
+	stream->used = file->reads;
+	stream->reads++;
+
+	return stream;
+}
+
+
+/*
+ * __ra_stream_adapt - resize the window of a stream every few reads: grow
+ * it when reads had to wait for pages, shrink it when pages read ahead
+ * were dropped unread, and keep enough pages in flight to cover the time
+ * a page fault takes at the rate the stream reads
+ *
+ * @stalled: the read waited on a page
+ *
+ * assumes file is locked
+ */
+static void
+__ra_stream_adapt (ra_file_t *file, ra_stream_t *stream, int stalled)
+{
+	uint64_t needed = 0;
+	uint64_t pages_per_read = 0;
 
-	if (trav)
-		/* comfortable enough */
+	if (!stream->confirmed)
 		return;
 
-	trav_offset = ra_offset;
+	stream->adapt_reads++;
+	if (stalled)
+		stream->stalls++;
 
-	trav = file->pages.next;
-	cap  = file->size ? file->size : ra_offset + ra_size;
+	if (stream->adapt_reads < RA_ADAPT_READS)
+		return;
+
+	if (file->conf->bdp_window) {
+		stream->window = ra_bdp_pages (file->conf);
+		goto out;
+	}
+
+	if (stream->stalls)
+		stream->window = min (stream->window * 2, file->page_count);
+	else if (stream->adapt_wasted > stream->window / 2)
+		stream->window = max (stream->window / 2, 1);
+
+	if (stream->interval_usec) {
+		pages_per_read = max (stream->size / file->page_size, 1);
+		needed = (file->fault_usec / stream->interval_usec + 1)
+			* pages_per_read;
+		if (stream->window < needed)
+			stream->window = min (needed, file->page_count);
+	}
+
+out:
+	stream->adapt_reads = 0;
+	stream->stalls = 0;
+	stream->adapt_wasted = 0;
+}
+
+
+/*
+ * ra_over_budget - whether the pages cached by all files have reached
+ * memory-limit. demand pages are faulted regardless, read ahead is not.
+ */
+static int
+ra_over_budget (ra_conf_t *conf)
+{
+	if (!conf->memory_limit)
+		return 0;
+
+	return (conf->pages_cached >= conf->memory_limit / conf->page_size);
+}
 
-	while (trav_offset < min(ra_offset + ra_size, cap)) {
-		fault = 0;
-		ra_file_lock (file);
-		{
-			trav = ra_page_get (file, trav_offset);
-			if (!trav) {
-				fault = 1;
-				trav = ra_page_create (file, trav_offset);
-				if (trav) 
-					trav->dirty = 1;
-			}
-		}
-		ra_file_unlock (file);
 
+/*
+ * ra_ahead_page - fault the page at offset for a stream unless it is there
+ *
+ * returns -1 when out of memory or over memory-limit
+ */
+static int
+ra_ahead_page (call_frame_t *frame, ra_file_t *file, ra_stream_t *stream,
+	       off_t offset)
+{
+	ra_page_t *trav = NULL;
+	char       fault = 0;
+
+	ra_file_lock (file);
+	{
+		trav = ra_page_get (file, offset);
+		if (!trav && ra_over_budget (file->conf)) {
+			ra_file_unlock (file);
+			return -1;
+		}
 		if (!trav) {
-			/* OUT OF MEMORY */
-			break;
+			fault = 1;
+			trav = ra_page_create (file, offset);
+			if (trav) {
+				trav->dirty = 1;
+				trav->stream = stream - file->streams;
+				stream->ahead++;
+			}
 		}
+	}
+	ra_file_unlock (file);
 
-		if (fault) {
-			gf_log (frame->this->name, GF_LOG_DEBUG,
-				"RA at offset=%"PRId64, trav_offset);
-			ra_page_fault (file, frame, trav_offset);
+	if (!trav) {
+		/* OUT OF MEMORY */
+		return -1;
+	}
+
+	if (fault) {
+		gf_log (frame->this->name, GF_LOG_DEBUG,
+			"RA at offset=%"PRId64, offset);
+		ra_page_fault (file, frame, offset);
+	}
+
+	return 0;
+}
+
+
+/*
+ * read_ahead - fault the pages the next reads of a stream should find,
+ * up to its window: those of the next few reads a stride apart, or for
+ * reads smaller than a page those right after (or before) the last one
+ */
+void
+read_ahead (call_frame_t *frame, ra_file_t *file, ra_stream_t *stream)
+{
+	off_t      page_size = file->page_size;
+	off_t      read_offset = 0;
+	size_t     read_size = 0;
+	off_t      stride = 0;
+	off_t      trav_offset = 0;
+	off_t      cap = 0;
+	uint32_t   pages = 0;
+	uint32_t   window = 0;
+
+	ra_file_lock (file);
+	{
+		read_offset = stream->offset;
+		read_size = stream->size;
+		stride = stream->stride;
+		window = stream->confirmed ? stream->window : 0;
+		cap = file->stbuf.st_size;
+	}
+	ra_file_unlock (file);
+
+	if (!window)
+		return;
+
+	if (stride >= page_size || stride <= -page_size) {
+		while (pages < window) {
+			read_offset += stride;
+			if (read_offset < 0 || (cap && read_offset >= cap))
+				break;
+
+			for (trav_offset = floor (read_offset, page_size);
+			     trav_offset < read_offset + read_size
+				     && pages < window;
+			     trav_offset += page_size, pages++) {
+				if (ra_ahead_page (frame, file, stream,
+						   trav_offset) == -1)
+					return;
+			}
+		}
+	} else if (stride >= 0) {
+		trav_offset = roof (read_offset + read_size, page_size);
+		for (; pages < window; trav_offset += page_size, pages++) {
+			if (cap && trav_offset >= cap)
+				break;
+			if (ra_ahead_page (frame, file, stream,
+					   trav_offset) == -1)
+				return;
+		}
+	} else {
+		trav_offset = floor (read_offset, page_size) - page_size;
+		for (; pages < window && trav_offset >= 0;
+		     trav_offset -= page_size, pages++) {
+			if (ra_ahead_page (frame, file, stream,
+					   trav_offset) == -1)
+				return;
 		}
-		trav_offset += file->page_size;
 	}
 
 	return;
@@ -327,9 +536,14 @@ ra_need_atime_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
 }
 
 
-static void
+/*
+ * dispatch_requests - serve a read from the pages of the file, faulting
+ * the missing ones. returns whether the read has to wait for a page.
+ */
+static int
 dispatch_requests (call_frame_t *frame,
-                   ra_file_t *file)
+                   ra_file_t *file,
+                   ra_stream_t *stream)
 {
 	ra_local_t   *local = NULL;
 	ra_conf_t    *conf = NULL;
@@ -340,6 +554,7 @@ dispatch_requests (call_frame_t *frame,
 	call_frame_t *ra_frame = NULL;
 	char          need_atime_update = 1;
 	char          fault = 0;
+	int           stalled = 0;
 
 
 	local = frame->local;
@@ -361,6 +576,8 @@ dispatch_requests (call_frame_t *frame,
 				trav = ra_page_create (file, trav_offset);
 				fault = 1;
 				need_atime_update = 0;
+				stalled = 1;
+				stream->misses++;
 			}
 
 			if (!trav)
@@ -371,12 +588,16 @@ dispatch_requests (call_frame_t *frame,
 					"HIT at offset=%"PRId64".",
 					trav_offset);
 				ra_frame_fill (trav, frame);
+				stream->hits++;
 			} else {
 				gf_log (frame->this->name, GF_LOG_DEBUG,
 					"IN-TRANSIT at offset=%"PRId64".",
 					trav_offset);
 				ra_wait_on_page (trav, frame);
 				need_atime_update = 0;
+				stalled = 1;
+				if (!fault)
+					stream->waits++;
 			}
 		}
 	unlock:
@@ -402,7 +623,7 @@ dispatch_requests (call_frame_t *frame,
 			    file->fd, 1, 1);
 	}
 
-	return ;
+	return stalled;
 }
 
 
@@ -423,14 +644,12 @@ ra_readv (call_frame_t *frame, xlator_t *this,
 {
 	ra_file_t    *file = NULL;
 	ra_local_t   *local = NULL;
-	ra_conf_t    *conf = NULL;
+	ra_stream_t  *stream = NULL;
 	int           op_errno = 0;
 	int           ret = 0;
-	char expected_offset = 1;
+	int           stalled = 0;
 	uint64_t tmp_file = 0;
 
-	conf = this->private;
-
 	gf_log (this->name, GF_LOG_DEBUG,
 		"NEW REQ at offset=%"PRId64" for size=%"GF_PRI_SIZET"",
 		offset, size);
@@ -438,28 +657,6 @@ ra_readv (call_frame_t *frame, xlator_t *this,
 	ret = fd_ctx_get (fd, this, &tmp_file);
 	file = (ra_file_t *)(long)tmp_file;
 
-	if (file->offset != offset) {
-		gf_log (this->name, GF_LOG_DEBUG,
-			"unexpected offset (%"PRId64" != %"PRId64") resetting",
-			file->offset, offset);
-
-		expected_offset = file->expected = file->page_count = 0;
-	} else {
-		gf_log (this->name, GF_LOG_DEBUG,
-			"expected offset (%"PRId64") when page_count=%d",
-			offset, file->page_count);
-
-		if (file->expected < (conf->page_size * conf->page_count)) {
-			file->expected += size;
-			file->page_count = min ((file->expected / file->page_size),
-						conf->page_count);
-		}
-	}
-
-	if (!expected_offset) {
-		flush_region (frame, file, 0, file->pages.prev->offset + 1);
-	}
-
 	if (file->disabled) {
 		STACK_WIND (frame, ra_readv_disabled_cbk,
 			    FIRST_CHILD (frame->this), 
@@ -488,16 +685,25 @@ ra_readv (call_frame_t *frame, xlator_t *this,
 
 	frame->local = local;
 
-	dispatch_requests (frame, file);
+	ra_file_lock (file);
+	{
+		stream = __ra_stream_get (file, offset, size);
+	}
+	ra_file_unlock (file);
+
+	stalled = dispatch_requests (frame, file, stream);
 
-	flush_region (frame, file, 0, floor (offset, file->page_size));
+	read_ahead (frame, file, stream);
 
-	read_ahead (frame, file);
+	ra_file_lock (file);
+	{
+		__ra_stream_adapt (file, stream, stalled);
+		ra_file_prune (file);
+	}
+	ra_file_unlock (file);
 
 	ra_frame_return (frame);
 
-	file->offset = offset + size;
-
 	return 0;
 
 unwind:
@@ -602,8 +808,12 @@ ra_writev (call_frame_t *frame, xlator_t *this, fd_t *fd,
 	if (file) {
 		flush_region (frame, file, 0, file->pages.prev->offset+1);
 
-		/* reset the read-ahead counters too */
-		file->expected = file->page_count = 0;
+		/* forget the streams too */
+		ra_file_lock (file);
+		{
+			memset (file->streams, 0, sizeof (file->streams));
+		}
+		ra_file_unlock (file);
 	}
 
 	frame->local = fd;
@@ -761,6 +971,135 @@ ra_ftruncate (call_frame_t *frame, xlator_t *this,
 }
 
 
+int
+ra_getxattr_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		 int32_t op_ret, int32_t op_errno, dict_t *dict)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, dict);
+	return 0;
+}
+
+
+/* a line per stream of each fd open on the inode */
+static char *
+ra_streams_dump (xlator_t *this, inode_t *inode)
+{
+	ra_conf_t   *conf = NULL;
+	ra_file_t   *file = NULL;
+	ra_stream_t *stream = NULL;
+	fd_t        *iter_fd = NULL;
+	char        *buf = NULL;
+	char        *tmp = NULL;
+	size_t       size = 0;
+	size_t       len = 0;
+	uint64_t     tmp_file = 0;
+	uint32_t     bdp_pages = 0;
+	int          i = 0;
+
+	size = 1024;
+	buf = CALLOC (1, size);
+	if (!buf)
+		return NULL;
+
+	conf = this->private;
+	bdp_pages = ra_bdp_pages (conf);
+
+	ra_conf_lock (conf);
+	{
+		len += snprintf (buf + len, size - len,
+				 "bandwidth=%"PRIu64" rtt-usec=%"PRIu64
+				 " bdp-pages=%u pages=%u limit=%"PRIu64"\n",
+				 conf->bandwidth, conf->rtt_usec, bdp_pages,
+				 conf->pages_cached,
+				 conf->memory_limit / conf->page_size);
+	}
+	ra_conf_unlock (conf);
+
+	LOCK (&inode->lock);
+	{
+		list_for_each_entry (iter_fd, &inode->fd_list, inode_list) {
+			if (fd_ctx_get (iter_fd, this, &tmp_file) != 0)
+				continue;
+			file = (ra_file_t *)(long)tmp_file;
+
+			ra_file_lock (file);
+			for (i = 0; i < RA_MAX_STREAMS && buf; i++) {
+				stream = &file->streams[i];
+				if (!stream->active)
+					continue;
+
+				if (size - len < 512) {
+					size *= 2;
+					tmp = realloc (buf, size);
+					if (!tmp) {
+						FREE (buf);
+						buf = NULL;
+						break;
+					}
+					buf = tmp;
+				}
+
+				len += snprintf (buf + len, size - len,
+						 "fd=%p stream=%d offset=%"PRId64
+						 " stride=%"PRId64" window=%u"
+						 " reads=%"PRIu64" hits=%"PRIu64
+						 " waits=%"PRIu64" misses=%"PRIu64
+						 " ahead=%"PRIu64" wasted=%"PRIu64
+						 " fault-usec=%"PRIu64"\n",
+						 iter_fd, i, stream->offset,
+						 (int64_t) stream->stride,
+						 stream->window, stream->reads,
+						 stream->hits, stream->waits,
+						 stream->misses, stream->ahead,
+						 stream->wasted,
+						 file->fault_usec);
+			}
+			ra_file_unlock (file);
+
+			if (!buf)
+				break;
+		}
+	}
+	UNLOCK (&inode->lock);
+
+	return buf;
+}
+
+
+int
+ra_getxattr (call_frame_t *frame, xlator_t *this,
+	     loc_t *loc, const char *name)
+{
+	dict_t  *dict = NULL;
+	char    *streams = NULL;
+	int32_t  op_errno = ENOMEM;
+
+	if (name && !strcmp (name, RA_STREAMS_XATTR)) {
+		dict = dict_new ();
+		streams = ra_streams_dump (this, loc->inode);
+		if (dict && streams
+		    && dict_set_dynstr (dict, (char *) name, streams) == 0) {
+			STACK_UNWIND (frame, 0, 0, dict);
+			dict_unref (dict);
+			return 0;
+		}
+
+		if (streams)
+			FREE (streams);
+		if (dict)
+			dict_unref (dict);
+		STACK_UNWIND (frame, -1, op_errno, NULL);
+		return 0;
+	}
+
+	STACK_WIND (frame, ra_getxattr_cbk,
+		    FIRST_CHILD (this),
+		    FIRST_CHILD (this)->fops->getxattr,
+		    loc, name);
+	return 0;
+}
+
+
 int
 init (xlator_t *this)
 {
@@ -783,7 +1122,7 @@ init (xlator_t *this)
 	conf = (void *) CALLOC (1, sizeof (*conf));
 	ERR_ABORT (conf);
 	conf->page_size = 256 * 1024;
-	conf->page_count = 2;
+	conf->page_count = 8;
 
 	if (dict_get (options, "page-size"))
 		page_size_string = data_to_str (dict_get (options,
@@ -832,6 +1171,36 @@ init (xlator_t *this)
 			gf_log (this->name, GF_LOG_DEBUG, "Forcing atime updates on cache hit");
 	}
 
+	if (dict_get (options, "bdp-window")) {
+		char *bdp_window_str = data_to_str (dict_get (options,
+							      "bdp-window"));
+		if (gf_string2boolean (bdp_window_str, &conf->bdp_window) == -1) {
+			gf_log (this->name, GF_LOG_ERROR,
+				"'bdp-window' takes only boolean options");
+			return -1;
+		}
+		if (conf->bdp_window) {
+			conf->memory_limit = RA_BDP_MEMORY_LIMIT;
+			gf_log (this->name, GF_LOG_DEBUG,
+				"Sizing windows by the bandwidth-delay product");
+		}
+	}
+
+	if (dict_get (options, "memory-limit")) {
+		char *memory_limit_str = data_to_str (dict_get (options,
+								"memory-limit"));
+		if (gf_string2bytesize (memory_limit_str,
+					&conf->memory_limit) != 0) {
+			gf_log (this->name, GF_LOG_ERROR,
+				"invalid number format \"%s\" of "
+				"\"option memory-limit\"", memory_limit_str);
+			return -1;
+		}
+		gf_log (this->name, GF_LOG_DEBUG,
+			"Using conf->memory_limit = %"PRIu64"",
+			conf->memory_limit);
+	}
+
 	conf->files.next = &conf->files;
 	conf->files.prev = &conf->files;
 
@@ -863,6 +1232,7 @@ struct xlator_fops fops = {
 	.ftruncate   = ra_ftruncate,
 	.fstat       = ra_fstat,
 	.fchown      = ra_fchown,
+	.getxattr    = ra_getxattr,
 };
 
 struct xlator_mops mops = {
@@ -886,5 +1256,13 @@ struct volume_options options[] = {
 	  .min  = 1, 
 	  .max  = 16 
 	},
+	{ .key  = {"bdp-window"},
+	  .type = GF_OPTION_TYPE_BOOL
+	},
+	{ .key  = {"memory-limit"},
+	  .type = GF_OPTION_TYPE_SIZET,
+	  .min  = 1 * GF_UNIT_MB,
+	  .max  = 1 * GF_UNIT_GB
+	},
 	{ .key = {NULL} },
 };
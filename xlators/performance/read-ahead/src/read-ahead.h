@@ -32,6 +32,15 @@
 #include "xlator.h"
 #include "common-utils.h"
 
+#define RA_MAX_STREAMS      8    /* read patterns followed per fd */
+#define RA_PAGE_HASH        64   /* buckets of the page index of a file */
+#define RA_ADAPT_READS      8    /* reads of a stream between resizes */
+#define RA_MAX_STRIDE_PAGES 64   /* farthest a stride is looked for */
+#define RA_BW_SAMPLE_USEC   10000 /* shortest bandwidth sample */
+#define RA_BDP_MEMORY_LIMIT (64 * GF_UNIT_MB)
+
+#define RA_STREAMS_XATTR    "glusterfs.read-ahead.streams"
+
 struct ra_conf;
 struct ra_local;
 struct ra_page;
@@ -52,7 +61,7 @@ struct ra_fill {
 	size_t          size;
 	struct iovec   *vector;
 	int32_t         count;
-	dict_t         *refs;
+	struct iobref  *iobref;
 };
 
 
@@ -68,21 +77,56 @@ struct ra_local {
 	fd_t             *fd;
 	int32_t           wait_count;
 	pthread_mutex_t   local_lock;
+	struct timeval    fault_time;  /* when a page fault was sent */
 };
 
 
 struct ra_page {
-	struct ra_page   *next;
+	struct ra_page   *next;        /* sorted by offset */
 	struct ra_page   *prev;
+	struct list_head  hash;        /* in a bucket of file->page_hash */
+	struct list_head  lru;
 	struct ra_file   *file;
 	char              dirty;
 	char              ready;
+	char              used;        /* read since it was filled */
+	int32_t           stream;      /* stream it was read ahead for, or -1 */
 	struct iovec     *vector;
 	int32_t           count;
 	off_t             offset;
 	size_t            size;
 	struct ra_waitq  *waitq;
-	dict_t           *ref;
+	struct iobref    *iobref;
+};
+
+
+/*
+ * ra_stream - one pattern of reads on an fd: each read follows the last
+ * one, or is a stride away from it, forwards or backwards. an fd has a
+ * few of them so that interleaved readers each get read-ahead.
+ */
+struct ra_stream {
+	char               active;
+	off_t              offset;       /* of the last read */
+	size_t             size;         /* of the last read */
+	off_t              stride;       /* from the last read to the next */
+	uint32_t           confirmed;    /* reads which followed the stride */
+	uint32_t           window;       /* pages to read ahead */
+	uint64_t           used;         /* file->reads at the last read */
+	struct timeval     last_read;
+	uint64_t           interval_usec;/* smoothed time between reads */
+
+	/* since the window was last resized */
+	uint32_t           adapt_reads;
+	uint32_t           stalls;       /* reads which waited on a page */
+	uint32_t           adapt_wasted; /* pages read ahead but never read */
+
+	uint64_t           reads;
+	uint64_t           hits;         /* pages ready when read */
+	uint64_t           waits;        /* pages still in transit */
+	uint64_t           misses;       /* pages faulted by the read */
+	uint64_t           ahead;        /* pages read ahead */
+	uint64_t           wasted;
 };
 
 
@@ -92,15 +136,19 @@ struct ra_file {
 	struct ra_conf    *conf;
 	fd_t              *fd;
 	int                disabled;
-	size_t             expected;
 	struct ra_page     pages;
-	off_t              offset;
+	struct list_head   page_hash[RA_PAGE_HASH];
+	struct list_head   page_lru;
+	uint32_t           pages_cached;
 	size_t             size;
 	int32_t            refcount;
 	pthread_mutex_t    file_lock;
 	struct stat        stbuf;
 	uint64_t           page_size;
-	uint32_t           page_count;
+	uint32_t           page_count;   /* largest window of a stream */
+	struct ra_stream   streams[RA_MAX_STREAMS];
+	uint64_t           reads;
+	uint64_t           fault_usec;   /* smoothed time a page fault takes */
 };
 
 
@@ -111,6 +159,17 @@ struct ra_conf {
 	struct ra_file    files;
 	gf_boolean_t      force_atime_update;
 	pthread_mutex_t   conf_lock;
+
+	uint64_t          memory_limit;  /* of the pages of all files */
+	uint32_t          pages_cached;
+
+	/* the subvolume as seen from the page faults, for bdp-window */
+	gf_boolean_t      bdp_window;
+	uint32_t          inflight;      /* page faults */
+	uint64_t          rtt_usec;      /* shortest recent fault time */
+	uint64_t          bandwidth;     /* best recent bytes per second */
+	uint64_t          sample_bytes;
+	struct timeval    sample_start;
 };
 
 
@@ -120,6 +179,7 @@ typedef struct ra_page ra_page_t;
 typedef struct ra_file ra_file_t;
 typedef struct ra_waitq ra_waitq_t;
 typedef struct ra_fill ra_fill_t;
+typedef struct ra_stream ra_stream_t;
 
 ra_page_t *
 ra_page_get (ra_file_t *file,
@@ -156,6 +216,15 @@ ra_frame_fill (ra_page_t *page,
 void
 ra_file_destroy (ra_file_t *file);
 
+void
+ra_file_init (ra_file_t *file);
+
+void
+ra_file_prune (ra_file_t *file);
+
+uint32_t
+ra_bdp_pages (ra_conf_t *conf);
+
 static inline void
 ra_file_lock (ra_file_t *file)
 {
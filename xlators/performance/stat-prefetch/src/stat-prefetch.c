@@ -22,487 +22,1020 @@
 #include "config.h"
 #endif
 
-#include "glusterfs.h"
 #include "stat-prefetch.h"
-#include "dict.h"
-#include "xlator.h"
-#include <sys/time.h>
-
-struct sp_cache {
-  struct sp_cache *next;
-  struct sp_cache *prev;
-  pid_t pid;
-  long long tv_time;
-  char *dirname;
-  dir_entry_t entries;
-  int32_t count;
-  pthread_mutex_t lock;
-};
 
+/*
+ * stat-prefetch keeps the attributes readdirp returns for the entries of
+ * a directory in the contexts of their inodes, and answers the lookup
+ * and stat calls following a listing (ls -l, find) from them. entries
+ * are found through the dentry hash of the inode table, the cached
+ * attributes are bounded by an LRU and expire after cache-timeout
+ * seconds. every fop changing the attributes of an inode or the entries
+ * of a directory drops what is cached for the inodes involved.
+ */
+
+
+static sp_inode_t *
+sp_inode_get (xlator_t *this, inode_t *inode)
+{
+	uint64_t tmp = 0;
+
+	if (!inode)
+		return NULL;
+
+	if (inode_ctx_get (inode, this, &tmp) != 0)
+		return NULL;
+
+	return (sp_inode_t *)(long) tmp;
+}
+
+
+static void
+__sp_inode_uncache (sp_conf_t *conf, sp_inode_t *sp_inode)
+{
+	if (!sp_inode->cached)
+		return;
+
+	list_del_init (&sp_inode->lru);
+	conf->lru_size--;
+	sp_inode->cached = 0;
+}
+
+
+/* drop what is cached for the inode, and keep readdirps already wound
+   from caching what they read before the change. the generation moves
+   on even for an inode without a context yet, the one lookup gives it
+   later starts from there. */
 static void
-stat_prefetch_cache_flush (struct sp_cache *cache, int32_t force)
-{
-  struct sp_cache *trav;
-  struct timeval tv;
-  long long tv_time;
-
-  gettimeofday (&tv, NULL);
-  tv_time = (tv.tv_usec + (tv.tv_sec * 1000000));
-
-  pthread_mutex_lock (&cache->lock);
-
-  trav = cache->next;
-  while (trav != cache) {
-    struct sp_cache *next = trav->next;
-    {
-      if (tv_time > trav->tv_time || force) {
-	gf_log ("stat-prefetch",
-		GF_LOG_DEBUG,
-		"flush on: %s",
-		trav->dirname);
-	dir_entry_t *entries;
-
-	trav->prev->next = trav->next;
-	trav->next->prev = trav->prev;
-
-	entries = trav->entries.next;
-
-	while (entries) {
-	  dir_entry_t *nextentry = entries->next;
-	  {
-	    free (entries->name);
-	    free (entries);
-	  }
-	  entries = nextentry;
+sp_invalidate (xlator_t *this, inode_t *inode)
+{
+	sp_conf_t  *conf = this->private;
+	sp_inode_t *sp_inode = NULL;
+
+	sp_inode = sp_inode_get (this, inode);
+
+	LOCK (&conf->lock);
+	{
+		conf->gen++;
+		if (!sp_inode)
+			goto unlock;
+
+		sp_inode->gen = conf->gen;
+		if (sp_inode->cached) {
+			__sp_inode_uncache (conf, sp_inode);
+			conf->invalidations++;
+		}
 	}
-	free (trav->dirname);
-	free (trav);
-      }
-    }
-    trav = next;
-  }
-
-  pthread_mutex_unlock (&cache->lock);
-}
-
-static int32_t
-stat_prefetch_cache_fill (struct sp_cache *cache,
-			  pid_t pid,
-			  char *dirname,
-			  dir_entry_t *entries)
-{
-  struct sp_cache *trav;
-  struct timeval tv;
-
-  pthread_mutex_unlock (&cache->lock);
-  trav = cache->next;
-  while (trav != cache) {
-    //    if (trav->pid == pid && !strcmp (trav->dirname, dirname)) {
-    if (!strcmp (trav->dirname, dirname)) {
-      break;
-    }
-    trav = trav->next;
-  }
-
-  if (trav == cache) {
-    trav = CALLOC (1, sizeof (*trav));
-    ERR_ABORT (trav);
-    trav->pid = pid;
-    trav->dirname = dirname;
-
-    trav->prev = cache->prev;
-    trav->next = cache;
-    trav->next->prev = trav;
-    trav->prev->next = trav;
-  } else {
-    free (dirname);
-  }
-
-  while (trav->entries.next) {
-    dir_entry_t *tmp = trav->entries.next;
-
-    trav->entries.next = trav->entries.next->next;
-    free (tmp->name);
-    free (tmp);
-  }
-  trav->entries.next = entries->next;
-  entries->next = NULL;
-
-  gettimeofday (&tv, NULL);
-  trav->tv_time = (tv.tv_usec + (tv.tv_sec * 1000000)) + cache->tv_time;
-
-  pthread_mutex_unlock (&cache->lock);
-  return 0;
-}
-
-static int32_t
-stat_prefetch_cache_lookup (struct sp_cache *cache,
-			    pid_t pid,
-			    const char *path,
-			    struct stat *buf)
-{
-  struct sp_cache *trav;
-  char *dirname = strdup (path);
-  char *filename = strrchr (dirname, '/');
-  dir_entry_t *entries;
-  dir_entry_t *prev = NULL;
-
-  *filename = '\0';
-  filename ++;
-
-  pthread_mutex_lock (&cache->lock);
-  trav = cache->next;
-  while (trav != cache) {
-    //    if ((trav->pid == pid) && !strcmp (dirname, trav->dirname))
-    if (!strcmp (dirname, trav->dirname))
-      break;
-    trav = trav->next;
-  }
-  if (trav == cache) {
-    free (dirname);
-    pthread_mutex_unlock (&cache->lock);
-    return -1;
-  }
-
-  entries = trav->entries.next;
-  prev = &trav->entries;
-  while (entries) {
-    if (!strcmp (entries->name, filename))
-      break;
-    prev = entries;
-    entries = entries->next;
-  }
-  if (!entries) {
-    free (dirname);
-    pthread_mutex_unlock (&cache->lock);
-    return -1;
-  }
-
-  *buf = entries->buf;
-  prev->next = entries->next;
-  free (entries->name);
-  free (entries);
-  free (dirname);
+unlock:
+	UNLOCK (&conf->lock);
+}
 
-  pthread_mutex_unlock (&cache->lock);
-
-  return 0;
+
+static void
+sp_fill (xlator_t *this, inode_t *inode, struct stat *stbuf,
+	 uint64_t gen, struct timeval *now)
+{
+	sp_conf_t  *conf = this->private;
+	sp_inode_t *sp_inode = NULL;
+	sp_inode_t *victim = NULL;
+
+	sp_inode = sp_inode_get (this, inode);
+	if (!sp_inode)
+		return;
+
+	LOCK (&conf->lock);
+	{
+		if (sp_inode->gen > gen)
+			goto unlock;
+
+		sp_inode->stbuf     = *stbuf;
+		sp_inode->cached_at = *now;
+
+		if (sp_inode->cached) {
+			list_move (&sp_inode->lru, &conf->lru);
+		} else {
+			list_add (&sp_inode->lru, &conf->lru);
+			conf->lru_size++;
+			sp_inode->cached = 1;
+		}
+		conf->fills++;
+
+		while (conf->lru_size > conf->lru_limit) {
+			victim = list_entry (conf->lru.prev, sp_inode_t, lru);
+			__sp_inode_uncache (conf, victim);
+			conf->evictions++;
+		}
+	}
+unlock:
+	UNLOCK (&conf->lock);
 }
 
-			    
+
+/* 0 and the cached attributes of the inode if there are any younger
+   than cache-timeout, -1 otherwise */
+static int
+sp_get (xlator_t *this, inode_t *inode, struct stat *stbuf)
+{
+	sp_conf_t      *conf = this->private;
+	sp_inode_t     *sp_inode = NULL;
+	struct timeval  now = {0, };
+	int64_t         age = 0;
+	int             ret = -1;
+
+	sp_inode = sp_inode_get (this, inode);
+
+	gettimeofday (&now, NULL);
+
+	LOCK (&conf->lock);
+	{
+		if (!sp_inode || !sp_inode->cached)
+			goto unlock;
+
+		age = (now.tv_sec - sp_inode->cached_at.tv_sec) * 1000000LL
+			+ (now.tv_usec - sp_inode->cached_at.tv_usec);
+
+		if (age < 0 || age >= conf->timeout * 1000000LL) {
+			__sp_inode_uncache (conf, sp_inode);
+			goto unlock;
+		}
+
+		*stbuf = sp_inode->stbuf;
+		list_move (&sp_inode->lru, &conf->lru);
+		ret = 0;
+	}
+unlock:
+	if (ret == 0)
+		conf->hits++;
+	else
+		conf->misses++;
+	UNLOCK (&conf->lock);
+
+	return ret;
+}
+
+
+static sp_local_t *
+sp_local_get (call_frame_t *frame)
+{
+	sp_local_t *local = frame->local;
+
+	if (!local) {
+		local = CALLOC (1, sizeof (*local));
+		frame->local = local;
+	}
+
+	return local;
+}
+
+
+/* invalidate now, and again when the fop returns, for the readdirps
+   wound in between */
+static void
+sp_local_invalidate (call_frame_t *frame, xlator_t *this, inode_t *inode)
+{
+	sp_local_t *local = NULL;
+
+	if (!inode)
+		return;
+
+	sp_invalidate (this, inode);
+
+	local = sp_local_get (frame);
+	if (!local || local->count == SP_LOCAL_INODES)
+		return;
+
+	local->inodes[local->count++] = inode_ref (inode);
+}
+
+
+static void
+sp_local_done (call_frame_t *frame, xlator_t *this)
+{
+	sp_local_t *local = frame->local;
+	int         i = 0;
+
+	if (!local)
+		return;
+
+	for (i = 0; i < local->count; i++) {
+		sp_invalidate (this, local->inodes[i]);
+		inode_unref (local->inodes[i]);
+		local->inodes[i] = NULL;
+	}
+	local->count = 0;
+}
+
+
 int32_t
-stat_prefetch_readdir_cbk (call_frame_t *frame,
-			   void *cookie,
-			   xlator_t *this,
-			   int32_t op_ret,
-			   int32_t op_errno,
-			   dir_entry_t *entries,
-			   int32_t count)
+sp_stbuf_cbk (call_frame_t *frame,
+	      void *cookie,
+	      xlator_t *this,
+	      int32_t op_ret,
+	      int32_t op_errno,
+	      struct stat *buf)
 {
-  char *path = frame->local;
-  pid_t pid = frame->root->pid;
-  frame->local = NULL;
+	sp_local_done (frame, this);
+
+	STACK_UNWIND (frame, op_ret, op_errno, buf);
+	return 0;
+}
 
-  STACK_UNWIND (frame, op_ret, op_errno, entries, count);
 
-  if (op_ret == 0)
-    stat_prefetch_cache_fill (this->private,
-			      pid,
-			      path,
-			      entries);
-  else
-    free (path);
+int32_t
+sp_err_cbk (call_frame_t *frame,
+	    void *cookie,
+	    xlator_t *this,
+	    int32_t op_ret,
+	    int32_t op_errno)
+{
+	sp_local_done (frame, this);
 
-  return 0;
+	STACK_UNWIND (frame, op_ret, op_errno);
+	return 0;
 }
 
+
 int32_t
-stat_prefetch_readdir (call_frame_t *frame,
-		       xlator_t *this,
-		       const char *path)
+sp_inode_cbk (call_frame_t *frame,
+	      void *cookie,
+	      xlator_t *this,
+	      int32_t op_ret,
+	      int32_t op_errno,
+	      inode_t *inode,
+	      struct stat *buf)
 {
-  stat_prefetch_cache_flush (this->private, 0);
+	sp_local_done (frame, this);
 
-  frame->local = strdup (path);
-  STACK_WIND (frame,
-	      stat_prefetch_readdir_cbk,
-	      FIRST_CHILD(this),
-	      FIRST_CHILD(this)->fops->readdir,
-	      path);
-  return 0;
+	STACK_UNWIND (frame, op_ret, op_errno, inode, buf);
+	return 0;
 }
 
 
 int32_t
-stat_prefetch_getattr_cbk (call_frame_t *frame,
-			   void *cookie,
-			   xlator_t *this,
-			   int32_t op_ret,
-			   int32_t op_errno,
-			   struct stat *buf)
+sp_dict_cbk (call_frame_t *frame,
+	     void *cookie,
+	     xlator_t *this,
+	     int32_t op_ret,
+	     int32_t op_errno,
+	     dict_t *dict)
 {
-  STACK_UNWIND (frame, op_ret, op_errno, buf);
-  return 0;
+	sp_local_done (frame, this);
+
+	STACK_UNWIND (frame, op_ret, op_errno, dict);
+	return 0;
 }
 
+
 int32_t
-stat_prefetch_getattr (call_frame_t *frame,
-		       struct xlator *this,
-		       const char *path)
+sp_lookup_cbk (call_frame_t *frame,
+	       void *cookie,
+	       xlator_t *this,
+	       int32_t op_ret,
+	       int32_t op_errno,
+	       inode_t *inode,
+	       struct stat *buf,
+	       dict_t *dict)
 {
-  struct stat buf;
-  pid_t pid = frame->root->pid;
-  stat_prefetch_cache_flush (this->private, 0);
+	sp_conf_t  *conf = this->private;
+	sp_inode_t *sp_inode = NULL;
+	uint64_t    tmp = 0;
+
+	if (op_ret == 0) {
+		LOCK (&conf->lock);
+		{
+			if (inode_ctx_get (inode, this, &tmp) != 0) {
+				sp_inode = CALLOC (1, sizeof (*sp_inode));
+				if (sp_inode) {
+					INIT_LIST_HEAD (&sp_inode->lru);
+					sp_inode->gen = conf->gen;
+					if (inode_ctx_put (inode, this,
+							   (uint64_t)(long)
+							   sp_inode) != 0)
+						FREE (sp_inode);
+				}
+			}
+		}
+		UNLOCK (&conf->lock);
+	}
 
-  if (stat_prefetch_cache_lookup (this->private,
-				  pid,
-				  path,
-				  &buf) == 0) {
-    STACK_UNWIND (frame, 0, 0, &buf);
-    return 0;
-  }
+	STACK_UNWIND (frame, op_ret, op_errno, inode, buf, dict);
+	return 0;
+}
 
-  STACK_WIND (frame,
-	      stat_prefetch_getattr_cbk,
-	      FIRST_CHILD(this),
-	      FIRST_CHILD(this)->fops->getattr,
-	      path);
 
-  return 0;
+int32_t
+sp_lookup (call_frame_t *frame,
+	   xlator_t *this,
+	   loc_t *loc,
+	   dict_t *xattr_req)
+{
+	struct stat stbuf = {0, };
+
+	/* a lookup asking for xattrs has to go down for them */
+	if (!xattr_req || !xattr_req->count) {
+		if (sp_get (this, loc->inode, &stbuf) == 0) {
+			STACK_UNWIND (frame, 0, 0, loc->inode, &stbuf, NULL);
+			return 0;
+		}
+	}
+
+	STACK_WIND (frame, sp_lookup_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->lookup,
+		    loc, xattr_req);
+	return 0;
 }
 
 
 int32_t
-stat_prefetch_unlink_cbk (call_frame_t *frame,
-                          void *cookie,
-                          xlator_t *this,
-                          int32_t op_ret,
-                          int32_t op_errno)
+sp_stat (call_frame_t *frame,
+	 xlator_t *this,
+	 loc_t *loc)
 {
-  STACK_UNWIND (frame, op_ret, op_errno);
-  return 0;
+	struct stat stbuf = {0, };
+
+	if (sp_get (this, loc->inode, &stbuf) == 0) {
+		STACK_UNWIND (frame, 0, 0, &stbuf);
+		return 0;
+	}
+
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->stat,
+		    loc);
+	return 0;
 }
 
+
 int32_t
-stat_prefetch_unlink (call_frame_t *frame,
-                      struct xlator *this,
-                      const char *path)
+sp_fstat (call_frame_t *frame,
+	  xlator_t *this,
+	  fd_t *fd)
 {
-  stat_prefetch_cache_flush (this->private, 1);
+	struct stat stbuf = {0, };
 
-  STACK_WIND (frame,
-              stat_prefetch_unlink_cbk,
-              FIRST_CHILD(this),
-              FIRST_CHILD(this)->fops->unlink,
-              path);
+	if (sp_get (this, fd->inode, &stbuf) == 0) {
+		STACK_UNWIND (frame, 0, 0, &stbuf);
+		return 0;
+	}
 
-  return 0;
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->fstat,
+		    fd);
+	return 0;
 }
 
 
 int32_t
-stat_prefetch_chmod_cbk (call_frame_t *frame,
-			 void *cookie,
-			 xlator_t *this,
-			 int32_t op_ret,
-			 int32_t op_errno,
-			 struct stat *buf)
+sp_readdirp_cbk (call_frame_t *frame,
+		 void *cookie,
+		 xlator_t *this,
+		 int32_t op_ret,
+		 int32_t op_errno,
+		 gf_dirent_t *entries)
 {
-  STACK_UNWIND (frame, op_ret, op_errno, buf);
-  return 0;
+	sp_local_t     *local = frame->local;
+	inode_t        *parent = NULL;
+	inode_t        *inode = NULL;
+	gf_dirent_t    *entry = NULL;
+	struct timeval  now = {0, };
+
+	parent = local->fd->inode;
+
+	if (op_ret > 0 && parent) {
+		gettimeofday (&now, NULL);
+
+		list_for_each_entry (entry, &entries->list, list) {
+			if (!entry->d_stat.st_ino)
+				continue;
+
+			inode = inode_search (parent->table, parent->ino,
+					      entry->d_name);
+			if (!inode)
+				continue;
+
+			/* a different inode under the name, or ours
+			   loaded where inode numbers are not those of
+			   the table */
+			if (inode->ino == entry->d_stat.st_ino)
+				sp_fill (this, inode, &entry->d_stat,
+					 local->gen, &now);
+
+			inode_unref (inode);
+		}
+	}
+
+	fd_unref (local->fd);
+	local->fd = NULL;
+
+	STACK_UNWIND (frame, op_ret, op_errno, entries);
+	return 0;
 }
 
+
 int32_t
-stat_prefetch_chmod (call_frame_t *frame,
-		     struct xlator *this,
-		     const char *path,
-		     mode_t mode)
+sp_readdirp (call_frame_t *frame,
+	     xlator_t *this,
+	     fd_t *fd,
+	     size_t size,
+	     off_t offset)
 {
-  stat_prefetch_cache_flush (this->private, 1);
+	sp_conf_t  *conf = this->private;
+	sp_local_t *local = NULL;
 
-  STACK_WIND (frame,
-              stat_prefetch_chmod_cbk,
-              FIRST_CHILD(this),
-              FIRST_CHILD(this)->fops->chmod,
-              path,
-	      mode);
+	local = sp_local_get (frame);
+	if (!local) {
+		STACK_UNWIND (frame, -1, ENOMEM, NULL);
+		return 0;
+	}
+
+	local->fd = fd_ref (fd);
+
+	LOCK (&conf->lock);
+	{
+		local->gen = conf->gen;
+	}
+	UNLOCK (&conf->lock);
 
-  return 0;
+	STACK_WIND (frame, sp_readdirp_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->readdirp,
+		    fd, size, offset);
+	return 0;
 }
 
 
 int32_t
-stat_prefetch_chown_cbk (call_frame_t *frame,
-			 void *cookie,
-			 xlator_t *this,
-			 int32_t op_ret,
-			 int32_t op_errno,
-			 struct stat *buf)
+sp_chmod (call_frame_t *frame,
+	  xlator_t *this,
+	  loc_t *loc,
+	  mode_t mode)
 {
-  STACK_UNWIND (frame, op_ret, op_errno, buf);
-  return 0;
+	sp_local_invalidate (frame, this, loc->inode);
+
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->chmod,
+		    loc, mode);
+	return 0;
 }
 
+
 int32_t
-stat_prefetch_chown (call_frame_t *frame,
-		     struct xlator *this,
-		     const char *path,
-		     uid_t uid,
-		     gid_t gid)
+sp_fchmod (call_frame_t *frame,
+	   xlator_t *this,
+	   fd_t *fd,
+	   mode_t mode)
 {
-  stat_prefetch_cache_flush (this->private, 1);
+	sp_local_invalidate (frame, this, fd->inode);
 
-  STACK_WIND (frame,
-              stat_prefetch_chown_cbk,
-              FIRST_CHILD(this),
-              FIRST_CHILD(this)->fops->chown,
-              path,
-	      uid,
-	      gid);
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->fchmod,
+		    fd, mode);
+	return 0;
+}
 
-  return 0;
+
+int32_t
+sp_chown (call_frame_t *frame,
+	  xlator_t *this,
+	  loc_t *loc,
+	  uid_t uid,
+	  gid_t gid)
+{
+	sp_local_invalidate (frame, this, loc->inode);
+
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->chown,
+		    loc, uid, gid);
+	return 0;
 }
 
 
 int32_t
-stat_prefetch_utimes_cbk (call_frame_t *frame,
-                          void *cookie,
-                          xlator_t *this,
-                          int32_t op_ret,
-                          int32_t op_errno,
-			  struct stat *buf)
+sp_fchown (call_frame_t *frame,
+	   xlator_t *this,
+	   fd_t *fd,
+	   uid_t uid,
+	   gid_t gid)
 {
-  STACK_UNWIND (frame, op_ret, op_errno, buf);
-  return 0;
+	sp_local_invalidate (frame, this, fd->inode);
+
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->fchown,
+		    fd, uid, gid);
+	return 0;
 }
 
+
 int32_t
-stat_prefetch_utimes (call_frame_t *frame,
-		      struct xlator *this,
-		      const char *path,
-		      struct timespec *tvp)
+sp_truncate (call_frame_t *frame,
+	     xlator_t *this,
+	     loc_t *loc,
+	     off_t offset)
 {
-  stat_prefetch_cache_flush (this->private, 1);
+	sp_local_invalidate (frame, this, loc->inode);
+
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->truncate,
+		    loc, offset);
+	return 0;
+}
+
 
-  STACK_WIND (frame,
-              stat_prefetch_utimes_cbk,
-              FIRST_CHILD(this),
-              FIRST_CHILD(this)->fops->utimes,
-              path,
-	      tvp);
+int32_t
+sp_ftruncate (call_frame_t *frame,
+	      xlator_t *this,
+	      fd_t *fd,
+	      off_t offset)
+{
+	sp_local_invalidate (frame, this, fd->inode);
 
-  return 0;
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->ftruncate,
+		    fd, offset);
+	return 0;
 }
 
 
 int32_t
-stat_prefetch_truncate_cbk (call_frame_t *frame,
-			    void *cookie,
-			    xlator_t *this,
-			    int32_t op_ret,
-			    int32_t op_errno,
-			    struct stat *buf)
+sp_open_cbk (call_frame_t *frame,
+	     void *cookie,
+	     xlator_t *this,
+	     int32_t op_ret,
+	     int32_t op_errno,
+	     fd_t *fd)
 {
-  STACK_UNWIND (frame, op_ret, op_errno, buf);
-  return 0;
+	sp_local_done (frame, this);
+
+	STACK_UNWIND (frame, op_ret, op_errno, fd);
+	return 0;
 }
 
+
+/* O_TRUNC changes size and times like truncate does */
 int32_t
-stat_prefetch_truncate (call_frame_t *frame,
-			struct xlator *this,
-			const char *path,
-			off_t offset)
+sp_open (call_frame_t *frame,
+	 xlator_t *this,
+	 loc_t *loc,
+	 int32_t flags,
+	 fd_t *fd)
 {
-  stat_prefetch_cache_flush (this->private, 1);
+	if (flags & O_TRUNC)
+		sp_local_invalidate (frame, this, loc->inode);
+
+	STACK_WIND (frame, sp_open_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->open,
+		    loc, flags, fd);
+	return 0;
+}
+
 
-  STACK_WIND (frame,
-              stat_prefetch_truncate_cbk,
-              FIRST_CHILD(this),
-              FIRST_CHILD(this)->fops->truncate,
-              path,
-	      offset);
+int32_t
+sp_utimens (call_frame_t *frame,
+	    xlator_t *this,
+	    loc_t *loc,
+	    struct timespec tv[2])
+{
+	sp_local_invalidate (frame, this, loc->inode);
 
-  return 0;
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->utimens,
+		    loc, tv);
+	return 0;
 }
 
 
 int32_t
-stat_prefetch_rename_cbk (call_frame_t *frame,
-                          void *cookie,
-                          xlator_t *this,
-                          int32_t op_ret,
-                          int32_t op_errno)
+sp_writev (call_frame_t *frame,
+	   xlator_t *this,
+	   fd_t *fd,
+	   struct iovec *vector,
+	   int32_t count,
+	   off_t offset)
 {
-  STACK_UNWIND (frame, op_ret, op_errno);
-  return 0;
+	sp_local_invalidate (frame, this, fd->inode);
+
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->writev,
+		    fd, vector, count, offset);
+	return 0;
 }
 
+
 int32_t
-stat_prefetch_rename (call_frame_t *frame,
-                      struct xlator *this,
-                      const char *oldpath,
-		      const char *newpath)
+sp_setxattr (call_frame_t *frame,
+	     xlator_t *this,
+	     loc_t *loc,
+	     dict_t *dict,
+	     int32_t flags)
 {
-  stat_prefetch_cache_flush (this->private, 1);
+	sp_local_invalidate (frame, this, loc->inode);
+
+	STACK_WIND (frame, sp_err_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->setxattr,
+		    loc, dict, flags);
+	return 0;
+}
+
 
-  STACK_WIND (frame,
-              stat_prefetch_rename_cbk,
-              FIRST_CHILD(this),
-              FIRST_CHILD(this)->fops->rename,
-              oldpath,
-	      newpath);
+int32_t
+sp_removexattr (call_frame_t *frame,
+		xlator_t *this,
+		loc_t *loc,
+		const char *name)
+{
+	sp_local_invalidate (frame, this, loc->inode);
 
-  return 0;
+	STACK_WIND (frame, sp_err_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->removexattr,
+		    loc, name);
+	return 0;
 }
 
-int32_t 
-init (struct xlator *this)
+
+int32_t
+sp_xattrop (call_frame_t *frame,
+	    xlator_t *this,
+	    loc_t *loc,
+	    gf_xattrop_flags_t optype,
+	    dict_t *xattr)
 {
-  struct sp_cache *cache;
-  dict_t *options = this->options;
+	sp_local_invalidate (frame, this, loc->inode);
 
-  if (!this->children || this->children->next) {
-    gf_log ("stat-prefetch",
-	    GF_LOG_ERROR,
-	    "FATAL: translator %s does not have exactly one child node",
-	    this->name);
-    return -1;
-  }
+	STACK_WIND (frame, sp_dict_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->xattrop,
+		    loc, optype, xattr);
+	return 0;
+}
 
-  cache = (void *) CALLOC (1, sizeof (*cache));
-  ERR_ABORT (cache);
-  cache->next = cache->prev = cache;
 
-  cache->tv_time = 1 * 1000000;
+int32_t
+sp_fxattrop (call_frame_t *frame,
+	     xlator_t *this,
+	     fd_t *fd,
+	     gf_xattrop_flags_t optype,
+	     dict_t *xattr)
+{
+	sp_local_invalidate (frame, this, fd->inode);
+
+	STACK_WIND (frame, sp_dict_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->fxattrop,
+		    fd, optype, xattr);
+	return 0;
+}
 
-  if (dict_get (options, "cache-seconds")) {
-    cache->tv_time = (data_to_int64 (dict_get (options, "cache-seconds")) *
-		      1000000);
-  }
 
-  pthread_mutex_init (&cache->lock, NULL);
+int32_t
+sp_create_cbk (call_frame_t *frame,
+	       void *cookie,
+	       xlator_t *this,
+	       int32_t op_ret,
+	       int32_t op_errno,
+	       fd_t *fd,
+	       inode_t *inode,
+	       struct stat *buf)
+{
+	sp_local_done (frame, this);
 
-  this->private = cache;
-  return 0;
+	STACK_UNWIND (frame, op_ret, op_errno, fd, inode, buf);
+	return 0;
 }
 
+
+int32_t
+sp_create (call_frame_t *frame,
+	   xlator_t *this,
+	   loc_t *loc,
+	   int32_t flags,
+	   mode_t mode,
+	   fd_t *fd)
+{
+	sp_local_invalidate (frame, this, loc->parent);
+
+	STACK_WIND (frame, sp_create_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->create,
+		    loc, flags, mode, fd);
+	return 0;
+}
+
+
+int32_t
+sp_mknod (call_frame_t *frame,
+	  xlator_t *this,
+	  loc_t *loc,
+	  mode_t mode,
+	  dev_t rdev)
+{
+	sp_local_invalidate (frame, this, loc->parent);
+
+	STACK_WIND (frame, sp_inode_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->mknod,
+		    loc, mode, rdev);
+	return 0;
+}
+
+
+int32_t
+sp_mkdir (call_frame_t *frame,
+	  xlator_t *this,
+	  loc_t *loc,
+	  mode_t mode)
+{
+	sp_local_invalidate (frame, this, loc->parent);
+
+	STACK_WIND (frame, sp_inode_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->mkdir,
+		    loc, mode);
+	return 0;
+}
+
+
+int32_t
+sp_symlink (call_frame_t *frame,
+	    xlator_t *this,
+	    const char *linkname,
+	    loc_t *loc)
+{
+	sp_local_invalidate (frame, this, loc->parent);
+
+	STACK_WIND (frame, sp_inode_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->symlink,
+		    linkname, loc);
+	return 0;
+}
+
+
+int32_t
+sp_link (call_frame_t *frame,
+	 xlator_t *this,
+	 loc_t *oldloc,
+	 loc_t *newloc)
+{
+	sp_local_invalidate (frame, this, oldloc->inode);
+	sp_local_invalidate (frame, this, newloc->parent);
+
+	STACK_WIND (frame, sp_inode_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->link,
+		    oldloc, newloc);
+	return 0;
+}
+
+
+int32_t
+sp_unlink (call_frame_t *frame,
+	   xlator_t *this,
+	   loc_t *loc)
+{
+	sp_local_invalidate (frame, this, loc->parent);
+	sp_local_invalidate (frame, this, loc->inode);
+
+	STACK_WIND (frame, sp_err_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->unlink,
+		    loc);
+	return 0;
+}
+
+
+int32_t
+sp_rmdir (call_frame_t *frame,
+	  xlator_t *this,
+	  loc_t *loc)
+{
+	sp_local_invalidate (frame, this, loc->parent);
+	sp_local_invalidate (frame, this, loc->inode);
+
+	STACK_WIND (frame, sp_err_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->rmdir,
+		    loc);
+	return 0;
+}
+
+
+int32_t
+sp_rename (call_frame_t *frame,
+	   xlator_t *this,
+	   loc_t *oldloc,
+	   loc_t *newloc)
+{
+	sp_local_invalidate (frame, this, oldloc->parent);
+	sp_local_invalidate (frame, this, oldloc->inode);
+	sp_local_invalidate (frame, this, newloc->parent);
+	sp_local_invalidate (frame, this, newloc->inode);
+
+	STACK_WIND (frame, sp_stbuf_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->rename,
+		    oldloc, newloc);
+	return 0;
+}
+
+
+int32_t
+sp_setdents (call_frame_t *frame,
+	     xlator_t *this,
+	     fd_t *fd,
+	     int32_t flags,
+	     dir_entry_t *entries,
+	     int32_t count)
+{
+	sp_local_invalidate (frame, this, fd->inode);
+
+	STACK_WIND (frame, sp_err_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->setdents,
+		    fd, flags, entries, count);
+	return 0;
+}
+
+
+int32_t
+sp_getxattr_cbk (call_frame_t *frame,
+		 void *cookie,
+		 xlator_t *this,
+		 int32_t op_ret,
+		 int32_t op_errno,
+		 dict_t *dict)
+{
+	STACK_UNWIND (frame, op_ret, op_errno, dict);
+	return 0;
+}
+
+
+static void
+sp_stats_get (xlator_t *this, xlator_counter_t *counters)
+{
+	sp_conf_t *conf = this->private;
+
+	LOCK (&conf->lock);
+	{
+		counters[0].value = conf->hits;
+		counters[1].value = conf->misses;
+		counters[2].value = conf->fills;
+		counters[3].value = conf->invalidations;
+		counters[4].value = conf->evictions;
+		counters[5].value = conf->lru_size;
+	}
+	UNLOCK (&conf->lock);
+}
+
+
+int32_t
+sp_getxattr (call_frame_t *frame,
+	     xlator_t *this,
+	     loc_t *loc,
+	     const char *name)
+{
+	xlator_counter_t counters[] = SP_STATS_COUNTERS;
+
+	if (name && !strncmp (name, SP_STATS_XATTR,
+			      strlen (SP_STATS_XATTR))) {
+		sp_stats_get (this, counters);
+		return xlator_counters_getxattr (frame, SP_STATS_XATTR, name,
+						 counters);
+	}
+
+	STACK_WIND (frame, sp_getxattr_cbk,
+		    FIRST_CHILD(this), FIRST_CHILD(this)->fops->getxattr,
+		    loc, name);
+	return 0;
+}
+
+
+int32_t
+sp_forget (xlator_t *this,
+	   inode_t *inode)
+{
+	sp_conf_t  *conf = this->private;
+	sp_inode_t *sp_inode = NULL;
+
+	sp_inode = sp_inode_get (this, inode);
+	if (!sp_inode)
+		return 0;
+
+	LOCK (&conf->lock);
+	{
+		__sp_inode_uncache (conf, sp_inode);
+	}
+	UNLOCK (&conf->lock);
+
+	FREE (sp_inode);
+	return 0;
+}
+
+
+int32_t
+init (xlator_t *this)
+{
+	sp_conf_t *conf = NULL;
+	dict_t    *options = this->options;
+	data_t    *data = NULL;
+
+	if (!this->children || this->children->next) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"FATAL: translator %s does not have exactly one "
+			"child node", this->name);
+		return -1;
+	}
+
+	if (!this->parents) {
+		gf_log (this->name, GF_LOG_WARNING,
+			"dangling volume. check volfile ");
+	}
+
+	conf = CALLOC (1, sizeof (*conf));
+	if (!conf) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"out of memory");
+		return -1;
+	}
+
+	conf->timeout   = SP_CACHE_TIMEOUT;
+	conf->lru_limit = SP_CACHE_ENTRIES;
+
+	data = dict_get (options, "cache-timeout");
+	if (data) {
+		conf->timeout = data_to_uint32 (data);
+		gf_log (this->name, GF_LOG_DEBUG,
+			"using cache-timeout %u", conf->timeout);
+	}
+
+	data = dict_get (options, "cache-entries");
+	if (data) {
+		conf->lru_limit = data_to_uint32 (data);
+		gf_log (this->name, GF_LOG_DEBUG,
+			"using cache-entries %u", conf->lru_limit);
+	}
+
+	LOCK_INIT (&conf->lock);
+	INIT_LIST_HEAD (&conf->lru);
+
+	this->private = conf;
+	return 0;
+}
+
+
 void
-fini (struct xlator *this)
+fini (xlator_t *this)
 {
-  return;
+	sp_conf_t        *conf = this->private;
+	xlator_counter_t  counters[] = SP_STATS_COUNTERS;
+
+	if (!conf)
+		return;
+
+	sp_stats_get (this, counters);
+	xlator_counters_log (this, counters);
+
+	LOCK_DESTROY (&conf->lock);
+	FREE (conf);
+
+	this->private = NULL;
+	return;
 }
 
 
 struct xlator_fops fops = {
-  .getattr     = stat_prefetch_getattr,
-  .readdir     = stat_prefetch_readdir,
-  .unlink      = stat_prefetch_unlink,
-  .chmod       = stat_prefetch_chmod,
-  .chown       = stat_prefetch_chown,
-  .rename      = stat_prefetch_rename,
-  .utimes      = stat_prefetch_utimes,
-  .truncate    = stat_prefetch_truncate,
+	.lookup      = sp_lookup,
+	.stat        = sp_stat,
+	.fstat       = sp_fstat,
+	.readdirp    = sp_readdirp,
+	.chmod       = sp_chmod,
+	.fchmod      = sp_fchmod,
+	.chown       = sp_chown,
+	.fchown      = sp_fchown,
+	.truncate    = sp_truncate,
+	.ftruncate   = sp_ftruncate,
+	.open        = sp_open,
+	.utimens     = sp_utimens,
+	.writev      = sp_writev,
+	.setxattr    = sp_setxattr,
+	.removexattr = sp_removexattr,
+	.xattrop     = sp_xattrop,
+	.fxattrop    = sp_fxattrop,
+	.create      = sp_create,
+	.mknod       = sp_mknod,
+	.mkdir       = sp_mkdir,
+	.symlink     = sp_symlink,
+	.link        = sp_link,
+	.unlink      = sp_unlink,
+	.rmdir       = sp_rmdir,
+	.rename      = sp_rename,
+	.setdents    = sp_setdents,
+	.getxattr    = sp_getxattr,
 };
 
 struct xlator_mops mops = {
 };
+
+struct xlator_cbks cbks = {
+	.forget      = sp_forget,
+};
+
+struct volume_options options[] = {
+	{ .key  = {"cache-timeout", "cache-seconds"},
+	  .type = GF_OPTION_TYPE_INT,
+	  .min  = 0,
+	  .max  = 60
+	},
+	{ .key  = {"cache-entries"},
+	  .type = GF_OPTION_TYPE_INT,
+	  .min  = 1,
+	  .max  = 1048576
+	},
+	{ .key  = {NULL} },
+};
@@ -27,6 +27,68 @@
 
 #include <stdio.h>
 #include <sys/time.h>
+#include "glusterfs.h"
+#include "logging.h"
+#include "dict.h"
 #include "xlator.h"
+#include "list.h"
+#include "locking.h"
+
+#define SP_CACHE_TIMEOUT      1        /* seconds */
+#define SP_CACHE_ENTRIES      16384
+
+/* inodes a fop can invalidate: both parents and both inodes of a
+   rename */
+#define SP_LOCAL_INODES       4
+
+#define SP_STATS_XATTR        "glusterfs.stat-prefetch."
+
+/* in the order sp_stats_get fills them */
+#define SP_STATS_COUNTERS     {{"hits", 0}, {"misses", 0}, {"fills", 0}, \
+			       {"invalidations", 0}, {"evictions", 0},  \
+			       {"entries", 0}, {NULL, 0}}
+
+/*
+ * sp_inode - the context of every inode looked up through stat-prefetch.
+ *            an inode is only answered from the cache once the xlators
+ *            below have seen a lookup of it, and so have their own
+ *            contexts for it.
+ *
+ * @lru:       in sp_conf.lru while stbuf is cached
+ * @stbuf:     attributes from the last readdirp listing the inode
+ * @cached_at: when they were received
+ * @gen:       sp_conf.gen at the last invalidation of the inode, a
+ *             readdirp wound before it must not fill the cache
+ * @cached:    stbuf is valid
+ */
+typedef struct sp_inode {
+	struct list_head  lru;
+	struct stat       stbuf;
+	struct timeval    cached_at;
+	uint64_t          gen;
+	char              cached;
+} sp_inode_t;
+
+typedef struct sp_conf {
+	gf_lock_t         lock;
+	struct list_head  lru;          /* most recently used first */
+	uint32_t          lru_size;
+	uint32_t          lru_limit;
+	uint32_t          timeout;      /* seconds */
+	uint64_t          gen;
+
+	uint64_t          hits;
+	uint64_t          misses;
+	uint64_t          fills;
+	uint64_t          invalidations;
+	uint64_t          evictions;
+} sp_conf_t;
+
+typedef struct sp_local {
+	fd_t             *fd;
+	uint64_t          gen;
+	inode_t          *inodes[SP_LOCAL_INODES];
+	int               count;
+} sp_local_t;
 
 #endif /* _STAT_PREFETCH_H_ */
@@ -0,0 +1,517 @@
+/*
+  Copyright (c) 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CONFIG_H
+#define _CONFIG_H
+#include "config.h"
+#endif
+
+#include "write-behind.h"
+
+
+static uint32_t
+__wb_extent_priority (wb_inode_t *wb_inode)
+{
+        wb_inode->seed = wb_inode->seed * 1103515245 + 12345;
+
+        return wb_inode->seed >> 8;
+}
+
+
+/* split the tree at root into the extents before offset and the rest */
+static void
+__wb_tree_split (wb_extent_t *root, off_t offset,
+                 wb_extent_t **left, wb_extent_t **right)
+{
+        if (!root) {
+                *left = *right = NULL;
+                return;
+        }
+
+        if (root->offset < offset) {
+                __wb_tree_split (root->right, offset, &root->right, right);
+                *left = root;
+        } else {
+                __wb_tree_split (root->left, offset, left, &root->left);
+                *right = root;
+        }
+}
+
+
+/* join two trees, all extents of left being before those of right */
+static wb_extent_t *
+__wb_tree_join (wb_extent_t *left, wb_extent_t *right)
+{
+        if (!left)
+                return right;
+        if (!right)
+                return left;
+
+        if (left->priority > right->priority) {
+                left->right = __wb_tree_join (left->right, right);
+                return left;
+        }
+
+        right->left = __wb_tree_join (left, right->left);
+        return right;
+}
+
+
+/*
+ * __wb_extent_floor - the last extent starting at or before offset
+ */
+wb_extent_t *
+__wb_extent_floor (wb_inode_t *wb_inode, off_t offset)
+{
+        wb_extent_t *trav = NULL;
+        wb_extent_t *floor = NULL;
+
+        trav = wb_inode->root;
+        while (trav) {
+                if (trav->offset <= offset) {
+                        floor = trav;
+                        trav = trav->right;
+                } else {
+                        trav = trav->left;
+                }
+        }
+
+        return floor;
+}
+
+
+static void
+__wb_extent_insert (wb_inode_t *wb_inode, wb_extent_t *extent)
+{
+        wb_extent_t *prev = NULL;
+        wb_extent_t *left = NULL;
+        wb_extent_t *right = NULL;
+
+        prev = __wb_extent_floor (wb_inode, extent->offset);
+        if (prev)
+                list_add (&extent->list, &prev->list);
+        else
+                list_add (&extent->list, &wb_inode->extents);
+
+        extent->left = extent->right = NULL;
+        extent->priority = __wb_extent_priority (wb_inode);
+
+        __wb_tree_split (wb_inode->root, extent->offset, &left, &right);
+        wb_inode->root = __wb_tree_join (__wb_tree_join (left, extent),
+                                         right);
+
+        wb_inode->dirty += extent->vector.iov_len;
+}
+
+
+void
+__wb_extent_remove (wb_inode_t *wb_inode, wb_extent_t *extent)
+{
+        wb_extent_t *left = NULL;
+        wb_extent_t *middle = NULL;
+        wb_extent_t *right = NULL;
+
+        __wb_tree_split (wb_inode->root, extent->offset, &left, &middle);
+        __wb_tree_split (middle, extent->offset + 1, &middle, &right);
+        wb_inode->root = __wb_tree_join (left, right);
+
+        list_del_init (&extent->list);
+        extent->left = extent->right = NULL;
+
+        wb_inode->dirty -= extent->vector.iov_len;
+}
+
+
+void
+wb_extent_destroy (wb_extent_t *extent)
+{
+        if (extent->iobref)
+                iobref_unref (extent->iobref);
+        if (extent->fd)
+                fd_unref (extent->fd);
+
+        FREE (extent);
+}
+
+
+/*
+ * __wb_extent_punch - drop what the extents hold of [offset, end). an
+ * extent straddling the whole range is split in two with tail.
+ */
+static void
+__wb_extent_punch (wb_inode_t *wb_inode, off_t offset, off_t end,
+                   wb_extent_t **tail)
+{
+        wb_extent_t *extent = NULL;
+        wb_extent_t *split = NULL;
+        list_head_t *trav = NULL;
+        off_t        extent_end = 0;
+
+        extent = __wb_extent_floor (wb_inode, offset);
+        if (extent)
+                trav = &extent->list;
+        else
+                trav = wb_inode->extents.next;
+
+        while (trav != &wb_inode->extents) {
+                extent = list_entry (trav, wb_extent_t, list);
+                trav = trav->next;
+
+                extent_end = extent->offset + extent->vector.iov_len;
+                if (extent->offset >= end)
+                        break;
+                if (extent_end <= offset)
+                        continue;
+
+                if (extent->offset < offset && extent_end > end) {
+                        split = *tail;
+                        *tail = NULL;
+
+                        split->offset = end;
+                        split->vector.iov_base = extent->vector.iov_base
+                                + (end - extent->offset);
+                        split->vector.iov_len = extent_end - end;
+                        split->spare = extent->spare;
+                        split->iobref = iobref_ref (extent->iobref);
+                        split->fd = fd_ref (extent->fd);
+                        split->gen = extent->gen;
+
+                        wb_inode->dirty -= extent_end - offset;
+                        extent->vector.iov_len = offset - extent->offset;
+                        extent->spare = 0;
+
+                        __wb_extent_insert (wb_inode, split);
+                        break;
+                }
+
+                if (extent->offset < offset) {
+                        /* the bytes past the end may have been read from
+                           it, they must not be written over */
+                        wb_inode->dirty -= extent_end - offset;
+                        extent->vector.iov_len = offset - extent->offset;
+                        extent->spare = 0;
+                        continue;
+                }
+
+                if (extent_end > end) {
+                        /* moving the start within the extent keeps it
+                           in place in the tree */
+                        wb_inode->dirty -= end - extent->offset;
+                        extent->vector.iov_base += end - extent->offset;
+                        extent->vector.iov_len = extent_end - end;
+                        extent->offset = end;
+                        break;
+                }
+
+                __wb_extent_remove (wb_inode, extent);
+                wb_extent_destroy (extent);
+        }
+}
+
+
+/*
+ * __wb_extent_append - copy a small write adjacent to the end of prev
+ * into the buffer of prev, which is made one of ours first if it is
+ * small too. returns 0 when prev took the write.
+ *
+ * the caller checks that the write came on the fd of prev
+ */
+static int32_t
+__wb_extent_append (wb_inode_t *wb_inode, wb_extent_t *prev,
+                    struct iovec *vector)
+{
+        struct iobuf_pool *iobuf_pool = NULL;
+        struct iobuf      *iobuf = NULL;
+        struct iobref     *iobref = NULL;
+        size_t             page_size = 0;
+
+        if (prev->spare >= vector->iov_len)
+                goto copy;
+
+        iobuf_pool = wb_inode->this->ctx->iobuf_pool;
+        page_size = iobpool_default_pagesize (iobuf_pool);
+        if (prev->vector.iov_len + vector->iov_len > page_size / 2)
+                return -1;
+
+        iobuf = iobuf_get (iobuf_pool);
+        if (!iobuf)
+                return -1;
+
+        iobref = iobref_new ();
+        if (!iobref) {
+                iobuf_unref (iobuf);
+                return -1;
+        }
+
+        iobref_add (iobref, iobuf);
+        memcpy (iobuf->ptr, prev->vector.iov_base, prev->vector.iov_len);
+        iobuf_unref (iobuf);
+
+        iobref_unref (prev->iobref);
+        prev->iobref = iobref;
+        prev->vector.iov_base = iobuf->ptr;
+        prev->spare = page_size - prev->vector.iov_len;
+
+copy:
+        memcpy (prev->vector.iov_base + prev->vector.iov_len,
+                vector->iov_base, vector->iov_len);
+        prev->vector.iov_len += vector->iov_len;
+        prev->spare -= vector->iov_len;
+        wb_inode->dirty += vector->iov_len;
+
+        return 0;
+}
+
+
+/*
+ * __wb_extent_write - take a write into the extents of the inode. it
+ * replaces what they hold of its range, small writes adjacent to an
+ * extent are appended to it, the others keep a ref on iobref instead of
+ * being copied.
+ *
+ * returns -1 when out of memory, with the extents left as they were
+ */
+int32_t
+__wb_extent_write (wb_inode_t *wb_inode, fd_t *fd, struct iovec *vector,
+                   int32_t count, off_t offset, struct iobref *iobref)
+{
+        struct iobuf *iobuf = NULL;
+        struct iovec  copy = {0, };
+        list_head_t   spares;
+        wb_extent_t  *extent = NULL;
+        wb_extent_t  *prev = NULL;
+        wb_extent_t  *tail = NULL;
+        size_t        size = 0;
+        off_t         trav_offset = 0;
+        int32_t       ret = -1;
+        int32_t       i = 0;
+
+        INIT_LIST_HEAD (&spares);
+
+        size = iov_length (vector, count);
+        if (!size)
+                return 0;
+
+        if (!iobref) {
+                /* nothing keeps the data of the write alive, copy it */
+                iobuf = iobuf_get2 (wb_inode->this->ctx->iobuf_pool, size);
+                iobref = iobref_new ();
+                if (!iobuf || !iobref)
+                        goto out;
+
+                iobref_add (iobref, iobuf);
+                copy.iov_base = iobuf->ptr;
+                copy.iov_len = size;
+                for (i = 0; i < count; i++) {
+                        memcpy (copy.iov_base + trav_offset,
+                                vector[i].iov_base, vector[i].iov_len);
+                        trav_offset += vector[i].iov_len;
+                }
+                vector = &copy;
+                count = 1;
+        } else {
+                iobref_ref (iobref);
+        }
+
+        /* one extent per iovec and one to split an extent with */
+        for (i = 0; i <= count; i++) {
+                extent = CALLOC (1, sizeof (*extent));
+                if (!extent)
+                        goto out;
+                list_add (&extent->list, &spares);
+        }
+
+        wb_inode->gen++;
+
+        tail = list_entry (spares.next, wb_extent_t, list);
+        list_del_init (&tail->list);
+        __wb_extent_punch (wb_inode, offset, offset + size, &tail);
+        if (tail)
+                list_add (&tail->list, &spares);
+
+        trav_offset = offset;
+        for (i = 0; i < count; i++) {
+                if (!vector[i].iov_len)
+                        continue;
+
+                prev = __wb_extent_floor (wb_inode, trav_offset);
+                if (prev && (prev->offset + prev->vector.iov_len
+                             == trav_offset)
+                    && prev->fd == fd
+                    && __wb_extent_append (wb_inode, prev, &vector[i]) == 0)
+                        goto next;
+
+                extent = list_entry (spares.next, wb_extent_t, list);
+                list_del_init (&extent->list);
+
+                extent->offset = trav_offset;
+                extent->vector = vector[i];
+                extent->iobref = iobref_ref (iobref);
+                extent->fd = fd_ref (fd);
+                extent->gen = wb_inode->gen;
+                __wb_extent_insert (wb_inode, extent);
+        next:
+                trav_offset += vector[i].iov_len;
+        }
+
+        ret = 0;
+out:
+        while (!list_empty (&spares)) {
+                extent = list_entry (spares.next, wb_extent_t, list);
+                list_del (&extent->list);
+                FREE (extent);
+        }
+
+        if (iobuf)
+                iobuf_unref (iobuf);
+        if (iobref)
+                iobref_unref (iobref);
+
+        return ret;
+}
+
+
+/*
+ * __wb_extent_read - when the extents hold all of [offset, offset +
+ * size), point vector at it and ref the buffers in a new iobref.
+ *
+ * returns 1 when they do, 0 when they do not and -1 when out of memory
+ */
+int32_t
+__wb_extent_read (wb_inode_t *wb_inode, off_t offset, size_t size,
+                  struct iovec **vector, int32_t *count,
+                  struct iobref **iobref)
+{
+        wb_extent_t *first = NULL;
+        wb_extent_t *extent = NULL;
+        off_t        end = offset + size;
+        off_t        covered = 0;
+        off_t        start = 0;
+        off_t        stop = 0;
+        int32_t      i = 0;
+
+        first = __wb_extent_floor (wb_inode, offset);
+        if (!first)
+                return 0;
+
+        extent = first;
+        covered = offset;
+        while (1) {
+                if (extent->offset > covered
+                    || extent->offset + extent->vector.iov_len <= covered)
+                        return 0;
+
+                covered = extent->offset + extent->vector.iov_len;
+                i++;
+                if (covered >= end)
+                        break;
+
+                if (extent->list.next == &wb_inode->extents)
+                        return 0;
+                extent = list_entry (extent->list.next, wb_extent_t, list);
+        }
+
+        *count = i;
+        *vector = CALLOC (i, sizeof (**vector));
+        *iobref = iobref_new ();
+        if (!*vector || !*iobref) {
+                if (*vector)
+                        FREE (*vector);
+                if (*iobref)
+                        iobref_unref (*iobref);
+                return -1;
+        }
+
+        extent = first;
+        for (i = 0; i < *count; i++) {
+                start = max (offset, extent->offset);
+                stop = min (end, (off_t) (extent->offset
+                                          + extent->vector.iov_len));
+
+                (*vector)[i].iov_base = extent->vector.iov_base
+                        + (start - extent->offset);
+                (*vector)[i].iov_len = stop - start;
+                iobref_merge (*iobref, extent->iobref);
+
+                extent = list_entry (extent->list.next, wb_extent_t, list);
+        }
+
+        return 1;
+}
+
+
+/*
+ * __wb_extent_run - the number of extents, at most MAX_VECTOR_COUNT, in
+ * the run of adjacent extents from first, and its size in bytes. a run
+ * is wound on the fd of first, so it ends where the fd changes.
+ */
+int32_t
+__wb_extent_run (wb_inode_t *wb_inode, wb_extent_t *first, size_t *size)
+{
+        wb_extent_t *extent = first;
+        wb_extent_t *next = NULL;
+        int32_t      count = 1;
+
+        *size = first->vector.iov_len;
+
+        while (count < MAX_VECTOR_COUNT
+               && extent->list.next != &wb_inode->extents) {
+                next = list_entry (extent->list.next, wb_extent_t, list);
+                if (next->offset != extent->offset + extent->vector.iov_len
+                    || next->fd != first->fd)
+                        break;
+
+                *size += next->vector.iov_len;
+                extent = next;
+                count++;
+        }
+
+        return count;
+}
+
+
+/*
+ * __wb_extent_pending - whether an extent holding data of a write up to
+ * gen overlaps [offset, end)
+ */
+int32_t
+__wb_extent_pending (wb_inode_t *wb_inode, off_t offset, off_t end,
+                     uint64_t gen)
+{
+        wb_extent_t *extent = NULL;
+        list_head_t *trav = NULL;
+
+        extent = __wb_extent_floor (wb_inode, offset);
+        if (extent)
+                trav = &extent->list;
+        else
+                trav = wb_inode->extents.next;
+
+        for (; trav != &wb_inode->extents; trav = trav->next) {
+                extent = list_entry (trav, wb_extent_t, list);
+                if (extent->offset >= end)
+                        break;
+
+                if (extent->offset + extent->vector.iov_len > offset
+                    && extent->gen <= gen)
+                        return 1;
+        }
+
+        return 0;
+}
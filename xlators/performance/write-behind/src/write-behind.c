@@ -17,98 +17,90 @@
   <http://www.gnu.org/licenses/>.
 */
 
-/*TODO: check for non null wb_file_data before getting wb_file */
-
+/*
+ * writes are taken into the dirty extents of the inode, shared by all
+ * its fds, and acknowledged while the inode has no more than window-size
+ * bytes dirty or in flight. a write replaces what the extents hold of
+ * its range, so rewrites of the same region go to the child once. runs
+ * of adjacent extents are wound as single writevs in offset order, when
+ * nothing else is in flight or once a run reaches aggregate-size. reads
+ * the extents hold are answered from them, the other fops that depend on
+ * the data written wait on a barrier until it is on the child.
+ */
 
 #ifndef _CONFIG_H
 #define _CONFIG_H
 #include "config.h"
 #endif
 
-#include "glusterfs.h"
-#include "logging.h"
-#include "dict.h"
-#include "xlator.h"
-#include "list.h"
-#include "compat.h"
-#include "compat-errno.h"
-#include "common-utils.h"
-
-#define MAX_VECTOR_COUNT 8
- 
-typedef struct list_head list_head_t;
-struct wb_conf;
-struct wb_page;
-struct wb_file;
-
-
-struct wb_conf {
-        uint64_t aggregate_size;
-        uint64_t window_size;
-        uint64_t disable_till;
-        gf_boolean_t enable_O_SYNC;
-        gf_boolean_t flush_behind;
-};
+#include "write-behind.h"
 
 
-typedef struct wb_local {
-        list_head_t winds;
-        struct wb_file *file;
-        list_head_t unwind_frames;
-        int op_ret;
-        int op_errno;
-        call_frame_t *frame;
-} wb_local_t;
-
-
-typedef struct write_request {
-        call_frame_t *frame;
-        off_t offset;
-        /*  int32_t op_ret;
-            int32_t op_errno; */
-        struct iovec *vector;
-        int32_t count;
-        dict_t *refs;
-        char write_behind;
-        char stack_wound;
-        char got_reply;
-        list_head_t list;
-        list_head_t winds;
-        /*  list_head_t unwinds;*/
-} wb_write_request_t;
-
-
-struct wb_file {
-        int disabled;
-        uint64_t disable_till;
-        off_t offset;
-        size_t window_size;
-        int32_t refcount;
-        int32_t op_ret;
-        int32_t op_errno;
-        list_head_t request;
-        fd_t *fd;
-        gf_lock_t lock;
-        xlator_t *this;
-};
+int32_t
+wb_process_queue (call_frame_t *frame, wb_inode_t *wb_inode);
 
 
-typedef struct wb_conf wb_conf_t;
-typedef struct wb_page wb_page_t;
-typedef struct wb_file wb_file_t;
+wb_inode_t *
+wb_inode_get (xlator_t *this, inode_t *inode)
+{
+        uint64_t tmp_wb_inode = 0;
 
+        if (!inode || inode_ctx_get (inode, this, &tmp_wb_inode))
+                return NULL;
 
-int32_t 
-wb_process_queue (call_frame_t *frame, wb_file_t *file, char flush_all);
+        return (wb_inode_t *)(long)tmp_wb_inode;
+}
 
-int32_t
-wb_sync (call_frame_t *frame, wb_file_t *file, list_head_t *winds);
 
-int32_t
-wb_sync_all (call_frame_t *frame, wb_file_t *file);
+wb_inode_t *
+wb_inode_create (xlator_t *this, inode_t *inode)
+{
+        wb_inode_t *wb_inode = NULL;
+
+        LOCK (&inode->lock);
+        {
+                wb_inode = wb_inode_get (this, inode);
+                if (wb_inode)
+                        goto unlock;
+
+                wb_inode = CALLOC (1, sizeof (*wb_inode));
+                if (!wb_inode)
+                        goto unlock;
+
+                INIT_LIST_HEAD (&wb_inode->extents);
+                INIT_LIST_HEAD (&wb_inode->syncs);
+                INIT_LIST_HEAD (&wb_inode->waiters);
+                INIT_LIST_HEAD (&wb_inode->barriers);
+                LOCK_INIT (&wb_inode->lock);
+                wb_inode->seed = (uint32_t)(long) wb_inode;
+                wb_inode->this = this;
+
+                inode_ctx_put (inode, this, (uint64_t)(long)wb_inode);
+        }
+unlock:
+        UNLOCK (&inode->lock);
 
-int32_t 
-__wb_mark_winds (list_head_t *list, list_head_t *winds, size_t aggregate_size);
+        return wb_inode;
+}
+
+
+void
+wb_inode_destroy (wb_inode_t *wb_inode)
+{
+        wb_extent_t *extent = NULL;
+
+        /* nothing is in flight or waiting once the inode is forgotten,
+           all fds on it being released */
+        while (!list_empty (&wb_inode->extents)) {
+                extent = list_entry (wb_inode->extents.next,
+                                     wb_extent_t, list);
+                __wb_extent_remove (wb_inode, extent);
+                wb_extent_destroy (extent);
+        }
+
+        LOCK_DESTROY (&wb_inode->lock);
+        FREE (wb_inode);
+}
 
 
 wb_file_t *
@@ -116,40 +108,105 @@ wb_file_create (xlator_t *this,
                 fd_t *fd)
 {
         wb_file_t *file = NULL;
-        wb_conf_t *conf = this->private; 
+        wb_conf_t *conf = this->private;
+
+        if (!wb_inode_create (this, fd->inode))
+                return NULL;
 
         file = CALLOC (1, sizeof (*file));
-        INIT_LIST_HEAD (&file->request);
+        if (!file)
+                return NULL;
 
         /* fd_ref() not required, file should never decide the existance of
          * an fd */
-        file->fd= fd;
         file->disable_till = conf->disable_till;
-        file->this = this;
-        file->refcount = 1;
+        LOCK_INIT (&file->lock);
 
         fd_ctx_set (fd, this, (uint64_t)(long)file);
-        
+
         return file;
 }
 
 void
 wb_file_destroy (wb_file_t *file)
 {
-        int32_t refcount = 0;
+        LOCK_DESTROY (&file->lock);
+        FREE (file);
 
-        LOCK (&file->lock);
-        {
-                refcount = --file->refcount;
+        return;
+}
+
+
+/*
+ * __wb_sync_new - take a run of count extents from first off the tree
+ * into a sync
+ */
+static wb_sync_t *
+__wb_sync_new (wb_inode_t *wb_inode, wb_extent_t *first, int32_t count)
+{
+        wb_sync_t   *sync = NULL;
+        wb_extent_t *extent = NULL;
+        list_head_t *trav = NULL;
+        int32_t      i = 0;
+
+        sync = CALLOC (1, sizeof (*sync));
+        if (!sync)
+                return NULL;
+
+        INIT_LIST_HEAD (&sync->winds);
+        INIT_LIST_HEAD (&sync->extents);
+        sync->inode = wb_inode;
+        sync->fd = first->fd;
+        sync->offset = first->offset;
+        sync->gen = first->gen;
+
+        trav = &first->list;
+        for (i = 0; i < count; i++) {
+                extent = list_entry (trav, wb_extent_t, list);
+                trav = trav->next;
+
+                __wb_extent_remove (wb_inode, extent);
+                list_add_tail (&extent->list, &sync->extents);
+
+                sync->size += extent->vector.iov_len;
+                sync->gen = min (sync->gen, extent->gen);
         }
-        UNLOCK (&file->lock);
 
-        if (!refcount){
-                LOCK_DESTROY (&file->lock);
-                FREE (file);
+        wb_inode->inflight += sync->size;
+        list_add_tail (&sync->list, &wb_inode->syncs);
+
+        return sync;
+}
+
+
+static void
+wb_sync_destroy (wb_sync_t *sync)
+{
+        wb_extent_t *extent = NULL;
+        wb_extent_t *dummy = NULL;
+
+        list_for_each_entry_safe (extent, dummy, &sync->extents, list) {
+                list_del (&extent->list);
+                wb_extent_destroy (extent);
         }
 
-        return;
+        FREE (sync);
+}
+
+
+static int32_t
+__wb_sync_overlaps (wb_inode_t *wb_inode, off_t offset, off_t end,
+                    uint64_t gen)
+{
+        wb_sync_t *sync = NULL;
+
+        list_for_each_entry (sync, &wb_inode->syncs, list) {
+                if (sync->gen <= gen && sync->offset < end
+                    && sync->offset + sync->size > offset)
+                        return 1;
+        }
+
+        return 0;
 }
 
 
@@ -161,149 +218,334 @@ wb_sync_cbk (call_frame_t *frame,
              int32_t op_errno,
              struct stat *stbuf)
 {
-        wb_local_t *local = NULL;
-        list_head_t *winds = NULL;
-        wb_file_t *file = NULL;
-        wb_write_request_t *request = NULL, *dummy = NULL;
+        wb_sync_t  *sync = NULL;
+        wb_inode_t *wb_inode = NULL;
 
-        local = frame->local;
-        winds = &local->winds;
-        file = local->file;
+        sync = frame->local;
+        frame->local = NULL;
+        wb_inode = sync->inode;
 
-        LOCK (&file->lock);
+        LOCK (&wb_inode->lock);
         {
-                list_for_each_entry_safe (request, dummy, winds, winds) {
-                        request->got_reply = 1;
-                        if (!request->write_behind && (op_ret == -1)) {
-                                wb_local_t *per_request_local = request->frame->local;
-                                per_request_local->op_ret = op_ret;
-                                per_request_local->op_errno = op_errno;
-                        }
+                list_del_init (&sync->list);
+                wb_inode->inflight -= sync->size;
+
+                if (op_ret == -1) {
+                        wb_inode->op_ret = op_ret;
+                        wb_inode->op_errno = op_errno;
+                } else if (stbuf) {
+                        wb_inode->stbuf = *stbuf;
+                }
+        }
+        UNLOCK (&wb_inode->lock);
+
+        wb_sync_destroy (sync);
 
-                        /*
-                          request->op_ret = op_ret;
-                          request->op_errno = op_errno; 
-                        */
+        wb_process_queue (frame, wb_inode);
+
+        STACK_DESTROY (frame->root);
+
+        return 0;
+}
+
+
+int32_t
+wb_sync (call_frame_t *frame, wb_inode_t *wb_inode, list_head_t *syncs)
+{
+        wb_sync_t     *sync = NULL;
+        wb_sync_t     *dummy = NULL;
+        wb_extent_t   *extent = NULL;
+        call_frame_t  *sync_frame = NULL;
+        struct iobref *iobref = NULL;
+        struct iovec   vector[MAX_VECTOR_COUNT];
+        int32_t        count = 0;
+        int32_t        bytes = 0;
+
+        list_for_each_entry_safe (sync, dummy, syncs, winds) {
+                list_del_init (&sync->winds);
+
+                iobref = iobref_new ();
+                count = 0;
+                list_for_each_entry (extent, &sync->extents, list) {
+                        vector[count++] = extent->vector;
+                        iobref_merge (iobref, extent->iobref);
                 }
+                bytes += sync->size;
+
+                sync_frame = copy_frame (frame);
+                sync_frame->local = sync;
+                sync_frame->root->req_refs = iobref;
+
+                STACK_WIND (sync_frame,
+                            wb_sync_cbk,
+                            FIRST_CHILD(sync_frame->this),
+                            FIRST_CHILD(sync_frame->this)->fops->writev,
+                            sync->fd, vector, count, sync->offset);
+
+                iobref_unref (iobref);
+        }
+
+        return bytes;
+}
+
+
+static int32_t
+__wb_barrier_overlaps (wb_inode_t *wb_inode, off_t offset, off_t end)
+{
+        wb_barrier_t *barrier = NULL;
+
+        list_for_each_entry (barrier, &wb_inode->barriers, list) {
+                if (barrier->offset < end && barrier->end > offset)
+                        return 1;
         }
-        UNLOCK (&file->lock);
 
-        if (op_ret == -1)
+        return 0;
+}
+
+
+/*
+ * __wb_mark_winds - take the runs of extents due to be written off the
+ * tree, in offset order. all of them are when nothing is in flight or
+ * half the window is dirty, otherwise runs of aggregate-size and those
+ * an fop waits on. a run overlapping a sync in flight waits for its
+ * reply, so that the child sees the writes to a region in order.
+ */
+static void
+__wb_mark_winds (wb_inode_t *wb_inode, list_head_t *winds)
+{
+        wb_conf_t   *conf = NULL;
+        wb_extent_t *extent = NULL;
+        wb_sync_t   *sync = NULL;
+        list_head_t *trav = NULL;
+        size_t       size = 0;
+        int32_t      count = 0;
+        int32_t      i = 0;
+        char         all = 0;
+
+        conf = wb_inode->this->private;
+
+        all = (list_empty (&wb_inode->syncs)
+               || wb_inode->dirty >= conf->window_size / 2);
+
+        trav = wb_inode->extents.next;
+        while (trav != &wb_inode->extents) {
+                extent = list_entry (trav, wb_extent_t, list);
+
+                count = __wb_extent_run (wb_inode, extent, &size);
+                for (i = 0; i < count; i++)
+                        trav = trav->next;
+
+                if (!all && size < conf->aggregate_size
+                    && !__wb_barrier_overlaps (wb_inode, extent->offset,
+                                               extent->offset + size))
+                        continue;
+
+                if (__wb_sync_overlaps (wb_inode, extent->offset,
+                                        extent->offset + size,
+                                        wb_inode->gen))
+                        continue;
+
+                sync = __wb_sync_new (wb_inode, extent, count);
+                if (!sync)
+                        break;
+
+                list_add_tail (&sync->winds, winds);
+        }
+}
+
+
+/*
+ * __wb_mark_unwinds - the writes held back which now fit in the window
+ */
+static void
+__wb_mark_unwinds (wb_inode_t *wb_inode, list_head_t *unwinds)
+{
+        wb_conf_t  *conf = NULL;
+        wb_local_t *local = NULL;
+
+        conf = wb_inode->this->private;
+
+        while (!list_empty (&wb_inode->waiters)
+               && wb_inode->dirty + wb_inode->inflight <= conf->window_size) {
+                local = list_entry (wb_inode->waiters.next,
+                                    wb_local_t, list);
+                list_move_tail (&local->list, unwinds);
+        }
+}
+
+
+static void
+__wb_mark_resumes (wb_inode_t *wb_inode, list_head_t *resumes)
+{
+        wb_barrier_t *barrier = NULL;
+        wb_barrier_t *dummy = NULL;
+
+        list_for_each_entry_safe (barrier, dummy, &wb_inode->barriers, list) {
+                if (__wb_sync_overlaps (wb_inode, barrier->offset,
+                                        barrier->end, barrier->gen))
+                        continue;
+
+                if (__wb_extent_pending (wb_inode, barrier->offset,
+                                         barrier->end, barrier->gen))
+                        continue;
+
+                list_move_tail (&barrier->list, resumes);
+        }
+}
+
+
+int32_t
+wb_stack_unwind (list_head_t *unwinds)
+{
+        struct stat buf = {0,};
+        wb_local_t *local = NULL, *dummy = NULL;
+
+        list_for_each_entry_safe (local, dummy, unwinds, list)
         {
-                file->op_ret = op_ret;
-                file->op_errno = op_errno;
+                list_del_init (&local->list);
+                STACK_UNWIND (local->frame, local->size, 0, &buf);
         }
 
-        wb_process_queue (frame, file, 0);  
-  
-        /* safe place to do fd_unref */
-        fd_unref (file->fd);
+        return 0;
+}
 
-        STACK_DESTROY (frame->root);
+
+int32_t
+wb_resume (list_head_t *resumes)
+{
+        wb_barrier_t *barrier = NULL, *dummy = NULL;
+
+        list_for_each_entry_safe (barrier, dummy, resumes, list)
+        {
+                list_del_init (&barrier->list);
+                call_resume (barrier->stub);
+                FREE (barrier);
+        }
 
         return 0;
 }
 
+
+/*
+ * wb_process_queue - wind what is due, acknowledge the writes that fit
+ * in the window and resume the fops whose barriers are passed. frame is
+ * only copied for the writevs, it must not be one that gets unwound.
+ */
 int32_t
-wb_sync_all (call_frame_t *frame, wb_file_t *file) 
+wb_process_queue (call_frame_t *frame, wb_inode_t *wb_inode)
 {
-        list_head_t winds;
-        int32_t bytes = 0;
+        list_head_t winds, unwinds, resumes;
 
         INIT_LIST_HEAD (&winds);
+        INIT_LIST_HEAD (&unwinds);
+        INIT_LIST_HEAD (&resumes);
 
-        LOCK (&file->lock);
+        if (!wb_inode)
         {
-                bytes = __wb_mark_winds (&file->request, &winds, 0);
+                return -1;
         }
-        UNLOCK (&file->lock);
 
-        wb_sync (frame, file, &winds);
+        LOCK (&wb_inode->lock);
+        {
+                __wb_mark_winds (wb_inode, &winds);
+                __wb_mark_unwinds (wb_inode, &unwinds);
+                __wb_mark_resumes (wb_inode, &resumes);
+        }
+        UNLOCK (&wb_inode->lock);
+
+        wb_sync (frame, wb_inode, &winds);
+        wb_stack_unwind (&unwinds);
+        wb_resume (&resumes);
 
-        return bytes;
+        return 0;
 }
 
 
-int32_t
-wb_sync (call_frame_t *frame, wb_file_t *file, list_head_t *winds)
+static int32_t
+__wb_pending (wb_inode_t *wb_inode, off_t offset, size_t size)
 {
-        wb_write_request_t *dummy = NULL, *request = NULL, *first_request = NULL, *next = NULL;
-        size_t total_count = 0, count = 0;
-        size_t copied = 0;
-        call_frame_t *sync_frame = NULL;
-        dict_t *refs = NULL;
-        wb_local_t *local = NULL;
-        struct iovec *vector = NULL;
-        int32_t bytes = 0;
-        size_t bytecount = 0;
+        off_t end = 0;
 
-        list_for_each_entry (request, winds, winds)
+        if (!size)
+                return (wb_inode->dirty || wb_inode->inflight);
+
+        end = offset + size;
+        return (__wb_sync_overlaps (wb_inode, offset, end, wb_inode->gen)
+                || __wb_extent_pending (wb_inode, offset, end,
+                                        wb_inode->gen));
+}
+
+
+/*
+ * wb_pending - whether the inode has writes dirty or in flight that
+ * overlap [offset, offset + size), all of the file when size is 0
+ */
+static int32_t
+wb_pending (wb_inode_t *wb_inode, off_t offset, size_t size)
+{
+        int32_t pending = 0;
+
+        if (!wb_inode)
+                return 0;
+
+        LOCK (&wb_inode->lock);
         {
-                total_count += request->count;
-                bytes += iov_length (request->vector, request->count);
+                pending = __wb_pending (wb_inode, offset, size);
         }
+        UNLOCK (&wb_inode->lock);
 
-        if (!total_count) {
-                return 0;
+        return pending;
+}
+
+
+/*
+ * wb_barrier - resume stub once the writes taken so far overlapping
+ * [offset, offset + size) are on the child, all of the file when size
+ * is 0. unwinds frame with ENOMEM when stub could not be made.
+ */
+static int32_t
+wb_barrier (call_frame_t *frame, wb_inode_t *wb_inode, call_stub_t *stub,
+            off_t offset, size_t size)
+{
+        wb_barrier_t *barrier = NULL;
+        call_frame_t *process_frame = NULL;
+
+        if (!stub)
+                goto unwind;
+
+        barrier = CALLOC (1, sizeof (*barrier));
+        if (!barrier) {
+                call_stub_destroy (stub);
+                goto unwind;
         }
-  
-        list_for_each_entry_safe (request, dummy, winds, winds) {
-                if (!vector) {
-                        vector = MALLOC (VECTORSIZE (MAX_VECTOR_COUNT));
-                        refs = get_new_dict ();
-        
-                        local = CALLOC (1, sizeof (*local));
-                        INIT_LIST_HEAD (&local->winds);
-            
-                        first_request = request;
-                }
 
-                count += request->count;
-                bytecount = VECTORSIZE (request->count);
-                memcpy (((char *)vector)+copied,
-                        request->vector,
-                        bytecount);
-                copied += bytecount;
-      
-                if (request->refs) {
-                        dict_copy (request->refs, refs);
-                }
+        INIT_LIST_HEAD (&barrier->list);
+        barrier->stub = stub;
+        barrier->offset = offset;
+        barrier->end = size ? (off_t) (offset + size) : WB_OFFSET_MAX;
 
-                next = NULL;
-                if (request->winds.next != winds) {    
-                        next = list_entry (request->winds.next, struct write_request, winds);
-                }
+        process_frame = copy_frame (frame);
 
-                list_del_init (&request->winds);
-                list_add_tail (&request->winds, &local->winds);
-
-                if (!next || ((count + next->count) > MAX_VECTOR_COUNT)) {
-                        sync_frame = copy_frame (frame);  
-                        sync_frame->local = local;
-                        local->file = file;
-                        sync_frame->root->req_refs = dict_ref (refs);
-                        fd_ref (file->fd);
-                        STACK_WIND (sync_frame,
-                                    wb_sync_cbk,
-                                    FIRST_CHILD(sync_frame->this),
-                                    FIRST_CHILD(sync_frame->this)->fops->writev,
-                                    file->fd, vector,
-                                    count, first_request->offset);
-        
-                        dict_unref (refs);
-                        FREE (vector);
-                        first_request = NULL;
-                        refs = NULL;
-                        vector = NULL;
-                        copied = count = 0;
-                }
+        LOCK (&wb_inode->lock);
+        {
+                barrier->gen = wb_inode->gen;
+                list_add_tail (&barrier->list, &wb_inode->barriers);
         }
+        UNLOCK (&wb_inode->lock);
 
-        return bytes;
+        wb_process_queue (process_frame, wb_inode);
+
+        STACK_DESTROY (process_frame->root);
+
+        return 0;
+
+unwind:
+        gf_log (frame->this->name, GF_LOG_ERROR, "out of memory");
+        return -1;
 }
 
 
-int32_t 
+int32_t
 wb_stat_cbk (call_frame_t *frame,
              void *cookie,
              xlator_t *this,
@@ -311,64 +553,66 @@ wb_stat_cbk (call_frame_t *frame,
              int32_t op_errno,
              struct stat *buf)
 {
-        wb_local_t *local = NULL;
-  
-        local = frame->local;
-  
-        if (local->file)
-                fd_unref (local->file->fd);
-
         STACK_UNWIND (frame, op_ret, op_errno, buf);
 
         return 0;
 }
 
 
+int32_t
+wb_stat_helper (call_frame_t *frame,
+                xlator_t *this,
+                loc_t *loc)
+{
+        STACK_WIND (frame, wb_stat_cbk,
+                    FIRST_CHILD(this),
+                    FIRST_CHILD(this)->fops->stat,
+                    loc);
+        return 0;
+}
+
+
 int32_t
 wb_stat (call_frame_t *frame,
          xlator_t *this,
          loc_t *loc)
 {
-        wb_file_t *file = NULL;
-        fd_t *iter_fd = NULL;
-        wb_local_t *local = NULL;
-	uint64_t tmp_file = 0;
-
-        if (loc->inode)
-        {
-                iter_fd = fd_lookup (loc->inode, frame->root->pid);
-                if (iter_fd) {
-                        if (!fd_ctx_get (iter_fd, this, &tmp_file)) {
-				file = (wb_file_t *)(long)tmp_file;
-                        } else {
-                                fd_unref (iter_fd);
-                        }
-                }
-                if (file) {
-                        wb_sync_all (frame, file);
-                }
+        wb_inode_t *wb_inode = NULL;
+
+        wb_inode = wb_inode_get (this, loc->inode);
+        if (wb_pending (wb_inode, 0, 0)) {
+                if (wb_barrier (frame, wb_inode,
+                                fop_stat_stub (frame, wb_stat_helper, loc),
+                                0, 0) == -1)
+                        STACK_UNWIND (frame, -1, ENOMEM, NULL);
+                return 0;
         }
 
-        local = CALLOC (1, sizeof (*local));
-        local->file = file;
+        wb_stat_helper (frame, this, loc);
+        return 0;
+}
 
-        frame->local = local;
 
-        STACK_WIND (frame, wb_stat_cbk,
+int32_t
+wb_fstat_helper (call_frame_t *frame,
+                 xlator_t *this,
+                 fd_t *fd)
+{
+        STACK_WIND (frame,
+                    wb_stat_cbk,
                     FIRST_CHILD(this),
-                    FIRST_CHILD(this)->fops->stat,
-                    loc);
+                    FIRST_CHILD(this)->fops->fstat,
+                    fd);
         return 0;
 }
 
 
-int32_t 
+int32_t
 wb_fstat (call_frame_t *frame,
           xlator_t *this,
           fd_t *fd)
 {
-        wb_file_t *file = NULL;
-        wb_local_t *local = NULL;
+        wb_inode_t *wb_inode = NULL;
   	uint64_t tmp_file = 0;
 
         if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -377,22 +621,16 @@ wb_fstat (call_frame_t *frame,
                 return 0;
         }
 
-	file = (wb_file_t *)(long)tmp_file;
-        if (file) {
-                fd_ref (file->fd);
-                wb_sync_all (frame, file);
+        wb_inode = wb_inode_get (this, fd->inode);
+        if (wb_pending (wb_inode, 0, 0)) {
+                if (wb_barrier (frame, wb_inode,
+                                fop_fstat_stub (frame, wb_fstat_helper, fd),
+                                0, 0) == -1)
+                        STACK_UNWIND (frame, -1, ENOMEM, NULL);
+                return 0;
         }
 
-        local = CALLOC (1, sizeof (*local));
-        local->file = file;
-
-        frame->local = local;
-  
-        STACK_WIND (frame,
-                    wb_stat_cbk,
-                    FIRST_CHILD(this),
-                    FIRST_CHILD(this)->fops->fstat,
-                    fd);
+        wb_fstat_helper (frame, this, fd);
         return 0;
 }
 
@@ -405,55 +643,61 @@ wb_truncate_cbk (call_frame_t *frame,
                  int32_t op_errno,
                  struct stat *buf)
 {
-        wb_local_t *local = NULL; 
-  
-        local = frame->local;
-        if (local->file)
-                fd_unref (local->file->fd);
-
         STACK_UNWIND (frame, op_ret, op_errno, buf);
         return 0;
 }
 
 
-int32_t 
+int32_t
+wb_truncate_helper (call_frame_t *frame,
+                    xlator_t *this,
+                    loc_t *loc,
+                    off_t offset)
+{
+        STACK_WIND (frame,
+                    wb_truncate_cbk,
+                    FIRST_CHILD(this),
+                    FIRST_CHILD(this)->fops->truncate,
+                    loc,
+                    offset);
+        return 0;
+}
+
+
+int32_t
 wb_truncate (call_frame_t *frame,
              xlator_t *this,
              loc_t *loc,
              off_t offset)
 {
-        wb_file_t *file = NULL;
-        fd_t *iter_fd = NULL;
-        wb_local_t *local = NULL;
-	uint64_t tmp_file = 0;
-
-        if (loc->inode)
-        {
-                iter_fd = fd_lookup (loc->inode, frame->root->pid);
-                if (iter_fd) {
-                        if (!fd_ctx_get (iter_fd, this, &tmp_file)){
-				file = (wb_file_t *)(long)tmp_file;
-                        } else {
-                                fd_unref (iter_fd);
-                        }
-                }
-    
-                if (file)
-                {
-                        wb_sync_all (frame, file);
-                }
+        wb_inode_t *wb_inode = NULL;
+
+        wb_inode = wb_inode_get (this, loc->inode);
+        if (wb_pending (wb_inode, 0, 0)) {
+                if (wb_barrier (frame, wb_inode,
+                                fop_truncate_stub (frame, wb_truncate_helper,
+                                                   loc, offset),
+                                0, 0) == -1)
+                        STACK_UNWIND (frame, -1, ENOMEM, NULL);
+                return 0;
         }
-  
-        local = CALLOC (1, sizeof (*local));
-        local->file = file;
 
-        frame->local = local;
+        wb_truncate_helper (frame, this, loc, offset);
+        return 0;
+}
 
+
+int32_t
+wb_ftruncate_helper (call_frame_t *frame,
+                     xlator_t *this,
+                     fd_t *fd,
+                     off_t offset)
+{
         STACK_WIND (frame,
                     wb_truncate_cbk,
                     FIRST_CHILD(this),
-                    FIRST_CHILD(this)->fops->truncate,
-                    loc,
+                    FIRST_CHILD(this)->fops->ftruncate,
+                    fd,
                     offset);
         return 0;
 }
@@ -465,8 +709,7 @@ wb_ftruncate (call_frame_t *frame,
               fd_t *fd,
               off_t offset)
 {
-        wb_file_t *file = NULL;
-        wb_local_t *local = NULL;
+        wb_inode_t *wb_inode = NULL;
 	uint64_t tmp_file = 0;
 
         if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -475,29 +718,23 @@ wb_ftruncate (call_frame_t *frame,
                 return 0;
         }
 
-	file = (wb_file_t *)(long)tmp_file;
-        if (file)
-                wb_sync_all (frame, file);
-
-        local = CALLOC (1, sizeof (*local));
-        local->file = file;
-
-        if (file)
-                fd_ref (file->fd);
-
-        frame->local = local;
+        wb_inode = wb_inode_get (this, fd->inode);
+        if (wb_pending (wb_inode, 0, 0)) {
+                if (wb_barrier (frame, wb_inode,
+                                fop_ftruncate_stub (frame,
+                                                    wb_ftruncate_helper,
+                                                    fd, offset),
+                                0, 0) == -1)
+                        STACK_UNWIND (frame, -1, ENOMEM, NULL);
+                return 0;
+        }
 
-        STACK_WIND (frame,
-                    wb_truncate_cbk,
-                    FIRST_CHILD(this),
-                    FIRST_CHILD(this)->fops->ftruncate,
-                    fd,
-                    offset);
+        wb_ftruncate_helper (frame, this, fd, offset);
         return 0;
 }
 
 
-int32_t 
+int32_t
 wb_utimens_cbk (call_frame_t *frame,
                 void *cookie,
                 xlator_t *this,
@@ -505,47 +742,17 @@ wb_utimens_cbk (call_frame_t *frame,
                 int32_t op_errno,
                 struct stat *buf)
 {
-        wb_local_t *local = NULL;       
-  
-        local = frame->local;
-        if (local->file)
-                fd_unref (local->file->fd);
-
         STACK_UNWIND (frame, op_ret, op_errno, buf);
         return 0;
 }
 
 
-int32_t 
-wb_utimens (call_frame_t *frame,
-            xlator_t *this,
-            loc_t *loc,
-            struct timespec tv[2])
+int32_t
+wb_utimens_helper (call_frame_t *frame,
+                   xlator_t *this,
+                   loc_t *loc,
+                   struct timespec tv[2])
 {
-        wb_file_t *file = NULL;
-        fd_t *iter_fd = NULL;
-        wb_local_t *local = NULL;
-	uint64_t tmp_file = 0;
-
-        if (loc->inode) {
-                iter_fd = fd_lookup (loc->inode, frame->root->pid);
-                if (iter_fd) {
-                        if (!fd_ctx_get (iter_fd, this, &tmp_file)) {
-				file = (wb_file_t *)(long)tmp_file;
-                        } else {
-                                fd_unref (iter_fd);
-                        }
-                }
-
-                if (file)
-                        wb_sync_all (frame, file);
-        }
-
-        local = CALLOC (1, sizeof (*local));
-        local->file = file;
-
-        frame->local = local;
-
         STACK_WIND (frame,
                     wb_utimens_cbk,
                     FIRST_CHILD(this),
@@ -555,6 +762,29 @@ wb_utimens (call_frame_t *frame,
         return 0;
 }
 
+
+int32_t
+wb_utimens (call_frame_t *frame,
+            xlator_t *this,
+            loc_t *loc,
+            struct timespec tv[2])
+{
+        wb_inode_t *wb_inode = NULL;
+
+        wb_inode = wb_inode_get (this, loc->inode);
+        if (wb_pending (wb_inode, 0, 0)) {
+                if (wb_barrier (frame, wb_inode,
+                                fop_utimens_stub (frame, wb_utimens_helper,
+                                                  loc, tv),
+                                0, 0) == -1)
+                        STACK_UNWIND (frame, -1, ENOMEM, NULL);
+                return 0;
+        }
+
+        wb_utimens_helper (frame, this, loc, tv);
+        return 0;
+}
+
 int32_t
 wb_open_cbk (call_frame_t *frame,
              void *cookie,
@@ -570,6 +800,12 @@ wb_open_cbk (call_frame_t *frame,
         if (op_ret != -1)
         {
                 file = wb_file_create (this, fd);
+                if (!file) {
+                        gf_log (this->name, GF_LOG_ERROR, "out of memory");
+                        op_ret = -1;
+                        op_errno = ENOMEM;
+                        goto unwind;
+                }
 
                 /* If mandatory locking has been enabled on this file,
                    we disable caching on it */
@@ -577,347 +813,113 @@ wb_open_cbk (call_frame_t *frame,
                 if ((fd->inode->st_mode & S_ISGID) && !(fd->inode->st_mode & S_IXGRP))
                         file->disabled = 1;
 
-                /* If O_DIRECT then, we disable chaching */
-                if (frame->local)
-                {
-                        flags = *((int32_t *)frame->local);
-                        if (((flags & O_DIRECT) == O_DIRECT) || 
-                            ((flags & O_RDONLY) == O_RDONLY) ||
-                            (((flags & O_SYNC) == O_SYNC) &&
-                             conf->enable_O_SYNC == _gf_true)) { 
-                                file->disabled = 1;
-                        }
-                }
-
-                LOCK_INIT (&file->lock);
-        }
-
-        STACK_UNWIND (frame, op_ret, op_errno, fd);
-        return 0;
-}
-
-
-int32_t
-wb_open (call_frame_t *frame,
-         xlator_t *this,
-         loc_t *loc,
-         int32_t flags,
-         fd_t *fd)
-{
-        frame->local = CALLOC (1, sizeof(int32_t));
-        *((int32_t *)frame->local) = flags;
-
-        STACK_WIND (frame,
-                    wb_open_cbk,
-                    FIRST_CHILD(this),
-                    FIRST_CHILD(this)->fops->open,
-                    loc, flags, fd);
-        return 0;
-}
-
-
-int32_t
-wb_create_cbk (call_frame_t *frame,
-               void *cookie,
-               xlator_t *this,
-               int32_t op_ret,
-               int32_t op_errno,
-               fd_t *fd,
-               inode_t *inode,
-               struct stat *buf)
-{
-        wb_file_t *file = NULL;
-
-        if (op_ret != -1)
-        {
-                file = wb_file_create (this, fd);
-                /* 
-                 * If mandatory locking has been enabled on this file,
-                 * we disable caching on it
-                 */
-                if ((fd->inode->st_mode & S_ISGID) && 
-                    !(fd->inode->st_mode & S_IXGRP))
-                {
-                        file->disabled = 1;
-                }
-
-                LOCK_INIT (&file->lock);
-        }
-
-        STACK_UNWIND (frame, op_ret, op_errno, fd, inode, buf);
-        return 0;
-}
-
-
-int32_t
-wb_create (call_frame_t *frame,
-           xlator_t *this,
-           loc_t *loc,
-           int32_t flags,
-           mode_t mode,
-           fd_t *fd)
-{
-        STACK_WIND (frame,
-                    wb_create_cbk,
-                    FIRST_CHILD(this),
-                    FIRST_CHILD(this)->fops->create,
-                    loc, flags, mode, fd);
-        return 0;
-}
-
-
-int32_t 
-__wb_cleanup_queue (wb_file_t *file)
-{
-        wb_write_request_t *request = NULL, *dummy = NULL;
-        int32_t bytes = 0;
-
-        list_for_each_entry_safe (request, dummy, &file->request, list)
-        {
-                if (request->got_reply && request->write_behind)
-                {
-                        bytes += iov_length (request->vector, request->count);
-                        list_del_init (&request->list);
-
-                        FREE (request->vector);
-                        dict_unref (request->refs);
-      
-                        FREE (request);
-                }
-        }
-
-        return bytes;
-}
-
-
-int32_t 
-__wb_mark_wind_all (list_head_t *list, list_head_t *winds)
-{
-        wb_write_request_t *request = NULL;
-        size_t size = 0;
-
-        list_for_each_entry (request, list, list)
-        {
-                if (!request->stack_wound)
-                {
-                        size += iov_length (request->vector, request->count);
-                        request->stack_wound = 1;
-                        list_add_tail (&request->winds, winds);
-                }
-        }
-  
-        return size;
-}
-
-
-size_t 
-__wb_get_aggregate_size (list_head_t *list)
-{
-        wb_write_request_t *request = NULL;
-        size_t size = 0;
-
-        list_for_each_entry (request, list, list)
-        {
-                if (!request->stack_wound)
-                {
-                        size += iov_length (request->vector, request->count);
-                }
-        }
-
-        return size;
-}
-
-uint32_t
-__wb_get_incomplete_writes (list_head_t *list)
-{
-        wb_write_request_t *request = NULL;
-        uint32_t count = 0;
-
-        list_for_each_entry (request, list, list)
-        {
-                if (request->stack_wound && !request->got_reply)
-                {
-                        count++;
-                }
-        }
-
-        return count;
-}
-
-int32_t
-__wb_mark_winds (list_head_t *list, list_head_t *winds, size_t aggregate_conf)
-{
-        size_t aggregate_current = 0;
-        uint32_t incomplete_writes = 0;
-
-        incomplete_writes = __wb_get_incomplete_writes (list); 
-
-        aggregate_current = __wb_get_aggregate_size (list);
-
-        if ((incomplete_writes == 0) || (aggregate_current >= aggregate_conf))
-        {
-                __wb_mark_wind_all (list, winds);
-        }
-
-        return aggregate_current;
-}
-
-
-size_t
-__wb_get_window_size (list_head_t *list)
-{
-        wb_write_request_t *request = NULL;
-        size_t size = 0;
-
-        list_for_each_entry (request, list, list)
-        {
-                if (request->write_behind && !request->got_reply)
-                {
-                        size += iov_length (request->vector, request->count);
-                }
-        }
-
-        return size;
-}
-
-
-size_t 
-__wb_mark_unwind_till (list_head_t *list, list_head_t *unwinds, size_t size)
-{
-        size_t written_behind = 0;
-        wb_write_request_t *request = NULL;
-
-        list_for_each_entry (request, list, list)
-        {
-                if (written_behind <= size)
-                {
-                        if (!request->write_behind)
-                        {
-                                wb_local_t *local = request->frame->local;
-                                written_behind += iov_length (request->vector, request->count);
-                                request->write_behind = 1;
-                                list_add_tail (&local->unwind_frames, unwinds);
-                        }
-                }
-                else
-                {
-                        break;
-                }
-        }
-
-        return written_behind;
-}
-
-
-int32_t 
-__wb_mark_unwinds (list_head_t *list, list_head_t *unwinds, size_t window_conf)
-{
-        size_t window_current = 0;
-
-        window_current = __wb_get_window_size (list);
-        if (window_current <= window_conf)
-        {
-                window_current += __wb_mark_unwind_till (list, unwinds,
-                                                         window_conf - window_current);
-        }
-
-        return window_current;
-}
-
-
-int32_t
-wb_stack_unwind (list_head_t *unwinds)
-{
-        struct stat buf = {0,};
-        wb_local_t *local = NULL, *dummy = NULL;
-
-        list_for_each_entry_safe (local, dummy, unwinds, unwind_frames)
-        {
-                list_del_init (&local->unwind_frames);
-                STACK_UNWIND (local->frame, local->op_ret, local->op_errno, &buf);
+                /* If O_DIRECT then, we disable chaching. writes on
+                   O_APPEND fds go to the end of the file whatever
+                   offset they are wound with, so those are not cached
+                   either */
+                if (frame->local)
+                {
+                        flags = *((int32_t *)frame->local);
+                        if (((flags & O_DIRECT) == O_DIRECT) ||
+                            ((flags & O_APPEND) == O_APPEND) ||
+                            ((flags & O_ACCMODE) == O_RDONLY) ||
+                            (((flags & O_SYNC) == O_SYNC) &&
+                             conf->enable_O_SYNC == _gf_true)) {
+                                file->disabled = 1;
+                        }
+                }
         }
 
+unwind:
+        STACK_UNWIND (frame, op_ret, op_errno, fd);
         return 0;
 }
 
 
 int32_t
-wb_do_ops (call_frame_t *frame, wb_file_t *file, list_head_t *winds, list_head_t *unwinds)
+wb_open (call_frame_t *frame,
+         xlator_t *this,
+         loc_t *loc,
+         int32_t flags,
+         fd_t *fd)
 {
-        /* copy the frame before calling wb_stack_unwind, since this request containing current frame might get unwound */
-        /*  call_frame_t *sync_frame = copy_frame (frame); */
- 
-        wb_stack_unwind (unwinds);
-        wb_sync (frame, file, winds);
+        frame->local = CALLOC (1, sizeof(int32_t));
+        *((int32_t *)frame->local) = flags;
 
+        STACK_WIND (frame,
+                    wb_open_cbk,
+                    FIRST_CHILD(this),
+                    FIRST_CHILD(this)->fops->open,
+                    loc, flags, fd);
         return 0;
 }
 
 
-int32_t 
-wb_process_queue (call_frame_t *frame, wb_file_t *file, char flush_all) 
+int32_t
+wb_create_cbk (call_frame_t *frame,
+               void *cookie,
+               xlator_t *this,
+               int32_t op_ret,
+               int32_t op_errno,
+               fd_t *fd,
+               inode_t *inode,
+               struct stat *buf)
 {
-        list_head_t winds, unwinds;
-        size_t size = 0;
-        wb_conf_t *conf = file->this->private;
-
-        INIT_LIST_HEAD (&winds);
-        INIT_LIST_HEAD (&unwinds);
+        int32_t flags = 0;
+        wb_file_t *file = NULL;
 
-        if (!file)
+        if (op_ret != -1)
         {
-                return -1;
-        }
+                file = wb_file_create (this, fd);
+                if (!file) {
+                        gf_log (this->name, GF_LOG_ERROR, "out of memory");
+                        op_ret = -1;
+                        op_errno = ENOMEM;
+                        goto unwind;
+                }
 
-        size = flush_all ? 0 : conf->aggregate_size;
-        LOCK (&file->lock);
-        {
-                __wb_cleanup_queue (file);
-                __wb_mark_winds (&file->request, &winds, size);
-                __wb_mark_unwinds (&file->request, &unwinds, conf->window_size);
+                /*
+                 * If mandatory locking has been enabled on this file,
+                 * we disable caching on it
+                 */
+                if ((fd->inode->st_mode & S_ISGID) &&
+                    !(fd->inode->st_mode & S_IXGRP))
+                {
+                        file->disabled = 1;
+                }
+
+                /* as in wb_open_cbk */
+                if (frame->local)
+                {
+                        flags = *((int32_t *)frame->local);
+                        if ((flags & O_APPEND) == O_APPEND)
+                                file->disabled = 1;
+                }
         }
-        UNLOCK (&file->lock);
 
-        wb_do_ops (frame, file, &winds, &unwinds);
+unwind:
+        STACK_UNWIND (frame, op_ret, op_errno, fd, inode, buf);
         return 0;
 }
 
 
-wb_write_request_t *
-wb_enqueue (wb_file_t *file, 
-            call_frame_t *frame,
-            struct iovec *vector,
-            int32_t count,
-            off_t offset)
+int32_t
+wb_create (call_frame_t *frame,
+           xlator_t *this,
+           loc_t *loc,
+           int32_t flags,
+           mode_t mode,
+           fd_t *fd)
 {
-        wb_write_request_t *request = NULL;
-        wb_local_t *local = CALLOC (1, sizeof (*local));
-
-        request = CALLOC (1, sizeof (*request));
-
-        INIT_LIST_HEAD (&request->list);
-        INIT_LIST_HEAD (&request->winds);
-
-        request->frame = frame;
-        request->vector = iov_dup (vector, count);
-        request->count = count;
-        request->offset = offset;
-        request->refs = dict_ref (frame->root->req_refs);
-
-        frame->local = local;
-        local->frame = frame;
-        local->op_ret = iov_length (vector, count);
-        local->op_errno = 0;
-        INIT_LIST_HEAD (&local->unwind_frames);
-
-        LOCK (&file->lock);
-        {
-                list_add_tail (&request->list, &file->request);
-                file->offset = offset + iov_length (vector, count);
-        }
-        UNLOCK (&file->lock);
+        frame->local = CALLOC (1, sizeof(int32_t));
+        *((int32_t *)frame->local) = flags;
 
-        return request;
+        STACK_WIND (frame,
+                    wb_create_cbk,
+                    FIRST_CHILD(this),
+                    FIRST_CHILD(this)->fops->create,
+                    loc, flags, mode, fd);
+        return 0;
 }
 
 
@@ -934,6 +936,26 @@ wb_writev_cbk (call_frame_t *frame,
 }
 
 
+int32_t
+wb_writev_helper (call_frame_t *frame,
+                  xlator_t *this,
+                  fd_t *fd,
+                  struct iovec *vector,
+                  int32_t count,
+                  off_t offset)
+{
+        STACK_WIND (frame,
+                    wb_writev_cbk,
+                    FIRST_CHILD (this),
+                    FIRST_CHILD (this)->fops->writev,
+                    fd,
+                    vector,
+                    count,
+                    offset);
+        return 0;
+}
+
+
 int32_t
 wb_writev (call_frame_t *frame,
            xlator_t *this,
@@ -942,13 +964,20 @@ wb_writev (call_frame_t *frame,
            int32_t count,
            off_t offset)
 {
+        wb_conf_t *conf = NULL;
         wb_file_t *file = NULL;
-        char offset_expected = 1, wb_disabled = 0; 
+        wb_inode_t *wb_inode = NULL;
+        wb_local_t *local = NULL;
+        char wb_disabled = 0, unwind = 0;
         call_frame_t *process_frame = NULL;
+        struct stat buf = {0,};
         size_t size = 0;
+        int32_t ret = -1;
 	uint64_t tmp_file = 0;
 
-        if (vector != NULL) 
+        conf = this->private;
+
+        if (vector != NULL)
                 size = iov_length (vector, count);
 
         if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -958,7 +987,8 @@ wb_writev (call_frame_t *frame,
         }
 
 	file = (wb_file_t *)(long)tmp_file;
-        if (!file) {
+        wb_inode = wb_inode_get (this, fd->inode);
+        if (!file || !wb_inode) {
                 gf_log (this->name, GF_LOG_ERROR,
                         "wb_file not found for fd %p", fd);
                 STACK_UNWIND (frame, -1, EBADFD, NULL);
@@ -975,31 +1005,64 @@ wb_writev (call_frame_t *frame,
                         }
                         wb_disabled = 1;
                 }
-
-                if (file->offset != offset)
-                        offset_expected = 0;
         }
         UNLOCK (&file->lock);
 
         if (wb_disabled) {
-                STACK_WIND (frame,
-                            wb_writev_cbk,
-                            FIRST_CHILD (frame->this),
-                            FIRST_CHILD (frame->this)->fops->writev,
-                            file->fd,
-                            vector,
-                            count,
-                            offset);
+                /* written through, after the writes behind it overlaps */
+                if (wb_pending (wb_inode, offset, size)) {
+                        if (wb_barrier (frame, wb_inode,
+                                        fop_writev_stub (frame,
+                                                         wb_writev_helper,
+                                                         fd, vector, count,
+                                                         offset),
+                                        offset, size) == -1)
+                                STACK_UNWIND (frame, -1, ENOMEM, NULL);
+                        return 0;
+                }
+
+                wb_writev_helper (frame, this, fd, vector, count, offset);
+                return 0;
+        }
+
+        local = CALLOC (1, sizeof (*local));
+        if (!local) {
+                gf_log (this->name, GF_LOG_ERROR, "out of memory");
+                STACK_UNWIND (frame, -1, ENOMEM, NULL);
                 return 0;
         }
 
+        INIT_LIST_HEAD (&local->list);
+        local->frame = frame;
+        local->size = size;
+        frame->local = local;
+
         process_frame = copy_frame (frame);
 
-        if (!offset_expected)
-                wb_process_queue (process_frame, file, 1);
+        LOCK (&wb_inode->lock);
+        {
+                ret = __wb_extent_write (wb_inode, fd, vector, count, offset,
+                                         frame->root->req_refs);
+                if (ret == 0) {
+                        if (list_empty (&wb_inode->waiters)
+                            && (wb_inode->dirty + wb_inode->inflight
+                                <= conf->window_size))
+                                unwind = 1;
+                        else
+                                list_add_tail (&local->list,
+                                               &wb_inode->waiters);
+                }
+        }
+        UNLOCK (&wb_inode->lock);
+
+        if (ret == -1) {
+                gf_log (this->name, GF_LOG_ERROR, "out of memory");
+                STACK_UNWIND (frame, -1, ENOMEM, NULL);
+        } else if (unwind) {
+                STACK_UNWIND (frame, size, 0, &buf);
+        }
 
-        wb_enqueue (file, frame, vector, count, offset);
-        wb_process_queue (process_frame, file, 0);
+        wb_process_queue (process_frame, wb_inode);
 
         STACK_DESTROY (process_frame->root);
 
@@ -1017,11 +1080,24 @@ wb_readv_cbk (call_frame_t *frame,
               int32_t count,
               struct stat *stbuf)
 {
-        wb_local_t *local = NULL;
+        STACK_UNWIND (frame, op_ret, op_errno, vector, count, stbuf);
+        return 0;
+}
 
-        local = frame->local;
 
-        STACK_UNWIND (frame, op_ret, op_errno, vector, count, stbuf);
+int32_t
+wb_readv_helper (call_frame_t *frame,
+                 xlator_t *this,
+                 fd_t *fd,
+                 size_t size,
+                 off_t offset)
+{
+        STACK_WIND (frame,
+                    wb_readv_cbk,
+                    FIRST_CHILD(this),
+                    FIRST_CHILD(this)->fops->readv,
+                    fd, size, offset);
+
         return 0;
 }
 
@@ -1033,8 +1109,13 @@ wb_readv (call_frame_t *frame,
           size_t size,
           off_t offset)
 {
-        wb_file_t *file = NULL;
-        wb_local_t *local = NULL;
+        wb_inode_t *wb_inode = NULL;
+        struct iovec *vector = NULL;
+        struct iobref *iobref = NULL;
+        struct stat stbuf = {0, };
+        int32_t count = 0;
+        int32_t ret = 0;
+        char pending = 0;
 	uint64_t tmp_file = 0;
 
         if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -1043,25 +1124,77 @@ wb_readv (call_frame_t *frame,
                 return 0;
         }
 
-	file = (wb_file_t *)(long)tmp_file;
-        if (file)
-                wb_sync_all (frame, file);
+        wb_inode = wb_inode_get (this, fd->inode);
+        if (wb_inode) {
+                LOCK (&wb_inode->lock);
+                {
+                        pending = __wb_pending (wb_inode, offset, size);
+                        if (wb_inode->dirty)
+                                ret = __wb_extent_read (wb_inode, offset,
+                                                        size, &vector,
+                                                        &count, &iobref);
+                        stbuf = wb_inode->stbuf;
+                }
+                UNLOCK (&wb_inode->lock);
+        }
 
-        local = CALLOC (1, sizeof (*local));
-        local->file = file;
+        if (ret == 1) {
+                /* all of it is yet to be written, answer from there */
+                if (stbuf.st_size < offset + size)
+                        stbuf.st_size = offset + size;
 
-        frame->local = local;
+                frame->root->rsp_refs = iobref;
+                STACK_UNWIND (frame, size, 0, vector, count, &stbuf);
 
-        STACK_WIND (frame,
-                    wb_readv_cbk,
-                    FIRST_CHILD(this),
-                    FIRST_CHILD(this)->fops->readv,
-                    fd, size, offset);
+                iobref_unref (iobref);
+                FREE (vector);
+                return 0;
+        }
+
+        if (ret == -1) {
+                gf_log (this->name, GF_LOG_ERROR, "out of memory");
+                STACK_UNWIND (frame, -1, ENOMEM, NULL);
+                return 0;
+        }
+
+        if (pending) {
+                if (wb_barrier (frame, wb_inode,
+                                fop_readv_stub (frame, wb_readv_helper,
+                                                fd, size, offset),
+                                offset, size) == -1)
+                        STACK_UNWIND (frame, -1, ENOMEM, NULL);
+                return 0;
+        }
+
+        wb_readv_helper (frame, this, fd, size, offset);
 
         return 0;
 }
 
 
+/*
+ * wb_get_error - the error of a write behind since the last flush or
+ * fsync of the inode, if any
+ */
+static void
+wb_get_error (wb_inode_t *wb_inode, int32_t *op_ret, int32_t *op_errno)
+{
+        if (!wb_inode)
+                return;
+
+        LOCK (&wb_inode->lock);
+        {
+                if (wb_inode->op_ret == -1) {
+                        *op_ret = wb_inode->op_ret;
+                        *op_errno = wb_inode->op_errno;
+
+                        wb_inode->op_ret = 0;
+                }
+        }
+        UNLOCK (&wb_inode->lock);
+}
+
+
 int32_t
 wb_ffr_bg_cbk (call_frame_t *frame,
                void *cookie,
@@ -1069,24 +1202,6 @@ wb_ffr_bg_cbk (call_frame_t *frame,
                int32_t op_ret,
                int32_t op_errno)
 {
-        wb_local_t *local = NULL;
-        wb_file_t *file = NULL;
-
-        local = frame->local;
-        file = local->file;
-
-        if (file) {
-                fd_unref (file->fd);
-        }
-
-        if (file->op_ret == -1)
-        {
-                op_ret = file->op_ret;
-                op_errno = file->op_errno;
-
-                file->op_ret = 0;
-        }
-  
         STACK_DESTROY (frame->root);
         return 0;
 }
@@ -1099,29 +1214,46 @@ wb_ffr_cbk (call_frame_t *frame,
             int32_t op_ret,
             int32_t op_errno)
 {
-        wb_local_t *local = NULL;
-        wb_file_t *file = NULL;
-
-        local = frame->local;
-        file = local->file;
-        if (file) {
-                /* corresponds to the fd_ref() done during wb_file_create() */
-                fd_unref (file->fd);
-        }
+        wb_inode_t *wb_inode = NULL;
 
-        if (file->op_ret == -1)
-        {
-                op_ret = file->op_ret;
-                op_errno = file->op_errno;
+        wb_inode = frame->local;
+        frame->local = NULL;
 
-                file->op_ret = 0;
-        }
+        wb_get_error (wb_inode, &op_ret, &op_errno);
 
         STACK_UNWIND (frame, op_ret, op_errno);
         return 0;
 }
 
 
+int32_t
+wb_flush_bg_helper (call_frame_t *frame,
+                    xlator_t *this,
+                    fd_t *fd)
+{
+        STACK_WIND (frame,
+                    wb_ffr_bg_cbk,
+                    FIRST_CHILD(this),
+                    FIRST_CHILD(this)->fops->flush,
+                    fd);
+        return 0;
+}
+
+
+int32_t
+wb_flush_helper (call_frame_t *frame,
+                 xlator_t *this,
+                 fd_t *fd)
+{
+        STACK_WIND (frame,
+                    wb_ffr_cbk,
+                    FIRST_CHILD(this),
+                    FIRST_CHILD(this)->fops->flush,
+                    fd);
+        return 0;
+}
+
+
 int32_t
 wb_flush (call_frame_t *frame,
           xlator_t *this,
@@ -1129,8 +1261,10 @@ wb_flush (call_frame_t *frame,
 {
         wb_conf_t *conf = NULL;
         wb_file_t *file = NULL;
+        wb_inode_t *wb_inode = NULL;
         call_frame_t *flush_frame = NULL;
-        wb_local_t *local = NULL;
+        int32_t op_ret = 0;
+        int32_t op_errno = 0;
 	uint64_t tmp_file = 0;
 
         conf = this->private;
@@ -1142,42 +1276,42 @@ wb_flush (call_frame_t *frame,
         }
 
 	file = (wb_file_t *)(long)tmp_file;
+        wb_inode = wb_inode_get (this, fd->inode);
 
-        local = CALLOC (1, sizeof (*local));
-        local->file = file;
-        if (file)
-                fd_ref (file->fd);
+        if (conf->flush_behind &&
+	    (!file->disabled) && (file->disable_till == 0)) {
+                flush_frame = copy_frame (frame);
+                wb_get_error (wb_inode, &op_ret, &op_errno);
+                STACK_UNWIND (frame, op_ret, op_errno); // liar! liar! :O
+
+                if (wb_pending (wb_inode, 0, 0)) {
+                        if (wb_barrier (flush_frame, wb_inode,
+                                        fop_flush_stub (flush_frame,
+                                                        wb_flush_bg_helper,
+                                                        fd),
+                                        0, 0) == -1)
+                                STACK_DESTROY (flush_frame->root);
+                        return 0;
+                }
 
-        if (&file->request != file->request.next) {
-                gf_log (this->name, GF_LOG_DEBUG,
-                        "request queue is not empty, it has to be synced");
+                wb_flush_bg_helper (flush_frame, this, fd);
+                return 0;
         }
 
-        if (conf->flush_behind && 
-	    (!file->disabled) && (file->disable_till == 0)) {
-                flush_frame = copy_frame (frame);     
-                STACK_UNWIND (frame, file->op_ret, 
-			      file->op_errno); // liar! liar! :O
-
-                flush_frame->local = local;
-                wb_sync_all (flush_frame, file);
-
-                STACK_WIND (flush_frame,
-                            wb_ffr_bg_cbk,
-                            FIRST_CHILD(this),
-                            FIRST_CHILD(this)->fops->flush,
-                            fd);
-        } else {
-                wb_sync_all (frame, file);
-
-                frame->local = local;
-                STACK_WIND (frame,
-                            wb_ffr_cbk,
-                            FIRST_CHILD(this),
-                            FIRST_CHILD(this)->fops->flush,
-                            fd);
+        frame->local = wb_inode;
+
+        if (wb_pending (wb_inode, 0, 0)) {
+                if (wb_barrier (frame, wb_inode,
+                                fop_flush_stub (frame, wb_flush_helper, fd),
+                                0, 0) == -1) {
+                        frame->local = NULL;
+                        STACK_UNWIND (frame, -1, ENOMEM);
+                }
+                return 0;
         }
 
+        wb_flush_helper (frame, this, fd);
+
         return 0;
 }
 
@@ -1189,32 +1323,40 @@ wb_fsync_cbk (call_frame_t *frame,
               int32_t op_ret,
               int32_t op_errno)
 {
-        wb_local_t *local = NULL;
-        wb_file_t *file = NULL;
+        wb_inode_t *wb_inode = NULL;
 
-        local = frame->local;
-        file = local->file;
+        wb_inode = frame->local;
+        frame->local = NULL;
 
-        if (file->op_ret == -1)
-        {
-                op_ret = file->op_ret;
-                op_errno = file->op_errno;
-
-                file->op_ret = 0;
-        }
+        wb_get_error (wb_inode, &op_ret, &op_errno);
 
         STACK_UNWIND (frame, op_ret, op_errno);
         return 0;
 }
 
+
+int32_t
+wb_fsync_helper (call_frame_t *frame,
+                 xlator_t *this,
+                 fd_t *fd,
+                 int32_t datasync)
+{
+        STACK_WIND (frame,
+                    wb_fsync_cbk,
+                    FIRST_CHILD(this),
+                    FIRST_CHILD(this)->fops->fsync,
+                    fd, datasync);
+        return 0;
+}
+
+
 int32_t
 wb_fsync (call_frame_t *frame,
           xlator_t *this,
           fd_t *fd,
           int32_t datasync)
 {
-        wb_file_t *file = NULL;
-        wb_local_t *local = NULL;
+        wb_inode_t *wb_inode = NULL;
 	uint64_t tmp_file = 0;
 
         if (fd_ctx_get (fd, this, &tmp_file)) {
@@ -1223,20 +1365,23 @@ wb_fsync (call_frame_t *frame,
                 return 0;
         }
 
-	file = (wb_file_t *)(long)tmp_file;
-        if (file)
-                wb_sync_all (frame, file);
-
-        local = CALLOC (1, sizeof (*local));
-        local->file = file;
-
-        frame->local = local;
+        /* the writes behind have to be on the child, and replied to,
+           before it is asked to sync them */
+        wb_inode = wb_inode_get (this, fd->inode);
+        frame->local = wb_inode;
+
+        if (wb_pending (wb_inode, 0, 0)) {
+                if (wb_barrier (frame, wb_inode,
+                                fop_fsync_stub (frame, wb_fsync_helper,
+                                                fd, datasync),
+                                0, 0) == -1) {
+                        frame->local = NULL;
+                        STACK_UNWIND (frame, -1, ENOMEM);
+                }
+                return 0;
+        }
 
-        STACK_WIND (frame,
-                    wb_fsync_cbk,
-                    FIRST_CHILD(this),
-                    FIRST_CHILD(this)->fops->fsync,
-                    fd, datasync);
+        wb_fsync_helper (frame, this, fd, datasync);
         return 0;
 }
 
@@ -1248,13 +1393,28 @@ wb_release (xlator_t *this,
         uint64_t file = 0;
 
 	fd_ctx_get (fd, this, &file);
-  	wb_file_destroy ((wb_file_t *)(long)file);
+        if (file)
+                wb_file_destroy ((wb_file_t *)(long)file);
+
+        return 0;
+}
+
+
+int32_t
+wb_forget (xlator_t *this,
+           inode_t *inode)
+{
+        uint64_t wb_inode = 0;
+
+        inode_ctx_del (inode, this, &wb_inode);
+        if (wb_inode)
+                wb_inode_destroy ((wb_inode_t *)(long)wb_inode);
 
         return 0;
 }
 
 
-int32_t 
+int32_t
 init (xlator_t *this)
 {
         dict_t *options = NULL;
@@ -1297,7 +1457,7 @@ init (xlator_t *this)
         }
 
         /* configure 'options aggregate-size <size>' */
-        conf->aggregate_size = 0;
+        conf->aggregate_size = WB_AGGREGATE_SIZE;
         ret = dict_get_str (options, "block-size", 
                             &aggregate_size_string);
         if (ret == 0) {
@@ -1349,11 +1509,12 @@ init (xlator_t *this)
                 }
         }
 
-        if (!conf->window_size && conf->aggregate_size) {
-                gf_log (this->name, GF_LOG_WARNING,
-                        "setting window-size to be equal to aggregate-size(%"PRIu64")",
-                        conf->aggregate_size);
-                conf->window_size = conf->aggregate_size;
+        if (!conf->window_size) {
+                conf->window_size = max (WB_WINDOW_SIZE,
+                                         conf->aggregate_size);
+                gf_log (this->name, GF_LOG_DEBUG,
+                        "using window-size = %"PRIu64"",
+                        conf->window_size);
         }
 
         if (conf->window_size < conf->aggregate_size) {
@@ -1415,6 +1576,7 @@ struct xlator_mops mops = {
 };
 
 struct xlator_cbks cbks = {
+        .forget   = wb_forget,
         .release  = wb_release
 };
 
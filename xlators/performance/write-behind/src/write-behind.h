@@ -0,0 +1,172 @@
+/*
+  Copyright (c) 2006, 2007, 2008, 2009 Z RESEARCH, Inc. <http://www.zresearch.com>
+  This file is part of GlusterFS.
+
+  GlusterFS is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  GlusterFS is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __WRITE_BEHIND_H
+#define __WRITE_BEHIND_H
+
+#ifndef _CONFIG_H
+#define _CONFIG_H
+#include "config.h"
+#endif
+
+#include "glusterfs.h"
+#include "logging.h"
+#include "dict.h"
+#include "xlator.h"
+#include "list.h"
+#include "compat.h"
+#include "compat-errno.h"
+#include "common-utils.h"
+#include "call-stub.h"
+#include "iobuf.h"
+
+#define MAX_VECTOR_COUNT   8                   /* iovecs in one writev */
+#define WB_AGGREGATE_SIZE  (128 * GF_UNIT_KB)
+#define WB_WINDOW_SIZE     (1 * GF_UNIT_MB)
+#define WB_OFFSET_MAX      ((off_t) (~0ULL >> 1))
+
+typedef struct list_head list_head_t;
+struct wb_conf;
+struct wb_inode;
+
+
+struct wb_conf {
+        uint64_t aggregate_size;
+        uint64_t window_size;
+        uint64_t disable_till;
+        gf_boolean_t enable_O_SYNC;
+        gf_boolean_t flush_behind;
+};
+
+
+/*
+ * wb_extent - data written to an inode and not yet wound to the child.
+ * the extents of an inode never overlap, a write replaces what it
+ * covers of them. they are kept both in a list and in a tree (a treap)
+ * sorted by offset.
+ */
+typedef struct wb_extent {
+        list_head_t        list;       /* wb_inode->extents or
+                                          wb_sync->extents */
+        struct wb_extent  *left;
+        struct wb_extent  *right;
+        uint32_t           priority;
+        off_t              offset;
+        struct iovec       vector;
+        size_t             spare;      /* bytes of our own buffer after
+                                          vector, for writes to append */
+        struct iobref     *iobref;
+        fd_t              *fd;         /* fd it was written through */
+        uint64_t           gen;        /* oldest write it holds data of */
+} wb_extent_t;
+
+
+/*
+ * wb_sync - a writev of a run of adjacent extents, in flight
+ */
+typedef struct wb_sync {
+        list_head_t        list;       /* wb_inode->syncs */
+        list_head_t        winds;
+        list_head_t        extents;
+        struct wb_inode   *inode;
+        fd_t              *fd;
+        off_t              offset;
+        size_t             size;
+        uint64_t           gen;
+} wb_sync_t;
+
+
+/*
+ * wb_barrier - an fop held back until the writes taken before it that
+ * overlap [offset, end) have been replied to by the child
+ */
+typedef struct wb_barrier {
+        list_head_t        list;
+        off_t              offset;
+        off_t              end;
+        uint64_t           gen;
+        call_stub_t       *stub;
+} wb_barrier_t;
+
+
+/*
+ * wb_inode - the write-behind state of an inode, shared by all its fds
+ */
+typedef struct wb_inode {
+        gf_lock_t          lock;
+        list_head_t        extents;    /* dirty, by offset */
+        wb_extent_t       *root;
+        uint32_t           seed;
+        uint64_t           gen;        /* writes taken so far */
+        size_t             dirty;      /* bytes in extents */
+        size_t             inflight;   /* bytes in syncs */
+        list_head_t        syncs;
+        list_head_t        waiters;    /* writes held back by the window */
+        list_head_t        barriers;
+        struct stat        stbuf;      /* from the last writev reply */
+        int32_t            op_ret;     /* of a write behind, reported by
+                                          the next flush or fsync */
+        int32_t            op_errno;
+        xlator_t          *this;
+} wb_inode_t;
+
+
+typedef struct wb_file {
+        int                disabled;
+        uint64_t           disable_till;
+        gf_lock_t          lock;
+} wb_file_t;
+
+
+typedef struct wb_local {
+        list_head_t        list;       /* wb_inode->waiters */
+        call_frame_t      *frame;
+        size_t             size;
+} wb_local_t;
+
+
+typedef struct wb_conf wb_conf_t;
+
+
+wb_extent_t *
+__wb_extent_floor (wb_inode_t *wb_inode, off_t offset);
+
+void
+__wb_extent_remove (wb_inode_t *wb_inode, wb_extent_t *extent);
+
+void
+wb_extent_destroy (wb_extent_t *extent);
+
+int32_t
+__wb_extent_write (wb_inode_t *wb_inode, fd_t *fd, struct iovec *vector,
+                   int32_t count, off_t offset, struct iobref *iobref);
+
+int32_t
+__wb_extent_read (wb_inode_t *wb_inode, off_t offset, size_t size,
+                  struct iovec **vector, int32_t *count,
+                  struct iobref **iobref);
+
+int32_t
+__wb_extent_run (wb_inode_t *wb_inode, wb_extent_t *first, size_t *size);
+
+int32_t
+__wb_extent_pending (wb_inode_t *wb_inode, off_t offset, off_t end,
+                     uint64_t gen);
+
+#endif /* __WRITE_BEHIND_H */
@@ -33,6 +33,7 @@
 #include "xlator.h"
 #include "logging.h"
 #include "timer.h"
+#include "event.h"
 #include "defaults.h"
 #include "compat.h"
 #include "compat-errno.h"
@@ -48,13 +49,13 @@
 int protocol_client_cleanup (transport_t *trans);
 int protocol_client_interpret (xlator_t *this, transport_t *trans,
                                char *hdr_p, size_t hdrlen,
-                               char *buf_p, size_t buflen);
+                               struct iobuf *iobuf, size_t buflen);
 int
 protocol_client_xfer (call_frame_t *frame, xlator_t *this, transport_t *trans,
                       int type, int op,
                       gf_hdr_common_t *hdr, size_t hdrlen,
                       struct iovec *vector, int count,
-                      dict_t *refs);
+                      struct iobref *iobref);
 
 static gf_op_t gf_fops[];
 static gf_op_t gf_mops[];
@@ -255,14 +256,19 @@ call_bail (void *data)
 {
 	client_connection_t *conn = NULL;
 	struct timeval       current;
+	struct timeval       expire_before = {0, };
 	int32_t              bail_out = 0;
 	transport_t         *trans = NULL;
+	struct list_head     expired;
+	int                  expired_count = 0;
 
 	GF_VALIDATE_OR_GOTO("client", data, out);
 	trans = data;
 
 	conn = trans->xl_private;
 
+	INIT_LIST_HEAD (&expired);
+
 	gettimeofday (&current, NULL);
 	pthread_mutex_lock (&conn->lock);
 	{
@@ -313,6 +319,19 @@ call_bail (void *data)
 				last_sent, last_received,
 				conn->transport_timeout);
 		}
+
+		/* the connection is alive, but individual requests may
+		   still have gone unanswered for too long */
+		if (!bail_out && (conn->saved_frames->count > 0)) {
+			expire_before.tv_sec  = current.tv_sec 
+				- conn->frame_timeout;
+			expire_before.tv_usec = current.tv_usec;
+
+			expired_count = 
+				saved_frames_expire (conn->saved_frames,
+						     &expire_before,
+						     &expired);
+		}
 	}
 
 	if (bail_out) {
@@ -321,6 +340,15 @@ call_bail (void *data)
 
 	pthread_mutex_unlock (&conn->lock);
 
+	if (expired_count) {
+		gf_log (trans->xl->name, GF_LOG_ERROR,
+			"%d frame(s) pending for more than %d seconds "
+			"(frame-timeout), unwinding them", 
+			expired_count, conn->frame_timeout);
+		saved_frames_unwind_expired (trans->xl, &expired,
+					     gf_fops, gf_mops, gf_cbks);
+	}
+
 	if (bail_out) {
 		gf_log (trans->xl->name, GF_LOG_CRITICAL,
 			"bailing transport");
@@ -550,7 +578,7 @@ protocol_client_xfer (call_frame_t *frame, xlator_t *this, transport_t *trans,
                       int type, int op,
                       gf_hdr_common_t *hdr, size_t hdrlen,
                       struct iovec *vector, int count,
-                      dict_t *refs)
+                      struct iobref *iobref)
 {
 	client_conf_t        *conf = NULL;
 	client_connection_t  *conn = NULL;
@@ -615,7 +643,7 @@ protocol_client_xfer (call_frame_t *frame, xlator_t *this, transport_t *trans,
 		    ((type == GF_OP_TYPE_MOP_REQUEST) &&
 		     (op == GF_MOP_SETVOLUME))) {
 			ret = transport_submit (trans, (char *)hdr, hdrlen,
-						vector, count, refs);
+						vector, count, iobref);
 		}
 		
 		if ((ret >= 0) && frame) {
@@ -2604,6 +2632,78 @@ unwind:
 }
 
 
+/**
+ * client_readdirp - readdirp function for client protocol
+ * @frame: call frame
+ * @this: this translator structure
+ *
+ * external reference through client_protocol_xlator->fops->readdirp
+ */
+
+int32_t
+client_readdirp (call_frame_t *frame,
+		 xlator_t *this,
+		 fd_t *fd,
+		 size_t size,
+		 off_t offset)
+{
+	gf_hdr_common_t *hdr = NULL;
+	gf_fop_readdirp_req_t *req = NULL;
+	size_t hdrlen = 0;
+	int64_t remote_fd = -1;
+	int ret = -1;
+	client_conf_t *conf = this->private;
+
+	if (conf->child) {
+		/* */
+		STACK_WIND (frame,
+			    default_readdirp_cbk,
+			    conf->child,
+			    conf->child->fops->readdirp,
+			    fd, size, offset);
+
+		return 0;
+	}
+
+	if (!conf->readdirp) {
+		/* entries come back through client_readdir_cbk
+		   without attributes (st_ino 0) */
+		return client_readdir (frame, this, fd, size, offset);
+	}
+
+	ret = this_fd_get (fd, this, &remote_fd);
+	if (ret == -1) {
+		gf_log (this->name, GF_LOG_DEBUG,
+			"(%"PRId64"): failed to get remote fd. returning EBADFD",
+			fd->inode->ino);
+		goto unwind;
+	}
+
+	hdrlen = gf_hdr_len (req, 0);
+	hdr    = gf_hdr_new (req, 0);
+	GF_VALIDATE_OR_GOTO(this->name, hdr, unwind);
+
+	req    = gf_param (hdr);
+
+	req->ino    = hton64 (fd->inode->ino);
+	req->fd     = hton64 (remote_fd);
+	req->size   = hton32 (size);
+	req->offset = hton64 (offset);
+
+	ret = protocol_client_xfer (frame, this,
+				    CLIENT_CHANNEL (this, CHANNEL_LOWLAT),
+				    GF_OP_TYPE_FOP_REQUEST, GF_FOP_READDIRP,
+				    hdr, hdrlen, NULL, 0, NULL);
+
+	return 0;
+unwind:
+	if (hdr)
+		free (hdr);
+	STACK_UNWIND (frame, -1, EBADFD, NULL);
+	return 0;
+}
+
+
 
 /**
  * client_fsyncdir - fsyncdir function for client protocol
@@ -3551,8 +3651,8 @@ client_setdents (call_frame_t *frame,
 	int64_t remote_fd = 0;
 	char   *buffer = NULL;
 	char *ptr = NULL;
-	data_t *buf_data = NULL;
-	dict_t *reply_dict = NULL;
+	struct iobuf  *iobuf = NULL;
+	struct iobref *iobref = NULL;
 	dir_entry_t *trav = NULL;
 	uint32_t len = 0;
 	int32_t  buf_len = 0;
@@ -3601,8 +3701,11 @@ client_setdents (call_frame_t *frame,
 		len += 256; // max possible for statbuf;
 		trav = trav->next;
 	}
-	buffer = CALLOC (1, len);
-	GF_VALIDATE_OR_GOTO (this->name, buffer, unwind);
+	iobuf = iobuf_get2 (this->ctx->iobuf_pool, len);
+	GF_VALIDATE_OR_GOTO (this->name, iobuf, unwind);
+
+	buffer = iobuf_ptr (iobuf);
+	buffer[0] = '\0';
 
 	ptr = buffer;
 
@@ -3673,15 +3776,10 @@ client_setdents (call_frame_t *frame,
 	req->count = hton32 (count);
 
 	{
-		buf_data = get_new_data ();
-		GF_VALIDATE_OR_GOTO (this->name, buf_data, unwind);
-		reply_dict = get_new_dict();
-		GF_VALIDATE_OR_GOTO (this->name, reply_dict, unwind);
-
-		buf_data->data = buffer;
-		buf_data->len = buf_len;
-		dict_set (reply_dict, NULL, buf_data);
-		frame->root->rsp_refs = dict_ref (reply_dict);
+		iobref = iobref_new ();
+		GF_VALIDATE_OR_GOTO (this->name, iobref, unwind);
+
+		iobref_add (iobref, iobuf);
 		vector[0].iov_base = buffer;
 		vector[0].iov_len = buf_len;
 		vec_count = 1;
@@ -3690,11 +3788,16 @@ client_setdents (call_frame_t *frame,
 	ret = protocol_client_xfer (frame, this,
 				    CLIENT_CHANNEL (this, CHANNEL_BULK),
 				    GF_OP_TYPE_FOP_REQUEST, GF_FOP_SETDENTS,
-				    hdr, hdrlen, vector, vec_count, 
-				    frame->root->rsp_refs);
+				    hdr, hdrlen, vector, vec_count, iobref);
+
+	iobref_unref (iobref);
+	iobuf_unref (iobuf);
 
 	return ret;
 unwind:
+	if (iobuf)
+		iobuf_unref (iobuf);
+
 	STACK_UNWIND (frame, op_ret, op_errno);
 	return 0;
 }
@@ -4622,7 +4725,6 @@ client_readv_cbk (call_frame_t *frame,
 	int32_t op_errno = 0;
 	struct iovec vector = {0, };
 	struct stat stbuf = {0, };
-	dict_t *refs = NULL;
 
 	rsp = gf_param (hdr);
 
@@ -4634,16 +4736,12 @@ client_readv_cbk (call_frame_t *frame,
 		vector.iov_base = buf;
 		vector.iov_len  = buflen;
 
-		refs = get_new_dict ();
-		dict_set (refs, NULL, data_from_dynptr (buf, 0));
-		frame->root->rsp_refs = dict_ref (refs);
+		/* buf lives in the iobuf set as rsp_refs by
+		   protocol_client_interpret */
 	}
 
 	STACK_UNWIND (frame, op_ret, op_errno, &vector, 1, &stbuf);
 
-	if (refs)
-		dict_unref (refs);
-
 	return 0;
 }
 
@@ -4708,6 +4806,36 @@ client_readdir_cbk (call_frame_t *frame,
 	return 0;
 }
 
+
+int32_t
+client_readdirp_cbk (call_frame_t *frame,
+		     gf_hdr_common_t *hdr, size_t hdrlen,
+		     char *buf, size_t buflen)
+{
+	gf_fop_readdirp_rsp_t *rsp = NULL;
+	int32_t op_ret = 0;
+	int32_t op_errno = 0;
+	uint32_t buf_size = 0;
+	gf_dirent_t entries;
+
+	rsp = gf_param (hdr);
+
+	op_ret    = ntoh32 (hdr->rsp.op_ret);
+	op_errno  = gf_error_to_errno (ntoh32 (hdr->rsp.op_errno));
+
+	INIT_LIST_HEAD (&entries.list);
+	if (op_ret > 0) {
+		buf_size = ntoh32 (rsp->size);
+		gf_direntp_unserialize (&entries, rsp->buf, buf_size);
+	}
+
+	STACK_UNWIND (frame, op_ret, op_errno, &entries);
+
+	gf_dirent_free (&entries);
+
+	return 0;
+}
+
 /*
  * client_fsync_cbk - fsync callback for client protocol
  *
@@ -5010,6 +5138,55 @@ client_access_cbk (call_frame_t *frame,
 
 
 
+/*
+ * client_dict_unserialize - unserialize the dict of a reply
+ * @frame: call frame
+ * @hdr: reply header
+ * @dict_buf: the dict in the header
+ * @dict_len: its length from the header
+ * @buf: reply payload
+ * @buflen: its length
+ * @dict: dict to fill in
+ *
+ * with GF_DICT_FORMAT_PAYLOAD the dict is the payload of the reply, which
+ * is used without copying, the dict holding a ref on it. otherwise it is
+ * copied out of the header, which the transport reuses.
+ *
+ * not for external reference
+ */
+static int32_t
+client_dict_unserialize (call_frame_t *frame, gf_hdr_common_t *hdr,
+			 char *dict_buf, int32_t dict_len,
+			 char *buf, size_t buflen, dict_t **dict)
+{
+	char    *dictbuf = NULL;
+	int32_t  ret = -1;
+
+	if (gf_hdr_format (ntoh32 (hdr->type)) == GF_DICT_FORMAT_PAYLOAD) {
+		if (!buf || (buflen < dict_len) || !frame->root->rsp_refs) {
+			gf_log (frame->this->name, GF_LOG_ERROR,
+				"reply dict of %"PRId32" bytes missing from "
+				"payload of %"GF_PRI_SIZET" bytes",
+				dict_len, buflen);
+			return -1;
+		}
+
+		(*dict)->extra_refs = iobref_ref (frame->root->rsp_refs);
+
+		return dict_unserialize (buf, dict_len, dict);
+	}
+
+	dictbuf = memdup (dict_buf, dict_len);
+	if (!dictbuf)
+		return -1;
+
+	(*dict)->extra_free = dictbuf;
+
+	ret = dict_unserialize (dictbuf, dict_len, dict);
+
+	return ret;
+}
+
 /*
  * client_lookup_cbk - lookup callback for client protocol
  *
@@ -5030,7 +5207,6 @@ client_lookup_cbk (call_frame_t *frame,
 	int32_t op_ret = 0;
 	int32_t op_errno = 0;
 	size_t dict_len = 0;
-	char *dictbuf = NULL;
 	int32_t ret = -1;
 	int32_t gf_errno = 0;
 	client_local_t *local = NULL;
@@ -5051,21 +5227,17 @@ client_lookup_cbk (call_frame_t *frame,
 		dict_len = ntoh32 (rsp->dict_len);
 
 		if (dict_len > 0) {
-			dictbuf = memdup (rsp->dict, dict_len);
-			GF_VALIDATE_OR_GOTO(frame->this->name, dictbuf, fail);
-			
 			xattr = dict_new();
 			GF_VALIDATE_OR_GOTO(frame->this->name, xattr, fail);
 
-			ret = dict_unserialize (dictbuf, dict_len, &xattr);
+			ret = client_dict_unserialize (frame, hdr, rsp->dict,
+						       dict_len, buf, buflen,
+						       &xattr);
 			if (ret < 0) {
 				gf_log (frame->this->name, GF_LOG_ERROR,
 					"%s (%"PRId64"): failed to unserialize dictionary",
 					local->loc.path, inode->ino);
 				goto fail;
-			} else {
-				xattr->extra_free = dictbuf;
-				dictbuf = NULL;
 			}
 		}
 		op_ret = 0;
@@ -5078,9 +5250,6 @@ fail:
 	
 	client_local_wipe (local);
 
-	if (dictbuf)
-		free (dictbuf);
-
 	if (xattr)
 		dict_unref (xattr);
 
@@ -5317,7 +5486,6 @@ client_getxattr_cbk (call_frame_t *frame,
 	int32_t dict_len = 0;
 	dict_t *dict = NULL;
 	int32_t ret = -1;
-	char *dictbuf = NULL;
 	client_local_t *local = NULL;
 	
 	local = frame->local;
@@ -5333,22 +5501,18 @@ client_getxattr_cbk (call_frame_t *frame,
 		dict_len = ntoh32 (rsp->dict_len);
 
 		if (dict_len > 0) {
-			dictbuf = memdup (rsp->dict, dict_len);
-			GF_VALIDATE_OR_GOTO(frame->this->name, dictbuf, fail);
-
 			dict = dict_new();
 			GF_VALIDATE_OR_GOTO(frame->this->name, dict, fail);
 
-			ret = dict_unserialize (dictbuf, dict_len, &dict);
+			ret = client_dict_unserialize (frame, hdr, rsp->dict,
+						       dict_len, buf, buflen,
+						       &dict);
 			if (ret < 0) {
 				gf_log (frame->this->name, GF_LOG_ERROR,
 					"%s (%"PRId64"): failed to "
 					"unserialize xattr dictionary", 
 					local->loc.path, local->loc.inode->ino);
 				goto fail;
-			} else {
-				dict->extra_free = dictbuf;
-				dictbuf = NULL;
 			}
 		}
 		op_ret = 0;
@@ -5360,9 +5524,6 @@ fail:
 	
 	client_local_wipe (local);
 
-	if (dictbuf)
-		free (dictbuf);
-
 	if (dict)
 		dict_unref (dict);
 
@@ -5783,6 +5944,7 @@ client_setvolume_cbk (call_frame_t *frame,
 	int32_t                 op_ret   = -1;
 	int32_t                 op_errno = EINVAL;
 	int32_t                 dict_len = 0;
+	int32_t                 readdirp = 0;
 
 
 	trans = frame->local; frame->local = NULL;
@@ -5826,6 +5988,11 @@ client_setvolume_cbk (call_frame_t *frame,
 			"failed to get 'process-uuid' from reply dictionary");
 	}
 
+	/* older servers do not know GF_FOP_READDIRP */
+	ret = dict_get_int32 (reply, "readdirp", &readdirp);
+	if (ret < 0)
+		readdirp = 0;
+
 	if (op_ret < 0) {
 		gf_log (trans->xl->name, GF_LOG_ERROR,
 			"SETVOLUME on remote-host failed: %s",
@@ -5849,6 +6016,8 @@ client_setvolume_cbk (call_frame_t *frame,
 			conf->child = xlator_search_by_name (this, 
 							     remote_subvol);
 		}
+		conf->readdirp = readdirp;
+
 		gf_log (trans->xl->name, GF_LOG_INFO,
 			"connection and handshake succeeded");
 
@@ -6091,6 +6260,7 @@ static gf_op_t gf_fops[] = {
 	[GF_FOP_CHECKSUM]       =  client_checksum_cbk,
 	[GF_FOP_XATTROP]        =  client_xattrop_cbk,
 	[GF_FOP_FXATTROP]       =  client_fxattrop_cbk,
+	[GF_FOP_READDIRP]       =  client_readdirp_cbk,
 };
 
 static gf_op_t gf_mops[] = {
@@ -6117,10 +6287,12 @@ static gf_op_t gf_cbks[] = {
 int
 protocol_client_interpret (xlator_t *this, transport_t *trans,
                            char *hdr_p, size_t hdrlen,
-                           char *buf_p, size_t buflen)
+                           struct iobuf *iobuf, size_t buflen)
 {
 	int ret = -1;
 	call_frame_t *frame = NULL;
+	struct iobref *iobref = NULL;
+	char *buf_p = NULL;
 	gf_hdr_common_t *hdr = NULL;
 	uint64_t callid = 0;
 	int type = -1;
@@ -6129,7 +6301,8 @@ protocol_client_interpret (xlator_t *this, transport_t *trans,
 
 	hdr  = (gf_hdr_common_t *)hdr_p;
 
-	type   = ntoh32 (hdr->type);
+	/* the format bits are for the callbacks to look at */
+	type   = gf_hdr_type (ntoh32 (hdr->type));
 	op     = ntoh32 (hdr->op);
 	callid = ntoh64 (hdr->callid);
 
@@ -6141,6 +6314,18 @@ protocol_client_interpret (xlator_t *this, transport_t *trans,
 		return 0;
 	}
 
+	/* the reply payload is passed up without copying. the frame
+	   may be gone once the reply is handled, so the ref is held
+	   here and not on the frame */
+	if (iobuf) {
+		iobref = iobref_new ();
+		if (iobref) {
+			iobref_add (iobref, iobuf);
+			frame->root->rsp_refs = iobref;
+		}
+		buf_p = iobuf_ptr (iobuf);
+	}
+
 	switch (type) {
 	case GF_OP_TYPE_FOP_REPLY:
 		if ((op > GF_FOP_MAXVALUE) || 
@@ -6175,6 +6360,9 @@ protocol_client_interpret (xlator_t *this, transport_t *trans,
 		break;
 	}
 
+	if (iobref)
+		iobref_unref (iobref);
+
 	return ret;
 }
 
@@ -6190,7 +6378,9 @@ init (xlator_t *this)
 	client_conf_t             *conf = NULL;
 	client_connection_t       *conn = NULL;
 	int32_t                    transport_timeout = 0;
+	int32_t                    frame_timeout = 0;
 	int32_t                    ping_timeout = 0;
+	int32_t                    event_threads = 0;
 	data_t                    *remote_subvolume = NULL;
 	int32_t                    ret = -1;
 	int                        i = 0;
@@ -6225,6 +6415,17 @@ init (xlator_t *this)
 		transport_timeout = 42;
 	}
 	
+	ret = dict_get_int32 (this->options, "frame-timeout", 
+			      &frame_timeout);
+	if (ret >= 0) {
+		gf_log (this->name, GF_LOG_DEBUG,
+			"setting frame-timeout to %d", frame_timeout);
+	} else {
+		gf_log (this->name, GF_LOG_DEBUG,
+			"defaulting frame-timeout to 1800");
+		frame_timeout = 1800;
+	}
+
 	ret = dict_get_int32 (this->options, "ping-timeout", 
 			      &ping_timeout);
 	if (ret >= 0) {
@@ -6235,6 +6436,15 @@ init (xlator_t *this)
 			"defaulting ping-timeout to 10");
 		ping_timeout = 10;
 	}
+
+	ret = dict_get_int32 (this->options, "event-threads",
+			      &event_threads);
+	if (ret == 0) {
+		gf_log (this->name, GF_LOG_DEBUG,
+			"setting event-threads to %d", event_threads);
+		event_pool_set_thread_count (this->ctx->event_pool,
+					     event_threads);
+	}
 	
 	conf = CALLOC (1, sizeof (client_conf_t));
 
@@ -6264,6 +6474,7 @@ init (xlator_t *this)
 			sizeof (conn->last_received));
 
 		conn->transport_timeout = transport_timeout;
+		conn->frame_timeout = frame_timeout;
 		conn->ping_timeout = ping_timeout;
 
 		pthread_mutex_init (&conn->lock, NULL);
@@ -6357,6 +6568,13 @@ protocol_client_handshake (xlator_t *this, transport_t *trans)
 			PACKAGE_VERSION);
 	}
 
+	/* lets the server send reply dicts as payload */
+	ret = dict_set_int32 (options, "dict-format", GF_DICT_FORMAT_MAX);
+	if (ret < 0) {
+		gf_log (this->name, GF_LOG_ERROR,
+			"failed to set dict-format in options dictionary");
+	}
+
 	dict_len = dict_serialized_length (options);
 	if (dict_len < 0) {
 		gf_log (this->name, GF_LOG_ERROR,
@@ -6418,7 +6636,7 @@ protocol_client_pollin (xlator_t *this, transport_t *trans)
 {
 	client_connection_t *conn = NULL;
 	int ret = -1;
-	char *buf = NULL;
+	struct iobuf *iobuf = NULL;
 	size_t buflen = 0;
 	char *hdr = NULL;
 	size_t hdrlen = 0;
@@ -6433,16 +6651,18 @@ protocol_client_pollin (xlator_t *this, transport_t *trans)
 	}
 	pthread_mutex_unlock (&conn->lock);
 
-	ret = transport_receive (trans, &hdr, &hdrlen, &buf, &buflen);
+	ret = transport_receive (trans, &hdr, &hdrlen, &iobuf, &buflen);
 
 	if (ret == 0)
 	{
 		ret = protocol_client_interpret (this, trans, hdr, hdrlen,
-						 buf, buflen);
+						 iobuf, buflen);
 	}
 
-	/* TODO: use mem-pool */
-	FREE (hdr);
+	/* hdr belongs to the transport */
+
+	if (iobuf)
+		iobuf_unref (iobuf);
 
 	return ret;
 }
@@ -6607,6 +6827,7 @@ struct xlator_fops fops = {
 	.removexattr = client_removexattr,
 	.opendir     = client_opendir,
 	.readdir     = client_readdir,
+	.readdirp    = client_readdirp,
 	.fsyncdir    = client_fsyncdir,
 	.access      = client_access,
 	.ftruncate   = client_ftruncate,
@@ -6662,10 +6883,20 @@ struct volume_options options[] = {
 	  .min   = 5, 
 	  .max   = 1013, 
 	}, 
+	{ .key   = {"frame-timeout"},
+	  .type  = GF_OPTION_TYPE_TIME,
+	  .min   = 5,
+	  .max   = 86400,
+	},
 	{ .key   = {"ping-timeout"},
 	  .type  = GF_OPTION_TYPE_TIME,
 	  .min   = 5,
 	  .max   = 1013,
 	},
+	{ .key   = {"event-threads"},
+	  .type  = GF_OPTION_TYPE_INT,
+	  .min   = 1,
+	  .max   = 64,
+	},
 	{ .key   = {NULL} },
 };
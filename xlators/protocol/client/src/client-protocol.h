@@ -78,6 +78,7 @@ struct _client_conf {
 		gf_lock_t lock;
 	} forget;
 	dict_t              *saved_fds;
+	int32_t              readdirp; /* server takes GF_FOP_READDIRP */
 	pthread_mutex_t      mutex;
 };
 typedef struct _client_conf client_conf_t;
@@ -88,6 +89,7 @@ struct client_connection {
 	uint64_t             callid;
 	struct saved_frames *saved_frames;
 	int32_t              transport_timeout;
+	int32_t              frame_timeout;
 	int32_t              ping_started;
 	int32_t              ping_timeout;
 	gf_timer_t          *reconnect;
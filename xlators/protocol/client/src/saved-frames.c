@@ -22,13 +22,65 @@
 #include "common-utils.h"
 #include "protocol.h"
 #include "xlator.h"
+#include "mem-pool.h"
+#include "compat-errno.h"
 
 
+/* saved_frame entries are shared by all connections of the process.
+   puts happen in the threads issuing requests and gets in the poll
+   thread, the per-thread caches move them across in batches */
+#define SAVED_FRAME_POOL_COUNT    4096
+#define SAVED_FRAME_THREAD_CACHE  64
+
+static struct mem_pool *saved_frame_pool;
+static pthread_once_t   saved_frame_pool_once = PTHREAD_ONCE_INIT;
+
+
+static void
+saved_frame_pool_init (void)
+{
+	saved_frame_pool = mem_pool_new (struct saved_frame,
+					 SAVED_FRAME_POOL_COUNT);
+	if (saved_frame_pool)
+		mem_pool_thread_cache_init (saved_frame_pool,
+					    SAVED_FRAME_THREAD_CACHE);
+}
+
+
+static struct saved_frame *
+saved_frame_new (void)
+{
+	struct saved_frame *saved_frame = NULL;
+
+	if (saved_frame_pool)
+		saved_frame = mem_get (saved_frame_pool);
+	else
+		saved_frame = MALLOC (sizeof (*saved_frame));
+
+	if (saved_frame)
+		memset (saved_frame, 0, sizeof (*saved_frame));
+
+	return saved_frame;
+}
+
+
+static void
+saved_frame_destroy (struct saved_frame *saved_frame)
+{
+	if (saved_frame_pool)
+		mem_put (saved_frame_pool, saved_frame);
+	else
+		FREE (saved_frame);
+}
+
 
 struct saved_frames *
 saved_frames_new (void)
 {
 	struct saved_frames *saved_frames = NULL;
+	int                  i = 0;
+
+	pthread_once (&saved_frame_pool_once, saved_frame_pool_init);
 
 	saved_frames = CALLOC (sizeof (*saved_frames), 1);
 	if (!saved_frames) {
@@ -39,6 +91,9 @@ saved_frames_new (void)
 	INIT_LIST_HEAD (&saved_frames->mops.list);
 	INIT_LIST_HEAD (&saved_frames->cbks.list);
 
+	for (i = 0; i < SAVED_FRAMES_HASH_SIZE; i++)
+		INIT_LIST_HEAD (&saved_frames->hash[i]);
+
 	return saved_frames;
 }
 
@@ -67,6 +122,13 @@ get_head_frame_for_type (struct saved_frames *frames, int8_t type)
 }
 
 
+static inline struct list_head *
+saved_frames_bucket (struct saved_frames *frames, uint64_t callid)
+{
+	return &frames->hash[callid & (SAVED_FRAMES_HASH_SIZE - 1)];
+}
+
+
 int
 saved_frames_put (struct saved_frames *frames, call_frame_t *frame,
 		  int32_t op, int8_t type, int64_t callid)
@@ -76,20 +138,22 @@ saved_frames_put (struct saved_frames *frames, call_frame_t *frame,
 
 	head_frame = get_head_frame_for_type (frames, type);
 
-	saved_frame = CALLOC (sizeof (*saved_frame), 1);
+	saved_frame = saved_frame_new ();
 	if (!saved_frame) {
 		return -ENOMEM;
 	}
 
 	INIT_LIST_HEAD (&saved_frame->list);
+	INIT_LIST_HEAD (&saved_frame->hash);
 	saved_frame->frame  = frame;
 	saved_frame->op     = op;
 	saved_frame->type   = type;
 	saved_frame->callid = callid;
 
-//	gettimeofday (&saved_frame->saved_at, NULL);
+	gettimeofday (&saved_frame->saved_at, NULL);
 
-	list_add (&saved_frame->list, &head_frame->list);
+	list_add_tail (&saved_frame->list, &head_frame->list);
+	list_add (&saved_frame->hash, saved_frames_bucket (frames, callid));
 	frames->count++;
 
 	return 0;
@@ -104,65 +168,187 @@ saved_frames_get (struct saved_frames *frames, int32_t op,
 	struct saved_frame *tmp = NULL;
 	struct saved_frame *head_frame = NULL;
 	call_frame_t       *frame = NULL;
+	struct timeval      now = {0, };
+	uint64_t            latency = 0;
 
 	head_frame = get_head_frame_for_type (frames, type);
 
-	list_for_each_entry (tmp, &head_frame->list, list) {
-		if (tmp->callid == callid) {
+	list_for_each_entry (tmp, saved_frames_bucket (frames, callid), hash) {
+		if ((tmp->callid == callid) &&
+		    (get_head_frame_for_type (frames, tmp->type) 
+		     == head_frame)) {
 			list_del_init (&tmp->list);
+			list_del_init (&tmp->hash);
 			frames->count--;
 			saved_frame = tmp;
 			break;
 		}
 	}
 
-	if (saved_frame)
-		frame = saved_frame->frame;
+	if (!saved_frame)
+		return NULL;
+
+	frame = saved_frame->frame;
+
+	gettimeofday (&now, NULL);
+	latency = ((now.tv_sec - saved_frame->saved_at.tv_sec) * 1000000)
+		+ (now.tv_usec - saved_frame->saved_at.tv_usec);
+
+	frames->latency_count++;
+	frames->latency_total += latency;
+	if (latency > frames->latency_max)
+		frames->latency_max = latency;
 
-	FREE (saved_frame);
+	saved_frame_destroy (saved_frame);
 
 	return frame;
 }
 
 
-void
-saved_frames_unwind (xlator_t *this, struct saved_frames *saved_frames,
-		     struct saved_frame *head,
-		     gf_op_t gf_ops[], char *gf_op_list[])
+static int
+__saved_frames_expire_list (struct saved_frames *frames,
+			    struct saved_frame *head, struct timeval *before,
+			    struct list_head *expired)
 {
-	struct saved_frame   *trav = NULL;
-	struct saved_frame   *tmp = NULL;
+	struct saved_frame *trav = NULL;
+	struct saved_frame *tmp = NULL;
+	int                 count = 0;
+
+	list_for_each_entry_safe (trav, tmp, &head->list, list) {
+		/* list is in the order frames were saved */
+		if (timercmp (&trav->saved_at, before, >=))
+			break;
+
+		list_del_init (&trav->hash);
+		list_move_tail (&trav->list, expired);
+		frames->count--;
+		count++;
+	}
+
+	return count;
+}
+
+
+/*
+ * saved_frames_expire - move frames saved before @before to @expired
+ *
+ * to be called with the connection lock held, the frames are then
+ * unwound with saved_frames_unwind_expired() after dropping it.
+ */
+int
+saved_frames_expire (struct saved_frames *frames, struct timeval *before,
+		     struct list_head *expired)
+{
+	int count = 0;
 
+	count += __saved_frames_expire_list (frames, &frames->fops,
+					     before, expired);
+	count += __saved_frames_expire_list (frames, &frames->mops,
+					     before, expired);
+	count += __saved_frames_expire_list (frames, &frames->cbks,
+					     before, expired);
+
+	return count;
+}
+
+
+static void
+saved_frame_unwind (xlator_t *this, struct saved_frame *trav,
+		    struct iobref *reply, int32_t op_errno,
+		    gf_op_t gf_fops[], gf_op_t gf_mops[], gf_op_t gf_cbks[])
+{
 	gf_hdr_common_t       hdr = {0, };
 	call_frame_t         *frame = NULL;
-	dict_t               *reply = NULL;
+	gf_op_t              *gf_ops = NULL;
+	char                **gf_op_list = NULL;
+
+	switch (trav->type) {
+	case GF_OP_TYPE_FOP_REQUEST:
+	case GF_OP_TYPE_FOP_REPLY:
+		gf_ops     = gf_fops;
+		gf_op_list = gf_fop_list;
+		break;
+	case GF_OP_TYPE_MOP_REQUEST:
+	case GF_OP_TYPE_MOP_REPLY:
+		gf_ops     = gf_mops;
+		gf_op_list = gf_mop_list;
+		break;
+	case GF_OP_TYPE_CBK_REQUEST:
+	case GF_OP_TYPE_CBK_REPLY:
+		gf_ops     = gf_cbks;
+		gf_op_list = gf_cbk_list;
+		break;
+	default:
+		return;
+	}
 
-	reply = get_new_dict();
-	dict_ref (reply);
+	gf_log (this->name, GF_LOG_ERROR,
+		"forced unwinding frame type(%d) op(%s)",
+		trav->type, gf_op_list[trav->op]);
 
 	hdr.rsp.op_ret   = hton32 (-1);
-	hdr.rsp.op_errno = hton32 (ENOTCONN);
+	hdr.rsp.op_errno = hton32 (gf_errno_to_error (op_errno));
+	hdr.type = hton32 (trav->type);
+	hdr.op   = hton32 (trav->op);
 
-	list_for_each_entry_safe (trav, tmp, &head->list, list) {
-		gf_log (this->name, GF_LOG_ERROR,
-			"forced unwinding frame type(%d) op(%s)",
-			trav->type, gf_op_list[trav->op]);
+	frame = trav->frame;
+	frame->root->rsp_refs = reply;
+
+	gf_ops[trav->op] (frame, &hdr, sizeof (hdr), NULL, 0);
+}
 
-		hdr.type = hton32 (trav->type);
-		hdr.op   = hton32 (trav->op);
 
-		frame = trav->frame;
-		frame->root->rsp_refs = reply;
+void
+saved_frames_unwind_expired (xlator_t *this, struct list_head *expired,
+			     gf_op_t gf_fops[], gf_op_t gf_mops[],
+			     gf_op_t gf_cbks[])
+{
+	struct saved_frame   *trav = NULL;
+	struct saved_frame   *tmp = NULL;
+	struct iobref        *reply = NULL;
 
-		saved_frames->count--;
+	if (list_empty (expired))
+		return;
 
-		gf_ops[trav->op] (frame, &hdr, sizeof (hdr), NULL, 0);
+	reply = iobref_new ();
 
+	list_for_each_entry_safe (trav, tmp, expired, list) {
 		list_del_init (&trav->list);
-		FREE (trav);
+
+		saved_frame_unwind (this, trav, reply, ETIMEDOUT,
+				    gf_fops, gf_mops, gf_cbks);
+
+		saved_frame_destroy (trav);
 	}
 
-	dict_unref (reply);
+	iobref_unref (reply);
+}
+
+
+void
+saved_frames_unwind (xlator_t *this, struct saved_frames *saved_frames,
+		     struct saved_frame *head,
+		     gf_op_t gf_fops[], gf_op_t gf_mops[], gf_op_t gf_cbks[])
+{
+	struct saved_frame   *trav = NULL;
+	struct saved_frame   *tmp = NULL;
+	struct iobref        *reply = NULL;
+
+	reply = iobref_new ();
+
+	list_for_each_entry_safe (trav, tmp, &head->list, list) {
+		saved_frames->count--;
+
+		list_del_init (&trav->list);
+		list_del_init (&trav->hash);
+
+		saved_frame_unwind (this, trav, reply, ENOTCONN,
+				    gf_fops, gf_mops, gf_cbks);
+
+		saved_frame_destroy (trav);
+	}
+
+	iobref_unref (reply);
 }
 
 
@@ -170,9 +356,20 @@ void
 saved_frames_destroy (xlator_t *this, struct saved_frames *frames,
 		      gf_op_t gf_fops[], gf_op_t gf_mops[], gf_op_t gf_cbks[])
 {
-	saved_frames_unwind (this, frames, &frames->fops, gf_fops, gf_fop_list);
-	saved_frames_unwind (this, frames, &frames->mops, gf_mops, gf_mop_list);
-	saved_frames_unwind (this, frames, &frames->cbks, gf_cbks, gf_cbk_list);
+	if (frames->latency_count) {
+		gf_log (this->name, GF_LOG_DEBUG,
+			"%"PRIu64" replies, latency avg %"PRIu64" usec, "
+			"max %"PRIu64" usec", frames->latency_count,
+			frames->latency_total / frames->latency_count,
+			frames->latency_max);
+	}
+
+	saved_frames_unwind (this, frames, &frames->fops,
+			     gf_fops, gf_mops, gf_cbks);
+	saved_frames_unwind (this, frames, &frames->mops,
+			     gf_fops, gf_mops, gf_cbks);
+	saved_frames_unwind (this, frames, &frames->cbks,
+			     gf_fops, gf_mops, gf_cbks);
 
 	FREE (frames);
 }
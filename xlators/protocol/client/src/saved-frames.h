@@ -37,6 +37,11 @@ typedef int32_t (*gf_op_t) (call_frame_t *frame,
                             char *buf, size_t buflen);
 
 
+/* callids are handed out sequentially per connection, so indexing
+   by the low bits spreads outstanding requests evenly over buckets */
+#define SAVED_FRAMES_HASH_SIZE   1024
+
+
 struct saved_frame {
 	union {
 		struct list_head list;
@@ -45,6 +50,7 @@ struct saved_frame {
 			struct saved_frame *frame_prev;
 		};
 	};
+	struct list_head  hash;
 
 	struct timeval  saved_at;
 	call_frame_t   *frame;
@@ -56,9 +62,16 @@ struct saved_frame {
 
 struct saved_frames {
 	int64_t            count;
+	/* per type, oldest first */
 	struct saved_frame fops;
 	struct saved_frame mops;
 	struct saved_frame cbks;
+	struct list_head   hash[SAVED_FRAMES_HASH_SIZE];
+
+	/* round trip time of replies matched so far, in usec */
+	uint64_t           latency_count;
+	uint64_t           latency_total;
+	uint64_t           latency_max;
 };
 
 
@@ -67,6 +80,11 @@ int saved_frames_put (struct saved_frames *frames, call_frame_t *frame,
 		      int32_t op, int8_t type, int64_t callid);
 call_frame_t *saved_frames_get (struct saved_frames *frames, int32_t op,
 				int8_t type, int64_t callid);
+int saved_frames_expire (struct saved_frames *frames, struct timeval *before,
+			 struct list_head *expired);
+void saved_frames_unwind_expired (xlator_t *this, struct list_head *expired,
+				  gf_op_t gf_fops[], gf_op_t gf_mops[],
+				  gf_op_t gf_cbks[]);
 void saved_frames_destroy (xlator_t *this, struct saved_frames *frames,
 			   gf_op_t gf_fops[], gf_op_t gf_mops[],
 			   gf_op_t gf_cbks[]);
@@ -40,6 +40,7 @@
 #include "dict.h"
 #include "compat.h"
 #include "compat-errno.h"
+#include "event.h"
 
 
 static void
@@ -47,7 +48,7 @@ protocol_server_reply (call_frame_t *frame,
                        int type, int op,
                        gf_hdr_common_t *hdr, size_t hdrlen,
                        struct iovec *vector, int count,
-                       dict_t *refs)
+                       struct iobref *iobref)
 {
 	server_state_t *state = NULL;
 	xlator_t *bound_xl = NULL;
@@ -61,7 +62,7 @@ protocol_server_reply (call_frame_t *frame,
 	hdr->type   = hton32 (type);
 	hdr->op     = hton32 (op);
 
-	transport_submit (trans, (char *)hdr, hdrlen, vector, count, refs);
+	transport_submit (trans, (char *)hdr, hdrlen, vector, count, iobref);
 	/* TODO: If transport submit fails, there is no reply sent to client, 
 	 * its bailed out as of now.. loggically, only this frame should fail. 
 	 */
@@ -74,6 +75,88 @@ protocol_server_reply (call_frame_t *frame,
 }
 
 
+static void
+server_dict_payload_release (void *buf, void *data)
+{
+	FREE (buf);
+	dict_unref ((dict_t *) data);
+}
+
+
+/*
+ * server_dict_payload - set up the dict of a reply to go as its payload
+ * @frame: call frame
+ * @dict: reply dict
+ * @vector: of SERVER_DICT_IOVEC entries, filled with the dict
+ * @iobref_p: set to what keeps @vector alive, to be passed to
+ *            protocol_server_reply ()
+ * @len_p: set to the length of the serialized dict
+ *
+ * only done for clients which take GF_DICT_FORMAT_PAYLOAD and dicts
+ * with values worth not copying, the rest are serialized into the
+ * header as before.
+ *
+ * returns the number of entries of @vector used, 0 when @dict has to
+ * go into the header.
+ */
+static int
+server_dict_payload (call_frame_t *frame, dict_t *dict,
+		     struct iovec *vector, struct iobref **iobref_p,
+		     int32_t *len_p)
+{
+	server_connection_t *conn = NULL;
+	struct iobref       *iobref = NULL;
+	struct iobuf        *iobuf = NULL;
+	char                *buf = NULL;
+	int32_t              buflen = 0;
+	int                  count = 0;
+
+	conn = SERVER_CONNECTION(frame);
+
+	if (!dict || !conn || (conn->dict_format < GF_DICT_FORMAT_PAYLOAD))
+		return 0;
+
+	/* a single entry is all of the dict copied into buf */
+	count = dict_iovec_len (dict, &buflen);
+	if ((count < 2) || (count > SERVER_DICT_IOVEC))
+		return 0;
+
+	buf = MALLOC (buflen);
+	if (!buf)
+		return 0;
+
+	count = dict_to_iovec (dict, buf, vector, SERVER_DICT_IOVEC);
+	if (count < 0) {
+		FREE (buf);
+		return 0;
+	}
+
+	/* the values are sent from where they are in the dict, it is
+	   held till the transport is done with them */
+	iobuf = iobuf_wrap (buf, buflen, server_dict_payload_release,
+			    dict_ref (dict));
+	if (!iobuf) {
+		FREE (buf);
+		dict_unref (dict);
+		return 0;
+	}
+
+	iobref = iobref_new ();
+	if (!iobref) {
+		iobuf_unref (iobuf);
+		return 0;
+	}
+
+	iobref_add (iobref, iobuf);
+	iobuf_unref (iobuf);
+
+	*iobref_p = iobref;
+	*len_p    = iov_length (vector, count);
+
+	return count;
+}
+
+
 /*
  * server_fchmod_cbk
  */
@@ -945,8 +1028,8 @@ server_getdents_cbk (call_frame_t *frame,
 	size_t  hdrlen = 0;
 	int32_t vec_count = 0;
 	int32_t gf_errno = 0;
-	int32_t ret = -1;
-	dict_t *reply_dict = NULL;
+	struct iobref *iobref = NULL;
+	struct iobuf  *iobuf = NULL;
 	char   *buffer = NULL;
 	size_t  buflen = 0;
 	struct iovec vector[1];
@@ -966,29 +1049,26 @@ server_getdents_cbk (call_frame_t *frame,
 			goto out;
 		}
 
-		reply_dict = dict_new ();
-		if (reply_dict == NULL) {
+		iobuf = iobuf_get2 (this->ctx->iobuf_pool, buflen);
+		iobref = iobref_new ();
+		if (!iobuf || !iobref) {
 			gf_log (this->name, GF_LOG_ERROR,
-				"fd - %"PRId64" (%"PRId64"): failed to get new dict",
+				"fd - %"PRId64" (%"PRId64"): failed to allocate "
+				"reply buffer",
 				state->fd_no, state->fd->inode->ino);
+			FREE (buffer);
 			op_ret = -1;
 			op_errno = ENOMEM;
 			goto out;
 		}
-		
-		ret = dict_set_dynptr (reply_dict, NULL, 
-				       buffer, buflen);
-		if (ret < 0) {
-			gf_log (this->name, GF_LOG_ERROR,
-				"fd - %"PRId64" (%"PRId64"): failed to set read buffer "
-				"to reply dictionary",
-				state->fd_no, state->fd->inode->ino);
-			op_ret = -1;
-			op_errno = -ret;
-			goto out;
-		}
-		frame->root->rsp_refs = reply_dict;
-		vector[0].iov_base = buffer;
+
+		memcpy (iobuf_ptr (iobuf), buffer, buflen);
+		FREE (buffer);
+
+		iobref_add (iobref, iobuf);
+		frame->root->rsp_refs = iobref;
+
+		vector[0].iov_base = iobuf_ptr (iobuf);
 		vector[0].iov_len = buflen;
 		vec_count = 1;
 	} else {
@@ -1015,10 +1095,13 @@ out:
 
 	protocol_server_reply (frame, GF_OP_TYPE_FOP_REPLY, GF_FOP_GETDENTS,
 			       hdr, hdrlen, vector, vec_count, 
-			       frame->root->rsp_refs);
+			       iobref);
 	
-	if (reply_dict)
-		dict_unref (reply_dict);
+	if (iobuf)
+		iobuf_unref (iobuf);
+
+	if (iobref)
+		iobref_unref (iobref);
 
 	return 0;
 }
@@ -1080,6 +1163,63 @@ server_readdir_cbk (call_frame_t *frame,
 }
 
 
+/*
+ * server_readdirp_cbk - readdirp callback for server protocol
+ * @frame: call frame
+ * @cookie:
+ * @this:
+ * @op_ret:
+ * @op_errno:
+ * @entries:
+ *
+ * not for external reference
+ */
+int32_t
+server_readdirp_cbk (call_frame_t *frame,
+		     void *cookie,
+		     xlator_t *this,
+		     int32_t op_ret,
+		     int32_t op_errno,
+		     gf_dirent_t *entries)
+{
+	gf_hdr_common_t       *hdr = NULL;
+	gf_fop_readdirp_rsp_t *rsp = NULL;
+	size_t  hdrlen = 0;
+	size_t  buf_size = 0;
+	int32_t gf_errno = 0;
+	server_state_t *state = NULL;
+
+	if (op_ret > 0)
+		buf_size = gf_direntp_serialize (entries, NULL, 0);
+
+	hdrlen = gf_hdr_len (rsp, buf_size);
+	hdr    = gf_hdr_new (rsp, buf_size);
+	rsp    = gf_param (hdr);
+
+	hdr->rsp.op_ret = hton32 (op_ret);
+	gf_errno        = gf_errno_to_error (op_errno);
+	hdr->rsp.op_errno = hton32 (gf_errno);
+
+	if (op_ret > 0) {
+		rsp->size = hton32 (buf_size);
+		gf_direntp_serialize (entries, rsp->buf, buf_size);
+	} else {
+		state = CALL_STATE(frame);
+
+		gf_log (this->name, GF_LOG_DEBUG,
+			"%"PRId64": READDIRP %"PRId64" (%"PRId64") ==> %"PRId32" (%s)",
+			frame->root->unique, state->fd_no,
+			state->fd ? state->fd->inode->ino : 0, op_ret,
+			strerror (op_errno));
+	}
+
+	protocol_server_reply (frame, GF_OP_TYPE_FOP_REPLY, GF_FOP_READDIRP,
+			       hdr, hdrlen, NULL, 0, NULL);
+
+	return 0;
+}
+
+
 /*
  * server_releasedir_cbk - releasedir callback for server protocol
  * @frame: call frame
@@ -1290,6 +1430,9 @@ server_getxattr_cbk (call_frame_t *frame,
 	gf_hdr_common_t       *hdr = NULL;
 	gf_fop_getxattr_rsp_t *rsp = NULL;
 	server_state_t *state = NULL;
+	struct iovec    vector[SERVER_DICT_IOVEC];
+	struct iobref  *iobref = NULL;
+	int     count = 0;
 	size_t  hdrlen = 0;
 	int32_t len = 0;
 	int32_t gf_errno = 0;
@@ -1297,7 +1440,11 @@ server_getxattr_cbk (call_frame_t *frame,
 
 	state = CALL_STATE(frame);
 
-	if (op_ret >= 0) {
+	if (op_ret >= 0)
+		count = server_dict_payload (frame, dict, vector, &iobref,
+					     &len);
+
+	if ((op_ret >= 0) && !count) {
 		len = dict_serialized_length (dict);
 		if (len < 0) {
 			gf_log (this->name, GF_LOG_ERROR,
@@ -1310,11 +1457,11 @@ server_getxattr_cbk (call_frame_t *frame,
 		}
 	}
 
-	hdrlen = gf_hdr_len (rsp, len + 1);
-	hdr    = gf_hdr_new (rsp, len + 1);
+	hdrlen = gf_hdr_len (rsp, (count ? 0 : len) + 1);
+	hdr    = gf_hdr_new (rsp, (count ? 0 : len) + 1);
 	rsp    = gf_param (hdr);
 
-	if (op_ret >= 0) {
+	if ((op_ret >= 0) && !count) {
 		ret = dict_serialize (dict, rsp->dict);
 		if (len < 0) {
 			gf_log (this->name, GF_LOG_ERROR,
@@ -1333,8 +1480,16 @@ server_getxattr_cbk (call_frame_t *frame,
 
 	server_loc_wipe (&(state->loc));
 
-	protocol_server_reply (frame, GF_OP_TYPE_FOP_REPLY, GF_FOP_GETXATTR,
-			       hdr, hdrlen, NULL, 0, NULL);
+	protocol_server_reply (frame,
+			       gf_hdr_type_format (GF_OP_TYPE_FOP_REPLY,
+						   (count ?
+						    GF_DICT_FORMAT_PAYLOAD :
+						    GF_DICT_FORMAT_INLINE)),
+			       GF_FOP_GETXATTR, hdr, hdrlen,
+			       vector, count, iobref);
+
+	if (iobref)
+		iobref_unref (iobref);
 
 	return 0;
 }
@@ -2333,6 +2488,9 @@ server_lookup_cbk (call_frame_t *frame,
 	gf_fop_lookup_rsp_t *rsp = NULL;
 	server_state_t *state = NULL;
 	inode_t *root_inode = NULL;
+	struct iovec   vector[SERVER_DICT_IOVEC];
+	struct iobref *iobref = NULL;
+	int      count = 0;
 	int32_t  dict_len = 0;
 	size_t   hdrlen = 0;
 	int32_t  gf_errno = 0;
@@ -2360,7 +2518,11 @@ server_lookup_cbk (call_frame_t *frame,
 		return 0;
 	}
 
-	if (dict) {
+	if ((op_ret >= 0) && dict)
+		count = server_dict_payload (frame, dict, vector, &iobref,
+					     &dict_len);
+
+	if (dict && !count) {
 		dict_len = dict_serialized_length (dict);
 		if (dict_len < 0) {
 			gf_log (this->name, GF_LOG_ERROR,
@@ -2373,11 +2535,11 @@ server_lookup_cbk (call_frame_t *frame,
 		}
 	}
 
-	hdrlen = gf_hdr_len (rsp, dict_len);
-	hdr    = gf_hdr_new (rsp, dict_len);
+	hdrlen = gf_hdr_len (rsp, (count ? 0 : dict_len));
+	hdr    = gf_hdr_new (rsp, (count ? 0 : dict_len));
 	rsp    = gf_param (hdr);
 
-	if ((op_ret >= 0) && dict) {
+	if ((op_ret >= 0) && dict && !count) {
 		ret = dict_serialize (dict, rsp->dict);
 		if (ret < 0) {
 			gf_log (this->name, GF_LOG_ERROR,
@@ -2419,8 +2581,16 @@ server_lookup_cbk (call_frame_t *frame,
 	}
 
 	server_loc_wipe (&state->loc);
-	protocol_server_reply (frame, GF_OP_TYPE_FOP_REPLY, GF_FOP_LOOKUP,
-			       hdr, hdrlen, NULL, 0, NULL);
+	protocol_server_reply (frame,
+			       gf_hdr_type_format (GF_OP_TYPE_FOP_REPLY,
+						   (count ?
+						    GF_DICT_FORMAT_PAYLOAD :
+						    GF_DICT_FORMAT_INLINE)),
+			       GF_FOP_LOOKUP, hdr, hdrlen,
+			       vector, count, iobref);
+
+	if (iobref)
+		iobref_unref (iobref);
 
 	return 0;
 }
@@ -4103,9 +4273,7 @@ server_writev (call_frame_t *frame, xlator_t *bound_xl,
 	server_connection_t *conn = NULL;
 	gf_fop_write_req_t *req = NULL;
 	struct iovec iov = {0, };
-	dict_t *refs = NULL;
 	server_state_t *state = NULL;
-	int32_t ret = -1;
 	
 	conn = SERVER_CONNECTION(frame);
 
@@ -4122,25 +4290,11 @@ server_writev (call_frame_t *frame, xlator_t *bound_xl,
 
 	GF_VALIDATE_OR_GOTO(bound_xl->name, state->fd, fail);
 
+	/* buf is the iobuf the transport read the payload into, and is
+	   held by frame->root->req_refs (see protocol_server_interpret) */
 	iov.iov_base = buf;
 	iov.iov_len = buflen;
 
-	refs = dict_new ();
-	GF_VALIDATE_OR_GOTO(bound_xl->name, refs, fail);
-
-	ret = dict_set_dynptr (refs, NULL, buf, buflen);
-	if (ret < 0) {
-		gf_log (frame->this->name, GF_LOG_ERROR,
-			"fd - %"PRId64" (%"PRId64"): failed to set buffer entry "
-			"to req_refs",
-			state->fd_no, state->fd->inode->ino);
-		goto fail;
-	} else {
-		buf = NULL;
-	}
-
-	frame->root->req_refs = refs;
-
 	gf_log (bound_xl->name, GF_LOG_DEBUG,
 		"%"PRId64": WRITEV \'fd=%"PRId64" (%"PRId64"); "
 		"offset=%"PRId64"; size=%"PRId64,
@@ -4153,19 +4307,11 @@ server_writev (call_frame_t *frame, xlator_t *bound_xl,
 		    BOUND_XL(frame)->fops->writev,
 		    state->fd, &iov, 1, state->offset);
 	
-	if (refs)
-		dict_unref (refs);
 	return 0;
 fail:
 	server_writev_cbk (frame, NULL, frame->this,
 			   -1, EINVAL, NULL);
 	
-	if (buf)
-		free (buf);
-
-	if (refs)
-		dict_unref (refs);
-
 	return 0;
 }
 
@@ -5310,6 +5456,65 @@ out:
 }
 
 
+/*
+ * server_readdirp - readdirp function for server protocol
+ * @frame: call frame
+ * @bound_xl:
+ * @params: parameter dictionary
+ *
+ * not for external reference
+ */
+int32_t
+server_readdirp (call_frame_t *frame, xlator_t *bound_xl,
+		 gf_hdr_common_t *hdr, size_t hdrlen,
+		 char *buf, size_t buflen)
+{
+	gf_fop_readdirp_req_t *req = NULL;
+	server_state_t *state = NULL;
+	server_connection_t *conn = NULL;
+
+	conn = SERVER_CONNECTION(frame);
+
+	req   = gf_param (hdr);
+	state = CALL_STATE(frame);
+	{
+		state->fd_no = ntoh64 (req->fd);
+		if (state->fd_no >= 0)
+			state->fd = gf_fd_fdptr_get (conn->fdtable,
+						     state->fd_no);
+
+		state->size   = ntoh32 (req->size);
+		state->offset = ntoh64 (req->offset);
+	}
+
+
+	if (state->fd == NULL) {
+		gf_log (frame->this->name, GF_LOG_ERROR,
+			"fd - %"PRId64": unresolved fd",
+			state->fd_no);
+
+		server_readdirp_cbk (frame, NULL, frame->this,
+				     -1, EINVAL, NULL);
+
+		goto out;
+	}
+
+	gf_log (bound_xl->name, GF_LOG_DEBUG,
+		"%"PRId64": READDIRP \'fd=%"PRId64" (%"PRId64"); "
+		"offset=%"PRId64"; size=%"PRId64,
+		frame->root->unique, state->fd_no, state->fd->inode->ino,
+		state->offset, (int64_t)state->size);
+
+	STACK_WIND (frame,
+		    server_readdirp_cbk,
+		    bound_xl,
+		    bound_xl->fops->readdirp,
+		    state->fd, state->size, state->offset);
+out:
+	return 0;
+}
+
+
 
 /*
  * server_fsyncdir - fsyncdir function for server protocol
@@ -7059,6 +7264,7 @@ mop_setvolume (call_frame_t *frame, xlator_t *bound_xl,
 	size_t                       rsp_hdrlen = -1;
 	size_t                       dict_len = -1;
 	size_t                       req_dictlen = -1;
+	int32_t                      dict_format = 0;
 
 	params = dict_new ();
 	reply  = dict_new ();
@@ -7230,6 +7436,15 @@ mop_setvolume (call_frame_t *frame, xlator_t *bound_xl,
 					 conn->bound_xl);
 	}
 
+	/* clients not announcing it only get dicts in the header */
+	conn->dict_format = GF_DICT_FORMAT_INLINE;
+	ret = dict_get_int32 (params, "dict-format", &dict_format);
+	if (ret == 0)
+		conn->dict_format = min (dict_format, GF_DICT_FORMAT_MAX);
+
+	/* clients send GF_FOP_READDIRP only to servers announcing it */
+	ret = dict_set_int32 (reply, "readdirp", 1);
+
 	ret = dict_set_str (reply, "process-uuid", 
 			    xl->ctx->process_uuid);
 
@@ -7548,6 +7763,7 @@ static gf_op_t gf_fops[] = {
 	[GF_FOP_CHECKSUM]     =  server_checksum,
 	[GF_FOP_XATTROP]      =  server_xattrop,
 	[GF_FOP_FXATTROP]     =  server_fxattrop,
+	[GF_FOP_READDIRP]     =  server_readdirp,
 };
 
 
@@ -7568,7 +7784,7 @@ static gf_op_t gf_cbks[] = {
 
 int
 protocol_server_interpret (xlator_t *this, transport_t *trans,
-                           char *hdr_p, size_t hdrlen, char *buf, 
+                           char *hdr_p, size_t hdrlen, struct iobuf *iobuf,
 			   size_t buflen)
 {
 	server_connection_t *conn = NULL;
@@ -7579,6 +7795,8 @@ protocol_server_interpret (xlator_t *this, transport_t *trans,
 	int32_t                      type = -1;
 	int32_t                      op = -1;
 	int32_t                      ret = -1;
+	struct iobref               *iobref = NULL;
+	char                        *buf = NULL;
 
 	hdr  = (gf_hdr_common_t *)hdr_p;
 	type = ntoh32 (hdr->type);
@@ -7605,6 +7823,23 @@ protocol_server_interpret (xlator_t *this, transport_t *trans,
 			break;
 		}
 		frame = get_frame_for_call (trans, hdr);
+
+		/* payload (of writev) is handed down the graph as is,
+		   anybody who needs it past the fop holds a ref on
+		   req_refs */
+		if (iobuf) {
+			iobref = iobref_new ();
+			if (!iobref) {
+				gf_log (this->name, GF_LOG_ERROR,
+					"out of memory");
+				STACK_DESTROY (frame->root);
+				break;
+			}
+			iobref_add (iobref, iobuf);
+			frame->root->req_refs = iobref;
+			buf = iobuf_ptr (iobuf);
+		}
+
 		ret = gf_fops[op] (frame, bound_xl, hdr, hdrlen, buf, buflen);
 		break;
 
@@ -7640,6 +7875,9 @@ protocol_server_interpret (xlator_t *this, transport_t *trans,
 		break;
 	}
 
+	if (iobref)
+		iobref_unref (iobref);
+
 	return ret;
 }
 
@@ -7764,6 +8002,7 @@ init (xlator_t *this)
 	int32_t ret = -1;
 	transport_t *trans = NULL;
 	server_conf_t *conf = NULL;
+	int32_t event_threads = 0;
 
 	if (this->children == NULL) {
 		gf_log (this->name, GF_LOG_ERROR,
@@ -7827,6 +8066,15 @@ init (xlator_t *this)
 		conf->max_block_size = DEFAULT_BLOCK_SIZE;
 	}
 
+	ret = dict_get_int32 (this->options, "event-threads",
+			      &event_threads);
+	if (ret == 0) {
+		gf_log (this->name, GF_LOG_DEBUG,
+			"setting event-threads to %d", event_threads);
+		event_pool_set_thread_count (this->ctx->event_pool,
+					     event_threads);
+	}
+
 #ifndef GF_DARWIN_HOST_OS
 	{
 		struct rlimit lim;
@@ -7866,19 +8114,21 @@ protocol_server_pollin (xlator_t *this, transport_t *trans)
 {
 	char                *hdr = NULL;
 	size_t               hdrlen = 0;
-	char                *buf = NULL;
+	struct iobuf        *iobuf = NULL;
 	size_t               buflen = 0;
 	int                  ret = -1;
 
 
-	ret = transport_receive (trans, &hdr, &hdrlen, &buf, &buflen);
+	ret = transport_receive (trans, &hdr, &hdrlen, &iobuf, &buflen);
 
 	if (ret == 0)
 		ret = protocol_server_interpret (this, trans, hdr, 
-						 hdrlen, buf, buflen);
+						 hdrlen, iobuf, buflen);
 
-	/* TODO: use mem-pool */
-	FREE (hdr);
+	/* hdr belongs to the transport */
+
+	if (iobuf)
+		iobuf_unref (iobuf);
 
 	return ret;
 }
@@ -7980,5 +8230,10 @@ struct volume_options options[] = {
 	{ .key   = {"client-volume-filename"}, 
 	  .type  = GF_OPTION_TYPE_PATH
 	}, 
+	{ .key   = {"event-threads"},
+	  .type  = GF_OPTION_TYPE_INT,
+	  .min   = 1,
+	  .max   = 64
+	},
 	{ .key   = {NULL} },
 };
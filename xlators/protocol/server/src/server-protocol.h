@@ -36,6 +36,7 @@
 #include "byte-order.h"
 
 #define DEFAULT_BLOCK_SIZE     4194304   /* 4MB */
+#define SERVER_DICT_IOVEC      8         /* of a reply dict as payload */
 #define GLUSTERFSD_SPEC_PATH   CONFDIR "/glusterfs-client.vol"
 
 typedef struct _server_state server_state_t;
@@ -67,6 +68,7 @@ struct _server_connection {
 	fdtable_t          *fdtable; 
 	struct _lock_table *ltable;
 	xlator_t           *bound_xl;
+	int                 dict_format; /* GF_DICT_FORMAT_* it takes */
 };
 
 typedef struct _server_connection server_connection_t;
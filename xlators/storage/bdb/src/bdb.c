@@ -681,9 +681,9 @@ bdb_readv (call_frame_t *frame,
 	struct iovec   vec        = {0,};
 	struct stat    stbuf      = {0,};
 	struct bdb_fd *bfd        = NULL;  
-	dict_t        *reply_dict = NULL;
+	struct iobref *iobref     = NULL;
+	struct iobuf  *iobuf      = NULL;
 	char          *buf        = NULL;
-	data_t        *buf_data   = NULL;
 	char          *db_path    = NULL;
 	int32_t        read_size  = 0;
 
@@ -721,31 +721,31 @@ bdb_readv (call_frame_t *frame,
 		goto out;
 	}
 
-	buf_data = get_new_data ();
-	op_ret = -1;
-	op_errno = ENOMEM;
-	GF_VALIDATE_OR_GOTO (this->name, buf_data, out);
+	if (size < read_size) {
+		op_ret = size;
+		read_size = size;
+	}
 
-	reply_dict = get_new_dict ();
+	/* the value comes in memory allocated by libdb, copy it over
+	   to an iobuf which can be passed up the graph */
+	iobuf = iobuf_get2 (this->ctx->iobuf_pool, read_size);
 	op_ret = -1;
 	op_errno = ENOMEM;
-	GF_VALIDATE_OR_GOTO (this->name, reply_dict, out);
+	GF_VALIDATE_OR_GOTO (this->name, iobuf, out);
 
-	buf_data->data      = buf;
+	iobref = iobref_new ();
+	GF_VALIDATE_OR_GOTO (this->name, iobref, out);
 
-	if (size < read_size) {
-		op_ret = size;
-		read_size = size;
-	}
+	memcpy (iobuf_ptr (iobuf), buf, read_size);
+	iobref_add (iobref, iobuf);
 
-	buf_data->len       = op_ret;
-      
-	dict_set (reply_dict, NULL, buf_data);
-      
-	frame->root->rsp_refs = dict_ref (reply_dict);
+	frame->root->rsp_refs = iobref;
 
-	vec.iov_base = buf;
+	vec.iov_base = iobuf_ptr (iobuf);
 	vec.iov_len = read_size;
+
+	op_ret = read_size;
+	op_errno = 0;
       
 	stbuf.st_ino = fd->inode->ino;
 	stbuf.st_size = op_ret ; 
@@ -754,8 +754,14 @@ bdb_readv (call_frame_t *frame,
 out:  
 	STACK_UNWIND (frame, op_ret, op_errno, &vec, 1, &stbuf);
 
-	if (reply_dict)
-		dict_unref (reply_dict);
+	if (iobref)
+		iobref_unref (iobref);
+
+	if (iobuf)
+		iobuf_unref (iobuf);
+
+	if (buf)
+		FREE (buf);
 
 	return 0;
 }
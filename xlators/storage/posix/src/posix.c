@@ -78,13 +78,44 @@ typedef struct {
 int
 posix_forget (xlator_t *this, inode_t *inode)
 {
-	uint64_t tmp_cache = 0;
-	if (!inode_ctx_del (inode, this, &tmp_cache))
-		dict_destroy ((dict_t *)(long)tmp_cache);
+	uint64_t change_count = 0;
+
+	inode_ctx_del (inode, this, &change_count);
 
 	return 0;
 }
 
+
+/*
+ * posix_change_count - the change count of an inode, for clients caching
+ * its data. it is the value of a volume-wide counter taken when the inode
+ * was last modified, or first asked for since the inode was forgotten, so
+ * it moves whenever the data may have changed.
+ *
+ * @modified: the data of the inode has just been modified
+ */
+static uint64_t
+posix_change_count (xlator_t *this, inode_t *inode, int modified)
+{
+	struct posix_private *priv  = this->private;
+	uint64_t              count = 0;
+
+	if (!inode)
+		return 0;
+
+	LOCK (&priv->change_lock);
+	{
+		if (modified || inode_ctx_get (inode, this, &count) != 0) {
+			count = ++priv->change_count;
+			inode_ctx_put (inode, this, count);
+		}
+	}
+	UNLOCK (&priv->change_lock);
+
+	return count;
+}
+
+
 static void
 _posix_xattr_get_set (dict_t *xattr_req,
     		      char *key,
@@ -161,6 +192,13 @@ _posix_xattr_get_set (dict_t *xattr_req,
 		} else {
 			ret = dict_set_uint32 (filler->xattr, key, 0);
 		}
+	} else if (!strcmp (key, GLUSTERFS_CHANGE_COUNT)) {
+		if (S_ISREG (filler->stbuf->st_mode)) {
+			ret = dict_set_uint64 (filler->xattr, key,
+					       posix_change_count (filler->this,
+								   filler->loc->inode,
+								   0));
+		}
 	} else {
 		xattr_size = lgetxattr (filler->real_path, key, NULL, 0);
 
@@ -1206,6 +1244,8 @@ posix_truncate (call_frame_t *frame,
                 goto out;
         }
 
+        posix_change_count (this, loc->inode, 1);
+
         op_ret = lstat (real_path, &stbuf);
         if (op_ret == -1) {
                 op_errno = errno;
@@ -1410,6 +1450,9 @@ posix_open (call_frame_t *frame, xlator_t *this,
                 goto out;
         }
 
+        if (flags & O_TRUNC)
+                posix_change_count (this, loc->inode, 1);
+
         pfd = CALLOC (1, sizeof (*pfd));
 
         if (!pfd) {
@@ -1460,6 +1503,19 @@ posix_open (call_frame_t *frame, xlator_t *this,
 #define ALIGN_BUF(ptr,bound) ((void *)((unsigned long)(ptr + bound - 1) & \
                                        (unsigned long)(~(bound - 1))))
 
+static int
+posix_iovec_aligned (struct iovec *vector, int count, int align)
+{
+        int i = 0;
+
+        for (i = 0; i < count; i++) {
+                if (((unsigned long)vector[i].iov_base) & (align - 1))
+                        return 0;
+        }
+
+        return 1;
+}
+
 int
 posix_readv (call_frame_t *frame, xlator_t *this,
              fd_t *fd, size_t size, off_t offset)
@@ -1468,16 +1524,14 @@ posix_readv (call_frame_t *frame, xlator_t *this,
         int32_t                op_ret     = -1;
         int32_t                op_errno   = 0;
         char *                 buf        = NULL;
-        char *                 alloc_buf  = NULL;
         int                    _fd        = -1;
         struct posix_private * priv       = NULL;
-        dict_t *               reply_dict = NULL;
+        struct iobuf *         iobuf      = NULL;
+        struct iobref *        iobref     = NULL;
         struct iovec           vec        = {0,};
         struct posix_fd *      pfd        = NULL;
         struct stat            stbuf      = {0,};
-        int                    align      = 1;
         int                    ret        = -1;
-        int                    dict_ret   = -1;
 
         VALIDATE_OR_GOTO (frame, out);
         VALIDATE_OR_GOTO (this, out);
@@ -1501,20 +1555,17 @@ posix_readv (call_frame_t *frame, xlator_t *this,
                 goto out;
         }
 
-        if (pfd->flags & O_DIRECT) {
-                align = 4096;    /* align to page boundary */
-        }
-
-        alloc_buf = MALLOC (1 * (size + align));
-        if (!alloc_buf) {
-                op_errno = errno;
+        /* iobufs are page aligned, which is good enough for O_DIRECT
+           too. the buffer is sent out by protocol/server as is. */
+        iobuf = iobuf_get2 (this->ctx->iobuf_pool, size);
+        if (!iobuf) {
+                op_errno = ENOMEM;
                 gf_log (this->name, GF_LOG_ERROR,
                         "out of memory :(");
                 goto out;
         }
 
-        /* page aligned buffer */
-        buf = ALIGN_BUF (alloc_buf, align);
+        buf = iobuf_ptr (iobuf);
 
         _fd = pfd->fd;
 
@@ -1542,21 +1593,15 @@ posix_readv (call_frame_t *frame, xlator_t *this,
         vec.iov_len  = op_ret;
 
 	op_ret = -1;
-        reply_dict = get_new_dict ();
-        if (!reply_dict) {
+        iobref = iobref_new ();
+        if (!iobref) {
+                op_errno = ENOMEM;
                 gf_log (this->name, GF_LOG_ERROR,
                         "out of memory :(");
                 goto out;
         }
-        dict_ref (reply_dict);
 
-        dict_ret = dict_set_ptr (reply_dict, NULL, alloc_buf);
-        if (dict_ret < 0) {
-                op_errno = -dict_ret;
-                gf_log (this->name, GF_LOG_ERROR, "could not dict_set: (%s)",
-                        strerror (op_errno));
-                goto out;
-        }
+        iobref_add (iobref, iobuf);
 
         /*
          *  readv successful, and we need to get the stat of the file
@@ -1576,22 +1621,22 @@ posix_readv (call_frame_t *frame, xlator_t *this,
         if (op_ret == -1) {
                 frame->root->rsp_refs = NULL;
 
-                if (reply_dict) {
-                        dict_unref (reply_dict);
-                        reply_dict = NULL;
+                if (iobref) {
+                        iobref_unref (iobref);
+                        iobref = NULL;
                 }
-
-                if ((alloc_buf != NULL) && (dict_ret != -1))
-                        FREE (alloc_buf);
         }
 
-        if (reply_dict)
-                frame->root->rsp_refs = reply_dict;
+        if (iobref)
+                frame->root->rsp_refs = iobref;
 
         STACK_UNWIND (frame, op_ret, op_errno, &vec, 1, &stbuf);
 
-        if (reply_dict)
-                dict_unref (reply_dict);
+        if (iobref)
+                iobref_unref (iobref);
+
+        if (iobuf)
+                iobuf_unref (iobuf);
 
         return 0;
 }
@@ -1648,8 +1693,11 @@ posix_writev (call_frame_t *frame, xlator_t *this,
                 goto out;
         }
 
-        /* Check for the O_DIRECT flag during open() */
-        if (pfd->flags & O_DIRECT) {
+        /* Check for the O_DIRECT flag during open(). payload received
+           from the network is already in page aligned iobufs, only
+           copy when it is not */
+        if ((pfd->flags & O_DIRECT) && !posix_iovec_aligned (vector, count,
+                                                             align)) {
                 /* This is O_DIRECT'd file */
 		op_ret = -1;
                 for (idx = 0; idx < count; idx++) {
@@ -1693,7 +1741,7 @@ posix_writev (call_frame_t *frame, xlator_t *this,
 
         } else /* if (O_DIRECT) */ {
 
-                /* This is not O_DIRECT'd fd */
+                /* not O_DIRECT, or already aligned */
                 op_ret = writev (_fd, vector, count);
                 if (op_ret == -1) {
                         op_errno = errno;
@@ -1707,6 +1755,8 @@ posix_writev (call_frame_t *frame, xlator_t *this,
         priv->write_value    += op_ret;
         priv->interval_write += op_ret;
 
+        posix_change_count (this, fd->inode, 1);
+
         if (op_ret >= 0) {
                 /* wiretv successful, we also need to get the stat of
                  * the file we wrote to
@@ -2595,6 +2645,8 @@ posix_ftruncate (call_frame_t *frame, xlator_t *this,
                 goto out;
         }
 
+        posix_change_count (this, fd->inode, 1);
+
         op_ret = fstat (_fd, &buf);
         if (op_ret == -1) {
                 op_errno = errno;
@@ -3156,9 +3208,9 @@ posix_fentrylk (call_frame_t *frame, xlator_t *this,
 }
 
 
-int32_t
-posix_readdir (call_frame_t *frame, xlator_t *this,
-               fd_t *fd, size_t size, off_t off)
+static int32_t
+posix_do_readdir (call_frame_t *frame, xlator_t *this,
+                  fd_t *fd, size_t size, off_t off, int whichop)
 {
 	uint64_t          tmp_pfd = 0;
         struct posix_fd * pfd    = NULL;
@@ -3175,6 +3227,9 @@ posix_readdir (call_frame_t *frame, xlator_t *this,
         struct dirent *   entry      = NULL;
         off_t             in_case    = -1;
         int32_t           this_size  = -1;
+        char *            entry_path = NULL;
+        int               path_len   = 0;
+        struct posix_private *priv   = NULL;
 
 
         VALIDATE_OR_GOTO (frame, out);
@@ -3201,6 +3256,16 @@ posix_readdir (call_frame_t *frame, xlator_t *this,
                 goto out;
         }
 
+        if (whichop == GF_FOP_READDIRP) {
+                priv = this->private;
+
+                /* pfd->path/<entry> */
+                path_len   = strlen (pfd->path) + 1;
+                entry_path = alloca (path_len + NAME_MAX + 1);
+                strcpy (entry_path, pfd->path);
+                entry_path[path_len - 1] = '/';
+        }
+
 
         if (!off) {
                 rewinddir (dir);
@@ -3234,6 +3299,8 @@ posix_readdir (call_frame_t *frame, xlator_t *this,
                 }
 
                 this_size = dirent_size (entry);
+                if (whichop == GF_FOP_READDIRP)
+                        this_size += sizeof (struct stat);
 
                 if (this_size + filled > size) {
                         seekdir (dir, in_case);
@@ -3252,6 +3319,20 @@ posix_readdir (call_frame_t *frame, xlator_t *this,
 		this_entry->d_off = telldir (dir);
 		this_entry->d_ino = entry->d_ino;
 
+                /* what lookup would return, nothing for the ones it
+                   would fail: other devices, and "." and ".." */
+                if ((whichop == GF_FOP_READDIRP) &&
+                    strcmp (entry->d_name, ".") &&
+                    strcmp (entry->d_name, "..")) {
+                        strcpy (entry_path + path_len, entry->d_name);
+
+                        if ((lstat (entry_path, &this_entry->d_stat) != 0)
+                            || (this_entry->d_stat.st_dev !=
+                                priv->base_stdev))
+                                memset (&this_entry->d_stat, 0,
+                                        sizeof (this_entry->d_stat));
+                }
+
 		list_add_tail (&this_entry->list, &entries.list);
 
                 filled += this_size;
@@ -3270,6 +3351,22 @@ posix_readdir (call_frame_t *frame, xlator_t *this,
 }
 
 
+int32_t
+posix_readdir (call_frame_t *frame, xlator_t *this,
+               fd_t *fd, size_t size, off_t off)
+{
+        return posix_do_readdir (frame, this, fd, size, off, GF_FOP_READDIR);
+}
+
+
+int32_t
+posix_readdirp (call_frame_t *frame, xlator_t *this,
+                fd_t *fd, size_t size, off_t off)
+{
+        return posix_do_readdir (frame, this, fd, size, off, GF_FOP_READDIRP);
+}
+
+
 int32_t
 posix_stats (call_frame_t *frame, xlator_t *this,
              int32_t flags)
@@ -3558,6 +3655,10 @@ init (xlator_t *this)
         _private->base_path_length = strlen (_private->base_path);
 	_private->base_stdev = buf.st_dev;
 
+	/* change counts handed out after a restart have to be new too */
+	LOCK_INIT (&_private->change_lock);
+	_private->change_count = ((uint64_t) time (NULL)) << 24;
+
 	_private->xattr_cache = posix_xattr_cache_init (16);
 	if (!_private->xattr_cache) {
 		gf_log (this->name, GF_LOG_ERROR,
@@ -3655,6 +3756,7 @@ struct xlator_fops fops = {
         .stat        = posix_stat,
         .opendir     = posix_opendir,
         .readdir     = posix_readdir,
+        .readdirp    = posix_readdirp,
         .readlink    = posix_readlink,
         .mknod       = posix_mknod,
         .mkdir       = posix_mkdir,
@@ -95,6 +95,9 @@ struct posix_private {
 	gf_boolean_t    export_statfs;
 
 	gf_boolean_t    o_direct;     /* always open files in O_DIRECT mode */
+
+	gf_lock_t       change_lock;
+	uint64_t        change_count; /* see posix_change_count () */
 };
 
 #define POSIX_BASE_PATH(this) (((struct posix_private *)this->private)->base_path)